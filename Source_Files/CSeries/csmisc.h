@@ -34,6 +34,10 @@ extern bool wait_for_click_or_keypress(
 
 extern void kill_screen_saver(void);
 
+// FNV-1a; start from FNV1A_OFFSET_BASIS, or from the hash of what came before
+#define FNV1A_OFFSET_BASIS 14695981039346656037ULL
+extern uint64_t fnv1a_hash(uint64_t hash, const void *data, size_t len);
+
 #ifdef DEBUG
 extern void initialize_debugger(bool on);
 #endif
@@ -100,3 +100,15 @@ bool wait_for_click_or_keypress(uint32 ticks)
 	}
 	return false;
 }
+
+uint64_t fnv1a_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < len; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
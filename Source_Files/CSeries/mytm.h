@@ -45,6 +45,9 @@ extern void myTMCleanup();
 extern bool take_mytm_mutex();
 extern bool release_mytm_mutex();
 
+// Takes the mutex only if nobody else has it; returns whether it did
+extern bool try_take_mytm_mutex();
+
 // ghs: exception-safe version of above
 class MyTMMutexTaker
 {
@@ -112,6 +112,13 @@ take_mytm_mutex() {
 
 
 
+bool
+try_take_mytm_mutex() {
+    return SDL_TryLockMutex(sTMTaskMutex) == 0;
+}
+
+
+
 bool
 release_mytm_mutex() {
     bool success = (SDL_UnlockMutex(sTMTaskMutex) != -1);
@@ -58,6 +58,7 @@
 
 #ifdef HAVE_ZZIP
 #include "SDL_rwops_zzip.h"
+#include "ZipArchive.h"
 #endif
 
 #if defined(__WIN32__)
@@ -65,6 +66,8 @@
 #define R_OK 4
 #endif
 #include <wchar.h>
+#include <fcntl.h>
+#include <io.h>
 #define PATH_SEP '\\'
 #else
 #define PATH_SEP '/'
@@ -132,6 +135,33 @@ static const zzip_plugin_io_handlers& utf8_zzip_io()
 #else
 static const zzip_plugin_io_handlers& utf8_zzip_io() { return *zzip_get_default_io(); }
 #endif
+// open a file for reading, looking inside zip archives if necessary
+static SDL_RWops* open_zipped_file(const std::string& path)
+{
+	SDL_RWops* f = SDL_RWFromFile(path.c_str(), "rb");
+	if (f)
+		return f;
+
+	std::shared_ptr<ZipArchive> archive;
+	const ZipArchive::Entry* entry;
+	if (ZipArchive::Resolve(path, archive, entry))
+	{
+		if (entry)
+		{
+			f = archive->Open(*entry);
+			if (f)
+				return f;
+		}
+		else
+		{
+			errno = ENOENT;
+			return NULL;
+		}
+	}
+
+	// something we couldn't index ourselves
+	return SDL_RWFromZZIP(path.c_str(), &utf8_zzip_io());
+}
 #endif // HAVE_ZZIP
 
 /*
@@ -420,7 +450,7 @@ bool FileSpecifier::Open(OpenedFile &OFile, bool Writable)
 #ifdef HAVE_ZZIP
 		if (!Writable)
 		{
-			f = OFile.f = SDL_RWFromZZIP(unix_path_separators(GetPath()).c_str(), &utf8_zzip_io());
+			f = OFile.f = open_zipped_file(unix_path_separators(GetPath()));
 			err = f ? 0 : errno;
 		} 
 		else {
@@ -496,8 +526,16 @@ bool FileSpecifier::Exists()
 #ifdef HAVE_ZZIP
 	if (err)
 	{
-		// Check whether zzip can open the file (slow!)
+		// Check whether the file is in an archive we've indexed
 		const auto n = unix_path_separators(name);
+		std::shared_ptr<ZipArchive> archive;
+		const ZipArchive::Entry* entry;
+		if (ZipArchive::Resolve(n, archive, entry))
+		{
+			return entry != nullptr;
+		}
+
+		// Check whether zzip can open the file (slow!)
 		ZZIP_FILE* file = zzip_open_ext_io(n.c_str(), O_RDONLY|o_binary, ZZIP_ONLYZIP, nullptr, &utf8_zzip_io());
 		if (file)
 		{
@@ -704,6 +742,32 @@ bool FileSpecifier::Rename(const FileSpecifier& Destination)
 	return err == 0;
 }
 
+bool FileSpecifier::Sync()
+{
+#if defined(__WIN32__)
+	const int fd = _wopen(utf8_to_wide(name).c_str(), _O_WRONLY | _O_BINARY);
+	if (fd < 0)
+	{
+		err = errno;
+		return false;
+	}
+	err = _commit(fd) == 0 ? 0 : errno;
+	_close(fd);
+#elif defined(HAVE_UNISTD_H)
+	const int fd = open(name.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		err = errno;
+		return false;
+	}
+	err = fsync(fd) == 0 ? 0 : errno;
+	close(fd);
+#else
+	err = 0;
+#endif
+	return err == 0;
+}
+
 // Set to local (per-user) data directory
 void FileSpecifier::SetToLocalDataDir()
 {
@@ -941,6 +1005,18 @@ bool FileSpecifier::ReadZIP(vector<string> &vec)
 	vec.clear();
 	
 #ifdef HAVE_ZZIP
+	// index the archive as if we were opening a member of it
+	const auto base = unix_path_separators(name);
+	const auto extension = base.find_last_of('.');
+	std::shared_ptr<ZipArchive> archive;
+	const ZipArchive::Entry* entry;
+	if (extension != std::string::npos && ZipArchive::Resolve(base.substr(0, extension) + "/", archive, entry))
+	{
+		for (const auto& e : archive->Entries())
+			vec.push_back(e.name);
+		return true;
+	}
+
 	const auto zip = zzip_dir_open_ext_io(unix_path_separators(name).c_str(), nullptr, nullptr, &utf8_zzip_io());
 	if (!zip)
 	{
@@ -959,6 +1035,17 @@ bool FileSpecifier::ReadZIP(vector<string> &vec)
 #endif
 }
 
+void FileSpecifier::Prefetch(const vector<FileSpecifier>& files)
+{
+#ifdef HAVE_ZZIP
+	vector<string> paths;
+	for (const auto& file : files)
+		paths.push_back(unix_path_separators(file.GetPath()));
+
+	ZipArchive::Prefetch(paths);
+#endif
+}
+
 // ZZZ: Filesystem browsing list that lets user actually navigate directories...
 class w_directory_browsing_list : public w_list<dir_entry>
 {
@@ -301,6 +301,9 @@ public:
 	// Rename file
 	bool Rename(const FileSpecifier& Destination);
 
+	// Flush file contents to disk (e.g. before renaming it over another)
+	bool Sync();
+
 	// Copy file specification
 	const FileSpecifier &operator=(const FileSpecifier &other);
 
@@ -345,6 +348,10 @@ public:
 	bool ReadZIP(vector<string> &vec);
 	vector<string> ReadZIP() {vector<string> vec; ReadZIP(vec); return vec;}
 
+	// Hint that these files are about to be opened; any that are inside
+	// ZIP archives get decompressed ahead of time, in parallel
+	static void Prefetch(const vector<FileSpecifier>& files);
+
 	int GetError() const {return err;}
 
 private:
@@ -0,0 +1,403 @@
+/*
+ *  ZipArchive.cpp - shared, cached index of ZIP archives (zipped plugins)
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+*/
+
+#include "cseries.h"
+#include "ZipArchive.h"
+#include "Logging.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <zlib.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace bip = boost::interprocess;
+
+// archives by path without the ".zip"; a null pointer means we looked
+// and there was nothing we could index there
+static std::mutex archive_cache_mutex;
+static std::map<std::string, std::shared_ptr<ZipArchive>> archive_cache;
+
+static uint16 read_le16(const uint8* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32 read_le32(const uint8* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32>(p[3]) << 24);
+}
+
+static const uint32 kEndOfCentralDirectorySignature = 0x06054b50;
+static const uint32 kCentralDirectorySignature = 0x02014b50;
+static const uint32 kLocalHeaderSignature = 0x04034b50;
+
+static const int kEndOfCentralDirectorySize = 22;
+static const int kCentralDirectoryEntrySize = 46;
+static const int kLocalHeaderSize = 30;
+
+static const uint16 kEncryptedFlag = 0x0001;
+
+ZipArchive::ZipArchive() = default;
+ZipArchive::~ZipArchive() = default;
+
+bool ZipArchive::Load(const std::string& path)
+{
+	try {
+		bip::file_mapping file(path.c_str(), bip::read_only);
+		m_mapping.reset(new bip::mapped_region(file, bip::read_only));
+	} catch (const bip::interprocess_exception& e) {
+		logNote("could not map %s (%s)", path.c_str(), e.what());
+		return false;
+	}
+
+	const uint8* base = static_cast<const uint8*>(m_mapping->get_address());
+	size_t size = m_mapping->get_size();
+	if (size < kEndOfCentralDirectorySize)
+		return false;
+
+	// the end of central directory record is followed by a comment of up
+	// to 64K, so search backwards for its signature
+	size_t eocd = size - kEndOfCentralDirectorySize;
+	size_t limit = eocd > 0xffff ? eocd - 0xffff : 0;
+	while (read_le32(base + eocd) != kEndOfCentralDirectorySignature)
+	{
+		if (eocd == limit)
+			return false;
+		--eocd;
+	}
+
+	uint16 entry_count = read_le16(base + eocd + 10);
+	uint32 directory_size = read_le32(base + eocd + 12);
+	uint32 directory_offset = read_le32(base + eocd + 16);
+
+	// leave multi-disk and ZIP64 archives to zziplib
+	if (read_le16(base + eocd + 4) != 0 ||
+	    entry_count == 0xffff ||
+	    directory_offset == 0xffffffff ||
+	    static_cast<size_t>(directory_offset) + directory_size > eocd)
+		return false;
+
+	m_entries.reserve(entry_count);
+
+	size_t p = directory_offset;
+	for (int i = 0; i < entry_count; ++i)
+	{
+		if (p + kCentralDirectoryEntrySize > eocd ||
+		    read_le32(base + p) != kCentralDirectorySignature)
+			return false;
+
+		Entry entry;
+		entry.flags = read_le16(base + p + 8);
+		entry.method = read_le16(base + p + 10);
+		entry.compressed_size = read_le32(base + p + 20);
+		entry.uncompressed_size = read_le32(base + p + 24);
+		uint16 name_length = read_le16(base + p + 28);
+		uint16 extra_length = read_le16(base + p + 30);
+		uint16 comment_length = read_le16(base + p + 32);
+		entry.local_header_offset = read_le32(base + p + 42);
+
+		if (p + kCentralDirectoryEntrySize + name_length > eocd)
+			return false;
+
+		entry.name.assign(reinterpret_cast<const char*>(base + p + kCentralDirectoryEntrySize), name_length);
+		m_entries.push_back(entry);
+
+		p += kCentralDirectoryEntrySize + name_length + extra_length + comment_length;
+	}
+
+	std::sort(m_entries.begin(), m_entries.end());
+	return true;
+}
+
+const ZipArchive::Entry* ZipArchive::Find(const std::string& name) const
+{
+	Entry key;
+	key.name = name;
+	auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key);
+	if (it != m_entries.end() && it->name == name)
+		return &*it;
+
+	return nullptr;
+}
+
+// finds the member's data, which starts after its local header
+bool ZipArchive::Data(const Entry& entry, const uint8*& data) const
+{
+	const uint8* base = static_cast<const uint8*>(m_mapping->get_address());
+	size_t size = m_mapping->get_size();
+
+	size_t p = entry.local_header_offset;
+	if (p + kLocalHeaderSize > size || read_le32(base + p) != kLocalHeaderSignature)
+		return false;
+
+	p += kLocalHeaderSize + read_le16(base + p + 26) + read_le16(base + p + 28);
+	if (p + entry.compressed_size > size)
+		return false;
+
+	data = base + p;
+	return true;
+}
+
+bool ZipArchive::Inflate(const Entry& entry, std::vector<uint8>& buffer) const
+{
+	const uint8* data;
+	if (!Data(entry, data))
+		return false;
+
+	buffer.resize(entry.uncompressed_size);
+
+	z_stream stream = {};
+	stream.next_in = const_cast<Bytef*>(data);
+	stream.avail_in = entry.compressed_size;
+	stream.next_out = buffer.data();
+	stream.avail_out = entry.uncompressed_size;
+
+	// raw deflate: no zlib header
+	if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+		return false;
+
+	int result = inflate(&stream, Z_FINISH);
+	inflateEnd(&stream);
+
+	return result == Z_STREAM_END && stream.total_out == entry.uncompressed_size;
+}
+
+// SDL_RWops over a block of memory that keeps its owner alive: either
+// the archive (for stored members) or an inflated buffer
+struct ZipMemberStream {
+	std::shared_ptr<ZipArchive> archive;
+	std::shared_ptr<std::vector<uint8>> buffer;
+	const uint8* data;
+	Sint64 size;
+	Sint64 position;
+};
+
+static ZipMemberStream* member_stream(SDL_RWops* context)
+{
+	return static_cast<ZipMemberStream*>(context->hidden.unknown.data1);
+}
+
+static Sint64 member_size(SDL_RWops* context)
+{
+	return member_stream(context)->size;
+}
+
+static Sint64 member_seek(SDL_RWops* context, Sint64 offset, int whence)
+{
+	ZipMemberStream* stream = member_stream(context);
+	Sint64 position;
+	switch (whence)
+	{
+	case RW_SEEK_SET:
+		position = offset;
+		break;
+	case RW_SEEK_CUR:
+		position = stream->position + offset;
+		break;
+	case RW_SEEK_END:
+		position = stream->size + offset;
+		break;
+	default:
+		return SDL_SetError("Unknown value for 'whence'");
+	}
+
+	stream->position = std::max<Sint64>(0, std::min(position, stream->size));
+	return stream->position;
+}
+
+static size_t member_read(SDL_RWops* context, void* ptr, size_t size, size_t maxnum)
+{
+	ZipMemberStream* stream = member_stream(context);
+	if (!size)
+		return 0;
+
+	size_t available = static_cast<size_t>(stream->size - stream->position) / size;
+	size_t count = std::min(available, maxnum);
+	memcpy(ptr, stream->data + stream->position, count * size);
+	stream->position += count * size;
+	return count;
+}
+
+static size_t member_write(SDL_RWops*, const void*, size_t, size_t)
+{
+	return 0;
+}
+
+static int member_close(SDL_RWops* context)
+{
+	if (context)
+	{
+		delete member_stream(context);
+		SDL_FreeRW(context);
+	}
+	return 0;
+}
+
+SDL_RWops* ZipArchive::Open(const Entry& entry)
+{
+	if (entry.flags & kEncryptedFlag)
+		return NULL;
+
+	std::unique_ptr<ZipMemberStream> stream(new ZipMemberStream);
+	stream->size = entry.uncompressed_size;
+	stream->position = 0;
+
+	if (entry.method == kStored)
+	{
+		if (entry.compressed_size != entry.uncompressed_size || !Data(entry, stream->data))
+			return NULL;
+		stream->archive = shared_from_this();
+	}
+	else if (entry.method == kDeflated)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_prefetched_mutex);
+			auto it = m_prefetched.find(&entry);
+			if (it != m_prefetched.end())
+			{
+				stream->buffer = it->second;
+				m_prefetched.erase(it);
+			}
+		}
+
+		if (!stream->buffer)
+		{
+			stream->buffer = std::make_shared<std::vector<uint8>>();
+			if (!Inflate(entry, *stream->buffer))
+			{
+				logWarning("could not inflate %s", entry.name.c_str());
+				return NULL;
+			}
+		}
+		stream->data = stream->buffer->data();
+	}
+	else
+	{
+		return NULL;
+	}
+
+	SDL_RWops* rwops = SDL_AllocRW();
+	if (!rwops)
+		return NULL;
+
+	rwops->size = member_size;
+	rwops->seek = member_seek;
+	rwops->read = member_read;
+	rwops->write = member_write;
+	rwops->close = member_close;
+	rwops->hidden.unknown.data1 = stream.release();
+	return rwops;
+}
+
+static std::shared_ptr<ZipArchive> cached_archive(const std::string& prefix, const std::function<std::shared_ptr<ZipArchive>()>& load)
+{
+	std::lock_guard<std::mutex> lock(archive_cache_mutex);
+	auto it = archive_cache.find(prefix);
+	if (it == archive_cache.end())
+	{
+		it = archive_cache.emplace(prefix, load()).first;
+	}
+	return it->second;
+}
+
+bool ZipArchive::Resolve(const std::string& path, std::shared_ptr<ZipArchive>& archive, const Entry*& entry)
+{
+	// like zziplib, try the longest prefix first
+	for (auto slash = path.rfind('/'); slash != std::string::npos && slash > 0; slash = path.rfind('/', slash - 1))
+	{
+		std::string prefix = path.substr(0, slash);
+		archive = cached_archive(prefix, [&prefix]() {
+			for (const char* extension : { ".zip", ".ZIP" })
+			{
+				boost::system::error_code ec;
+				std::string zip_path = prefix + extension;
+				if (boost::filesystem::is_regular_file(zip_path, ec))
+				{
+					std::shared_ptr<ZipArchive> archive(new ZipArchive);
+					if (archive->Load(zip_path))
+						return archive;
+					break;
+				}
+			}
+			return std::shared_ptr<ZipArchive>();
+		});
+
+		if (archive)
+		{
+			entry = archive->Find(path.substr(slash + 1));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ZipArchive::FlushCache()
+{
+	std::lock_guard<std::mutex> lock(archive_cache_mutex);
+	archive_cache.clear();
+}
+
+void ZipArchive::Prefetch(const std::vector<std::string>& paths)
+{
+	struct Job {
+		std::shared_ptr<ZipArchive> archive;
+		const Entry* entry;
+		std::shared_ptr<std::vector<uint8>> buffer;
+	};
+
+	std::vector<Job> jobs;
+	for (auto& path : paths)
+	{
+		Job job;
+		if (Resolve(path, job.archive, job.entry) &&
+		    job.entry &&
+		    job.entry->method == kDeflated &&
+		    !(job.entry->flags & kEncryptedFlag))
+		{
+			job.buffer = std::make_shared<std::vector<uint8>>();
+			jobs.push_back(job);
+		}
+	}
+
+	if (jobs.empty())
+		return;
+
+	WorkerPool::instance()->run(jobs.size(), [&jobs](size_t i) {
+		Job& job = jobs[i];
+		if (!job.archive->Inflate(*job.entry, *job.buffer))
+			job.buffer.reset();
+	});
+
+	for (auto& job : jobs)
+	{
+		if (job.buffer)
+		{
+			std::lock_guard<std::mutex> lock(job.archive->m_prefetched_mutex);
+			job.archive->m_prefetched[job.entry] = job.buffer;
+		}
+	}
+}
@@ -0,0 +1,94 @@
+/*
+ *  ZipArchive.h - shared, cached index of ZIP archives (zipped plugins)
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Each archive's central directory is read once into a sorted name
+	table; stored members are served straight out of a read-only mapping
+	of the archive, and deflated members are inflated on open (or ahead
+	of time, in parallel, with Prefetch())
+*/
+
+#ifndef ZIP_ARCHIVE_H
+#define ZIP_ARCHIVE_H
+
+#include "cstypes.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <SDL2/SDL_rwops.h>
+
+namespace boost { namespace interprocess { class mapped_region; } }
+
+class ZipArchive : public std::enable_shared_from_this<ZipArchive>
+{
+public:
+	struct Entry {
+		std::string name;
+		uint32 local_header_offset;
+		uint32 compressed_size;
+		uint32 uncompressed_size;
+		uint16 method;
+		uint16 flags;
+
+		bool operator<(const Entry& other) const { return name < other.name; }
+	};
+
+	enum { kStored = 0, kDeflated = 8 };
+
+	// Resolves a path like "Plugins/Foo/Scripts/bar.lua" to a member of
+	// "Plugins/Foo.zip"; returns false if no archive prefix of the path
+	// could be indexed. If it returns true, archive is set, and entry is
+	// set if the archive actually has the member
+	static bool Resolve(const std::string& path, std::shared_ptr<ZipArchive>& archive, const Entry*& entry);
+
+	// Forget all indexed archives (e.g. after plugins are re-enumerated);
+	// members that are still open keep their archive alive
+	static void FlushCache();
+
+	// Inflate the given members (full paths, as for Resolve()) in
+	// parallel, so the following opens don't have to
+	static void Prefetch(const std::vector<std::string>& paths);
+
+	const std::vector<Entry>& Entries() const { return m_entries; }
+	const Entry* Find(const std::string& name) const;
+
+	// Returns a read-only SDL_RWops for the member, or NULL if the member
+	// uses a feature we don't support (encryption, other compression)
+	SDL_RWops* Open(const Entry& entry);
+
+	~ZipArchive();
+
+private:
+	ZipArchive();
+
+	bool Load(const std::string& path);
+	bool Data(const Entry& entry, const uint8*& data) const;
+	bool Inflate(const Entry& entry, std::vector<uint8>& buffer) const;
+
+	std::unique_ptr<boost::interprocess::mapped_region> m_mapping;
+	std::vector<Entry> m_entries; // sorted by name
+
+	std::mutex m_prefetched_mutex;
+	std::map<const Entry*, std::shared_ptr<std::vector<uint8>>> m_prefetched;
+};
+
+#endif
@@ -269,9 +269,14 @@ static uint16 crc_ccitt_table [256] =
 };
 
 uint16 calculate_data_crc_ccitt(unsigned char *data, int32 length)
+{
+  return update_data_crc_ccitt(0xffff, data, length);
+}
+
+uint16 update_data_crc_ccitt(uint16 previous_crc, const unsigned char *data, int32 length)
 {
   int32 count;
-  uint32 crc = 0xffff;
+  uint32 crc = previous_crc;
   uint32 temp;
 
   for (count = 0; count < length; ++count)
@@ -39,5 +39,7 @@ uint32 calculate_crc_for_opened_file(OpenedFile& OFile);
 uint32 calculate_data_crc(unsigned char *buffer, int32 length);
 
 uint16 calculate_data_crc_ccitt(unsigned char *buffer, int32 length);
+// continues a CRC over data that isn't contiguous; start with 0xffff
+uint16 update_data_crc_ccitt(uint16 crc, const unsigned char *buffer, int32 length);
 
 #endif
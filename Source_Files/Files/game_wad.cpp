@@ -129,6 +129,13 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 #include "motion_sensor.h"	// ZZZ for reset_motion_sensor()
 
 #include "Music.h"
+#include "Logging.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include <SDL2/SDL_thread.h>
 
 // unify the save game code into one structure.
 
@@ -793,7 +800,7 @@ bool goto_level(
 	// LP: doing this here because level-specific MML may specify which level-specific
 	// textures to load.
 	ResetLevelScript();
-	if (!game_is_networked || use_map_file(((game_info*)NetGetGameData())->parent_checksum))
+	if ((!game_is_networked && !NetIsSpectating()) || use_map_file(((game_info*)NetGetGameData())->parent_checksum))
 	{
 		RunLevelScript(entry->level_number);
 	}
@@ -808,6 +815,11 @@ bool goto_level(
 		/* calls process_map_wad on it. */
 		success= NetChangeMap(entry);
 	} 
+	else if (NetIsSpectating())
+	{
+		/* The hub sends a spectator each level as it does its players */
+		success= NetSpectatorChangeMap();
+	}
 	else 
 #endif // !defined(DISABLE_NETWORKING)
 	{
@@ -824,7 +836,7 @@ bool goto_level(
 		{
 			LoadSoloLua();
 		}
-		else if (!game_is_networked)
+		else if (!game_is_networked && !NetIsSpectating())
 		{
 			LoadReplayNetLua();
 		}
@@ -1229,6 +1241,9 @@ bool load_game_from_file(FileSpecifier& File, bool run_scripts)
 {
 	bool success= false;
 
+	/* It might be the save we're still writing */
+	wait_for_save_game_file();
+
 	ResetPassedLua();
 	ResetLevelScript();
 
@@ -1429,83 +1444,84 @@ void get_current_saved_game_name(FileSpecifier& File)
 	File = revert_game_data.SavedGame;
 }
 
-/* The current mapfile should be set to the save game file... */
-bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata)
+// A save on its way to disk: the game itself is packed into wad on the main
+// thread, then the save thread builds the preview and metadata, writes the
+// temporary file, syncs it and renames it over the real one
+struct pending_save_game
 {
+	FileSpecifier File;
+	FileSpecifier TempFile;
 	struct wad_header header;
-	short err = 0;
-	bool success= false;
-	int32 offset, wad_length;
-	struct directory_entry entries[2];
-	struct wad_data *wad, *meta_wad;
+	struct wad_data *wad;
+	int32 wad_length;
+	std::string metadata;
+	std::function<std::string()> build_imagedata;
+	std::function<void(bool)> on_complete;
+
+	SDL_Thread *thread;
+	std::atomic<bool> finished;
+	short err;
+	bool success;
+};
 
-	clear_game_error();
+static std::unique_ptr<pending_save_game> pending_save;
 
-	/* Save off the random seed. */
-	dynamic_world->random_seed= get_random_seed();
+static int write_save_game_file(void *data)
+{
+	pending_save_game *save = static_cast<pending_save_game *>(data);
+	struct directory_entry entries[2];
+	int32 offset, wad_length;
+	short err = 0;
+	bool success = false;
 
-	/* Setup to revert the game properly */
-	revert_game_data.game_is_from_disk= true;
-	revert_game_data.SavedGame = File;
+	std::string imagedata;
+	if (save->build_imagedata)
+	{
+		imagedata = save->build_imagedata();
+	}
 
-	// LP: add a file here; use temporary file for a safe save.
-	// Write into the temporary file first
-	FileSpecifier TempFile;
-	TempFile.SetTempName(File);
-	
-	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
-	fill_default_wad_header(File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, &header);
-		
-	/* Assume that we confirmed on save as... */
-	if (create_wadfile(TempFile,_typecode_savegame))
+	if (create_wadfile(save->TempFile, _typecode_savegame))
 	{
 		OpenedFile SaveFile;
-		if(open_wad_file_for_writing(TempFile,SaveFile))
+		if (open_wad_file_for_writing(save->TempFile, SaveFile))
 		{
 			/* Write out the new header */
-			if (write_wad_header(SaveFile, &header))
+			if (write_wad_header(SaveFile, &save->header))
 			{
 				offset= SIZEOF_wad_header;
-		
-				wad= build_save_game_wad(&header, &wad_length);
-				if (wad)
+				
+				/* Set the entry data.. */
+				set_indexed_directory_offset_and_length(&save->header,
+					entries, 0, offset, save->wad_length, 0);
+				
+				/* Save it.. */
+				if (write_wad(SaveFile, &save->header, save->wad, offset))
 				{
-					/* Set the entry data.. */
-					set_indexed_directory_offset_and_length(&header, 
-						entries, 0, offset, wad_length, 0);
+					/* Update the new header */
+					offset+= save->wad_length;
+					save->header.directory_offset= offset;
 					
-					/* Save it.. */
-					if (write_wad(SaveFile, &header, wad, offset))
+					/* Create metadata wad */
+					struct wad_data *meta_wad = build_meta_game_wad(save->metadata, imagedata, &save->header, &wad_length);
+					if (meta_wad)
 					{
-						/* Update the new header */
-						offset+= wad_length;
-						header.directory_offset= offset;
-						header.parent_checksum= read_wad_file_checksum(MapFileSpec);
+						set_indexed_directory_offset_and_length(&save->header,
+							entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
 						
-						/* Create metadata wad */
-						meta_wad = build_meta_game_wad(metadata, imagedata, &header, &wad_length);
-						if (meta_wad)
+						if (write_wad(SaveFile, &save->header, meta_wad, offset))
 						{
-							set_indexed_directory_offset_and_length(&header,
-								entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
+							offset+= wad_length;
+							save->header.directory_offset= offset;
 							
-							if (write_wad(SaveFile, &header, meta_wad, offset))
+							if (write_wad_header(SaveFile, &save->header) && write_directorys(SaveFile, &save->header, entries))
 							{
-								offset+= wad_length;
-								header.directory_offset= offset;
-						
-								if (write_wad_header(SaveFile, &header) && write_directorys(SaveFile, &header, entries))
-								{
-									/* We win. */
-									success= true;
-								}
+								/* We win. */
+								success= true;
 							}
-							
-							free_wad(meta_wad);
 						}
+						
+						free_wad(meta_wad);
 					}
-
-					free_wad(wad);
 				}
 			}
 
@@ -1513,24 +1529,131 @@ bool save_game_file(FileSpecifier& File, const std::string& metadata, const std:
 			close_wad_file(SaveFile);
 		}
 		
+		/* Make sure it's all on disk before it replaces the old one */
+		if (!err && !save->TempFile.Sync())
+		{
+			err = save->TempFile.GetError();
+		}
+
 		if (!err)
 		{
-			if (!TempFile.Rename(File))
+			if (!save->TempFile.Rename(save->File))
 			{
 				err = 1;
 			}
 		}
+		else
+		{
+			save->TempFile.Delete();
+		}
 	}
+
+	// game errors are per thread, so this only sees our own
+	if (err || error_pending())
+	{
+		if (!err) err = get_game_error(NULL);
+		clear_game_error();
+		success = false;
+	}
+
+	save->err = err;
+	save->success = success;
+	save->finished = true;
+	return 0;
+}
+
+static void finish_save_game_file()
+{
+	std::unique_ptr<pending_save_game> save = std::move(pending_save);
+
+	if (save->thread)
+	{
+		SDL_WaitThread(save->thread, NULL);
+	}
+
+	free_wad(save->wad);
+
+	if (save->err)
+	{
+		alert_user(infoError, strERRORS, fileError, save->err);
+	}
+
+	if (save->on_complete)
+	{
+		save->on_complete(save->success);
+	}
+}
+
+/* The current mapfile should be set to the save game file... */
+bool save_game_file(FileSpecifier& File, const std::string& metadata, std::function<std::string()> build_imagedata, std::function<void(bool)> on_complete)
+{
+	/* One at a time, so saves land in the order they were made */
+	wait_for_save_game_file();
+
+	clear_game_error();
+
+	/* Save off the random seed. */
+	dynamic_world->random_seed= get_random_seed();
+
+	/* Setup to revert the game properly */
+	revert_game_data.game_is_from_disk= true;
+	revert_game_data.SavedGame = File;
+
+	std::unique_ptr<pending_save_game> save(new pending_save_game);
+	save->File = File;
+	save->metadata = metadata;
+	save->build_imagedata = std::move(build_imagedata);
+	save->on_complete = std::move(on_complete);
+	save->thread = NULL;
+	save->finished = false;
+	save->err = 0;
+	save->success = false;
+
+	// LP: add a file here; use temporary file for a safe save.
+	// Write into the temporary file first
+	save->TempFile.SetTempName(File);
 	
-	if(err || error_pending())
+	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
+	fill_default_wad_header(File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, &save->header);
+	save->header.parent_checksum= read_wad_file_checksum(MapFileSpec);
+
+	/* Snapshot the game; this is the only part that has to hold up the game */
+	save->wad= build_save_game_wad(&save->header, &save->wad_length);
+	if (!save->wad || error_pending())
 	{
-		if(!err) err= get_game_error(NULL);
-		alert_user(infoError, strERRORS, fileError, err);
+		short err = get_game_error(NULL);
+		if (save->wad) free_wad(save->wad);
+		alert_user(infoError, strERRORS, fileError, err ? err : 1);
 		clear_game_error();
-		success= false;
+		return false;
+	}
+
+	pending_save = std::move(save);
+	pending_save->thread = SDL_CreateThread(write_save_game_file, "save_game_file", pending_save.get());
+	if (!pending_save->thread)
+	{
+		logWarning("Could not start save thread (%s); saving in the foreground", SDL_GetError());
+		write_save_game_file(pending_save.get());
+		finish_save_game_file();
 	}
 	
-	return success;
+	return true;
+}
+
+void idle_save_game_file()
+{
+	if (pending_save && pending_save->finished)
+	{
+		finish_save_game_file();
+	}
+}
+
+void wait_for_save_game_file()
+{
+	if (pending_save)
+	{
+		finish_save_game_file();
+	}
 }
 
 /* -------- static functions */
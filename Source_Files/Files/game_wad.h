@@ -35,11 +35,20 @@ Aug 12, 2000 (Loren Petrich):
 
 #include "cstypes.h"
 #include "map.h"
+#include <functional>
 #include <string>
 
 class FileSpecifier;
 
-bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata);
+// Packs the game up right away, then builds the preview (build_imagedata)
+// and writes the file on a background thread. Returns false if the game
+// couldn't be packed; otherwise on_complete is called from the main thread
+// once the save has landed (or failed)
+bool save_game_file(FileSpecifier& File, const std::string& metadata, std::function<std::string()> build_imagedata, std::function<void(bool)> on_complete);
+// Finishes a save if the background write is done; call regularly
+void idle_save_game_file();
+// Blocks until any save in progress has landed
+void wait_for_save_game_file();
 struct wad_data *build_meta_game_wad(const std::string& metadata, const std::string& imagedata, struct wad_header *header, int32 *length);
 
 bool export_level(FileSpecifier& File);
@@ -130,10 +130,13 @@ bool choose_saved_game_to_load(FileSpecifier &saved_game)
 
 bool save_game(void)
 {
-    bool success = create_quick_save();
-    if (success)
-        screen_printf("Game saved");
-    else
+    bool success = create_quick_save([](bool saved) {
+        if (saved)
+            screen_printf("Game saved");
+        else
+            screen_printf("Save failed");
+    });
+    if (!success)
         screen_printf("Save failed");
 
 	return success;
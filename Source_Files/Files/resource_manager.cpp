@@ -39,6 +39,14 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <memory>
+#include <algorithm>
+
+#include <boost/unordered_map.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace bip = boost::interprocess;
 
 #ifndef NO_STD_NAMESPACE
 using std::iostream;
@@ -116,26 +124,26 @@ bool is_macbinary(SDL_RWops *f, int32 &data_length, int32 &rsrc_length)
 
 // Structure for open resource file
 struct res_file_t {
-	res_file_t() : f(NULL) {}
-	res_file_t(SDL_RWops *file) : f(file) {}
-	res_file_t(const res_file_t &other) {f = other.f;}
+	res_file_t(SDL_RWops *file, uint32 seq) : f(file), seq(seq) {}
+	res_file_t(const res_file_t &other) = delete;
 	~res_file_t() {}
 
-	const res_file_t &operator=(const res_file_t &other)
-	{
-		if (this != &other)
-			f = other.f;
-		return *this;
-	}
+	const res_file_t &operator=(const res_file_t &other) = delete;
 
 	bool read_map(void);
+	void map_file(const char *path);
 	size_t count_resources(uint32 type) const;
 	void get_resource_id_list(uint32 type, vector<int> &ids) const;
 	bool get_resource(uint32 type, int id, LoadedResource &rsrc) const;
 	bool get_ind_resource(uint32 type, int index, LoadedResource &rsrc) const;
 	bool has_resource(uint32 type, int id) const;
+	bool read_resource(uint32 offset, LoadedResource &rsrc) const;
 
 	SDL_RWops *f;		// Opened resource file
+	uint32 seq;			// Position in the list of open files; later files have higher numbers
+
+	// Read-only view of the whole file, if the OS let us map it
+	std::unique_ptr<bip::mapped_region> mapping;
 
 	typedef map<int, uint32> id_map_t;			// Maps resource ID to offset to resource data
 	typedef map<uint32, id_map_t> type_map_t;	// Maps resource type to ID map
@@ -147,6 +155,64 @@ struct res_file_t {
 // List of open resource files
 static list<res_file_t *> res_file_list;
 static list<res_file_t *>::iterator cur_res_file_t;
+static uint32 next_res_file_seq = 0;
+
+// Index of every resource in every open file, so lookups that search
+// the whole chain don't have to walk each file's map; the locations for
+// a key are kept in the same order as res_file_list
+struct res_location_t {
+	res_file_t *file;
+	uint32 offset;
+};
+
+typedef std::pair<uint32, int> res_key_t;
+static boost::unordered_map<res_key_t, vector<res_location_t> > res_index;
+
+static void add_to_res_index(res_file_t *r)
+{
+	for (res_file_t::type_map_t::const_iterator i = r->types.begin(); i != r->types.end(); ++i) {
+		for (res_file_t::id_map_t::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
+			res_location_t location = { r, j->second };
+			res_index[res_key_t(i->first, j->first)].push_back(location);
+		}
+	}
+}
+
+static void remove_from_res_index(res_file_t *r)
+{
+	for (res_file_t::type_map_t::const_iterator i = r->types.begin(); i != r->types.end(); ++i) {
+		for (res_file_t::id_map_t::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
+			auto it = res_index.find(res_key_t(i->first, j->first));
+			if (it == res_index.end())
+				continue;
+
+			vector<res_location_t> &locations = it->second;
+			locations.erase(std::remove_if(locations.begin(), locations.end(), [r](const res_location_t &l) { return l.file == r; }), locations.end());
+			if (locations.empty())
+				res_index.erase(it);
+		}
+	}
+}
+
+// Finds the copy of a resource that a search from the current file back
+// to the first one would find first
+static const res_location_t *find_in_res_index(uint32 type, int id)
+{
+	if (res_file_list.empty())
+		return NULL;
+
+	auto it = res_index.find(res_key_t(type, id));
+	if (it == res_index.end())
+		return NULL;
+
+	uint32 cur_seq = (*cur_res_file_t)->seq;
+	const vector<res_location_t> &locations = it->second;
+	for (auto l = locations.rbegin(); l != locations.rend(); ++l) {
+		if (l->file->seq <= cur_seq)
+			return &*l;
+	}
+	return NULL;
+}
 
 
 /*
@@ -294,21 +360,86 @@ bool res_file_t::read_map(void)
 	return true;
 }
 
+/*
+ *  Map the file into memory, so resource reads are plain copies
+ */
+
+void res_file_t::map_file(const char *path)
+{
+	try {
+		bip::file_mapping file(path, bip::read_only);
+		mapping.reset(new bip::mapped_region(file, bip::read_only));
+
+		if (mapping->get_size() != static_cast<size_t>(SDL_RWsize(f))) {
+			// not the file we opened (e.g. the path was replaced underneath us)
+			mapping.reset();
+		}
+	} catch (const bip::interprocess_exception &e) {
+		logNote("could not map resource file, falling back to reads (%s)", e.what());
+		mapping.reset();
+	}
+}
+
+/*
+ *  Read resource data at the given offset (must be freed with free())
+ */
+
+bool res_file_t::read_resource(uint32 offset, LoadedResource &rsrc) const
+{
+	rsrc.Unload();
+
+	if (mapping) {
+		const uint8 *base = static_cast<const uint8 *>(mapping->get_address());
+		size_t file_size = mapping->get_size();
+		if (offset + 4 > file_size)
+			return false;
+
+		uint32 size = (base[offset] << 24) | (base[offset + 1] << 16) | (base[offset + 2] << 8) | base[offset + 3];
+		if (size > file_size - offset - 4)
+			return false;
+
+		void *p = malloc(size);
+		if (p == NULL)
+			return false;
+		memcpy(p, base + offset + 4, size);
+		rsrc.p = p;
+		rsrc.size = size;
+		return true;
+	}
+
+	// Read data size
+	SDL_RWseek(f, offset, SEEK_SET);
+	uint32 size = SDL_ReadBE32(f);
+
+	// Allocate memory and read data
+	void *p = malloc(size);
+	if (p == NULL)
+		return false;
+	SDL_RWread(f, p, 1, size);
+	rsrc.p = p;
+	rsrc.size = size;
+	return true;
+}
+
 /*
  *  Open resource file, set current file to the newly opened one
  */
- 
-SDL_RWops*
-open_res_file_from_rwops(SDL_RWops* f) {
+
+static SDL_RWops*
+open_res_file_from_rwops(SDL_RWops* f, const char* path) {
     if (f) {
 
             // Successful, create res_file_t object and read resource map
-            res_file_t *r = new res_file_t(f);
+            res_file_t *r = new res_file_t(f, next_res_file_seq++);
             if (r->read_map()) {
 
+                    if (path)
+                            r->map_file(path);
+
                     // Successful, add file to list of open files
                     res_file_list.push_back(r);
                     cur_res_file_t = --res_file_list.end();
+                    add_to_res_index(r);
                     
                     // ZZZ: this exists mostly to help the user understand (via logContexts) which of
                     // potentially several copies of a resource fork is actually being used.
@@ -327,10 +458,15 @@ open_res_file_from_rwops(SDL_RWops* f) {
     return f;
 }
 
+SDL_RWops*
+open_res_file_from_rwops(SDL_RWops* f) {
+	return open_res_file_from_rwops(f, NULL);
+}
+
 static SDL_RWops*
 open_res_file_from_path(const char* inPath) 
 {
-	return open_res_file_from_rwops(SDL_RWFromFile(inPath, "rb"));
+	return open_res_file_from_rwops(SDL_RWFromFile(inPath, "rb"), inPath);
 }
 
 SDL_RWops *open_res_file(FileSpecifier &file)
@@ -381,6 +517,7 @@ void close_res_file(SDL_RWops *file)
 
 		// Remove it from the list, close the file and delete the res_file_t
 		res_file_t *r = *i;
+		remove_from_res_index(r);
 		SDL_RWclose(r->f);
 		res_file_list.erase(i);
 		delete r;
@@ -497,20 +634,9 @@ bool res_file_t::get_resource(uint32 type, int id, LoadedResource &rsrc) const
 		id_map_t::const_iterator j = i->second.find(id);
 		if (j != i->second.end()) {
 
-			// Found, read data size
-			SDL_RWseek(f, j->second, SEEK_SET);
-			uint32 size = SDL_ReadBE32(f);
-
-			// Allocate memory and read data
-			void *p = malloc(size);
-			if (p == NULL)
-				return false;
-			SDL_RWread(f, p, 1, size);
-			rsrc.p = p;
-			rsrc.size = size;
-
-//			fprintf(stderr, "get_resource type %c%c%c%c, id %d -> data %p, size %d\n", type >> 24, type >> 16, type >> 8, type, id, p, size);
-			return true;
+			// Found, read data
+//			fprintf(stderr, "get_resource type %c%c%c%c, id %d\n", type >> 24, type >> 16, type >> 8, type, id);
+			return read_resource(j->second, rsrc);
 		}
 	}
 	return false;
@@ -523,17 +649,11 @@ bool get_1_resource(uint32 type, int id, LoadedResource &rsrc)
 
 bool get_resource(uint32 type, int id, LoadedResource &rsrc)
 {
-	if (!res_file_list.size())
-		return false;
-	list<res_file_t *>::const_iterator i = cur_res_file_t, begin = res_file_list.begin();
-	while (true) {
-		bool found = (*i)->get_resource(type, id, rsrc);
-		if (found)
-			return true;
-		if (i == begin)
-			break;
-		i--;
-	}
+	rsrc.Unload();
+
+	const res_location_t *location = find_in_res_index(type, id);
+	if (location)
+		return location->file->read_resource(location->offset, rsrc);
 	return false;
 }
 
@@ -555,20 +675,8 @@ bool res_file_t::get_ind_resource(uint32 type, int index, LoadedResource &rsrc)
 		for (int k=1; k<index; k++)
 			++j;
 
-		// Read data size
-		SDL_RWseek(f, j->second, SEEK_SET);
-		uint32 size = SDL_ReadBE32(f);
-
-		// Allocate memory and read data
-		void *p = malloc(size);
-		if (p == NULL)
-			return false;
-		SDL_RWread(f, p, 1, size);
-		rsrc.p = p;
-		rsrc.size = size;
-
-//		fprintf(stderr, "get_ind_resource type %c%c%c%c, index %d -> data %p, size %d\n", type >> 24, type >> 16, type >> 8, type, index, p, size);
-		return true;
+//		fprintf(stderr, "get_ind_resource type %c%c%c%c, index %d\n", type >> 24, type >> 16, type >> 8, type, index);
+		return read_resource(j->second, rsrc);
 	}
 	return false;
 }
@@ -617,15 +725,5 @@ bool has_1_resource(uint32 type, int id)
 
 bool has_resource(uint32 type, int id)
 {
-	if (!res_file_list.size())
-		return false;
-	list<res_file_t *>::const_iterator i = cur_res_file_t, begin = res_file_list.begin();
-	while (true) {
-		if ((*i)->has_resource(type, id))
-			return true;
-		if (i == begin)
-			break;
-		i--;
-	}
-	return false;
+	return find_in_res_index(type, id) != NULL;
 }
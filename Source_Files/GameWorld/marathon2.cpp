@@ -666,6 +666,8 @@ bool entering_map(bool restoring_saved)
 	/* and since no monsters have paths, we should make sure no paths think they have monsters */
 	reset_paths();
 	
+	invalidate_render_geometry();
+
 	/* mark our shape collections for loading and load them */
 	mark_environment_collections(static_world->environment_code, true);
 	mark_all_monster_collections(true);
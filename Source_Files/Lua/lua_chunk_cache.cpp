@@ -0,0 +1,195 @@
+/*
+LUA_CHUNK_CACHE.CPP
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Keeps the bytecode Lua compiles script source to in the local data
+	directory, so a large script isn't parsed again every time it's loaded
+
+	Entries are named for a hash of the Lua release, the chunk name and the
+	source, and start with the source's length and CRC, which must match
+	before the bytecode is used; Lua checks its own header (version,
+	format, byte order, type sizes) when it loads it
+*/
+
+#include "cseries.h"
+#include "lua_chunk_cache.h"
+
+extern "C"
+{
+#include "lua.h"
+#include "lauxlib.h"
+}
+
+#include "crc.h"
+#include "FileHandler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// below this, parsing the source is about as quick as reading the bytecode
+static const size_t kMinimumSourceSize = 16 * 1024;
+
+// past this, the entries written longest ago are removed
+static const size_t kMaximumEntries = 64;
+
+static const uint32 kEntryTag = FOUR_CHARS_TO_INT('A', '1', 'L', 'C');
+static const uint32 kEntryVersion = 1;
+
+struct entry_header
+{
+	uint32 tag;
+	uint32 version;
+	uint32 source_length;
+	uint32 source_crc;
+};
+
+static bool cache_directory(DirectorySpecifier& directory)
+{
+	extern DirectorySpecifier local_data_dir;
+	if (local_data_dir.GetPath()[0] == '\0')
+		return false;
+
+	directory = local_data_dir + "Lua Cache";
+
+	static bool created = false;
+	if (!created)
+	{
+		directory.CreateDirectory();
+		created = true;
+	}
+
+	return directory.Exists();
+}
+
+static std::string entry_name(const char *buffer, size_t len, const char *desc)
+{
+	uint64_t hash = FNV1A_OFFSET_BASIS;
+	hash = fnv1a_hash(hash, LUA_RELEASE, sizeof(LUA_RELEASE));
+	hash = fnv1a_hash(hash, desc, strlen(desc) + 1);
+	hash = fnv1a_hash(hash, buffer, len);
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.luac", static_cast<unsigned long long>(hash));
+	return name;
+}
+
+static bool read_entry(FileSpecifier& file, const entry_header& expected, std::string& bytecode)
+{
+	if (!file.Exists())
+		return false;
+
+	OpenedFile f;
+	int32 length;
+	if (!file.Open(f) || !f.GetLength(length) || length <= static_cast<int32>(sizeof(entry_header)))
+		return false;
+
+	entry_header header;
+	if (!f.Read(sizeof(header), &header) || memcmp(&header, &expected, sizeof(header)) != 0)
+		return false;
+
+	bytecode.resize(length - sizeof(header));
+	return f.Read(static_cast<int32>(bytecode.size()), &bytecode[0]);
+}
+
+static void remove_old_entries(DirectorySpecifier& directory)
+{
+	std::vector<dir_entry> entries;
+	if (!directory.ReadDirectory(entries))
+		return;
+
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [](const dir_entry& entry) { return entry.is_directory; }), entries.end());
+	if (entries.size() <= kMaximumEntries)
+		return;
+
+	std::sort(entries.begin(), entries.end(), [](const dir_entry& a, const dir_entry& b) { return a.date < b.date; });
+	for (size_t i = 0; i < entries.size() - kMaximumEntries; ++i)
+	{
+		FileSpecifier file = directory + entries[i].name;
+		file.Delete();
+	}
+}
+
+static void write_entry(DirectorySpecifier& directory, FileSpecifier& file, const entry_header& header, const std::string& bytecode)
+{
+	std::string data(reinterpret_cast<const char *>(&header), sizeof(header));
+	data += bytecode;
+
+	// another copy of the engine may be reading the same entry
+	FileSpecifier temp_file;
+	temp_file.SetTempName(file);
+
+	bool success = false;
+	{
+		OpenedFile f;
+		if (temp_file.Open(f, true))
+			success = f.Write(static_cast<int32>(data.size()), &data[0]);
+	}
+
+	if (!success || !temp_file.Rename(file))
+	{
+		temp_file.Delete();
+		return;
+	}
+
+	remove_old_entries(directory);
+}
+
+static int append_bytecode(lua_State *, const void *p, size_t sz, void *ud)
+{
+	static_cast<std::string *>(ud)->append(static_cast<const char *>(p), sz);
+	return 0;
+}
+
+int L_Load_Cached_Chunk(lua_State *L, const char *buffer, size_t len, const char *desc)
+{
+	DirectorySpecifier directory;
+	if (len < kMinimumSourceSize || len > INT32_MAX || !cache_directory(directory))
+		return luaL_loadbufferx(L, buffer, len, desc, "t");
+
+	FileSpecifier file = directory + entry_name(buffer, len, desc);
+
+	entry_header header;
+	header.tag = kEntryTag;
+	header.version = kEntryVersion;
+	header.source_length = static_cast<uint32>(len);
+	header.source_crc = calculate_data_crc(reinterpret_cast<unsigned char *>(const_cast<char *>(buffer)), static_cast<int32>(len));
+
+	std::string bytecode;
+	if (read_entry(file, header, bytecode))
+	{
+		if (luaL_loadbufferx(L, bytecode.data(), bytecode.size(), desc, "b") == LUA_OK)
+			return LUA_OK;
+
+		// written by some other build of Lua, or damaged
+		lua_pop(L, 1);
+		file.Delete();
+	}
+
+	// as text only, so what gets dumped was compiled here
+	int status = luaL_loadbufferx(L, buffer, len, desc, "t");
+	if (status == LUA_OK)
+	{
+		bytecode.clear();
+		if (lua_dump(L, append_bytecode, &bytecode) == 0)
+			write_entry(directory, file, header, bytecode);
+	}
+
+	return status;
+}
@@ -0,0 +1,36 @@
+#ifndef LUA_CHUNK_CACHE_H
+#define LUA_CHUNK_CACHE_H
+/*
+LUA_CHUNK_CACHE.H
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Keeps the bytecode Lua compiles script source to in the local data
+	directory, so a large script isn't parsed again every time it's loaded
+*/
+
+#include <cstddef>
+
+struct lua_State;
+
+// loads buffer as Lua source, as luaL_loadbufferx(L, buffer, len, desc, "t")
+// would; if the same source was compiled under the same name before, its
+// bytecode comes from the cache instead. Only bytecode the cache wrote
+// itself is ever loaded, never anything from the buffer
+int L_Load_Cached_Chunk(lua_State *L, const char *buffer, size_t len, const char *desc);
+
+#endif
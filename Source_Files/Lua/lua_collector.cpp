@@ -0,0 +1,192 @@
+/*
+LUA_COLLECTOR.CPP
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Drives garbage collection for the engine's Lua states from the main
+	loop, so collection happens between frames instead of wherever an
+	allocation happens to come due
+*/
+
+#include "cseries.h"
+#include "lua_collector.h"
+
+extern "C"
+{
+#include "lua.h"
+}
+
+#include "Console.h"
+#include "shell.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// start a cycle once the heap has doubled since the last one finished, as
+// Lua's own collector would
+static const int kCyclePause = 200;
+
+// past this, stepping isn't keeping up; collect everything at once
+static const int kEmergencyPause = 400;
+
+// smaller heaps than this (in kilobytes) aren't worth the bother
+static const int kMinimumHeap = 256;
+
+// allocation (in kilobytes) each lua_gc(LUA_GCSTEP) call pays off
+static const int kStepSize = 4;
+
+typedef std::chrono::steady_clock collector_clock;
+
+struct CollectedState
+{
+	lua_State *L;
+	std::string name;
+
+	int live_kb;		// heap when the last cycle finished
+	bool collecting;	// a cycle is under way
+
+	uint32 cycles;
+	uint32 slices;		// steps that did work on this state
+	double slice_time;	// seconds
+	double longest_slice;
+
+	uint32 emergencies;
+	double emergency_time;
+	double longest_emergency;
+};
+
+static std::vector<CollectedState> collected_states;
+static size_t first_state = 0;
+
+static int heap_kb(lua_State *L)
+{
+	return lua_gc(L, LUA_GCCOUNT, 0);
+}
+
+static bool over_pause(const CollectedState& state, int pause)
+{
+	return heap_kb(state.L) >= std::max(state.live_kb, kMinimumHeap) * pause / 100;
+}
+
+struct lua_gc_command
+{
+	void operator() (const std::string&) const {
+		if (collected_states.empty())
+		{
+			screen_printf("no Lua states are running");
+			return;
+		}
+
+		for (const auto& state : collected_states)
+		{
+			screen_printf("%s: %d KB (%d KB live); %u cycles in %u steps, %.2f ms, longest %.2f ms; %u emergency collections, %.2f ms, longest %.2f ms",
+				      state.name.c_str(), heap_kb(state.L), state.live_kb,
+				      state.cycles, state.slices, state.slice_time * 1000, state.longest_slice * 1000,
+				      state.emergencies, state.emergency_time * 1000, state.longest_emergency * 1000);
+		}
+	}
+};
+
+void L_Collector_Add(lua_State *L, const char *name)
+{
+	static bool registered_command = false;
+	if (!registered_command)
+	{
+		Console::instance()->register_command("lua_gc", lua_gc_command());
+		registered_command = true;
+	}
+
+	lua_gc(L, LUA_GCSTOP, 0);
+
+	CollectedState state = {};
+	state.L = L;
+	state.name = name;
+	state.live_kb = heap_kb(L);
+	collected_states.push_back(state);
+}
+
+void L_Collector_Remove(lua_State *L)
+{
+	collected_states.erase(std::remove_if(collected_states.begin(), collected_states.end(), [L](const CollectedState& state) { return state.L == L; }), collected_states.end());
+}
+
+void L_Collector_Step(int budget_microseconds)
+{
+	if (collected_states.empty())
+		return;
+
+	auto deadline = collector_clock::now() + std::chrono::microseconds(budget_microseconds);
+
+	// take turns going first, so one busy state can't starve the rest
+	first_state = (first_state + 1) % collected_states.size();
+	for (size_t i = 0; i < collected_states.size(); ++i)
+	{
+		auto& state = collected_states[(first_state + i) % collected_states.size()];
+
+		// a script can restart it with collectgarbage("restart")
+		if (lua_gc(state.L, LUA_GCISRUNNING, 0))
+			lua_gc(state.L, LUA_GCSTOP, 0);
+
+		if (!state.collecting)
+		{
+			if (!over_pause(state, kCyclePause))
+				continue;
+
+			state.collecting = true;
+		}
+
+		auto start = collector_clock::now();
+		if (start >= deadline)
+			break;
+
+		do {
+			if (lua_gc(state.L, LUA_GCSTEP, kStepSize))
+			{
+				state.collecting = false;
+				state.live_kb = heap_kb(state.L);
+				++state.cycles;
+				break;
+			}
+		} while (collector_clock::now() < deadline);
+
+		std::chrono::duration<double> elapsed = collector_clock::now() - start;
+		++state.slices;
+		state.slice_time += elapsed.count();
+		state.longest_slice = std::max(state.longest_slice, elapsed.count());
+	}
+}
+
+void L_Collector_Check_Pressure()
+{
+	for (auto& state : collected_states)
+	{
+		if (!over_pause(state, kEmergencyPause))
+			continue;
+
+		auto start = collector_clock::now();
+		lua_gc(state.L, LUA_GCCOLLECT, 0);
+		std::chrono::duration<double> elapsed = collector_clock::now() - start;
+
+		state.collecting = false;
+		state.live_kb = heap_kb(state.L);
+		++state.emergencies;
+		state.emergency_time += elapsed.count();
+		state.longest_emergency = std::max(state.longest_emergency, elapsed.count());
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef LUA_COLLECTOR_H
+#define LUA_COLLECTOR_H
+/*
+LUA_COLLECTOR.H
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Drives garbage collection for the engine's Lua states from the main
+	loop, so collection happens between frames instead of wherever an
+	allocation happens to come due
+*/
+
+struct lua_State;
+
+// stops the state's own collector; the state must be removed before it's closed
+void L_Collector_Add(lua_State *L, const char *name);
+void L_Collector_Remove(lua_State *L);
+
+// collects for up to budget_microseconds, picking up where the last call
+// left off; states that are between cycles cost nothing
+void L_Collector_Step(int budget_microseconds);
+
+// if a state's heap has outgrown what stepping can keep up with, collects
+// it all at once
+void L_Collector_Check_Pressure();
+
+#endif
@@ -342,6 +342,7 @@ static int Lua_Image_Get_Crop_Rect(lua_State *L)
 
 int Lua_Image_Rescale(lua_State *L)
 {
+	Lua_HUDInstance()->draw_pending(Lua_Image::Object(L, 1));
 	Lua_Image::Object(L, 1)->Rescale(lua_tonumber(L, 2), lua_tonumber(L, 3));
 	return 0;
 }
@@ -388,6 +389,7 @@ const luaL_Reg Lua_Image_Set[] = {
 
 static int Lua_Image_GC(lua_State *L)
 {
+	Lua_HUDInstance()->draw_pending(Lua_Image::Object(L, 1));
 	delete Lua_Image::Object(L, 1);
 	Lua_Image::Invalidate(L, Lua_Image::Index(L, 1));
 	return 0;
@@ -666,6 +668,7 @@ static int Lua_Shape_Get_Crop_Rect(lua_State *L)
 
 int Lua_Shape_Rescale(lua_State *L)
 {
+	Lua_HUDInstance()->draw_pending(Lua_Shape::Object(L, 1));
 	Lua_Shape::Object(L, 1)->Rescale(lua_tonumber(L, 2), lua_tonumber(L, 3));
 	return 0;
 }
@@ -712,6 +715,7 @@ const luaL_Reg Lua_Shape_Set[] = {
 
 static int Lua_Shape_GC(lua_State *L)
 {
+	Lua_HUDInstance()->draw_pending(Lua_Shape::Object(L, 1));
 	delete Lua_Shape::Object(L, 1);
 	Lua_Shape::Invalidate(L, Lua_Shape::Index(L, 1));
 	return 0;
@@ -916,6 +920,7 @@ const luaL_Reg Lua_Font_Set[] = {
 
 static int Lua_Font_GC(lua_State *L)
 {
+	Lua_HUDInstance()->draw_pending(Lua_Font::Object(L, 1));
 	delete Lua_Font::Object(L, 1);
 	Lua_Font::Invalidate(L, Lua_Font::Index(L, 1));
 	return 0;
@@ -43,6 +43,9 @@ extern "C"
 
 #include "lua_hud_script.h"
 #include "lua_hud_objects.h"
+#include "lua_chunk_cache.h"
+#include "lua_collector.h"
+#include "lua_profiler.h"
 
 #include <boost/iostreams/device/array.hpp>
 #include <boost/iostreams/stream_buffer.hpp>
@@ -77,11 +80,15 @@ void* L_Persistent_Table_Key();
 class LuaHUDState
 {
 public:
-	LuaHUDState() : running_(false), inited_(false), num_scripts_(0) {
+	LuaHUDState() : running_(false), inited_(false), num_scripts_(0), called_trigger_(nullptr) {
 		state_.reset(luaL_newstate(), lua_close);
+		L_Collector_Add(State(), "HUD Lua");
+		L_Profiler_Add(State(), "HUD Lua");
 	}
 
 	virtual ~LuaHUDState() {
+		L_Profiler_Remove(State());
+		L_Collector_Remove(State());
 	}
 
 public:
@@ -128,6 +135,7 @@ private:
 	bool running_;
 	int num_scripts_;
     bool inited_;
+	const char *called_trigger_;	// the last one GetTrigger pushed, for the profiler
 };
 
 LuaHUDState *hud_state = NULL;
@@ -153,13 +161,16 @@ bool LuaHUDState::GetTrigger(const char* trigger)
 	}
 
 	lua_remove(State(), -2);
+	called_trigger_ = trigger;
 	return true;
 }
 
 void LuaHUDState::CallTrigger(int numArgs)
 {
+	L_Profile_Enter(State(), called_trigger_);
 	if (lua_pcall(State(), numArgs, 0, 0) == LUA_ERRRUN)
 		L_Error(lua_tostring(State(), -1));
+	L_Profile_Leave(State());
 }
 
 void LuaHUDState::Init()
@@ -201,7 +212,7 @@ void LuaHUDState::RegisterFunctions()
 
 bool LuaHUDState::Load(const char *buffer, size_t len)
 {
-	int status = luaL_loadbufferx(State(), buffer, len, "HUD Lua", "t");
+	int status = L_Load_Cached_Chunk(State(), buffer, len, "HUD Lua");
 	if (status == LUA_ERRRUN)
 		logWarning("Lua loading failed: error running script.");
 	if (status == LUA_ERRFILE)
@@ -303,6 +314,8 @@ void L_Call_HUDDraw()
 {
 	if (hud_state)
 		hud_state->Draw();
+
+	L_Collector_Check_Pressure();
 }
 
 void L_Call_HUDResize()
@@ -1788,6 +1788,95 @@ int16 Lua_Polygons_Length() {
 	return dynamic_world->polygon_count;
 }
 
+void Lua_Polygons_Flood(int16 polygon_index, int depth, const std::function<bool (int16)>& in_range, std::vector<int16>& polygons)
+{
+	// each flood stamps the polygons it's seen with a number of its own, so
+	// nothing needs clearing between floods
+	static std::vector<uint32> seen;
+	static uint32 flood = 0;
+
+	seen.resize(dynamic_world->polygon_count);
+	if (++flood == 0)
+	{
+		std::fill(seen.begin(), seen.end(), 0);
+		flood = 1;
+	}
+
+	polygons.clear();
+	polygons.push_back(polygon_index);
+	seen[polygon_index] = flood;
+
+	size_t step_start = 0;
+	for (int step = 0; depth == NONE || step < depth; ++step)
+	{
+		size_t step_end = polygons.size();
+		if (step_start == step_end)
+			break;
+
+		for (size_t i = step_start; i < step_end; ++i)
+		{
+			polygon_data *polygon = get_polygon_data(polygons[i]);
+			for (int side = 0; side < polygon->vertex_count; ++side)
+			{
+				int16 adjacent_index = polygon->adjacent_polygon_indexes[side];
+				if (adjacent_index == NONE || seen[adjacent_index] == flood)
+					continue;
+
+				seen[adjacent_index] = flood;
+				if (in_range(adjacent_index))
+					polygons.push_back(adjacent_index);
+			}
+		}
+
+		step_start = step_end;
+	}
+}
+
+// Polygons.adjacent(polygon, [depth], [results])
+static int Lua_Polygons_Adjacent(lua_State *L)
+{
+	int16 polygon_index;
+	if (lua_isnumber(L, 1))
+	{
+		polygon_index = static_cast<int16>(lua_tonumber(L, 1));
+		if (!Lua_Polygon::Valid(polygon_index))
+			return luaL_error(L, "adjacent: invalid polygon index");
+	}
+	else if (Lua_Polygon::Is(L, 1))
+	{
+		polygon_index = Lua_Polygon::Index(L, 1);
+	}
+	else
+		return luaL_error(L, "adjacent: incorrect argument type");
+
+	int depth = 1;
+	int results = 2;
+	if (lua_isnumber(L, 2))
+	{
+		depth = static_cast<int>(lua_tonumber(L, 2));
+		if (depth < 0)
+			return luaL_error(L, "adjacent: invalid depth");
+		results = 3;
+	}
+	else if (lua_isnoneornil(L, 2))
+	{
+		// nil holds depth's place, so results can still follow it
+		results = 3;
+	}
+
+	static std::vector<int16> polygons;
+	Lua_Polygons_Flood(polygon_index, depth, [](int16) { return true; }, polygons);
+	polygons.erase(polygons.begin());
+
+	L_Push_Results<Lua_Polygon>(L, results, polygons);
+	return 1;
+}
+
+const luaL_Reg Lua_Polygons_Methods[] = {
+	{"adjacent", L_TableFunction<Lua_Polygons_Adjacent>},
+	{0, 0}
+};
+
 char Lua_Side_ControlPanel_Name[] = "side_control_panel";
 typedef L_Class<Lua_Side_ControlPanel_Name> Lua_Side_ControlPanel;
 
@@ -3762,7 +3851,7 @@ int Lua_Map_register(lua_State *L)
 	Lua_Polygon::Register(L, Lua_Polygon_Get, Lua_Polygon_Set);
 	Lua_Polygon::Valid = Lua_Polygon_Valid;
 
-	Lua_Polygons::Register(L);
+	Lua_Polygons::Register(L, Lua_Polygons_Methods);
 	Lua_Polygons::Length = Lua_Polygons_Length;
 
 	Lua_Side_ControlPanel::Register(L, Lua_Side_ControlPanel_Get, Lua_Side_ControlPanel_Set);
@@ -148,6 +148,11 @@ typedef L_Container<Lua_Medias_Name, Lua_Media> Lua_Medias;
 extern char Lua_CompletionState_Name[];
 typedef L_Enum<Lua_CompletionState_Name> Lua_CompletionState;
 
+// the polygons reachable from polygon_index, itself first and then outward
+// through adjacent polygons in the order their sides come, no more than
+// depth steps (NONE for no limit), and only into polygons in_range accepts
+void Lua_Polygons_Flood(int16 polygon_index, int depth, const std::function<bool (int16)>& in_range, std::vector<int16>& polygons);
+
 int Lua_Map_register (lua_State *L);
 
 #endif
@@ -1128,7 +1128,102 @@ int Lua_Monsters_New(lua_State *L)
 	return 1;
 }
 
+// whether any of the polygon's sides come within radius of (x, y)
+static bool polygon_in_radius(int16 polygon_index, double x, double y, double radius)
+{
+	polygon_data *polygon = get_polygon_data(polygon_index);
+	for (int i = 0; i < polygon->vertex_count; ++i)
+	{
+		const world_point2d& a = get_endpoint_data(polygon->endpoint_indexes[i])->vertex;
+		const world_point2d& b = get_endpoint_data(polygon->endpoint_indexes[(i + 1) % polygon->vertex_count])->vertex;
+
+		// the closest point on the side
+		double dx = b.x - a.x;
+		double dy = b.y - a.y;
+		double length_squared = dx * dx + dy * dy;
+		double t = length_squared > 0 ? ((x - a.x) * dx + (y - a.y) * dy) / length_squared : 0;
+		t = std::max(0.0, std::min(1.0, t));
+
+		double closest_x = a.x + t * dx - x;
+		double closest_y = a.y + t * dy - y;
+		if (closest_x * closest_x + closest_y * closest_y <= radius * radius)
+			return true;
+	}
+
+	return false;
+}
+
+// Monsters.in_radius(x, y, z, radius, [polygon], [results])
+int Lua_Monsters_In_Radius(lua_State *L)
+{
+	if (!lua_isnumber(L, 1) || !lua_isnumber(L, 2) || !lua_isnumber(L, 3) || !lua_isnumber(L, 4))
+		return luaL_error(L, "in_radius: incorrect argument type");
+
+	double x = lua_tonumber(L, 1) * WORLD_ONE;
+	double y = lua_tonumber(L, 2) * WORLD_ONE;
+	double z = lua_tonumber(L, 3) * WORLD_ONE;
+	double radius = lua_tonumber(L, 4) * WORLD_ONE;
+
+	int results = 5;
+	int16 polygon_index;
+	if (lua_isnumber(L, 5))
+	{
+		polygon_index = static_cast<int16>(lua_tonumber(L, 5));
+		if (!Lua_Polygon::Valid(polygon_index))
+			return luaL_error(L, "in_radius: invalid polygon index");
+		results = 6;
+	}
+	else if (Lua_Polygon::Is(L, 5))
+	{
+		polygon_index = Lua_Polygon::Index(L, 5);
+		results = 6;
+	}
+	else
+	{
+		// nil holds the polygon's place, so results can still follow it
+		if (lua_isnoneornil(L, 5))
+			results = 6;
+
+		world_point2d p = { static_cast<world_distance>(x), static_cast<world_distance>(y) };
+		polygon_index = ::world_point_to_polygon_index(&p);
+	}
+
+	// flood out from the centre's polygon through the ones the circle
+	// reaches, and take the monsters standing in them
+	static std::vector<int16> polygons;
+	static std::vector<int16> monster_indexes;
+	monster_indexes.clear();
+
+	if (polygon_index != NONE)
+	{
+		Lua_Polygons_Flood(polygon_index, NONE, [x, y, radius](int16 index) { return polygon_in_radius(index, x, y, radius); }, polygons);
+
+		for (auto index : polygons)
+		{
+			for (int16 object_index = get_polygon_data(index)->first_object; object_index != NONE; object_index = get_object_data(object_index)->next_object)
+			{
+				object_data *object = get_object_data(object_index);
+				if (GET_OBJECT_OWNER(object) != _object_is_monster || !Lua_Monster::Valid(object->permutation))
+					continue;
+
+				double dx = object->location.x - x;
+				double dy = object->location.y - y;
+				double dz = object->location.z - z;
+				if (dx * dx + dy * dy + dz * dz <= radius * radius)
+					monster_indexes.push_back(object->permutation);
+			}
+		}
+
+		// in the order Monsters() would go
+		std::sort(monster_indexes.begin(), monster_indexes.end());
+	}
+
+	L_Push_Results<Lua_Monster>(L, results, monster_indexes);
+	return 1;
+}
+
 const luaL_Reg Lua_Monsters_Methods[] = {
+	{"in_radius", L_TableFunction<Lua_Monsters_In_Radius>},
 	{"new", L_TableFunction<Lua_Monsters_New>},
 	{0, 0}
 };
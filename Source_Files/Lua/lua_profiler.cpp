@@ -0,0 +1,385 @@
+/*
+LUA_PROFILER.CPP
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Samples where the engine's Lua states spend their time, per trigger and
+	per function, and writes it out as collapsed stacks for flame graphs
+
+	A count hook looks at the clock every so many instructions, and once
+	enough time has gone by, charges it to the stack it finds. Time in the
+	engine functions a script calls lands on the Lua frame that called them.
+*/
+
+#include "cseries.h"
+#include "lua_profiler.h"
+
+extern "C"
+{
+#include "lua.h"
+}
+
+#include "Console.h"
+#include "FileHandler.h"
+#include "Logging.h"
+#include "shell.h"
+#include "shell_options.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// instructions between looks at the clock
+static const int kHookCount = 1000;
+
+// how long to let a script run between looks at its stack
+static const std::chrono::microseconds kSampleInterval(100);
+
+typedef std::chrono::steady_clock profiler_clock;
+
+struct ProfiledTrigger
+{
+	const char *name;
+	int depth;	// frames on the stack when it was called
+	profiler_clock::time_point start;
+};
+
+struct ProfiledState
+{
+	lua_State *L;
+	std::string name;
+
+	std::vector<ProfiledTrigger> triggers;	// being called, outermost first
+
+	// time since last_mark hasn't been charged yet; if nothing better comes
+	// along, it goes to last_stack
+	profiler_clock::time_point last_mark;
+	std::string last_stack;
+};
+
+struct TriggerTimes
+{
+	uint32 calls;
+	double time;	// seconds
+	double longest;
+};
+
+bool lua_profiler_running = false;
+
+static std::vector<ProfiledState> profiled_states;
+
+// kept by state name rather than state, so a profile can span levels
+static std::map<std::string, double> stack_times;
+static std::map<std::string, TriggerTimes> trigger_times;
+static uint32 profiled_ticks = 0;
+
+static double seconds(profiler_clock::duration d)
+{
+	return std::chrono::duration<double>(d).count();
+}
+
+static ProfiledState *find_state(lua_State *L)
+{
+	for (auto& state : profiled_states)
+	{
+		if (state.L == L)
+			return &state;
+	}
+
+	return nullptr;
+}
+
+static std::string frame_name(lua_State *L, lua_Debug& ar)
+{
+	lua_getinfo(L, "Sn", &ar);
+
+	std::ostringstream s;
+	if (*ar.what == 'm')
+		s << "main chunk (" << ar.short_src << ")";
+	else if (*ar.what == 'C')
+		s << (ar.name ? ar.name : "function");
+	else
+		s << (ar.name ? ar.name : "function") << " (" << ar.short_src << ":" << ar.linedefined << ")";
+
+	// the separator in collapsed stacks
+	std::string name = s.str();
+	std::replace(name.begin(), name.end(), ';', ':');
+	return name;
+}
+
+// outermost first
+static std::vector<std::string> stack_frames(lua_State *L)
+{
+	std::vector<std::string> frames;
+
+	lua_Debug ar;
+	for (int level = 0; lua_getstack(L, level, &ar); ++level)
+		frames.push_back(frame_name(L, ar));
+
+	std::reverse(frames.begin(), frames.end());
+	return frames;
+}
+
+static int stack_depth(lua_State *L)
+{
+	lua_Debug ar;
+	int depth = 0;
+	while (lua_getstack(L, depth, &ar))
+		++depth;
+
+	return depth;
+}
+
+// the state, then its frames, with each trigger being called in front of the
+// frames it called
+static std::string collapse_stack(const ProfiledState& state)
+{
+	std::string stack = state.name;
+
+	auto frames = stack_frames(state.L);
+	auto trigger = state.triggers.begin();
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		for (; trigger != state.triggers.end() && trigger->depth <= static_cast<int>(i); ++trigger)
+			stack += std::string(";") + trigger->name;
+
+		stack += ";" + frames[i];
+	}
+
+	for (; trigger != state.triggers.end(); ++trigger)
+		stack += std::string(";") + trigger->name;
+
+	return stack;
+}
+
+static void charge(ProfiledState& state, profiler_clock::time_point now, const std::string& stack)
+{
+	stack_times[stack] += seconds(now - state.last_mark);
+	state.last_mark = now;
+}
+
+static void profiler_hook(lua_State *L, lua_Debug *)
+{
+	ProfiledState *state = find_state(L);
+	if (!state || state->triggers.empty())
+		return;
+
+	auto now = profiler_clock::now();
+	if (now - state->last_mark < kSampleInterval)
+		return;
+
+	state->last_stack = collapse_stack(*state);
+	charge(*state, now, state->last_stack);
+}
+
+void L_Profiler_Enter_Trigger(lua_State *L, const char *trigger)
+{
+	ProfiledState *state = find_state(L);
+	if (!state)
+		return;
+
+	auto now = profiler_clock::now();
+	if (state->triggers.empty())
+		state->last_mark = now;
+	else
+		charge(*state, now, collapse_stack(*state));
+
+	state->triggers.push_back({trigger, stack_depth(L), now});
+	state->last_stack = collapse_stack(*state);
+}
+
+void L_Profiler_Leave_Trigger(lua_State *L)
+{
+	ProfiledState *state = find_state(L);
+	if (!state || state->triggers.empty())
+		return;
+
+	auto now = profiler_clock::now();
+	charge(*state, now, state->last_stack);
+
+	const ProfiledTrigger& trigger = state->triggers.back();
+	double elapsed = seconds(now - trigger.start);
+
+	TriggerTimes& times = trigger_times[state->name + " " + trigger.name];
+	++times.calls;
+	times.time += elapsed;
+	times.longest = std::max(times.longest, elapsed);
+
+	state->triggers.pop_back();
+	if (state->triggers.empty())
+		state->last_stack.clear();
+	else
+		state->last_stack = collapse_stack(*state);
+}
+
+void L_Profiler_Count_Tick()
+{
+	++profiled_ticks;
+}
+
+static void start_profiling(ProfiledState& state)
+{
+	state.triggers.clear();
+	state.last_stack.clear();
+	lua_sethook(state.L, profiler_hook, LUA_MASKCOUNT, kHookCount);
+}
+
+static void stop_profiling(ProfiledState& state)
+{
+	// unless a script has put in one of its own
+	if (lua_gethook(state.L) == profiler_hook)
+		lua_sethook(state.L, nullptr, 0, 0);
+
+	state.triggers.clear();
+	state.last_stack.clear();
+}
+
+static void write_profile()
+{
+	std::ostringstream s;
+	for (const auto& stack : stack_times)
+	{
+		long microseconds = std::lround(stack.second * 1000000);
+		if (microseconds > 0)
+			s << stack.first << " " << microseconds << "\n";
+	}
+	std::string data = s.str();
+
+	extern DirectorySpecifier log_dir;
+	FileSpecifier file = log_dir + "Lua Profile.txt";
+
+	bool success = false;
+	{
+		OpenedFile f;
+		if (file.Open(f, true))
+			success = f.Write(static_cast<int32>(data.size()), const_cast<char *>(data.data()));
+	}
+
+	if (success)
+		screen_printf("wrote Lua profile to %s", file.GetPath());
+	else
+		screen_printf("could not write Lua profile to %s", file.GetPath());
+
+	// the costliest triggers to the console, and all of them to the log
+	std::vector<std::pair<std::string, TriggerTimes> > triggers(trigger_times.begin(), trigger_times.end());
+	std::sort(triggers.begin(), triggers.end(), [](const std::pair<std::string, TriggerTimes>& a, const std::pair<std::string, TriggerTimes>& b) {
+		return a.second.time > b.second.time;
+	});
+
+	logNote("Lua profile over %u ticks:", profiled_ticks);
+	for (size_t i = 0; i < triggers.size(); ++i)
+	{
+		const TriggerTimes& times = triggers[i].second;
+		double per_tick = profiled_ticks ? times.time / profiled_ticks : times.time;
+		if (i < 5)
+		{
+			screen_printf("%s: %.3f ms per tick, longest %.2f ms",
+				      triggers[i].first.c_str(), per_tick * 1000, times.longest * 1000);
+		}
+
+		logNote("%s: %u calls, %.2f ms, %.3f ms per tick, longest %.2f ms",
+			triggers[i].first.c_str(), times.calls, times.time * 1000, per_tick * 1000, times.longest * 1000);
+	}
+}
+
+void L_Profiler_Start()
+{
+	if (lua_profiler_running)
+		return;
+
+	stack_times.clear();
+	trigger_times.clear();
+	profiled_ticks = 0;
+
+	for (auto& state : profiled_states)
+		start_profiling(state);
+
+	lua_profiler_running = true;
+}
+
+void L_Profiler_Stop()
+{
+	if (!lua_profiler_running)
+		return;
+
+	lua_profiler_running = false;
+
+	for (auto& state : profiled_states)
+		stop_profiling(state);
+
+	write_profile();
+}
+
+struct lua_profile_start_command
+{
+	void operator() (const std::string&) const {
+		if (lua_profiler_running)
+		{
+			screen_printf("the Lua profiler is already running");
+			return;
+		}
+
+		L_Profiler_Start();
+		screen_printf("started the Lua profiler");
+	}
+};
+
+struct lua_profile_stop_command
+{
+	void operator() (const std::string&) const {
+		if (!lua_profiler_running)
+		{
+			screen_printf("the Lua profiler isn't running");
+			return;
+		}
+
+		L_Profiler_Stop();
+	}
+};
+
+void L_Profiler_Add(lua_State *L, const char *name)
+{
+	static bool registered_command = false;
+	if (!registered_command)
+	{
+		CommandParser profile_parser;
+		profile_parser.register_command("start", lua_profile_start_command());
+		profile_parser.register_command("stop", lua_profile_stop_command());
+		Console::instance()->register_command("lua_profile", profile_parser);
+		registered_command = true;
+
+		if (shell_options.lua_profile)
+			L_Profiler_Start();
+	}
+
+	ProfiledState state;
+	state.L = L;
+	state.name = name;
+	profiled_states.push_back(state);
+
+	if (lua_profiler_running)
+		start_profiling(profiled_states.back());
+}
+
+void L_Profiler_Remove(lua_State *L)
+{
+	profiled_states.erase(std::remove_if(profiled_states.begin(), profiled_states.end(), [L](const ProfiledState& state) { return state.L == L; }), profiled_states.end());
+}
@@ -0,0 +1,63 @@
+#ifndef LUA_PROFILER_H
+#define LUA_PROFILER_H
+/*
+LUA_PROFILER.H
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Samples where the engine's Lua states spend their time, per trigger and
+	per function, and writes it out as collapsed stacks for flame graphs
+*/
+
+struct lua_State;
+
+// states are profiled from when they're added until they're removed, while
+// the profiler is running
+void L_Profiler_Add(lua_State *L, const char *name);
+void L_Profiler_Remove(lua_State *L);
+
+// "lua_profile start" and "lua_profile stop" in the console do the same;
+// stopping writes Lua Profile.txt to the log directory
+void L_Profiler_Start();
+void L_Profiler_Stop();
+
+extern bool lua_profiler_running;
+
+void L_Profiler_Enter_Trigger(lua_State *L, const char *trigger);
+void L_Profiler_Leave_Trigger(lua_State *L);
+void L_Profiler_Count_Tick();
+
+// these cost a test of lua_profiler_running when it isn't
+inline void L_Profile_Enter(lua_State *L, const char *trigger)
+{
+	if (lua_profiler_running)
+		L_Profiler_Enter_Trigger(L, trigger);
+}
+
+inline void L_Profile_Leave(lua_State *L)
+{
+	if (lua_profiler_running)
+		L_Profiler_Leave_Trigger(L);
+}
+
+inline void L_Profile_Tick()
+{
+	if (lua_profiler_running)
+		L_Profiler_Count_Tick();
+}
+
+#endif
@@ -353,7 +353,42 @@ int Lua_Projectiles_New_Projectile(lua_State *L)
 	return 1;
 }
 
+// Projectiles.in_polygon(polygon, [results])
+int Lua_Projectiles_In_Polygon(lua_State *L)
+{
+	int16 polygon_index;
+	if (lua_isnumber(L, 1))
+	{
+		polygon_index = static_cast<int16>(lua_tonumber(L, 1));
+		if (!Lua_Polygon::Valid(polygon_index))
+			return luaL_error(L, "in_polygon: invalid polygon index");
+	}
+	else if (Lua_Polygon::Is(L, 1))
+	{
+		polygon_index = Lua_Polygon::Index(L, 1);
+	}
+	else
+		return luaL_error(L, "in_polygon: incorrect argument type");
+
+	static std::vector<int16> projectile_indexes;
+	projectile_indexes.clear();
+
+	for (int16 object_index = get_polygon_data(polygon_index)->first_object; object_index != NONE; object_index = get_object_data(object_index)->next_object)
+	{
+		object_data *object = get_object_data(object_index);
+		if (GET_OBJECT_OWNER(object) == _object_is_projectile && Lua_Projectile::Valid(object->permutation))
+			projectile_indexes.push_back(object->permutation);
+	}
+
+	// in the order Projectiles() would go
+	std::sort(projectile_indexes.begin(), projectile_indexes.end());
+
+	L_Push_Results<Lua_Projectile>(L, 2, projectile_indexes);
+	return 1;
+}
+
 const luaL_Reg Lua_Projectiles_Methods[] = {
+	{"in_polygon", L_TableFunction<Lua_Projectiles_In_Polygon>},
 	{"new", L_TableFunction<Lua_Projectiles_New_Projectile>},
 	{0, 0}
 };
@@ -69,6 +69,7 @@ extern "C"
 #include "lualib.h"
 }
 
+#include <chrono>
 #include <functional>
 #include <string>
 #include <stdlib.h>
@@ -112,6 +113,9 @@ extern "C"
 #include "interpolated_world.h"
 
 #include "lua_script.h"
+#include "lua_chunk_cache.h"
+#include "lua_collector.h"
+#include "lua_profiler.h"
 #include "lua_music.h"
 #include "lua_ephemera.h"
 #include "lua_map.h"
@@ -182,6 +186,65 @@ void* L_Persistent_Table_Key()
 	return const_cast<char*>(key);
 }
 
+enum TriggerType {
+	_trigger_init,
+	_trigger_idle,
+	_trigger_cleanup,
+	_trigger_postidle,
+	_trigger_start_refuel,
+	_trigger_end_refuel,
+	_trigger_tag_switch,
+	_trigger_light_switch,
+	_trigger_platform_switch,
+	_trigger_projectile_switch,
+	_trigger_terminal_enter,
+	_trigger_terminal_exit,
+	_trigger_pattern_buffer,
+	_trigger_got_item,
+	_trigger_light_activated,
+	_trigger_platform_activated,
+	_trigger_player_revived,
+	_trigger_player_killed,
+	_trigger_monster_killed,
+	_trigger_monster_damaged,
+	_trigger_player_damaged,
+	_trigger_projectile_detonated,
+	_trigger_projectile_created,
+	_trigger_item_created,
+	_trigger_calculate_level_completion_state,
+	_trigger_monster_kamikazed,
+	NUMBER_OF_LUA_TRIGGERS
+};
+
+static const char *trigger_names[NUMBER_OF_LUA_TRIGGERS] = {
+	"init",
+	"idle",
+	"cleanup",
+	"postidle",
+	"start_refuel",
+	"end_refuel",
+	"tag_switch",
+	"light_switch",
+	"platform_switch",
+	"projectile_switch",
+	"terminal_enter",
+	"terminal_exit",
+	"pattern_buffer",
+	"got_item",
+	"light_activated",
+	"platform_activated",
+	"player_revived",
+	"player_killed",
+	"monster_killed",
+	"monster_damaged",
+	"player_damaged",
+	"projectile_detonated",
+	"projectile_created",
+	"item_created",
+	"calculate_level_completion_state",
+	"monster_kamikazed",
+};
+
 std::map<int, std::string> PassedLuaState;
 std::map<int, std::string> SavedLuaState;
 
@@ -189,11 +252,16 @@ class LuaState
 {
 	friend bool CollectLuaStats(std::map<std::string, std::string>&, std::map<std::string, std::string>&);
 public:
-	LuaState() : running_(false), num_scripts_(0) {
+	LuaState(const char *name) : running_(false), num_scripts_(0), called_trigger_(_trigger_init), triggers_present_(0), triggers_tracked_(false), trigger_names_ref_(LUA_NOREF) {
 		state_.reset(luaL_newstate(), lua_close);
+		std::fill_n(trigger_refs_, NUMBER_OF_LUA_TRIGGERS, LUA_NOREF);
+		L_Collector_Add(State(), name);
+		L_Profiler_Add(State(), name);
 	}
 
 	virtual ~LuaState() {
+		L_Profiler_Remove(State());
+		L_Collector_Remove(State());
 	}
 
 public:
@@ -242,6 +310,7 @@ public:
 
 		RegisterFunctions();
 		LoadCompatibility();
+		SyncTriggers();
 	}
 
 	virtual void SetSearchPath(const std::string& path) {
@@ -249,9 +318,13 @@ public:
 	}
 
 protected:
-	bool GetTrigger(const char *trigger);
+	bool HasTrigger(TriggerType trigger) { return running_ && (triggers_present_ & (1u << trigger)); }
+	bool GetTrigger(TriggerType trigger);
 	void CallTrigger(int numArgs = 0);
 
+	// after running any script code, catch up with what it did to Triggers
+	void SyncTriggers();
+
 	virtual void RegisterFunctions();
 	virtual void LoadCompatibility();
 
@@ -298,8 +371,18 @@ public:
 	int RestoreAll(const std::string& s);
 
 private:
+	void ReleaseTriggers();
+
 	bool running_;
 	int num_scripts_;
+	TriggerType called_trigger_;	// the last one GetTrigger pushed, for the profiler
+
+	// registry references to the trigger functions, and which ones exist;
+	// Triggers is an ordinary table, looked at again after any script code
+	int trigger_refs_[NUMBER_OF_LUA_TRIGGERS];
+	uint32 triggers_present_;
+	bool triggers_tracked_;
+	int trigger_names_ref_;	// as Lua strings, so looking them up doesn't hash them
 };
 
 typedef LuaState EmbeddedLuaState;
@@ -309,7 +392,7 @@ typedef LuaState StatsLuaState;
 class SoloScriptState : public LuaState
 {
 public:
-	SoloScriptState() : LuaState() { }
+	SoloScriptState() : LuaState("Solo Lua") { }
 
 	void Initialize() {
 		LuaState::Initialize();
@@ -321,7 +404,7 @@ public:
 class AchievementsLuaState : public LuaState
 {
 public:
-	AchievementsLuaState() : LuaState() { }
+	AchievementsLuaState() : LuaState("Achievements Lua") { }
 
 	void Initialize() {
 		LuaState::Initialize();
@@ -334,11 +417,19 @@ public:
 	}
 };
 
-bool LuaState::GetTrigger(const char* trigger)
+bool LuaState::GetTrigger(TriggerType trigger)
 {
-	if (!running_)
+	if (!HasTrigger(trigger))
 		return false;
 
+	called_trigger_ = trigger;
+
+	if (triggers_tracked_)
+	{
+		lua_rawgeti(State(), LUA_REGISTRYINDEX, trigger_refs_[trigger]);
+		return true;
+	}
+
 	lua_getglobal(State(), "Triggers");
 	if (!lua_istable(State(), -1))
 	{
@@ -346,7 +437,7 @@ bool LuaState::GetTrigger(const char* trigger)
 		return false;
 	}
 
-	lua_pushstring(State(), trigger);
+	lua_pushstring(State(), trigger_names[trigger]);
 	lua_gettable(State(), -2);
 	if (!lua_isfunction(State(), -1))
 	{
@@ -360,13 +451,106 @@ bool LuaState::GetTrigger(const char* trigger)
 
 void LuaState::CallTrigger(int numArgs)
 {
+	L_Profile_Enter(State(), trigger_names[called_trigger_]);
 	if (lua_pcall(State(), numArgs, 0, 0) == LUA_ERRRUN)
 		L_Error(lua_tostring(State(), -1));
+	L_Profile_Leave(State());
+
+	SyncTriggers();
+}
+
+void LuaState::SyncTriggers()
+{
+	lua_getglobal(State(), "Triggers");
+	if (!lua_istable(State(), -1))
+	{
+		// no triggers at all
+		lua_pop(State(), 1);
+		ReleaseTriggers();
+		return;
+	}
+
+	if (lua_getmetatable(State(), -1))
+	{
+		// the script has its own ideas about Triggers; look
+		// every trigger up by name, the way we always did
+		lua_pop(State(), 2);
+		ReleaseTriggers();
+		triggers_present_ = ~0u;
+		return;
+	}
+
+	if (trigger_names_ref_ == LUA_NOREF)
+	{
+		lua_createtable(State(), NUMBER_OF_LUA_TRIGGERS, 0);
+		for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+		{
+			lua_pushstring(State(), trigger_names[i]);
+			lua_rawseti(State(), -2, i + 1);
+		}
+		trigger_names_ref_ = luaL_ref(State(), LUA_REGISTRYINDEX);
+	}
+
+	if (!triggers_tracked_)
+	{
+		triggers_present_ = 0;
+		triggers_tracked_ = true;
+	}
+
+	// raw lookups, so what the script sees in Triggers, with rawget() and
+	// next() too, is what gets called; a reference is kept while the
+	// function it names is still there
+	lua_rawgeti(State(), LUA_REGISTRYINDEX, trigger_names_ref_);
+	for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+	{
+		uint32 bit = 1u << i;
+
+		lua_rawgeti(State(), -1, i + 1);
+		lua_rawget(State(), -3);
+		if (triggers_present_ & bit)
+		{
+			lua_rawgeti(State(), LUA_REGISTRYINDEX, trigger_refs_[i]);
+			bool unchanged = lua_rawequal(State(), -1, -2);
+			lua_pop(State(), 1);
+			if (unchanged)
+			{
+				lua_pop(State(), 1);
+				continue;
+			}
+
+			luaL_unref(State(), LUA_REGISTRYINDEX, trigger_refs_[i]);
+			trigger_refs_[i] = LUA_NOREF;
+			triggers_present_ &= ~bit;
+		}
+
+		if (lua_isfunction(State(), -1))
+		{
+			trigger_refs_[i] = luaL_ref(State(), LUA_REGISTRYINDEX);
+			triggers_present_ |= bit;
+		}
+		else
+		{
+			lua_pop(State(), 1);
+		}
+	}
+	lua_pop(State(), 2);
+}
+
+void LuaState::ReleaseTriggers()
+{
+	for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+	{
+		luaL_unref(State(), LUA_REGISTRYINDEX, trigger_refs_[i]);
+		trigger_refs_[i] = LUA_NOREF;
+	}
+
+	triggers_present_ = 0;
+	triggers_tracked_ = false;
 }
 
 void LuaState::Init(bool fRestoringSaved)
 {
-	if (GetTrigger("init"))
+	if (GetTrigger(_trigger_init))
 	{
 		lua_pushboolean(State(), fRestoringSaved);
 		CallTrigger(1);
@@ -375,25 +559,25 @@ void LuaState::Init(bool fRestoringSaved)
 
 void LuaState::Idle()
 {
-	if (GetTrigger("idle"))
+	if (GetTrigger(_trigger_idle))
 		CallTrigger();
 }
 
 void LuaState::Cleanup()
 {
-	if (GetTrigger("cleanup"))
+	if (GetTrigger(_trigger_cleanup))
 		CallTrigger();
 }
 
 void LuaState::PostIdle()
 {
-	if (GetTrigger("postidle"))
+	if (GetTrigger(_trigger_postidle))
 		CallTrigger();
 }
 
 void LuaState::StartRefuel(short type, short player_index, short panel_side_index)
 {
-	if (GetTrigger("start_refuel"))
+	if (GetTrigger(_trigger_start_refuel))
 	{
 		Lua_ControlPanelClass::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -404,7 +588,7 @@ void LuaState::StartRefuel(short type, short player_index, short panel_side_inde
 
 void LuaState::EndRefuel(short type, short player_index, short panel_side_index)
 {
-	if (GetTrigger("end_refuel"))
+	if (GetTrigger(_trigger_end_refuel))
 	{
 		Lua_ControlPanelClass::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -415,7 +599,7 @@ void LuaState::EndRefuel(short type, short player_index, short panel_side_index)
 
 void LuaState::TagSwitch(short tag, short player_index, short side_index)
 {
-	if (GetTrigger("tag_switch"))
+	if (GetTrigger(_trigger_tag_switch))
 	{
 		Lua_Tag::Push(State(), tag);
 		Lua_Player::Push(State(), player_index);
@@ -426,7 +610,7 @@ void LuaState::TagSwitch(short tag, short player_index, short side_index)
 
 void LuaState::LightSwitch(short light, short player_index, short side_index)
 {
-	if (GetTrigger("light_switch"))
+	if (GetTrigger(_trigger_light_switch))
 	{
 		Lua_Light::Push(State(), light);
 		Lua_Player::Push(State(), player_index);
@@ -437,7 +621,7 @@ void LuaState::LightSwitch(short light, short player_index, short side_index)
 
 void LuaState::PlatformSwitch(short platform, short player_index, short side_index)
 {
-	if (GetTrigger("platform_switch"))
+	if (GetTrigger(_trigger_platform_switch))
 	{
 		Lua_Polygon::Push(State(), platform);
 		Lua_Player::Push(State(), player_index);
@@ -448,7 +632,7 @@ void LuaState::PlatformSwitch(short platform, short player_index, short side_ind
 
 void LuaState::ProjectileSwitch(short side_index, short projectile_index)
 {
-	if (GetTrigger("projectile_switch"))
+	if (GetTrigger(_trigger_projectile_switch))
 	{
 		Lua_Projectile::Push(State(), projectile_index);
 		Lua_Side::Push(State(), side_index);
@@ -458,7 +642,7 @@ void LuaState::ProjectileSwitch(short side_index, short projectile_index)
 
 void LuaState::TerminalEnter(short terminal_id, short player_index)
 {
-	if (GetTrigger("terminal_enter"))
+	if (GetTrigger(_trigger_terminal_enter))
 	{
 		Lua_Terminal::Push(State(), terminal_id);
 		Lua_Player::Push(State(), player_index);
@@ -468,7 +652,7 @@ void LuaState::TerminalEnter(short terminal_id, short player_index)
 
 void LuaState::TerminalExit(short terminal_id, short player_index)
 {
-	if (GetTrigger("terminal_exit"))
+	if (GetTrigger(_trigger_terminal_exit))
 	{
 		Lua_Terminal::Push(State(), terminal_id);
 		Lua_Player::Push(State(), player_index);
@@ -478,7 +662,7 @@ void LuaState::TerminalExit(short terminal_id, short player_index)
 
 void LuaState::PatternBuffer(short side_index, short player_index)
 {
-	if (GetTrigger("pattern_buffer"))
+	if (GetTrigger(_trigger_pattern_buffer))
 	{
 		Lua_Side::Push(State(), side_index);
 		Lua_Player::Push(State(), player_index);
@@ -488,7 +672,7 @@ void LuaState::PatternBuffer(short side_index, short player_index)
 
 void LuaState::GotItem(short type, short player_index)
 {
-	if (GetTrigger("got_item"))
+	if (GetTrigger(_trigger_got_item))
 	{
 		Lua_ItemType::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -498,7 +682,7 @@ void LuaState::GotItem(short type, short player_index)
 
 void LuaState::LightActivated(short index)
 {
-	if (GetTrigger("light_activated"))
+	if (GetTrigger(_trigger_light_activated))
 	{
 		Lua_Light::Push(State(), index);
 		CallTrigger(1);
@@ -507,7 +691,7 @@ void LuaState::LightActivated(short index)
 
 void LuaState::PlatformActivated(short index)
 {
-	if (GetTrigger("platform_activated"))
+	if (GetTrigger(_trigger_platform_activated))
 	{
 		Lua_Polygon::Push(State(), index);
 		CallTrigger(1);
@@ -516,7 +700,7 @@ void LuaState::PlatformActivated(short index)
 
 void LuaState::PlayerRevived (short player_index)
 {
-	if (GetTrigger("player_revived"))
+	if (GetTrigger(_trigger_player_revived))
 	{
 		Lua_Player::Push(State(), player_index);
 		CallTrigger(1);
@@ -525,7 +709,7 @@ void LuaState::PlayerRevived (short player_index)
 
 void LuaState::PlayerKilled (short player_index, short aggressor_player_index, short action, short projectile_index)
 {
-	if (GetTrigger("player_killed"))
+	if (GetTrigger(_trigger_player_killed))
 	{
 		Lua_Player::Push(State(), player_index);
 
@@ -546,7 +730,7 @@ void LuaState::PlayerKilled (short player_index, short aggressor_player_index, s
 
 void LuaState::MonsterKilled (short monster_index, short aggressor_player_index, short projectile_index)
 {
-	if (GetTrigger("monster_killed"))
+	if (GetTrigger(_trigger_monster_killed))
 	{
 		Lua_Monster::Push(State(), monster_index);
 		if (aggressor_player_index != -1)
@@ -565,7 +749,7 @@ void LuaState::MonsterKilled (short monster_index, short aggressor_player_index,
 
 void LuaState::MonsterDamaged(short monster_index, short aggressor_monster_index, int16 damage_type, short damage_amount, short projectile_index)
 {
-	if (GetTrigger("monster_damaged"))
+	if (GetTrigger(_trigger_monster_damaged))
 	{
 		Lua_Monster::Push(State(), monster_index);
 		if (aggressor_monster_index != -1) 
@@ -588,7 +772,7 @@ void LuaState::MonsterDamaged(short monster_index, short aggressor_monster_index
 
 void LuaState::PlayerDamaged (short player_index, short aggressor_player_index, short aggressor_monster_index, int16 damage_type, short damage_amount, short projectile_index)
 {
-	if (GetTrigger("player_damaged"))
+	if (GetTrigger(_trigger_player_damaged))
 	{
 		Lua_Player::Push(State(), player_index);
 
@@ -616,7 +800,7 @@ void LuaState::PlayerDamaged (short player_index, short aggressor_player_index,
 
 void LuaState::ProjectileDetonated(short type, short owner_index, short polygon, world_point3d location, uint16_t flags, int16_t obstruction_index, int16_t line_index) 
 {
-	if (GetTrigger("projectile_detonated"))
+	if (GetTrigger(_trigger_projectile_detonated))
 	{
 		Lua_ProjectileType::Push(State(), type);
 		if (owner_index != -1)
@@ -665,7 +849,7 @@ void LuaState::ProjectileDetonated(short type, short owner_index, short polygon,
 
 void LuaState::ProjectileCreated (short projectile_index)
 {
-	if (GetTrigger("projectile_created"))
+	if (GetTrigger(_trigger_projectile_created))
 	{
 		Lua_Projectile::Push(State(), projectile_index);
 		CallTrigger(1);
@@ -674,7 +858,7 @@ void LuaState::ProjectileCreated (short projectile_index)
 
 void LuaState::ItemCreated (short item_index)
 {
-	if (GetTrigger("item_created"))
+	if (GetTrigger(_trigger_item_created))
 	{
 		Lua_Item::Push(State(), item_index);
 		CallTrigger(1);
@@ -683,7 +867,7 @@ void LuaState::ItemCreated (short item_index)
 
 bool LuaState::CalculateCompletionState(short& completion_state)
 {
-	if (GetTrigger("calculate_level_completion_state"))
+	if (GetTrigger(_trigger_calculate_level_completion_state))
 	{
 		if (lua_pcall(State(), 0, 1, 0) == LUA_ERRRUN)
 		{
@@ -705,6 +889,8 @@ bool LuaState::CalculateCompletionState(short& completion_state)
 
 		completion_state = lua_tonumber(State(), -1);
 		lua_pop(State(), 1);
+
+		SyncTriggers();
 		
 		return true;
 	}
@@ -714,7 +900,7 @@ bool LuaState::CalculateCompletionState(short& completion_state)
 
 void LuaState::MonsterKamikazed(short monster_index)
 {
-	if (GetTrigger("monster_kamikazed"))
+	if (GetTrigger(_trigger_monster_kamikazed))
 	{
 		Lua_Monster::Push(State(), monster_index);
 
@@ -910,7 +1096,7 @@ void LuaState::LoadCompatibility()
 
 bool LuaState::Load(const char *buffer, size_t len, const char *desc)
 {
-	int status = luaL_loadbufferx(State(), buffer, len, desc, "t");
+	int status = L_Load_Cached_Chunk(State(), buffer, len, desc);
 	if (status == LUA_ERRRUN)
 		logWarning("Lua loading failed: error running script.");
 	if (status == LUA_ERRFILE)
@@ -949,6 +1135,8 @@ bool LuaState::Run()
 			break;
 		}
 	}
+
+	SyncTriggers();
 	
 	if (result == 0) running_ = true;
 	return (result == 0);
@@ -1001,6 +1189,7 @@ bool LuaState::ExecuteCommand(const std::string& line)
 	}
 	
 	lua_settop(State(), 0);
+	SyncTriggers();
 	return success;
 }
 
@@ -1068,7 +1257,6 @@ int LuaState::RestoreAll(const std::string& s)
 	} 
 	else
 	{
-		lua_pop(State(), 2);
 		lua_pushboolean(State(), false);
 	}
 
@@ -1108,6 +1296,12 @@ int LuaState::RestorePassed(const std::string& s)
 	return 1;
 }
 
+static void log_save(const char *verb, size_t size, std::chrono::steady_clock::time_point start)
+{
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	logNote("%s Lua state: %u bytes in %.2f ms", verb, static_cast<unsigned>(size), elapsed);
+}
+
 std::string LuaState::SaveAll()
 {
 	std::string retval;
@@ -1125,10 +1319,12 @@ std::string LuaState::SaveAll()
 	lua_pushnil(State());
 	lua_setfield(State(), -2, Lua_Ephemera_Name);
 
+	auto start = std::chrono::steady_clock::now();
 	std::stringbuf sb;
 	if (lua_save(State(), &sb))
 	{
 		retval = sb.str();
+		log_save("saved", retval.size(), start);
 	}
 
 	// restore the ephemera fields
@@ -1156,10 +1352,13 @@ std::string LuaState::SavePassed()
 	
 	lua_remove(State(), -2);
 
+	auto start = std::chrono::steady_clock::now();
 	std::stringbuf sb;
 	if (lua_save(State(), &sb))
 	{
-		return sb.str();
+		std::string retval = sb.str();
+		log_save("passed on", retval.size(), start);
+		return retval;
 	} 
 	else
 	{
@@ -1283,6 +1482,8 @@ void L_Call_Idle()
 {
 	UpdateLuaCameras();
 	L_Dispatch(std::bind(&LuaState::Idle, std::placeholders::_1));
+	L_Collector_Check_Pressure();
+	L_Profile_Tick();
 }
 
 void L_Call_PostIdle()
@@ -1860,13 +2061,13 @@ static std::unique_ptr<LuaState> LuaStateFactory(ScriptType script_type)
 {
 	switch (script_type) {
 	case _embedded_lua_script:
-        return std::make_unique<EmbeddedLuaState>();
+        return std::make_unique<EmbeddedLuaState>("Map Lua");
 	case _lua_netscript:
-        return std::make_unique<NetscriptState>();
+        return std::make_unique<NetscriptState>("Netscript");
 	case _solo_lua_script:
         return std::make_unique<SoloScriptState>();
 	case _stats_lua_script:
-        return std::make_unique<StatsLuaState>();
+        return std::make_unique<StatsLuaState>("Stats Lua");
 	case _achievements_lua_script:
 		return std::make_unique<AchievementsLuaState>();
 	}
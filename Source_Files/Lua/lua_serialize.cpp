@@ -26,8 +26,38 @@ LUA_SERIALIZE.CPP
 
 #include "BStream.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 const static int SAVED_REFERENCE_PSEUDOTYPE = -2;
-const uint16 kVersion = 1;
+const uint16 kVersion = 2;
+
+// version 2 writes each value as one of these tags, followed by:
+enum
+{
+	kTagNil,
+	kTagFalse,
+	kTagTrue,
+	kTagInteger,		// zigzag varint, for numbers with no fraction
+	kTagNumber,		// little-endian double
+	kTagString,		// varint length, bytes; gets the next string id
+	kTagStringReference,	// varint string id
+	kTagTable,		// varint array length, uint32 pair count, the array
+				// values, then the key/value pairs; gets the next
+				// object id
+	kTagUserdata,		// type name (a string), varint index; gets the next
+				// object id
+	kTagObjectReference	// varint object id
+};
+
+// however big the data says a table is, restoring sizes it no bigger than
+// this up front
+const static size_t kMaximumPreallocation = 1 << 16;
 
 static bool valid_key(int type)
 {
@@ -38,101 +68,272 @@ static bool valid_key(int type)
 		type == LUA_TUSERDATA);
 }
 
-static void save(lua_State *L, BOStreamBE& s, uint32& counter)
+static bool integral(double d)
 {
-	// if the object has already been written, write a reference to it
+	// -0 would come back as 0
+	return d >= -9007199254740992.0 && d <= 9007199254740992.0 && d == std::floor(d) && !(d == 0 && std::signbit(d));
+}
 
-	lua_pushvalue(L, -1);
-	lua_rawget(L, 1);
-	if (!lua_isnil(L, -1))
+// walks tables with a stack of its own rather than by recursion, so how
+// deeply they nest is limited only by the Lua stack
+class Saver
+{
+public:
+	Saver(lua_State *L, std::string& data) : L(L), data(data) { }
+
+	// writes the value on top of the stack and pops it
+	void save();
+
+private:
+	enum { kArrayPart, kNextKey, kValue };
+
+	struct Frame
+	{
+		int table;	// stack index
+		int phase;
+		size_t length;	// of the array part
+		size_t next;	// array index to write next
+		size_t count_position;
+		uint32 count;	// key/value pairs written
+	};
+
+	void put(uint8 byte) { data.push_back(static_cast<char>(byte)); }
+	void put_varint(uint64_t value);
+	void put_number(double d);
+	void put_string();
+	bool put_userdata();
+
+	// writes the value on top of the stack; a table not written before is
+	// left there for its contents to be written next, and true returned
+	bool write();
+
+	bool write_pair(const Frame& frame);
+
+	lua_State *L;
+	std::string& data;
+
+	std::vector<Frame> frames;
+	std::unordered_map<const void *, uint32> objects;
+	// Lua keeps one copy of each short string, so most repeats are the
+	// same pointer
+	std::unordered_map<const char *, uint32> strings;
+};
+
+void Saver::put_varint(uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		put(static_cast<uint8>(value | 0x80));
+		value >>= 7;
+	}
+	put(static_cast<uint8>(value));
+}
+
+void Saver::put_number(double d)
+{
+	if (integral(d))
+	{
+		int64_t i = static_cast<int64_t>(d);
+		put(kTagInteger);
+		put_varint((static_cast<uint64_t>(i) << 1) ^ static_cast<uint64_t>(i >> 63));
+	}
+	else
+	{
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(bits));
+
+		put(kTagNumber);
+		for (int i = 0; i < 8; ++i)
+			put(static_cast<uint8>(bits >> (i * 8)));
+	}
+}
+
+void Saver::put_string()
+{
+	size_t length;
+	const char *s = lua_tolstring(L, -1, &length);
+
+	auto it = strings.find(s);
+	if (it != strings.end())
+	{
+		put(kTagStringReference);
+		put_varint(it->second);
+	}
+	else
+	{
+		uint32 id = static_cast<uint32>(strings.size() + 1);
+		strings.emplace(s, id);
+
+		put(kTagString);
+		put_varint(length);
+		data.append(s, length);
+	}
+}
+
+bool Saver::put_userdata()
+{
+	// assume that this is one of our userdata
+	if (!lua_getmetatable(L, -1))
+		return false;
+
+	lua_gettable(L, LUA_REGISTRYINDEX);
+	if (lua_type(L, -1) != LUA_TSTRING)
 	{
-		s << static_cast<int8>(SAVED_REFERENCE_PSEUDOTYPE)
-		  << static_cast<uint32>(lua_tonumber(L, -1));
 		lua_pop(L, 1);
-		return;
+		return false;
 	}
+
+	objects.emplace(lua_topointer(L, -2), static_cast<uint32>(objects.size() + 1));
+
+	put(kTagUserdata);
+	put_string();
 	lua_pop(L, 1);
 
-	s << static_cast<int8>(lua_type(L, -1));
+	lua_getfield(L, -1, "index");
+	put_varint(static_cast<uint32>(lua_tonumber(L, -1)));
+	lua_pop(L, 1);
+
+	return true;
+}
+
+bool Saver::write()
+{
 	switch (lua_type(L, -1))
 	{
-		case LUA_TNIL:
-			break;
-		case LUA_TNUMBER:
-			{
-				s << static_cast<double>(lua_tonumber(L, -1));
-			}
-			break;
 		case LUA_TBOOLEAN:
-			s << static_cast<uint8>(lua_toboolean(L, -1) ? 1 : 0);
+			put(lua_toboolean(L, -1) ? kTagTrue : kTagFalse);
+			return false;
+		case LUA_TNUMBER:
+			put_number(lua_tonumber(L, -1));
+			return false;
+		case LUA_TSTRING:
+			put_string();
+			return false;
+		case LUA_TTABLE:
+		case LUA_TUSERDATA:
 			break;
-		case LUA_TSTRING: 
+		default:
+			// we silently ignore other types
+			put(kTagNil);
+			return false;
+	}
+
+	// if the object has already been written, write a reference to it
+	auto it = objects.find(lua_topointer(L, -1));
+	if (it != objects.end())
+	{
+		put(kTagObjectReference);
+		put_varint(it->second);
+		return false;
+	}
+
+	if (lua_type(L, -1) == LUA_TUSERDATA)
+	{
+		if (!put_userdata())
+			put(kTagNil);
+		return false;
+	}
+
+	if (!lua_checkstack(L, 4))
+		throw basic_bstream::failure("tables nested too deeply");
+
+	objects.emplace(lua_topointer(L, -1), static_cast<uint32>(objects.size() + 1));
+
+	Frame frame;
+	frame.table = lua_gettop(L);
+	frame.phase = kArrayPart;
+	frame.length = lua_rawlen(L, -1);
+	frame.next = 1;
+
+	put(kTagTable);
+	put_varint(frame.length);
+
+	// filled in once the pairs have been counted
+	frame.count_position = data.size();
+	frame.count = 0;
+	data.append(4, '\0');
+
+	frames.push_back(frame);
+	return true;
+}
+
+// the key and value are on top of the stack
+bool Saver::write_pair(const Frame& frame)
+{
+	int key_type = lua_type(L, -2);
+	if (!valid_key(key_type))
+		return false;
+
+	// already in the array values
+	if (key_type == LUA_TNUMBER)
+	{
+		double key = lua_tonumber(L, -2);
+		if (key >= 1 && key <= frame.length && key == std::floor(key))
+			return false;
+	}
+
+	// values we ignore would come back as nil anyway
+	return valid_key(lua_type(L, -1));
+}
+
+void Saver::save()
+{
+	if (!write())
+	{
+		lua_pop(L, 1);
+		return;
+	}
+
+	while (!frames.empty())
+	{
+		// careful, write() can move frames
+		Frame& frame = frames.back();
+		if (frame.phase == kArrayPart)
+		{
+			if (frame.next <= frame.length)
 			{
-				s << static_cast<uint32>(lua_rawlen(L, -1));
-				s.write(lua_tostring(L, -1), lua_rawlen(L, -1));
+				lua_rawgeti(L, frame.table, static_cast<int>(frame.next++));
+				if (!write())
+					lua_pop(L, 1);
+				continue;
 			}
-			break;
-		case LUA_TTABLE:
-			{
-				// add to the reference table
-				lua_pushvalue(L, -1);
-				lua_pushnumber(L, static_cast<lua_Number>(++counter));
-				lua_rawset(L, 1);
 
-				// write the reference
-				s << counter;
+			frame.phase = kNextKey;
+			lua_pushnil(L);
+		}
 
-				// write all k/v pairs
-				lua_pushnil(L);
-				while (lua_next(L, -2)) 
-				{
-					if (valid_key(lua_type(L, -2))) {
-						// another key
-						lua_pushvalue(L, -2);
-						
-						save(L, s, counter);
-						lua_pop(L, 1);
-						
-						save(L, s, counter);
-						lua_pop(L, 1);
-					} else {
-						lua_pop(L, 1);
-					}
-				}
+		if (frame.phase == kNextKey)
+		{
+			if (!lua_next(L, frame.table))
+			{
+				for (int i = 0; i < 4; ++i)
+					data[frame.count_position + i] = static_cast<char>(frame.count >> (i * 8));
 
-				lua_pushnil(L);
-				save(L, s, counter);
+				// the table's done
 				lua_pop(L, 1);
+				frames.pop_back();
+				continue;
 			}
-			break;
-		case LUA_TUSERDATA:
-			{
-				// add to the reference table
-				lua_pushvalue(L, -1);
-				lua_pushnumber(L, static_cast<lua_Number>(++counter));
-				lua_rawset(L, 1);
 
-				// write the reference
-				s << counter;
+			if (!write_pair(frame))
+			{
+				lua_pop(L, 1);
+				continue;
+			}
 
-				// assume that this is one of our userdata
-				lua_getmetatable(L, -1);
-				lua_gettable(L, LUA_REGISTRYINDEX);
+			++frame.count;
+			frame.phase = kValue;
 
-				s << static_cast<uint8>(lua_rawlen(L, -1));
-				s.write(lua_tostring(L, -1), lua_rawlen(L, -1));
+			lua_pushvalue(L, -2);
+			if (!write())
 				lua_pop(L, 1);
-
-				lua_getfield(L, -1, "index");
-				
-				s << static_cast<uint32>(lua_tonumber(L, -1));
+		}
+		else
+		{
+			frame.phase = kNextKey;
+			if (!write())
 				lua_pop(L, 1);
-			}
-			break;
-		
-		default:
-			// we silently ignore other types
-			break;
+		}
 	}
 }
 
@@ -140,32 +341,36 @@ bool lua_save(lua_State *L, std::streambuf* sb)
 {
 	lua_assert(lua_gettop(L) == 1);
 
-	// create a references table
-	lua_newtable(L);
+	// start out big enough for the last thing saved
+	static size_t last_size = 0;
+	std::string data;
+	data.reserve(last_size + last_size / 4 + 64);
 
-	// put it at the bottom of the stack
-	lua_insert(L, 1);
-	
-	uint32 counter = 0;
-	BOStreamBE s(sb);
-	try 
+	data.push_back(static_cast<char>(kVersion >> 8));
+	data.push_back(static_cast<char>(kVersion));
+
+	int top = lua_gettop(L);
+	try
 	{
-		s << kVersion;
-		save(L, s, counter);
+		lua_pushvalue(L, -1);
+		Saver(L, data).save();
+
+		if (sb->sputn(data.data(), data.size()) != static_cast<std::streamsize>(data.size()))
+			throw basic_bstream::failure("serialization bound check failed");
 	}
 	catch (const basic_bstream::failure& e)
 	{
 		logWarning("failed to save Lua data; %s", e.what());
-		lua_settop(L, 0);
+		lua_settop(L, top);
 		return false;
 	}
 
-	// remove the reference table
-	lua_remove(L, 1);
+	last_size = data.size();
 	return true;
 }
 
-static int restore(lua_State *L, BIStreamBE& s)
+// version 1 data, written before lua_save() kept ids of its own
+static int restore_version_1(lua_State *L, BIStreamBE& s)
 {
 	int8 type;
 	s >> type;
@@ -207,10 +412,10 @@ static int restore(lua_State *L, BIStreamBE& s)
 				lua_pushvalue(L, -2);
 				lua_rawset(L, 1);
 
-				int key_type = restore(L, s);
+				int key_type = restore_version_1(L, s);
 				while (key_type != LUA_TNIL)
 				{
-					restore(L, s); // value
+					restore_version_1(L, s); // value
 					if (lua_isnil(L, -2)) 
 					{
 						// maybe an invalid userdata?
@@ -220,7 +425,7 @@ static int restore(lua_State *L, BIStreamBE& s)
 					{
 						lua_rawset(L, -3);
 					}
-					key_type = restore(L, s); // next key
+					key_type = restore_version_1(L, s); // next key
 				}
 				lua_pop(L, 1);
 			}
@@ -275,34 +480,332 @@ static int restore(lua_State *L, BIStreamBE& s)
 	return type;
 }
 
-bool lua_restore(lua_State *L, std::streambuf* sb)
+// reads as it goes, and like Saver, without recursion
+class Restorer
+{
+public:
+	// objects and strings are the stack indices of tables to keep ids in
+	Restorer(lua_State *L, std::streambuf *sb, int objects, int strings) : L(L), sb(sb), objects(objects), strings(strings), object_count(0), string_count(0) { }
+
+	// pushes the value read
+	void restore();
+
+private:
+	struct Frame
+	{
+		int table;	// stack index
+		uint64_t length;	// of the array part
+		uint64_t next;	// array index to read next
+		uint32 count;	// key/value pairs left to read
+		bool key_read;
+	};
+
+	uint8 get();
+	uint64_t get_varint();
+	uint32 get_uint32();
+	uint32 get_id(uint32 count);
+
+	void push_string(uint8 tag);
+	void push_userdata();
+
+	// pushes the value read; a table with contents is left for them to be
+	// read next, and true returned
+	bool read();
+
+	// puts the value on top of the stack into the table being read
+	void place();
+
+	lua_State *L;
+	std::streambuf *sb;
+	int objects;
+	int strings;
+	uint32 object_count;
+	uint32 string_count;
+
+	std::vector<Frame> frames;
+	std::string buffer;
+};
+
+uint8 Restorer::get()
+{
+	int c = sb->sbumpc();
+	if (c == std::char_traits<char>::eof())
+		throw basic_bstream::failure("serialization bound check failed");
+
+	return static_cast<uint8>(c);
+}
+
+uint64_t Restorer::get_varint()
+{
+	uint64_t value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		uint8 byte = get();
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+
+	throw basic_bstream::failure("malformed Lua data");
+}
+
+uint32 Restorer::get_uint32()
+{
+	uint32 value = 0;
+	for (int i = 0; i < 4; ++i)
+		value |= static_cast<uint32>(get()) << (i * 8);
+
+	return value;
+}
+
+uint32 Restorer::get_id(uint32 count)
 {
-	// create a reference table
-	lua_newtable(L);
+	uint64_t id = get_varint();
+	if (id == 0 || id > count)
+		throw basic_bstream::failure("malformed Lua data");
 
-        // put it at the bottom of the stack
-        lua_insert(L, 1);
+	return static_cast<uint32>(id);
+}
 
-	BIStreamBE s(sb);
+void Restorer::push_string(uint8 tag)
+{
+	if (tag == kTagStringReference)
+	{
+		lua_rawgeti(L, strings, get_id(string_count));
+		return;
+	}
+
+	if (tag != kTagString)
+		throw basic_bstream::failure("malformed Lua data");
+
+	uint64_t length = get_varint();
+	buffer.resize(0);
+	while (buffer.size() < length)
+	{
+		// a chunk at a time, in case length is nonsense
+		size_t offset = buffer.size();
+		size_t chunk = static_cast<size_t>(std::min<uint64_t>(length - offset, 65536));
+		buffer.resize(offset + chunk);
+		if (sb->sgetn(&buffer[offset], chunk) != static_cast<std::streamsize>(chunk))
+			throw basic_bstream::failure("serialization bound check failed");
+	}
+
+	lua_pushlstring(L, buffer.data(), buffer.size());
+	lua_pushvalue(L, -1);
+	lua_rawseti(L, strings, ++string_count);
+}
+
+void Restorer::push_userdata()
+{
+	push_string(get());
+	uint64_t index = get_varint();
+
+	// get the metatable
+	lua_gettable(L, LUA_REGISTRYINDEX);
+	if (lua_istable(L, -1))
+	{
+		// get the accessor we added
+		lua_getfield(L, -1, "__new");
+		if (lua_isfunction(L, -1))
+		{
+			lua_pushnumber(L, static_cast<lua_Number>(index));
+			lua_call(L, 1, 1);
+		}
+
+		lua_remove(L, -2);
+	}
+	else
+	{
+		lua_pop(L, 1);
+		lua_pushnil(L);
+	}
+
+	// add to the reference table
+	lua_pushvalue(L, -1);
+	lua_rawseti(L, objects, ++object_count);
+}
+
+bool Restorer::read()
+{
+	uint8 tag = get();
+	switch (tag)
+	{
+		case kTagNil:
+			lua_pushnil(L);
+			break;
+		case kTagFalse:
+		case kTagTrue:
+			lua_pushboolean(L, tag == kTagTrue);
+			break;
+		case kTagInteger:
+			{
+				uint64_t z = get_varint();
+				int64_t i = static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+				lua_pushnumber(L, static_cast<lua_Number>(i));
+			}
+			break;
+		case kTagNumber:
+			{
+				uint64_t bits = 0;
+				for (int i = 0; i < 8; ++i)
+					bits |= static_cast<uint64_t>(get()) << (i * 8);
+
+				double d;
+				memcpy(&d, &bits, sizeof(d));
+				lua_pushnumber(L, static_cast<lua_Number>(d));
+			}
+			break;
+		case kTagString:
+		case kTagStringReference:
+			push_string(tag);
+			break;
+		case kTagTable:
+			{
+				Frame frame;
+				frame.length = get_varint();
+				frame.next = 1;
+				frame.count = get_uint32();
+				frame.key_read = false;
+
+				if (!lua_checkstack(L, 4))
+					throw basic_bstream::failure("tables nested too deeply");
+
+				lua_createtable(L, static_cast<int>(std::min<uint64_t>(frame.length, kMaximumPreallocation)), static_cast<int>(std::min<size_t>(frame.count, kMaximumPreallocation)));
+
+				// add to the reference table
+				lua_pushvalue(L, -1);
+				lua_rawseti(L, objects, ++object_count);
+
+				if (frame.length || frame.count)
+				{
+					frame.table = lua_gettop(L);
+					frames.push_back(frame);
+					return true;
+				}
+			}
+			break;
+		case kTagUserdata:
+			push_userdata();
+			break;
+		case kTagObjectReference:
+			lua_rawgeti(L, objects, get_id(object_count));
+			break;
+		default:
+			throw basic_bstream::failure("malformed Lua data");
+	}
+
+	return false;
+}
+
+void Restorer::place()
+{
+	Frame& frame = frames.back();
+	if (frame.next <= frame.length)
+	{
+		// nil is a hole, or maybe an invalid userdata
+		if (lua_isnil(L, -1))
+			lua_pop(L, 1);
+		else
+			lua_rawseti(L, frame.table, static_cast<int>(frame.next));
+
+		++frame.next;
+	}
+	else if (!frame.key_read)
+	{
+		frame.key_read = true;
+	}
+	else
+	{
+		// maybe an invalid userdata? a NaN key would raise an error
+		if (lua_isnil(L, -2) || lua_isnil(L, -1) || (lua_type(L, -2) == LUA_TNUMBER && lua_tonumber(L, -2) != lua_tonumber(L, -2)))
+			lua_pop(L, 2);
+		else
+			lua_rawset(L, frame.table);
+
+		frame.key_read = false;
+		--frame.count;
+	}
+}
+
+void Restorer::restore()
+{
+	if (!read())
+		return;
+
+	while (true)
+	{
+		const Frame& frame = frames.back();
+		if (frame.next > frame.length && frame.count == 0)
+		{
+			// the table's done, and on top of the stack
+			frames.pop_back();
+			if (frames.empty())
+				return;
+
+			place();
+		}
+		else if (!read())
+		{
+			place();
+		}
+	}
+}
+
+bool lua_restore(lua_State *L, std::streambuf* sb)
+{
+	int top = lua_gettop(L);
+	bool version_1_references = false;
 	try {
 		int16 version;
-		s >> version;
+		BIStreamBE(sb) >> version;
 		if (version > kVersion)
 		{
 			logWarning("failed to restore Lua data; saved data is newer version");
 			return false;
 		}
 
-		restore(L, s);
+		if (version < 2)
+		{
+			// create a reference table
+			lua_newtable(L);
+
+			// put it at the bottom of the stack
+			lua_insert(L, 1);
+			version_1_references = true;
+
+			BIStreamBE s(sb);
+			restore_version_1(L, s);
+
+			// remove the reference table
+			lua_remove(L, 1);
+			version_1_references = false;
+		}
+		else
+		{
+			// reference tables for objects and strings
+			lua_newtable(L);
+			lua_newtable(L);
+
+			Restorer(L, sb, top + 1, top + 2).restore();
+
+			lua_replace(L, top + 1);
+			lua_settop(L, top + 1);
+		}
 	}
 	catch (const basic_bstream::failure& e)
 	{
 		logWarning("failed to restore Lua data; %s", e.what());
-		lua_settop(L, 0);
+		if (version_1_references)
+		{
+			lua_settop(L, top + 1);
+			lua_remove(L, 1);
+		}
+		else
+		{
+			lua_settop(L, top);
+		}
 		return false;
 	}
-	
-	// remove the reference table
-	lua_remove(L, 1);
+
 	return true;
 }
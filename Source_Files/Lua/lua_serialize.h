@@ -37,7 +37,8 @@ extern "C"
 // saves object on top of the stack to s
 bool lua_save(lua_State *L, std::streambuf* sb);
 
-// restores object in s to top of the stack
+// restores object in s to top of the stack; reads what earlier versions
+// saved too. On failure, the stack is left as it was
 bool lua_restore(lua_State *L, std::streambuf* sb);
 
 #endif
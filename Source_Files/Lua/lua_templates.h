@@ -34,10 +34,12 @@ extern "C"
 
 #include "lua_script.h"
 #include "lua_mnemonics.h" // for lang_def and mnemonics
+#include <cmath>
 #include <sstream>
 #include <map>
 #include <new>
 #include <functional>
+#include <vector>
 
 static inline int luaL_typerror(lua_State* L, int narg, const char* tname)
 {
@@ -124,6 +126,18 @@ protected:
 		lua_pushlightuserdata(L, (void *) (&name[3]));
 	}
 
+	// pushes f as a closure over the get (or set) methods table and our
+	// metatable, so a field access doesn't have to look either one up
+	static void _push_accessor_closure(lua_State *L, lua_CFunction f, void (*push_key)(lua_State *)) {
+		push_key(L);
+		lua_rawget(L, LUA_REGISTRYINDEX);
+		luaL_getmetatable(L, name);
+		lua_pushcclosure(L, f, 2);
+	}
+
+	static bool _check_self(lua_State *L);
+	static void _call_accessor(lua_State *L, int nargs, int nresults);
+
 	// special tables
 	static void _push_custom_fields_table(lua_State *L);
 };
@@ -139,6 +153,26 @@ std::function<bool (index_t)> L_Class<name, index_t>::Valid = always_valid();
 template<char *name, typename index_t>
 void L_Class<name, index_t>::Register(lua_State *L, const luaL_Reg get[], const luaL_Reg set[], const luaL_Reg metatable[])
 {
+	// register get methods
+	_push_get_methods_key(L);
+	lua_newtable(L);
+
+	// always want index
+	lua_pushcfunction(L, _index);
+	lua_setfield(L, -2, "index");
+
+	if (get)
+		luaL_setfuncs(L, get, 0);
+	lua_settable(L, LUA_REGISTRYINDEX);
+
+	// register set methods
+	_push_set_methods_key(L);
+	lua_newtable(L);
+
+	if (set)
+		luaL_setfuncs(L, set, 0);
+	lua_settable(L, LUA_REGISTRYINDEX);
+
 	// create the metatable itself
 	luaL_newmetatable(L, name);
 
@@ -148,11 +182,11 @@ void L_Class<name, index_t>::Register(lua_State *L, const luaL_Reg get[], const
 	lua_settable(L, LUA_REGISTRYINDEX);
 
 	// register metatable get
-	lua_pushcfunction(L, _get);
+	_push_accessor_closure(L, _get, _push_get_methods_key);
 	lua_setfield(L, -2, "__index");
 
 	// register metatable set
-	lua_pushcfunction(L, _set);
+	_push_accessor_closure(L, _set, _push_set_methods_key);
 	lua_setfield(L, -2, "__newindex");
 
 	// register metatable tostring
@@ -167,26 +201,6 @@ void L_Class<name, index_t>::Register(lua_State *L, const luaL_Reg get[], const
 	
 	// clear the stack
 	lua_pop(L, 1);
-	
-	// register get methods
-	_push_get_methods_key(L);
-	lua_newtable(L);
-
-	// always want index
-	lua_pushcfunction(L, _index);
-	lua_setfield(L, -2, "index");
-
-	if (get)
-		luaL_setfuncs(L, get, 0);
-	lua_settable(L, LUA_REGISTRYINDEX);
-
-	// register set methods
-	_push_set_methods_key(L);
-	lua_newtable(L);
-
-	if (set)
-		luaL_setfuncs(L, set, 0);
-	lua_settable(L, LUA_REGISTRYINDEX);
 		
 	// register a table for instances
 	_push_instances_key(L);
@@ -345,20 +359,81 @@ int L_Class<name, index_t>::_is(lua_State *L)
 	return 1;
 }
 
+// checks that argument 1 is one of ours; returns true if we're running as a
+// closure from _push_accessor_closure(), with the methods table as upvalue 1
+template<char *name, typename index_t>
+bool L_Class<name, index_t>::_check_self(lua_State *L)
+{
+	if (lua_getmetatable(L, 1))
+	{
+		bool cached = lua_rawequal(L, -1, lua_upvalueindex(2));
+		lua_pop(L, 1);
+		if (cached)
+			return true;
+	}
+
+	luaL_checktype(L, 1, LUA_TUSERDATA);
+	luaL_checkudata(L, 1, name);
+	return false;
+}
+
+// calls the accessor on top of the stack, with the object at 1, the key at
+// 2, and any other arguments (nargs in all) after the key; plain C accessors,
+// which is nearly all of them, are called in place instead of through
+// lua_pcall
+template<char *name, typename index_t>
+void L_Class<name, index_t>::_call_accessor(lua_State *L, int nargs, int nresults)
+{
+	lua_CFunction f = lua_tocfunction(L, -1);
+	if (f && !lua_getupvalue(L, -1, 1))
+	{
+		// drop the accessor and the key, leaving its arguments; errors it
+		// raises with luaL_error already report the script's line, since
+		// it isn't running as a call level of its own
+		lua_pop(L, 1);
+		lua_remove(L, 2);
+		int results = f(L);
+		if (nresults && results == 0)
+			lua_pushnil(L);
+		else if (results > nresults)
+			lua_pop(L, results - nresults);
+		return;
+	}
+	else if (f)
+	{
+		// pop the upvalue
+		lua_pop(L, 1);
+	}
+
+	// execute the function with the object and the rest as arguments
+	lua_pushvalue(L, 1);
+	for (int i = 3; i <= nargs + 1; ++i)
+		lua_pushvalue(L, i);
+	if (lua_pcall(L, nargs, nresults, 0) == LUA_ERRRUN)
+	{
+		// report the error as being on this line
+		luaL_where(L, 1);
+		lua_pushvalue(L, -2);
+		lua_concat(L, 2);
+		lua_error(L);
+	}
+}
+
 template<char *name, typename index_t>
 int L_Class<name, index_t>::_get(lua_State *L)
 {
 	if (lua_isstring(L, 2))
 	{
-		luaL_checktype(L, 1, LUA_TUSERDATA);
-		luaL_checkudata(L, 1, name);
-		if (!Valid(Index(L, 1)) && strcmp(lua_tostring(L, 2), "valid") != 0 && strcmp(lua_tostring(L, 2), "index") != 0)
+		bool cached = _check_self(L);
+		index_t index = Index(L, 1);
+		const char *key = lua_tostring(L, 2);
+		if (!Valid(index) && strcmp(key, "valid") != 0 && strcmp(key, "index") != 0)
 			luaL_error(L, "invalid object");
 
-		if (lua_tostring(L, 2)[0] == '_')
+		if (key[0] == '_')
 		{
 			_push_custom_fields_table(L);
-			lua_pushnumber(L, Index(L, 1));
+			lua_pushnumber(L, index);
 			lua_gettable(L, -2);
 			if (lua_istable(L, -1))
 			{
@@ -376,27 +451,26 @@ int L_Class<name, index_t>::_get(lua_State *L)
 		}
 		else
 		{
-			// pop the get table
-			_push_get_methods_key(L);
-			lua_gettable(L, LUA_REGISTRYINDEX);
+			// push the get table
+			if (cached)
+			{
+				lua_pushvalue(L, lua_upvalueindex(1));
+			}
+			else
+			{
+				_push_get_methods_key(L);
+				lua_rawget(L, LUA_REGISTRYINDEX);
+			}
 
 			// get the function from that table
 			lua_pushvalue(L, 2);
-			lua_gettable(L, -2);
+			lua_rawget(L, -2);
 			lua_remove(L, -2);
 		
 			if (lua_isfunction(L, -1))
 			{
 				// execute the function with table as our argument
-				lua_pushvalue(L, 1);
-				if (lua_pcall(L, 1, 1, 0) == LUA_ERRRUN)
-				{
-					// report the error as being on this line
-					luaL_where(L, 1);
-					lua_pushvalue(L, -2);
-					lua_concat(L, 2);
-					lua_error(L);
-				}
+				_call_accessor(L, 1, 1);
 			}
 			else
 			{
@@ -432,8 +506,7 @@ int L_Class<name, index_t>::_new(lua_State *L)
 template<char *name, typename index_t>
 int L_Class<name, index_t>::_set(lua_State *L)
 {
-	luaL_checktype(L, 1, LUA_TUSERDATA);
-	luaL_checkudata(L, 1, name);
+	bool cached = _check_self(L);
 
 	if (lua_isstring(L, 2) && lua_tostring(L, 2)[0] == '_')
 	{
@@ -467,13 +540,21 @@ int L_Class<name, index_t>::_set(lua_State *L)
 	}
 	else
 	{
-		// pop the set table
-		_push_set_methods_key(L);
-		lua_gettable(L, LUA_REGISTRYINDEX);
+		// push the set table
+		if (cached)
+		{
+			lua_pushvalue(L, lua_upvalueindex(1));
+		}
+		else
+		{
+			_push_set_methods_key(L);
+			lua_rawget(L, LUA_REGISTRYINDEX);
+		}
 		
 		// get the function from that table
 		lua_pushvalue(L, 2);
-		lua_gettable(L, -2);
+		lua_rawget(L, -2);
+		lua_remove(L, -2);
 		
 		if (lua_isnil(L, -1))
 		{
@@ -481,18 +562,7 @@ int L_Class<name, index_t>::_set(lua_State *L)
 		}
 		
 		// execute the function with table, value as our arguments
-		lua_pushvalue(L, 1);
-		lua_pushvalue(L, 3);
-		if (lua_pcall(L, 2, 0, 0) == LUA_ERRRUN)
-		{
-			// report the error as being on this line
-			luaL_where(L, 1);
-			lua_pushvalue(L, -2);
-			lua_concat(L, 2);
-			lua_error(L);
-		}
-		
-		lua_pop(L, 1);
+		_call_accessor(L, 2, 0);
 	}
 
 	return 0;
@@ -799,7 +869,7 @@ void L_Container<name, T>::Register(lua_State *L, const luaL_Reg get[], const lu
 	L_Class<name>::Register(L, get, set, metatable);
 	luaL_getmetatable(L, name);
 	
-	lua_pushcfunction(L, _get_container);
+	L_Class<name>::_push_accessor_closure(L, _get_container, L_Class<name>::_push_get_methods_key);
 	lua_setfield(L, -2, "__index");
 	
 	lua_pushcfunction(L, _call);
@@ -873,6 +943,47 @@ int L_Container<name, T>::_length(lua_State *L)
 	return 1;
 }
 
+// leaves a table of the objects at indexes, in order, on the stack; if the
+// argument at results is a table, it's filled instead of making a new one,
+// and any numbered entries past them are cleared out, holes or not, so a
+// script querying every tick can hand back the same table
+template<class T>
+void L_Push_Results(lua_State *L, int results, const std::vector<typename T::index_type>& indexes)
+{
+	bool reused = lua_istable(L, results);
+	if (reused)
+		lua_pushvalue(L, results);
+	else
+		lua_createtable(L, static_cast<int>(indexes.size()), 0);
+
+	int n = 0;
+	for (auto index : indexes)
+	{
+		T::Push(L, index);
+		lua_rawseti(L, -2, ++n);
+	}
+
+	if (!reused)
+		return;
+
+	// clearing fields that are there is allowed while going through them
+	lua_pushnil(L);
+	while (lua_next(L, -2))
+	{
+		lua_pop(L, 1);
+		if (lua_type(L, -1) != LUA_TNUMBER)
+			continue;
+
+		lua_Number key = lua_tonumber(L, -1);
+		if (key > n && key == std::floor(key))
+		{
+			lua_pushvalue(L, -1);
+			lua_pushnil(L);
+			lua_rawset(L, -4);
+		}
+	}
+}
+
 // enum containers will be able to look up by strings
 template<char *name, class T>
 class L_EnumContainer : public L_Container<name, T>
@@ -890,7 +1001,7 @@ void L_EnumContainer<name, T>::Register(lua_State *L, const luaL_Reg methods[],
 	
 	luaL_getmetatable(L, name);
 
-	lua_pushcfunction(L, _get_enumcontainer);
+	L_Class<name>::_push_accessor_closure(L, _get_enumcontainer, L_Class<name>::_push_get_methods_key);
 	lua_setfield(L, -2, "__index");
 
 	lua_pop(L, 1);
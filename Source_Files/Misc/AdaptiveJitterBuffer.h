@@ -0,0 +1,150 @@
+/*
+ *  AdaptiveJitterBuffer.h
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  Picks how far behind the latest flags to run, from a stream of latency
+ *  measurements (in ticks), without ever throwing its history away.
+ *
+ *  The distribution is kept as a histogram whose old samples fade out
+ *  with the given half-life, so the lead can cover a quantile of it (the
+ *  fraction of ticks that should arrive before they're needed); an EWMA of
+ *  the level, which forgets faster, pulls the lead up as soon as the whole
+ *  distribution moves. The lead itself only moves a tick at a time: up
+ *  promptly, since running short means stalling, and down slowly, since a
+ *  latency spike gone is often a latency spike about to come back.
+ */
+
+#ifndef ADAPTIVEJITTERBUFFER_H
+#define ADAPTIVEJITTERBUFFER_H
+
+#include "cstypes.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+class AdaptiveJitterBuffer {
+public:
+	enum {
+		kMaxLatency = 127,	// longer measurements count as this
+		kRaiseInterval = 4,	// samples between raising the lead a tick
+		kLowerInterval = 60	// samples between lowering it a tick
+	};
+
+	AdaptiveJitterBuffer(double inQuantile, int inHalfLife) { reset(inQuantile, inHalfLife); }
+
+	void	reset() { reset(mQuantile, mHalfLife); }
+	void	reset(double inQuantile, int inHalfLife)
+	{
+		mQuantile = inQuantile;
+		mHalfLife = std::max(inHalfLife, 1);
+		mSketchDecay = std::pow(2.0, -1.0 / mHalfLife);
+		mLevelGain = 1.0 - std::pow(2.0, -4.0 / mHalfLife);
+
+		mBuckets.fill(0.0);
+		mTotalWeight = 0.0;
+		mNextWeight = 1.0;
+		mMean = 0.0;
+		mSamples = 0;
+		mLead = 0;
+		mSamplesSinceStep = 0;
+	}
+
+	void	insert(int32 inLatency)
+	{
+		int32 theLatency = std::min(std::max(inLatency, static_cast<int32>(0)), static_cast<int32>(kMaxLatency));
+
+		// rather than decaying every bucket, weigh each new sample more than the last
+		mBuckets[theLatency] += mNextWeight;
+		mTotalWeight += mNextWeight;
+		mNextWeight /= mSketchDecay;
+		if (mNextWeight > 1e100)
+		{
+			for (double& theBucket : mBuckets)
+				theBucket /= mNextWeight;
+			mTotalWeight /= mNextWeight;
+			mNextWeight = 1.0;
+		}
+
+		if (mSamples == 0)
+			mMean = theLatency;
+		else
+			mMean += mLevelGain * (theLatency - mMean);
+
+		++mSamples;
+		++mSamplesSinceStep;
+
+		int32 theTarget = target();
+		if (mSamples == static_cast<uint32>(mHalfLife))
+		{
+			mLead = theTarget;
+			mSamplesSinceStep = 0;
+		}
+		else if (theTarget > mLead && mSamplesSinceStep >= kRaiseInterval)
+		{
+			++mLead;
+			mSamplesSinceStep = 0;
+		}
+		else if (theTarget < mLead && mSamplesSinceStep >= kLowerInterval)
+		{
+			--mLead;
+			mSamplesSinceStep = 0;
+		}
+	}
+
+	// smallest latency at least inQuantile of the (weighted) samples are within
+	int32	quantile(double inQuantile) const
+	{
+		double theThreshold = inQuantile * mTotalWeight;
+		double theWeight = 0.0;
+		for (int32 i = 0; i < kMaxLatency; ++i)
+		{
+			theWeight += mBuckets[i];
+			if (theWeight >= theThreshold)
+				return i;
+		}
+		return kMaxLatency;
+	}
+
+	// where the lead is heading
+	int32	target() const { return std::max(quantile(mQuantile), static_cast<int32>(std::ceil(mMean))); }
+
+	// a half-life's worth of samples before there's anything to go on
+	bool	ready() const { return mSamples >= static_cast<uint32>(mHalfLife); }
+	int32	lead() const { return mLead; }
+
+	double	mean() const { return mMean; }
+
+private:
+	double	mQuantile;
+	int	mHalfLife;
+	double	mSketchDecay;
+	double	mLevelGain;
+
+	std::array<double, kMaxLatency + 1> mBuckets;
+	double	mTotalWeight;
+	double	mNextWeight;
+
+	double	mMean;
+
+	uint32	mSamples;
+	int32	mLead;
+	int32	mSamplesSinceStep;
+};
+
+#endif // ADAPTIVEJITTERBUFFER_H
@@ -0,0 +1,121 @@
+/*
+ *  WorkerPool.cpp - threads kept for splitting work up across cores
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+*/
+
+#include "cseries.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool* WorkerPool::instance()
+{
+	static WorkerPool pool;
+	return &pool;
+}
+
+WorkerPool::WorkerPool() :
+	m_job(nullptr),
+	m_count(0),
+	m_next(0),
+	m_generation(0),
+	m_wanted(0),
+	m_busy(0),
+	m_quit(false)
+{
+	unsigned cores = std::thread::hardware_concurrency();
+	m_thread_count = cores > 1 ? cores - 1 : 0;
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t)>& job)
+{
+	if (count == 0)
+		return;
+
+	std::lock_guard<std::mutex> run_lock(m_run_mutex);
+
+	size_t helpers = std::min(count - 1, m_thread_count);
+	if (helpers == 0)
+	{
+		for (size_t i = 0; i < count; ++i)
+			job(i);
+		return;
+	}
+
+	while (m_threads.size() < m_thread_count)
+		m_threads.emplace_back(&WorkerPool::worker, this);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job = &job;
+		m_count = count;
+		m_next = 0;
+		m_wanted = helpers;
+		m_busy = helpers;
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	work();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_busy == 0; });
+	m_job = nullptr;
+}
+
+void WorkerPool::worker()
+{
+	uint64_t generation = 0;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_wake.wait(lock, [this, generation] { return m_quit || (m_generation != generation && m_wanted > 0); });
+		if (m_quit)
+			return;
+
+		generation = m_generation;
+		--m_wanted;
+
+		lock.unlock();
+		work();
+		lock.lock();
+
+		if (--m_busy == 0)
+			m_done.notify_one();
+	}
+}
+
+void WorkerPool::work()
+{
+	for (size_t i = m_next++; i < m_count; i = m_next++)
+		(*m_job)(i);
+}
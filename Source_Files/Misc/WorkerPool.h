@@ -0,0 +1,73 @@
+/*
+ *  WorkerPool.h - threads kept for splitting work up across cores
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  The threads are started the first time there is work for them, and
+ *  then wait for more, so work that comes around every frame doesn't pay
+ *  for starting threads each time.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+public:
+	static WorkerPool* instance();
+	~WorkerPool();
+
+	// calls job(i) for every i below count, on the calling thread and on
+	// as many of the pool's threads as there are jobs for, and returns
+	// once they're all done; one run() at a time, and never from a job
+	void run(size_t count, const std::function<void(size_t)>& job);
+
+	// not counting the one calling run()
+	size_t thread_count() const { return m_thread_count; }
+
+private:
+	WorkerPool();
+
+	void worker();
+	void work();
+
+	size_t m_thread_count;
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_run_mutex;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	const std::function<void(size_t)>* m_job;
+	size_t m_count;
+	std::atomic<size_t> m_next;
+	uint64_t m_generation;
+	size_t m_wanted;	// threads still to join in the current run
+	size_t m_busy;		// threads not yet done with it
+	bool m_quit;
+};
+
+#endif
@@ -25,8 +25,10 @@
 #include "cseries.h"
 #include "game_errors.h"
 
-static short last_type= systemError;
-static short last_error= 0;
+// per thread, so a save being written in the background can't clobber
+// (or be clobbered by) errors on the main thread
+static thread_local short last_type= systemError;
+static thread_local short last_error= 0;
 
 void set_game_error(
 	short type, 
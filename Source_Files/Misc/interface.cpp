@@ -178,6 +178,11 @@ enum recording_version {
 const short default_recording_version = RECORDING_VERSION_ALEPH_ONE_1_7;
 const short max_handled_recording= RECORDING_VERSION_ALEPH_ONE_1_7;
 
+short get_default_recording_version(void)
+{
+	return default_recording_version;
+}
+
 #include "screen_definitions.h"
 #include "interface_menus.h"
 
@@ -2450,6 +2455,7 @@ static bool begin_game(
 #endif // !defined(DISABLE_NETWORKING)
 			break;
 
+		case _spectator:
 		case _replay_from_file:
 		case _replay:
 		case _demo:
@@ -2498,6 +2504,13 @@ static bool begin_game(
 					success= setup_for_replay_from_file(DraggedReplayFile, get_current_map_checksum());
 					user= _replay;
 					break;
+
+#if !defined(DISABLE_NETWORKING)
+				case _spectator:
+					success= setup_for_spectating();
+					user= _replay;
+					break;
+#endif
 					
 				default:
 					assert(false);
@@ -2661,7 +2674,7 @@ static bool begin_game(
 		{
 			start_game(user, false);
 		} else {
-			clean_up_after_failed_game(user == _network_player, record_game, clean_up_on_failure);
+			clean_up_after_failed_game(user == _network_player || NetIsSpectating(), record_game, clean_up_on_failure);
 		}
 	} else {
 		/* This means that some weird replay problem happened: */
@@ -2846,6 +2859,11 @@ static void finish_game(
 			force_system_colors(false);
 			display_net_game_stats();
 		}
+
+		if (NetIsSpectating())
+		{
+			exit_networking();
+		}
 	}
 	
 	set_local_player_index(NONE);
@@ -2899,6 +2917,7 @@ static void handle_network_game(
 #if !defined(DISABLE_NETWORKING)
 	bool successful_gather = false;
 	bool joined_resume_game = false;
+	bool joined_as_spectator = false;
 
 	force_system_colors(true);
 
@@ -2915,6 +2934,7 @@ static void handle_network_game(
 		int theNetworkJoinResult= network_join();
 		if (theNetworkJoinResult == kNetworkJoinedNewGame || theNetworkJoinResult == kNetworkJoinedResumeGame) successful_gather= true;
 		if (theNetworkJoinResult == kNetworkJoinedResumeGame) joined_resume_game= true;
+		if (theNetworkJoinResult == kNetworkJoinedSpectator) successful_gather= joined_as_spectator= true;
 	}
 	
 	if (successful_gather)
@@ -2923,6 +2943,10 @@ static void handle_network_game(
 		{
 			if (join_networked_resume_game() == false) clean_up_after_failed_game(true /*netgame*/, false /*recording*/, true /*full cleanup*/);
 		}
+		else if (joined_as_spectator)
+		{
+			begin_game(_spectator, false);
+		}
 		else
 		{
 			begin_game(_network_player, false);
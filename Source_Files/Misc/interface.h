@@ -217,6 +217,7 @@ enum { /* controllers */
 	_demo,
 	_replay,
 	_replay_from_file,
+	_spectator, // watching a standalone hub's game, as a replay
 	NUMBER_OF_PSEUDO_PLAYERS
 };
 
@@ -248,6 +249,7 @@ bool networking_available(void);
 /* ---------- prototypes/INTERFACE.C */
 
 void initialize_game_state(void);
+short get_default_recording_version(void);
 void force_game_state_change(void);
 bool player_controlling_game(void);
 
@@ -401,7 +403,8 @@ enum {	// Results for network_join
 	kNetworkJoinFailedUnjoined,
         kNetworkJoinFailedJoined,
         kNetworkJoinedNewGame,
-        kNetworkJoinedResumeGame
+        kNetworkJoinedResumeGame,
+        kNetworkJoinedSpectator
 };
 
 bool network_gather(bool inResumingGame, bool& outUseRemoteHub);
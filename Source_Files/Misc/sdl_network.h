@@ -30,6 +30,7 @@
 
 #include <SDL2/SDL_net.h>
 #include <string>
+#include <vector>
 
 #include "cseries.h"
 
@@ -95,6 +96,36 @@ void NetDDPDisposeFrame(DDPFramePtr frame);
 
 OSErr NetDDPSendFrame(DDPFramePtr frame, const NetAddrBlock *address);
 
+// Datagrams assembled from pieces of caller-owned memory (which must stay put until the
+// batch is sent), all sent at once
+struct DDPSendBatch
+{
+	struct Piece {
+		const byte* data;
+		uint16 size;
+	};
+
+	struct Datagram {
+		NetAddrBlock address;
+		size_t first_piece;
+		size_t piece_count;
+		uint16 size;
+	};
+
+	std::vector<Piece> pieces;
+	std::vector<Datagram> datagrams;
+
+	void add_datagram(const NetAddrBlock& address);
+	void add_piece(const byte* data, uint16 size);
+	void clear() { pieces.clear(); datagrams.clear(); }
+};
+
+OSErr NetDDPSendBatch(const DDPSendBatch& batch);
+
+// Received packets are normally handed to the packet handler by the receiving thread, unless
+// the mytm mutex is busy; tick tasks call this (with the mutex held) to handle any still waiting.
+void NetDDPDispatchPackets(void);
+
 /* ---------- prototypes/NETWORK_ADSP.C */
 
 // jkvw: removed - we use TCPMess now
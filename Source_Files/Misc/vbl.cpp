@@ -100,11 +100,10 @@ Feb 20, 2002 (Woody Zenfell):
 #include "joystick.h"
 #include "Movie.h"
 #include "InfoTree.h"
+#include "network.h"
 
 /* ---------- constants */
 
-#define RECORD_CHUNK_SIZE            (MAXIMUM_QUEUE_SIZE/2)
-#define END_OF_RECORDING_INDICATOR  (RECORD_CHUNK_SIZE+1)
 #define MAXIMUM_TIME_DIFFERENCE     15 // allowed between heartbeat_count and dynamic_world->tick_count
 #define MAXIMUM_NET_QUEUE_SIZE       8
 #define DISK_CACHE_SIZE             ((sizeof(int16)+sizeof(uint32))*100)
@@ -155,7 +154,6 @@ static void record_action_flags(short player_identifier, const uint32 *action_fl
 static short get_recording_queue_size(short which_queue);
 
 static uint8 *unpack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
-static uint8 *pack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
 
 // #define DEBUG_REPLAY
 
@@ -301,6 +299,10 @@ bool input_controller(
 					if (replay.replay_speed > 0 || (--phase<=0))
 					{
 						short flag_count= MAX(replay.replay_speed, 1);
+						// a spectator who's fallen behind the hub (or just arrived, and
+						// is playing the level from its start) catches up as fast as we can
+						if (replay.game_is_being_spectated && NetSpectatorBacklog() > TICKS_PER_SECOND)
+							flag_count= MAX(flag_count, MAXIMUM_TIME_DIFFERENCE - 1);
 						flag_count = pull_flags_from_recording(flag_count);
 					
 						if (!flag_count) // oops. silly me.
@@ -586,6 +588,30 @@ bool setup_for_replay_from_file(
 	return successful;
 }
 
+#if !defined(DISABLE_NETWORKING)
+/* Watching a game on a standalone hub (see NetSpectate()) is a replay of a film
+   the hub sends as it's played */
+bool setup_for_spectating(
+	void)
+{
+	assert(!replay.valid);
+	build_net_recording_header(&replay.header, *static_cast<game_info*>(NetGetGameData()));
+	replay.header.game_information.cheat_flags = _allow_crosshair | _allow_tunnel_vision | _allow_behindview | _allow_overlay_map;
+
+	/* The hub sends the map; the file is only for its scripts and images, if we have it */
+	use_map_file(replay.header.map_checksum);
+
+	replay.valid= true;
+	replay.have_read_last_chunk= false;
+	replay.game_is_being_replayed= true;
+	replay.game_is_being_spectated= true;
+	replay.replay_speed= 1;
+	movie_export_phase = 0;
+
+	return true;
+}
+#endif
+
 /* Note that we _must_ set the header information before we start recording!! */
 void start_recording(
 	void)
@@ -711,7 +737,8 @@ void check_recording_replaying(
 			if(queue_size>= RECORD_CHUNK_SIZE) load_new_data= false;
 		}
 		
-		if(load_new_data)
+		// a spectator keeps up with the hub's stream as it arrives, so it never backs up
+		if(load_new_data || replay.game_is_being_spectated)
 		{
 			// at this point, we've determined that the queues are sufficently empty, so
 			// we'll fill 'em up.
@@ -739,7 +766,11 @@ void stop_replay(
 		assert(replay.valid);
 
 		replay.game_is_being_replayed= false;
-		if (replay.resource_data)
+		if (replay.game_is_being_spectated)
+		{
+			replay.game_is_being_spectated= false;
+		}
+		else if (replay.resource_data)
 		{
 			delete []replay.resource_data;
 			replay.resource_data= NULL;
@@ -768,6 +799,27 @@ static void read_recording_queue_chunks(
 	uint32 action_flags; 
 	int16 count, player_index, num_flags;
 	ActionQueue *queue;
+
+	if (replay.game_is_being_spectated)
+	{
+		// the hub's flags are tick-major, every player every tick
+		static uint32 hub_flags[RECORD_CHUNK_SIZE * MAXIMUM_NUMBER_OF_PLAYERS];
+		bool game_over;
+		int max_ticks = MIN(RECORD_CHUNK_SIZE, MAXIMUM_QUEUE_SIZE - 1 - get_recording_queue_size(0));
+		int32 tick_count = NetSpectatorTakeFlags(hub_flags, max_ticks, game_over);
+		for (player_index = 0; player_index < dynamic_world->player_count; player_index++)
+		{
+			queue= get_player_recording_queue(player_index);
+			for (i = 0; i < tick_count; i++)
+			{
+				*(queue->buffer + queue->write_index) = hub_flags[i * dynamic_world->player_count + player_index];
+				INCREMENT_QUEUE_COUNTER(queue->write_index);
+				assert(queue->read_index != queue->write_index);
+			}
+		}
+		if (game_over) replay.have_read_last_chunk= true;
+		return;
+	}
 	
 	for (player_index = 0; player_index < dynamic_world->player_count; player_index++)
 	{
@@ -1026,6 +1078,29 @@ uint8 *pack_recording_header(uint8 *Stream, recording_header *Objects, size_t Co
 	return S;
 }
 
+#if !defined(DISABLE_NETWORKING)
+void build_net_recording_header(recording_header *Header, const game_info& GameInfo)
+{
+	obj_clear(*Header);
+
+	construct_multiplayer_starts(Header->starts, &Header->num_players);
+	Header->level_number = GameInfo.level_number;
+	Header->map_checksum = GameInfo.parent_checksum;
+	Header->version = get_default_recording_version();
+
+	game_data& GameData = Header->game_information;
+	GameData.game_time_remaining = GameInfo.time_limit;
+	GameData.kill_limit = GameInfo.kill_limit;
+	GameData.game_type = GameInfo.net_game_type;
+	GameData.game_options = GameInfo.game_options;
+	GameData.initial_random_seed = GameInfo.initial_random_seed;
+	GameData.difficulty_level = GameInfo.difficulty_level;
+	GameData.cheat_flags = GameInfo.cheat_flags;
+
+	Header->length = SIZEOF_recording_header;
+}
+#endif
+
 // Constants
 #define MAXIMUM_FLAG_PERSISTENCE    15
 #define DOUBLE_CLICK_PERSISTENCE    10
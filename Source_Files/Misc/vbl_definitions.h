@@ -32,6 +32,8 @@ Aug 12, 2000 (Loren Petrich):
 #include "player.h"
 
 #define MAXIMUM_QUEUE_SIZE           512
+#define RECORD_CHUNK_SIZE            (MAXIMUM_QUEUE_SIZE/2)
+#define END_OF_RECORDING_INDICATOR  (RECORD_CHUNK_SIZE+1)
 
 typedef struct action_queue /* 8 bytes */
 {
@@ -51,6 +53,13 @@ struct recording_header
 };
 const int SIZEOF_recording_header = 352;
 
+// also used by the standalone hub, which writes films of the games it hosts
+uint8 *pack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
+
+// the header of a film of a network game, as the gatherer set the game up
+struct game_info;
+void build_net_recording_header(recording_header *Header, const game_info& GameInfo);
+
 struct replay_private_data {
 	bool valid;
 	struct recording_header header;
@@ -58,6 +67,7 @@ struct replay_private_data {
 	bool game_is_being_replayed;
 	bool game_is_being_recorded;
 	bool have_read_last_chunk;
+	bool game_is_being_spectated; // the flags come from a standalone hub, not a film
 	ActionQueue *recording_queues;
 	
 	// fileref recording_file_refnum;
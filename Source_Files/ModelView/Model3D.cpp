@@ -24,6 +24,7 @@
 
 #include <string.h>
 #include <math.h>
+#include <algorithm>
 #include <iostream>
 
 #include "VecOps.h"
@@ -38,30 +39,94 @@
 /* Need Sgl* macros */
 #include "OGL_Setup.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MODEL3D_SSE 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MODEL3D_NEON 1
+#endif
+
 // Bone-stack and transformation-matrix locally-used arrays;
-// the matrices have dimensions (output coords)(input-coord multipliers + offset for output)
-static vector<Model3D_Transform> BoneMatrices;
-static vector<size_t> BoneStack;
+// the matrices have dimensions (output coords)(input-coord multipliers + offset for output).
+// Per thread, since models may have their positions found in parallel
+static thread_local vector<Model3D_Transform> BoneMatrices;
+static thread_local vector<size_t> BoneStack;
 
 
-// Find transform of point (source and dest must be different arrays)
-inline void TransformPoint(GLfloat *Dest, GLfloat *Src, Model3D_Transform& T)
+// Find transforms of Count points or vectors (such as normals), packed 3 to a
+// vertex; Dest may be Src. Each vertex is done as one 4-wide multiply-add
+// of the matrix's columns where SSE or NEON is present
+template<bool Translate>
+static void TransformVertices(GLfloat *Dest, const GLfloat *Src, size_t Count, const Model3D_Transform& T)
 {
-	for (int ic=0; ic<3; ic++)
+#if defined(MODEL3D_SSE)
+	const __m128 C0 = _mm_setr_ps(T.M[0][0], T.M[1][0], T.M[2][0], 0);
+	const __m128 C1 = _mm_setr_ps(T.M[0][1], T.M[1][1], T.M[2][1], 0);
+	const __m128 C2 = _mm_setr_ps(T.M[0][2], T.M[1][2], T.M[2][2], 0);
+	const __m128 C3 = Translate ? _mm_setr_ps(T.M[0][3], T.M[1][3], T.M[2][3], 0) : _mm_setzero_ps();
+	for (size_t k=0; k<Count; k++, Src+=3, Dest+=3)
 	{
-		GLfloat *Row = T.M[ic];
-		Dest[ic] = ScalarProd(Src,Row) + Row[3];
+		__m128 R = _mm_add_ps(_mm_mul_ps(C0, _mm_set1_ps(Src[0])), _mm_mul_ps(C1, _mm_set1_ps(Src[1])));
+		R = _mm_add_ps(_mm_add_ps(R, _mm_mul_ps(C2, _mm_set1_ps(Src[2]))), C3);
+		// Three floats only, so as not to overwrite the next vertex
+		_mm_storel_pi(reinterpret_cast<__m64 *>(Dest), R);
+		_mm_store_ss(Dest + 2, _mm_movehl_ps(R, R));
 	}
+#elif defined(MODEL3D_NEON)
+	const float Columns[4][4] = {
+		{T.M[0][0], T.M[1][0], T.M[2][0], 0},
+		{T.M[0][1], T.M[1][1], T.M[2][1], 0},
+		{T.M[0][2], T.M[1][2], T.M[2][2], 0},
+		{Translate ? T.M[0][3] : 0, Translate ? T.M[1][3] : 0, Translate ? T.M[2][3] : 0, 0}
+	};
+	const float32x4_t C0 = vld1q_f32(Columns[0]);
+	const float32x4_t C1 = vld1q_f32(Columns[1]);
+	const float32x4_t C2 = vld1q_f32(Columns[2]);
+	const float32x4_t C3 = vld1q_f32(Columns[3]);
+	for (size_t k=0; k<Count; k++, Src+=3, Dest+=3)
+	{
+		float32x4_t R = vaddq_f32(vmulq_n_f32(C0, Src[0]), vmulq_n_f32(C1, Src[1]));
+		R = vaddq_f32(vaddq_f32(R, vmulq_n_f32(C2, Src[2])), C3);
+		// Three floats only, so as not to overwrite the next vertex
+		vst1_f32(Dest, vget_low_f32(R));
+		vst1q_lane_f32(Dest + 2, R, 2);
+	}
+#else
+	for (size_t k=0; k<Count; k++, Src+=3, Dest+=3)
+	{
+		GLfloat V[3] = {Src[0], Src[1], Src[2]};
+		for (int ic=0; ic<3; ic++)
+		{
+			const GLfloat *Row = T.M[ic];
+			Dest[ic] = V[0]*Row[0] + V[1]*Row[1] + V[2]*Row[2] + (Translate ? Row[3] : 0);
+		}
+	}
+#endif
 }
 
-// Like above, but a vector, such as a normal (source and dest must be different arrays)
-inline void TransformVector(GLfloat *Dest, GLfloat *Src, Model3D_Transform& T)
+static inline void TransformPoints(GLfloat *Dest, const GLfloat *Src, size_t Count, const Model3D_Transform& T)
 {
-	for (int ic=0; ic<3; ic++)
-	{
-		GLfloat *Row = T.M[ic];
-		Dest[ic] = ScalarProd(Src,Row);
-	}
+	TransformVertices<true>(Dest, Src, Count, T);
+}
+
+static inline void TransformVectors(GLfloat *Dest, const GLfloat *Src, size_t Count, const Model3D_Transform& T)
+{
+	TransformVertices<false>(Dest, Src, Count, T);
+}
+
+static Model3D_Pose MakePose(short Kind, bool UseModelTransform, GLshort SeqIndex,
+	GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex)
+{
+	Model3D_Pose Pose;
+	Pose.Kind = Kind;
+	Pose.UseModelTransform = UseModelTransform;
+	Pose.SeqIndex = SeqIndex;
+	Pose.FrameIndex = FrameIndex;
+	// The additional frame only matters when mixed in
+	Pose.MixFrac = MixFrac;
+	Pose.AddlFrameIndex = (MixFrac != 0) ? AddlFrameIndex : FrameIndex;
+	return Pose;
 }
 
 // Bone and Frame (positions, angles) -> Transform Matrix
@@ -96,6 +161,7 @@ void Model3D::Clear()
 	SeqFrames.clear();
 	SeqFrmPointers.clear();
 	FindBoundingBox();
+	InvalidatePoses();
 }
 
 // Normalize an individual normal; return whether the normal had a nonzero length
@@ -216,6 +282,8 @@ void Model3D::CalculateTangents()
 // Normalize the normals
 void Model3D::AdjustNormals(int NormalType, float SmoothThreshold)
 {
+	InvalidatePoses();
+	
 	// Copy in normal sources for processing
 	if (!NormSources.empty())
 	{
@@ -694,12 +762,62 @@ void Model3D::BuildInverseVSIndices()
 }
 
 
+void Model3D::InvalidatePoses()
+{
+	CurrentPose = MakePose(Model3D_Pose::None, false, NONE, NONE, 0, NONE);
+	PoseCache.clear();
+}
+
+bool Model3D::RecallPose(const Model3D_Pose& Pose)
+{
+	if (CurrentPose == Pose) return true;
+	
+	for (size_t k=0; k<PoseCache.size(); k++)
+	{
+		CachedPose& Cached = PoseCache[k];
+		if (!(Cached.Pose == Pose)) continue;
+		
+		// The pose that was current takes its place in the cache
+		Positions.swap(Cached.Positions);
+		Normals.swap(Cached.Normals);
+		std::swap(CurrentPose, Cached.Pose);
+		if (Cached.Pose.Kind == Model3D_Pose::None)
+			PoseCache.erase(PoseCache.begin() + k);
+		else
+			std::rotate(PoseCache.begin(), PoseCache.begin() + k, PoseCache.begin() + k + 1);
+		return true;
+	}
+	
+	return false;
+}
+
+void Model3D::StorePose()
+{
+	if (CurrentPose.Kind == Model3D_Pose::None) return;
+	
+	// Displaces the least recently used; its arrays get reused
+	if (PoseCache.size() < PoseCacheSize)
+		PoseCache.emplace_back();
+	std::rotate(PoseCache.begin(), PoseCache.end() - 1, PoseCache.end());
+	
+	CachedPose& Cached = PoseCache.front();
+	Cached.Pose = CurrentPose;
+	Positions.swap(Cached.Positions);
+	Normals.swap(Cached.Normals);
+	CurrentPose.Kind = Model3D_Pose::None;
+}
+
+
 // Neutral case: returns whether vertex-source data was used (present in animated models)
 bool Model3D::FindPositions_Neutral(bool UseModelTransform)
 {
 	// Positions already there
 	if (VtxSrcIndices.empty()) return false;
 	
+	Model3D_Pose Pose = MakePose(Model3D_Pose::Neutral, UseModelTransform, NONE, NONE, 0, NONE);
+	if (RecallPose(Pose)) return true;
+	StorePose();
+	
 	// Straight copy of the vertices:
 	
 	size_t NumVertices = VtxSrcIndices.size();
@@ -710,63 +828,40 @@ bool Model3D::FindPositions_Neutral(bool UseModelTransform)
 	
 	size_t NumVtxSources = VtxSources.size();
 	
-	if (UseModelTransform)
+	for (size_t k=0; k<NumVertices; k++, IP++)
 	{
-		for (size_t k=0; k<NumVertices; k++, IP++, PP+=3)
+		size_t VSIndex = *IP;
+		if (VSIndex < NumVtxSources)
 		{
-			size_t VSIndex = *IP;
-			if (VSIndex < NumVtxSources)
-			{
-				Model3D_VertexSource& VS = VtxSources[VSIndex];
-				TransformPoint(PP,VS.Position,TransformPos);
-			}
-			else
-			{
-				GLfloat VP[3] = {0,0,0};
-				TransformPoint(PP,VP,TransformPos);
-			}
+			Model3D_VertexSource& VS = VtxSources[VSIndex];
+			GLfloat *VP = VS.Position;
+			*(PP++) = *(VP++);
+			*(PP++) = *(VP++);
+			*(PP++) = *(VP++);
 		}
-	}
-	else
-	{
-		for (size_t k=0; k<NumVertices; k++, IP++)
+		else
 		{
-			size_t VSIndex = *IP;
-			if (VSIndex < NumVtxSources)
-			{
-				Model3D_VertexSource& VS = VtxSources[VSIndex];
-				GLfloat *VP = VS.Position;
-				*(PP++) = *(VP++);
-				*(PP++) = *(VP++);
-				*(PP++) = *(VP++);
-			}
-			else
-			{
-				*(PP++) = 0;
-				*(PP++) = 0;
-				*(PP++) = 0;
-			}
+			*(PP++) = 0;
+			*(PP++) = 0;
+			*(PP++) = 0;
 		}
 	}
 	
+	if (UseModelTransform)
+		TransformPoints(PosBase(),PosBase(),NumVertices,TransformPos);
+	
 	// Copy in the normals
 	Normals.resize(NormSources.size());
 	
-	if (UseModelTransform)
+	if (!Normals.empty())
 	{
-		GLfloat *NormPtr = NormBase();
-		GLfloat *NormBasePtr = NormSrcBase();
-		size_t NumNorms = NormSources.size()/3;
-		for (size_t k=0; k<NumNorms; k++, NormPtr+=3, NormBasePtr+=3)
-		{
-			TransformVector(NormPtr, NormBasePtr, TransformNorm);			
-		}
-	}
-	else
-	{
-		objlist_copy(NormBase(),NormSrcBase(),NormSources.size());
+		if (UseModelTransform)
+			TransformVectors(NormBase(),NormSrcBase(),NormSources.size()/3,TransformNorm);
+		else
+			objlist_copy(NormBase(),NormSrcBase(),NormSources.size());
 	}
 	
+	CurrentPose = Pose;
 	return true;
 }
 
@@ -781,6 +876,21 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 	size_t NumBones = Bones.size();
 	if (FrameIndex < 0 || NumBones*FrameIndex >= Frames.size()) return false;
 	
+	Model3D_Pose Pose = MakePose(Model3D_Pose::Frame, UseModelTransform, NONE, FrameIndex, MixFrac, AddlFrameIndex);
+	if (RecallPose(Pose)) return true;
+	StorePose();
+	
+	FindFramePositions(UseModelTransform, FrameIndex, MixFrac, AddlFrameIndex);
+	
+	CurrentPose = Pose;
+	return true;
+}
+
+void Model3D::FindFramePositions(bool UseModelTransform,
+	GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex)
+{
+	size_t NumBones = Bones.size();
+	
 	if (InverseVSIndices.empty()) BuildInverseVSIndices();
 	
 	size_t NumVertices = VtxSrcIndices.size();
@@ -844,14 +954,14 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 		if (VS.Bone0 >= 0)
 		{
 			Model3D_Transform& T0 = BoneMatrices[VS.Bone0];
-			TransformPoint(Position,VS.Position,T0);
+			TransformPoints(Position,VS.Position,1,T0);
 
 			if (NormalsPresent)
 			{
 				for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
 				{
 					int Indx = 3*InverseVSIndices[iv];
-					TransformVector(NormBase() + Indx, NormSrcBase() + Indx, T0);
+					TransformVectors(NormBase() + Indx, NormSrcBase() + Indx, 1, T0);
 				}
 			}			
 			
@@ -861,7 +971,7 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 				Model3D_Transform& T1 = BoneMatrices[VS.Bone1];
 				GLfloat PosExtra[3];
 				GLfloat PosDiff[3];
-				TransformPoint(PosExtra,VS.Position,T1);
+				TransformPoints(PosExtra,VS.Position,1,T1);
 				VecSub(PosExtra,Position,PosDiff);
 				VecScalarMultTo(PosDiff,Blend);
 				VecAddTo(Position,PosDiff);
@@ -875,7 +985,7 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 						GLfloat NormDiff[3];
 						GLfloat *OrigNorm = NormSrcBase() + Indx;
 						GLfloat *Norm = NormBase() + Indx;
-						TransformVector(NormExtra,OrigNorm,T1);
+						TransformVectors(NormExtra,OrigNorm,1,T1);
 						VecSub(NormExtra,Norm,NormDiff);
 						VecScalarMultTo(NormDiff,Blend);
 						VecAddTo(Norm,NormDiff);
@@ -903,23 +1013,10 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 	
 	if (UseModelTransform)
 	{
-		GLfloat *PP = PosBase();
-		for (size_t k=0; k<Positions.size()/3; k++, PP+=3)
-		{
-			GLfloat Position[3];
-			TransformPoint(Position,PP,TransformPos);
-			VecCopy(Position,PP);
-		}
-		GLfloat *NP = NormBase();
-		for (size_t k=0; k<Normals.size()/3; k++, NP+=3)
-		{
-			GLfloat Normal[3];
-			TransformVector(Normal,NP,TransformNorm);
-			VecCopy(Normal,NP);
-		}
+		TransformPoints(PosBase(),PosBase(),Positions.size()/3,TransformPos);
+		if (!Normals.empty())
+			TransformVectors(NormBase(),NormBase(),Normals.size()/3,TransformNorm);
 	}
-	
-	return true;
 }
 
 // Returns 0 for out-of-range sequence
@@ -941,22 +1038,31 @@ bool Model3D::FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 	
 	if (FrameIndex < 0 || FrameIndex >= NumSF) return false;
 	
-	Model3D_Transform TSF;
-	
 	Model3D_SeqFrame& SF = SeqFrames[SeqFrmPointers[SeqIndex] + FrameIndex];
 	
-	if (MixFrac != 0 && AddlFrameIndex != FrameIndex)
+	bool Mixed = (MixFrac != 0 && AddlFrameIndex != FrameIndex);
+	if (Mixed && (AddlFrameIndex < 0 || AddlFrameIndex >= NumSF)) return false;
+	
+	Model3D_SeqFrame& ASF = Mixed ? SeqFrames[SeqFrmPointers[SeqIndex] + AddlFrameIndex] : SF;
+	
+	if (Frames.empty() || SF.Frame < 0 || Bones.size()*SF.Frame >= Frames.size()) return false;
+	
+	Model3D_Pose Pose = Mixed ?
+		MakePose(Model3D_Pose::Sequence, UseModelTransform, SeqIndex, FrameIndex, MixFrac, AddlFrameIndex) :
+		MakePose(Model3D_Pose::Sequence, UseModelTransform, SeqIndex, FrameIndex, 0, FrameIndex);
+	if (RecallPose(Pose)) return true;
+	StorePose();
+	
+	Model3D_Transform TSF;
+	
+	if (Mixed)
 	{
-		if (AddlFrameIndex < 0 || AddlFrameIndex >= NumSF) return false;
-		
-		Model3D_SeqFrame& ASF = SeqFrames[SeqFrmPointers[SeqIndex] + AddlFrameIndex];
 		FindFrameTransform(TSF,SF,MixFrac,ASF);
-		
-		if (!FindPositions_Frame(false,SF.Frame,MixFrac,ASF.Frame)) return false;
+		FindFramePositions(false,SF.Frame,MixFrac,ASF.Frame);
 	}
 	else
 	{
-		if (!FindPositions_Frame(false,SF.Frame)) return false;
+		FindFramePositions(false,SF.Frame,0,SF.Frame);
 		FindFrameTransform(TSF,SF,0,SF);
 	}
 	
@@ -967,14 +1073,7 @@ bool Model3D::FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 		obj_copy(TTot,TSF);
 	
 	size_t NumVerts = Positions.size()/3;
-	GLfloat *Pos = PosBase();
-	for (size_t iv=0; iv<NumVerts; iv++)
-	{
-		GLfloat NewPos[3];
-		TransformPoint(NewPos,Pos,TTot);
-		VecCopy(NewPos,Pos);
-		Pos += 3;
-	}
+	TransformPoints(PosBase(),PosBase(),NumVerts,TTot);
 	
 	bool NormalsPresent = !NormSources.empty();
 	if (NormalsPresent)
@@ -984,21 +1083,14 @@ bool Model3D::FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 			TMatMultiply(TTot,TransformNorm,TSF);
 		else
 			obj_copy(TTot,TSF);
-				
-		GLfloat *Norm = NormBase();
-		for (size_t iv=0; iv<NumVerts; iv++)
-		{
-			GLfloat NewNorm[3];
-			TransformVector(NewNorm,Norm,TTot);
-			VecCopy(NewNorm,Norm);
-			Norm += 3;
-		}
+		
+		TransformVectors(NormBase(),NormBase(),NumVerts,TTot);
 	}
 	
+	CurrentPose = Pose;
 	return true;
 }
 
-
 void Model3D_Transform::Identity()
 {
 	obj_clear(*this);
@@ -100,6 +100,31 @@ struct Model3D_Transform
 };
 
 
+// What a model's positions and normals were found for
+struct Model3D_Pose
+{
+	enum
+	{
+		None,
+		Neutral,
+		Frame,
+		Sequence
+	};
+	
+	short Kind;
+	bool UseModelTransform;
+	GLshort SeqIndex, FrameIndex, AddlFrameIndex;
+	GLfloat MixFrac;
+	
+	bool operator==(const Model3D_Pose& Other) const
+	{
+		return Kind == Other.Kind && UseModelTransform == Other.UseModelTransform &&
+			SeqIndex == Other.SeqIndex && FrameIndex == Other.FrameIndex &&
+			AddlFrameIndex == Other.AddlFrameIndex && MixFrac == Other.MixFrac;
+	}
+};
+
+
 struct Model3D
 {
 	// Assumed dimensions:
@@ -254,8 +279,42 @@ struct Model3D
 	bool FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 		GLshort FrameIndex, GLfloat MixFrac = 0, GLshort AddlFrameIndex = 0);
 	
+	// The position finders keep the last few poses they found, so a model drawn
+	// in the same pose more than once (by several monsters, or through several
+	// clipping windows and rendering passes) is only transformed once;
+	// a cached pose is swapped into the position and normal arrays, not copied.
+	// Each model's cache may be filled on a thread of its own.
+	enum {PoseCacheSize = 8};
+	
+	// Call when the positions, normals or model transforms are changed
+	// other than by the finders
+	void InvalidatePoses();
+	
 	// Constructor
-	Model3D() {FindBoundingBox(); TransformPos.Identity(); TransformNorm.Identity();}
+	Model3D() {FindBoundingBox(); TransformPos.Identity(); TransformNorm.Identity(); InvalidatePoses();}
+
+private:
+	struct CachedPose
+	{
+		Model3D_Pose Pose;
+		vector<GLfloat> Positions, Normals;
+	};
+	
+	// What the position and normal arrays now hold
+	Model3D_Pose CurrentPose;
+	
+	// Most recently used first
+	vector<CachedPose> PoseCache;
+	
+	// Makes Pose current if it's cached
+	bool RecallPose(const Model3D_Pose& Pose);
+	
+	// Moves the current pose into the cache, before another is found
+	void StorePose();
+	
+	// Frame case, with the frame index already checked
+	void FindFramePositions(bool UseModelTransform,
+		GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex);
 };
 
 #endif
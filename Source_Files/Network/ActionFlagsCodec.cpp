@@ -0,0 +1,170 @@
+/*
+ *  ActionFlagsCodec.cpp - compact encoding of runs of action_flags for the star protocol
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+*/
+
+#include "ActionFlagsCodec.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+
+enum {
+	kRawValueBits = 2 + 32
+};
+
+class BitWriter
+{
+public:
+	BitWriter(std::vector<uint8>& outBytes) : mBytes(outBytes), mBitsUsed(8) {}
+
+	void write(uint32 inValue, int inBits)
+	{
+		while (inBits > 0)
+		{
+			if (mBitsUsed == 8)
+			{
+				mBytes.push_back(0);
+				mBitsUsed = 0;
+			}
+
+			int theBits = std::min(inBits, 8 - mBitsUsed);
+			uint8 theChunk = (inValue >> (inBits - theBits)) & ((1 << theBits) - 1);
+			mBytes.back() |= theChunk << (8 - mBitsUsed - theBits);
+			mBitsUsed += theBits;
+			inBits -= theBits;
+		}
+	}
+
+private:
+	std::vector<uint8>& mBytes;
+	int mBitsUsed;
+};
+
+class BitReader
+{
+public:
+	BitReader(AIStream& inStream) : mStream(inStream), mByte(0), mBitsLeft(0) {}
+
+	uint32 read(int inBits)
+	{
+		uint32 theValue = 0;
+		while (inBits > 0)
+		{
+			if (mBitsLeft == 0)
+			{
+				mStream >> mByte;
+				mBitsLeft = 8;
+			}
+
+			int theBits = std::min(inBits, mBitsLeft);
+			theValue = (theValue << theBits) | ((mByte >> (mBitsLeft - theBits)) & ((1 << theBits) - 1));
+			mBitsLeft -= theBits;
+			inBits -= theBits;
+		}
+
+		return theValue;
+	}
+
+private:
+	AIStream& mStream;
+	uint8 mByte;
+	int mBitsLeft;
+};
+
+void pack_action_flags(const uint32* inFlags, size_t inCount, uint8 inStride, std::vector<uint8>& outPacked)
+{
+	assert(inCount <= UINT16_MAX);
+
+	outPacked.push_back(static_cast<uint8>(inCount >> 8));
+	outPacked.push_back(static_cast<uint8>(inCount));
+	outPacked.push_back(inStride);
+
+	BitWriter theWriter(outPacked);
+	for (size_t i = 0; i < inCount; i++)
+	{
+		uint32 theReference = (inStride > 0 && i >= inStride) ? inFlags[i - inStride] : 0;
+		uint32 theDifference = inFlags[i] ^ theReference;
+
+		if (theDifference == 0)
+		{
+			theWriter.write(0, 1);
+			continue;
+		}
+
+		int theMask = 0;
+		for (int byte = 0; byte < 4; byte++)
+		{
+			if (theDifference & (0xff000000 >> (byte * 8)))
+				theMask |= 8 >> byte;
+		}
+
+		int theChangedBytes = (theMask & 1) + ((theMask >> 1) & 1) + ((theMask >> 2) & 1) + ((theMask >> 3) & 1);
+		if (2 + 4 + theChangedBytes * 8 < kRawValueBits)
+		{
+			theWriter.write(2, 2);
+			theWriter.write(theMask, 4);
+			for (int byte = 0; byte < 4; byte++)
+			{
+				if (theMask & (8 >> byte))
+					theWriter.write(theDifference >> (24 - byte * 8), 8);
+			}
+		}
+		else
+		{
+			theWriter.write(3, 2);
+			theWriter.write(inFlags[i], 32);
+		}
+	}
+}
+
+void unpack_action_flags(AIStream& inStream, std::vector<uint32>& outFlags)
+{
+	uint16 theCount;
+	uint8 theStride;
+	inStream >> theCount >> theStride;
+
+	size_t theFirst = outFlags.size();
+	outFlags.reserve(theFirst + theCount);
+
+	BitReader theReader(inStream);
+	for (size_t i = 0; i < theCount; i++)
+	{
+		uint32 theReference = (theStride > 0 && i >= theStride) ? outFlags[theFirst + i - theStride] : 0;
+
+		if (theReader.read(1) == 0)
+		{
+			outFlags.push_back(theReference);
+		}
+		else if (theReader.read(1) == 0)
+		{
+			int theMask = theReader.read(4);
+			uint32 theDifference = 0;
+			for (int byte = 0; byte < 4; byte++)
+			{
+				if (theMask & (8 >> byte))
+					theDifference |= theReader.read(8) << (24 - byte * 8);
+			}
+			outFlags.push_back(theReference ^ theDifference);
+		}
+		else
+		{
+			outFlags.push_back(theReader.read(32));
+		}
+	}
+}
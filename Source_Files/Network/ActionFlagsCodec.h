@@ -0,0 +1,47 @@
+/*
+ *  ActionFlagsCodec.h - compact encoding of runs of action_flags for the star protocol
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Hub packets carry action_flags tick-major, so the flags "stride"
+	places back are the same player's flags on the previous tick; most
+	of the time they haven't changed, and when they have, only a byte or
+	two of them has (the mouse deltas). Each value is coded against that
+	reference as one of
+		0				same as the reference
+		10 mmmm <bytes>	XOR with the reference, only the bytes set in mask m
+		11 <32 bits>	the raw value
+	most significant bit first. The run is preceded by a big-endian
+	uint16 count and a uint8 stride, and padded out to a whole byte.
+*/
+
+#ifndef ACTION_FLAGS_CODEC_H
+#define ACTION_FLAGS_CODEC_H
+
+#include "cstypes.h"
+#include "AStream.h"
+
+#include <vector>
+
+// Appends the packed run to outPacked
+void pack_action_flags(const uint32* inFlags, size_t inCount, uint8 inStride, std::vector<uint8>& outPacked);
+
+// Reads a run written by pack_action_flags(); throws AStream::failure if
+// the stream ends first
+void unpack_action_flags(AIStream& inStream, std::vector<uint32>& outFlags);
+
+#endif
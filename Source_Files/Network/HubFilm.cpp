@@ -0,0 +1,173 @@
+/*
+ *  HubFilm.cpp - films of the games a standalone hub hosts
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+*/
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "HubFilm.h"
+#include "map.h"
+#include "vbl_definitions.h"
+#include "interface.h"
+#include "network.h"
+#include "Packing.h"
+
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+
+// one (int16 run length, uint32 flags) pair
+static const int kRunSize = sizeof(int16) + sizeof(uint32);
+
+HubFilm::HubFilm() :
+	mNumPlayers(0),
+	mLength(0),
+	mWriteFailed(false)
+{
+}
+
+HubFilm::~HubFilm()
+{
+	if (is_recording())
+		stop();
+}
+
+bool
+HubFilm::start(FileSpecifier& inFile, const recording_header& inHeader)
+{
+	if (inHeader.num_players <= 0)
+		return false;
+
+	recording_header theHeader = inHeader;
+	mHeader.resize(SIZEOF_recording_header);
+	pack_recording_header(mHeader.data(), &theHeader, 1);
+
+	if (!inFile.Create(_typecode_film) || !inFile.Open(mFile, true))
+		return false;
+
+	mNumPlayers = theHeader.num_players;
+	mLength = theHeader.length;
+	mChunkFlags.clear();
+	mChunkFlags.reserve(RECORD_CHUNK_SIZE * mNumPlayers);
+	mWriteFailed = !mFile.Write(SIZEOF_recording_header, mHeader.data());
+
+	return !mWriteFailed;
+}
+
+void
+HubFilm::record(const uint32* inFlags, size_t inTickCount)
+{
+	if (!is_recording() || mWriteFailed)
+		return;
+
+	for (size_t theTick = 0; theTick < inTickCount; theTick++)
+	{
+		const uint32* theTickFlags = inFlags + theTick * mNumPlayers;
+		mChunkFlags.insert(mChunkFlags.end(), theTickFlags, theTickFlags + mNumPlayers);
+
+		if (mChunkFlags.size() == static_cast<size_t>(RECORD_CHUNK_SIZE * mNumPlayers))
+			write_chunks(false);
+	}
+}
+
+// each player's chunk in turn, encoded as save_recording_queue_chunk() does
+void
+HubFilm::write_chunks(bool inLast)
+{
+	size_t theTickCount = mChunkFlags.size() / mNumPlayers;
+
+	mBuffer.resize(mNumPlayers * (RECORD_CHUNK_SIZE + 1) * kRunSize);
+	uint8* S = mBuffer.data();
+
+	for (int thePlayer = 0; thePlayer < mNumPlayers; thePlayer++)
+	{
+		int16 theRunCount = 0;
+		uint32 theRunFlags = 0;
+		for (size_t theTick = 0; theTick < theTickCount; theTick++)
+		{
+			uint32 theFlags = mChunkFlags[theTick * mNumPlayers + thePlayer];
+			if (theRunCount && theFlags != theRunFlags)
+			{
+				ValueToStream(S, theRunCount);
+				ValueToStream(S, theRunFlags);
+				theRunCount = 0;
+			}
+			theRunFlags = theFlags;
+			theRunCount++;
+		}
+
+		if (theRunCount)
+		{
+			ValueToStream(S, theRunCount);
+			ValueToStream(S, theRunFlags);
+		}
+
+		if (inLast)
+		{
+			int16 theEndIndicator = END_OF_RECORDING_INDICATOR;
+			int32 theEndFlags = 0;
+			ValueToStream(S, theEndIndicator);
+			ValueToStream(S, theEndFlags);
+		}
+	}
+
+	int32 theSize = static_cast<int32>(S - mBuffer.data());
+	if (mFile.Write(theSize, mBuffer.data()))
+		mLength += theSize;
+	else
+		mWriteFailed = true;
+
+	mChunkFlags.clear();
+}
+
+bool
+HubFilm::stop()
+{
+	if (!is_recording())
+		return false;
+
+	if (!mWriteFailed)
+	{
+		write_chunks(true);
+
+		// the length is the header's first field
+		uint8* S = mHeader.data();
+		ValueToStream(S, mLength);
+		mWriteFailed = !mFile.SetPosition(0) || !mFile.Write(SIZEOF_recording_header, mHeader.data());
+	}
+
+	mFile.Close();
+	return !mWriteFailed;
+}
+
+FileSpecifier
+hub_film_file(int inGameNumber, int inPlayerCount)
+{
+	extern DirectorySpecifier recordings_dir;
+
+	char theTime[80];
+	time_t t = time(nullptr);
+	strftime(theTime, sizeof(theTime), "%Y%m%d%H%M%S", localtime(&t));
+
+	std::ostringstream theName;
+	theName << theTime << "_" << inGameNumber << "_" << inPlayerCount << "P.filA";
+
+	return recordings_dir + theName.str();
+}
+
+#endif // !defined(DISABLE_NETWORKING)
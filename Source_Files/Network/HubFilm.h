@@ -0,0 +1,71 @@
+/*
+ *  HubFilm.h - films of the games a standalone hub hosts
+ 
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	The film is the same one the players record (see vbl.cpp): the
+	header, then each player's flags run-length encoded a chunk at a
+	time. The hub has every player's flags for a tick once it's final,
+	so it writes a chunk for everyone as soon as it has that many ticks;
+	nothing more than that is ever kept in memory. It's written from the
+	main thread, from what hub_take_confirmed_flags() hands over, so the
+	hub's tick task never waits on the disk.
+*/
+
+#ifndef HUB_FILM_H
+#define HUB_FILM_H
+
+#include "cstypes.h"
+#include "FileHandler.h"
+
+#include <vector>
+
+struct recording_header;
+
+class HubFilm
+{
+public:
+	HubFilm();
+	~HubFilm();
+
+	// the header comes from build_net_recording_header(), like the players' films
+	bool start(FileSpecifier& inFile, const recording_header& inHeader);
+
+	// tick-major, every player every tick
+	void record(const uint32* inFlags, size_t inTickCount);
+
+	// writes what's left, the end of each player's flags, and the final length
+	bool stop();
+
+	bool is_recording() { return mFile.IsOpen(); }
+
+private:
+	void write_chunks(bool inLast);
+
+	OpenedFile mFile;
+	int mNumPlayers;
+	int32 mLength;
+	std::vector<uint8> mHeader;
+	std::vector<uint32> mChunkFlags;	// fewer than a chunk's worth of ticks
+	std::vector<uint8> mBuffer;
+	bool mWriteFailed;
+};
+
+// in recordings_dir, named for when the game started, which game it is and how many played
+FileSpecifier hub_film_file(int inGameNumber, int inPlayerCount);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ *  HubTelemetry.cpp - what the hub saw of each player, for whoever runs it
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+*/
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "HubTelemetry.h"
+#include "FileHandler.h"
+#include "InfoTree.h"
+
+#include <assert.h>
+
+static const char* sNetDeadReasonNames[HubTelemetry::kNumNetDeadReasons] = {
+	"",
+	"silent in pregame",
+	"silent in game",
+	"late acks",
+	"last player left"
+};
+
+TelemetryHistogram::TelemetryHistogram(std::initializer_list<int32> inBounds) :
+	mBoundCount(0)
+{
+	assert(inBounds.size() <= kMaxBounds);
+	for (int32 bound : inBounds)
+		mBounds[mBoundCount++] = bound;
+
+	for (auto& count : mCounts)
+		count.store(0, std::memory_order_relaxed);
+}
+
+void
+TelemetryHistogram::record(int32 inValue)
+{
+	int theBucket = 0;
+	while (theBucket < mBoundCount && inValue > mBounds[theBucket])
+		theBucket++;
+
+	mCounts[theBucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+TelemetryHistogram::save(InfoTree& outTree) const
+{
+	for (int i = 0; i <= mBoundCount; i++)
+	{
+		InfoTree theBucket;
+		if (i < mBoundCount)
+			theBucket.put_attr("max", mBounds[i]);
+		theBucket.put_attr("count", mCounts[i].load(std::memory_order_relaxed));
+		outTree.add_child("bucket", theBucket);
+	}
+}
+
+HubPlayerTelemetry::HubPlayerTelemetry() :
+	mLatency({ 50, 100, 150, 200, 250, 300, 400, 500, 750, 1000 }),
+	mJitter({ 5, 10, 20, 30, 50, 75, 100, 150, 200 }),
+	mFlagsMadeUp(0),
+	mLateFlags(0),
+	mRecoverySends(0),
+	mPacketsIn(0),
+	mBytesIn(0),
+	mPacketsOut(0),
+	mBytesOut(0),
+	mNetDeadReason(HubTelemetry::kNotNetDead),
+	mNetDeadTick(0)
+{
+}
+
+HubTelemetry::HubTelemetry(int inNumPlayers) :
+	mTickCompletionLag({ 0, 33, 67, 100, 150, 200, 300, 500, 1000 }),
+	mNetworkTicks(0),
+	mNumPlayers(inNumPlayers),
+	mPlayers(new HubPlayerTelemetry[inNumPlayers])
+{
+}
+
+void
+HubTelemetry::net_dead(int inPlayerIndex, NetDeadReason inReason, int32 inTick)
+{
+	mPlayers[inPlayerIndex].mNetDeadTick.store(inTick, std::memory_order_relaxed);
+	mPlayers[inPlayerIndex].mNetDeadReason.store(inReason, std::memory_order_relaxed);
+}
+
+void
+HubTelemetry::save(InfoTree& outTree) const
+{
+	InfoTree theRoot;
+	theRoot.put_attr("players", mNumPlayers);
+	theRoot.put_attr("network_ticks", mNetworkTicks.load(std::memory_order_relaxed));
+
+	InfoTree theLag;
+	mTickCompletionLag.save(theLag);
+	theRoot.add_child("tick_completion_lag", theLag);
+
+	for (int i = 0; i < mNumPlayers; i++)
+	{
+		const HubPlayerTelemetry& thePlayer = mPlayers[i];
+
+		InfoTree thePlayerTree;
+		thePlayerTree.put_attr("index", i);
+		thePlayerTree.put_attr("packets_in", thePlayer.mPacketsIn.load(std::memory_order_relaxed));
+		thePlayerTree.put_attr("bytes_in", thePlayer.mBytesIn.load(std::memory_order_relaxed));
+		thePlayerTree.put_attr("packets_out", thePlayer.mPacketsOut.load(std::memory_order_relaxed));
+		thePlayerTree.put_attr("bytes_out", thePlayer.mBytesOut.load(std::memory_order_relaxed));
+		thePlayerTree.put_attr("recovery_sends", thePlayer.mRecoverySends.load(std::memory_order_relaxed));
+		thePlayerTree.put_attr("flags_made_up", thePlayer.mFlagsMadeUp.load(std::memory_order_relaxed));
+		thePlayerTree.put_attr("late_flags", thePlayer.mLateFlags.load(std::memory_order_relaxed));
+
+		int theReason = thePlayer.mNetDeadReason.load(std::memory_order_relaxed);
+		if (theReason != kNotNetDead)
+		{
+			thePlayerTree.put_attr("netdead", std::string(sNetDeadReasonNames[theReason]));
+			thePlayerTree.put_attr("netdead_tick", thePlayer.mNetDeadTick.load(std::memory_order_relaxed));
+		}
+
+		InfoTree theLatency;
+		thePlayer.mLatency.save(theLatency);
+		thePlayerTree.add_child("latency", theLatency);
+
+		InfoTree theJitter;
+		thePlayer.mJitter.save(theJitter);
+		thePlayerTree.add_child("jitter", theJitter);
+
+		theRoot.add_child("player", thePlayerTree);
+	}
+
+	outTree.put_child("hub_telemetry", theRoot);
+}
+
+bool
+HubTelemetry::write(FileSpecifier& inFile) const
+{
+	InfoTree theTree;
+	save(theTree);
+
+	std::ostringstream theStream;
+	theTree.save_xml(theStream);
+	std::string theData = theStream.str();
+
+	FileSpecifier theTempFile;
+	theTempFile.SetTempName(inFile);
+
+	bool success = false;
+	{
+		OpenedFile f;
+		if (theTempFile.Open(f, true))
+		{
+			success = f.Write(static_cast<int32>(theData.size()), theData.data());
+		}
+	}
+
+	if (!success || !theTempFile.Rename(inFile))
+	{
+		theTempFile.Delete();
+		return false;
+	}
+
+	return true;
+}
+
+#endif // !defined(DISABLE_NETWORKING)
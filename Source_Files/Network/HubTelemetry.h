@@ -0,0 +1,109 @@
+/*
+ *  HubTelemetry.h - what the hub saw of each player, for whoever runs it
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	The hub's tick task and packet handler record as they go, with
+	relaxed atomic increments, so recording never waits on anything;
+	the main thread reads whatever has been recorded so far and writes
+	it out. A snapshot can be a tick out of step with itself, which
+	doesn't matter for this.
+*/
+
+#ifndef HUB_TELEMETRY_H
+#define HUB_TELEMETRY_H
+
+#include "cstypes.h"
+
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+
+class FileSpecifier;
+class InfoTree;
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "hub telemetry needs lock-free atomic ints");
+
+class TelemetryHistogram
+{
+public:
+	enum { kMaxBounds = 12 };
+
+	// upper bounds of the buckets, ascending; one more bucket takes everything above
+	TelemetryHistogram(std::initializer_list<int32> inBounds);
+
+	void record(int32 inValue);
+	void save(InfoTree& outTree) const;
+
+private:
+	int32 mBounds[kMaxBounds];
+	int mBoundCount;
+	std::atomic<uint32> mCounts[kMaxBounds + 1];
+};
+
+struct HubPlayerTelemetry
+{
+	HubPlayerTelemetry();
+
+	TelemetryHistogram mLatency;	// ms, each tick's round trip
+	TelemetryHistogram mJitter;	// ms, as computed for NetworkStats
+
+	std::atomic<uint32> mFlagsMadeUp;
+	std::atomic<uint32> mLateFlags;	// arrived after we'd made them up
+	std::atomic<uint32> mRecoverySends;
+	std::atomic<uint32> mPacketsIn;
+	std::atomic<uint32> mBytesIn;
+	std::atomic<uint32> mPacketsOut;
+	std::atomic<uint32> mBytesOut;
+
+	std::atomic<int> mNetDeadReason;
+	std::atomic<int32> mNetDeadTick;
+};
+
+class HubTelemetry
+{
+public:
+	enum NetDeadReason {
+		kNotNetDead,
+		kSilentInPregame,
+		kSilentInGame,
+		kLateAcks,
+		kLastPlayerLeft,	// a hub without a local player doesn't run a game for one
+		kNumNetDeadReasons
+	};
+
+	explicit HubTelemetry(int inNumPlayers);
+
+	HubPlayerTelemetry& player(int inPlayerIndex) { return mPlayers[inPlayerIndex]; }
+
+	void net_dead(int inPlayerIndex, NetDeadReason inReason, int32 inTick);
+
+	// ms from the first flags arriving for a tick to the last
+	TelemetryHistogram mTickCompletionLag;
+	std::atomic<int32> mNetworkTicks;
+
+	void save(InfoTree& outTree) const;
+
+	// replaces the file whole, so a reader never sees half of it
+	bool write(FileSpecifier& inFile) const;
+
+private:
+	int mNumPlayers;
+	std::unique_ptr<HubPlayerTelemetry[]> mPlayers;
+};
+
+#endif
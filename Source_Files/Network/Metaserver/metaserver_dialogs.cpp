@@ -44,9 +44,12 @@ extern ChatHistory gMetaserverChatHistory;
 extern MetaserverClient* gMetaserverClient;
 
 const IPaddress
-run_network_metaserver_ui()
+run_network_metaserver_ui(uint32& outHostPlayerID)
 {
-	return MetaserverClientUi::Create()->GetJoinAddressByRunning();
+	auto ui = MetaserverClientUi::Create();
+	IPaddress address = ui->GetJoinAddressByRunning();
+	outHostPlayerID = ui->GetJoinHostPlayerID();
+	return address;
 }
 
 
@@ -433,6 +436,7 @@ void MetaserverClientUi::JoinGame(const GameListMessage::GameListEntry& game)
 {
 	memcpy(&m_joinAddress.host, &game.m_ipAddress, sizeof(m_joinAddress.host));
 	m_joinAddress.port = game.m_port;
+	m_joinHostPlayerID = game.m_hostPlayerID;
 	Stop();
 }
 
@@ -30,7 +30,8 @@
 #include "shared_widgets.h"
 
 
-const IPaddress run_network_metaserver_ui();
+// outHostPlayerID: the metaserver player id of the picked game's host
+const IPaddress run_network_metaserver_ui(uint32& outHostPlayerID);
 
 // This doesn't go here
 void setupAndConnectClient(MetaserverClient& client, bool use_remote_hub);
@@ -71,6 +72,7 @@ public:
 	static std::unique_ptr<MetaserverClientUi> Create();
 
 	const IPaddress GetJoinAddressByRunning();
+	uint32 GetJoinHostPlayerID() const { return m_joinHostPlayerID; }
 
 	virtual ~MetaserverClientUi () {};
 
@@ -103,6 +105,7 @@ protected:
 	ColorfulChatWidget*                             m_chatWidget;
 	ButtonWidget*					m_cancelWidget;
 	IPaddress					m_joinAddress;
+	uint32						m_joinHostPlayerID = 0;
 	bool						m_used;
 	ButtonWidget*                                   m_muteWidget;
 	ButtonWidget*                                   m_joinWidget;
@@ -264,6 +264,7 @@ public:
 
 	void setPlayerName(const std::string& name);
 	const std::string& playerName() const { return m_playerName; }
+	uint32 playerID() const { return m_playerID; }
 
 	void setAway(bool away, const std::string& away_message);
 	void setMode(uint16 mode, const std::string& session_id);
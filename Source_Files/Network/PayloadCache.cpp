@@ -0,0 +1,180 @@
+/*
+ *  PayloadCache.cpp - game data (map, physics, Lua) joiners have received before
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+*/
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "PayloadCache.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+#include <zlib.h>
+
+static const char* kPayloadExtension = ".payload";
+
+static std::string payload_file_name(const PayloadKey& key)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%08x%08x%08x%s", key.length, key.crc, key.adler, kPayloadExtension);
+	return name;
+}
+
+static bool parse_payload_file_name(const std::string& name, PayloadKey& key)
+{
+	if (name.size() != 24 + strlen(kPayloadExtension) || name.compare(24, std::string::npos, kPayloadExtension) != 0)
+		return false;
+
+	unsigned int length, crc, adler;
+	if (sscanf(name.c_str(), "%8x%8x%8x", &length, &crc, &adler) != 3)
+		return false;
+
+	key.length = length;
+	key.crc = crc;
+	key.adler = adler;
+	return true;
+}
+
+PayloadKey PayloadKey::Of(const byte* buffer, size_t length)
+{
+	PayloadKey key;
+	key.length = static_cast<uint32>(length);
+	key.crc = crc32(crc32(0L, Z_NULL, 0), buffer, static_cast<uInt>(length));
+	key.adler = adler32(adler32(0L, Z_NULL, 0), buffer, static_cast<uInt>(length));
+	return key;
+}
+
+PayloadCache* PayloadCache::instance()
+{
+	static PayloadCache* m_instance = nullptr;
+	if (!m_instance)
+	{
+		m_instance = new PayloadCache;
+	}
+
+	return m_instance;
+}
+
+PayloadCache::PayloadCache()
+{
+	m_directory.SetToLocalDataDir();
+	m_directory += "Network Cache";
+	m_directory.CreateDirectory();
+}
+
+// newest first
+static std::vector<std::pair<PayloadKey, TimeType>> cached_payloads(DirectorySpecifier& directory)
+{
+	std::vector<std::pair<PayloadKey, TimeType>> payloads;
+	for (auto& entry : directory.ReadDirectory())
+	{
+		PayloadKey key;
+		if (!entry.is_directory && parse_payload_file_name(entry.name, key))
+		{
+			payloads.push_back(std::make_pair(key, entry.date));
+		}
+	}
+
+	std::stable_sort(payloads.begin(), payloads.end(), [](const std::pair<PayloadKey, TimeType>& a, const std::pair<PayloadKey, TimeType>& b) {
+		return a.second > b.second;
+	});
+
+	return payloads;
+}
+
+std::vector<PayloadKey> PayloadCache::Keys()
+{
+	std::vector<PayloadKey> keys;
+	for (auto& payload : cached_payloads(m_directory))
+	{
+		if (keys.size() == kMaxEntries)
+			break;
+
+		keys.push_back(payload.first);
+	}
+
+	return keys;
+}
+
+bool PayloadCache::Load(const PayloadKey& key, std::vector<byte>& data)
+{
+	FileSpecifier file = m_directory + payload_file_name(key);
+	OpenedFile f;
+	if (!file.Open(f))
+	{
+		logWarning("cached payload %s is gone", payload_file_name(key).c_str());
+		return false;
+	}
+
+	data.resize(key.length);
+	if (key.length && !f.Read(key.length, data.data()))
+	{
+		logWarning("could not read cached payload %s", payload_file_name(key).c_str());
+		return false;
+	}
+
+	if (!(PayloadKey::Of(data.data(), data.size()) == key))
+	{
+		logWarning("cached payload %s is corrupt; removing it", payload_file_name(key).c_str());
+		f.Close();
+		file.Delete();
+		return false;
+	}
+
+	return true;
+}
+
+void PayloadCache::Store(const PayloadKey& key, const byte* buffer, size_t length)
+{
+	FileSpecifier file = m_directory + payload_file_name(key);
+	if (file.Exists())
+	{
+		return;
+	}
+
+	// write it under a temporary name, so we never advertise half a payload
+	FileSpecifier temp_file;
+	temp_file.SetTempName(file);
+
+	bool success = false;
+	{
+		OpenedFile f;
+		if (temp_file.Open(f, true))
+		{
+			success = length == 0 || f.Write(static_cast<int32>(length), const_cast<byte*>(buffer));
+		}
+	}
+
+	if (!success || !temp_file.Rename(file))
+	{
+		logWarning("could not cache payload %s", payload_file_name(key).c_str());
+		temp_file.Delete();
+		return;
+	}
+
+	auto payloads = cached_payloads(m_directory);
+	for (size_t i = kMaxEntries; i < payloads.size(); ++i)
+	{
+		FileSpecifier old_file = m_directory + payload_file_name(payloads[i].first);
+		old_file.Delete();
+	}
+}
+
+#endif // !defined(DISABLE_NETWORKING)
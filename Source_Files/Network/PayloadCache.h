@@ -0,0 +1,76 @@
+/*
+ *  PayloadCache.h - game data (map, physics, Lua) joiners have received before
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Joiners advertise the keys of the payloads they hold at join time;
+	the gatherer then only sends the key for any payload that matches,
+	instead of the payload itself
+*/
+
+#ifndef PAYLOAD_CACHE_H
+#define PAYLOAD_CACHE_H
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "cseries.h"
+#include "FileHandler.h"
+
+#include <vector>
+
+// identifies a payload by its contents
+struct PayloadKey
+{
+	uint32 length;
+	uint32 crc;
+	uint32 adler;
+
+	static PayloadKey Of(const byte* buffer, size_t length);
+
+	bool operator==(const PayloadKey& other) const {
+		return length == other.length && crc == other.crc && adler == other.adler;
+	}
+	bool operator<(const PayloadKey& other) const {
+		if (length != other.length) return length < other.length;
+		if (crc != other.crc) return crc < other.crc;
+		return adler < other.adler;
+	}
+};
+
+class PayloadCache
+{
+public:
+	static PayloadCache* instance();
+
+	enum { kMaxEntries = 32 };
+
+	// newest first
+	std::vector<PayloadKey> Keys();
+
+	// reads a payload back, checking it still matches its key
+	bool Load(const PayloadKey& key, std::vector<byte>& data);
+	void Store(const PayloadKey& key, const byte* buffer, size_t length);
+
+private:
+	PayloadCache();
+
+	DirectorySpecifier m_directory;
+};
+
+#endif // !defined(DISABLE_NETWORKING)
+
+#endif
@@ -17,25 +17,44 @@
 */
 
 #include "StandaloneHub.h"
+#include "network_star.h"
+#include "ActionFlagsCodec.h"
+#include "HubFilm.h"
+#include "Logging.h"
+#include "vbl_definitions.h"
 
-StandaloneHub* StandaloneHub::_instance = nullptr;
+#include <algorithm>
 
-bool StandaloneHub::Init(uint16 port)
+enum {
+	kSpectatorBatchTicks = TICKS_PER_SECOND / 2,
+	kSpectatorHistoryTicks = TICKS_PER_SECOND * 60
+};
+
+thread_local StandaloneHub* StandaloneHub::_instance = nullptr;
+
+bool StandaloneHub::Init(std::shared_ptr<CommunicationsChannel> gatherer, std::shared_ptr<StandaloneHubInbox> inbox)
 {
 	if (_instance) return true;
-	if (!port) return false;
-	_instance = new StandaloneHub(port);
+	_instance = new StandaloneHub(gatherer, inbox);
 	return NetEnter(false);
 }
 
-StandaloneHub::StandaloneHub(uint16 port)
+StandaloneHub::StandaloneHub(std::shared_ptr<CommunicationsChannel> gatherer, std::shared_ptr<StandaloneHubInbox> inbox)
 {
-	_port = port;
-	_server = std::make_unique<CommunicationsChannelFactory>(port);
+	_gatherer = gatherer;
+	_inbox = inbox;
 }
 
 StandaloneHub::~StandaloneHub()
 {
+	StopRecording();
+
+	// what's still queued for the spectators is the end of the game
+	std::vector<CommunicationsChannel*> spectators;
+	for (auto& spectator : _spectators)
+		spectators.push_back(spectator.get());
+	CommunicationsChannel::multipleFlushOutgoingMessages(spectators, false, _spectator_send_timeout_ms, _spectator_send_timeout_ms);
+
 	NetExit();
 }
 
@@ -59,7 +78,10 @@ bool StandaloneHub::SetupGathererGame(bool& gathering_done)
 		return Reset();
 	}
 
-	if (!GatherJoiners())
+	bool started = GatherJoiners();
+	DropUngatheredJoiners();
+
+	if (!started)
 	{
 		NetCancelGather();
 		return Reset();
@@ -69,25 +91,11 @@ bool StandaloneHub::SetupGathererGame(bool& gathering_done)
 	return true;
 }
 
-bool StandaloneHub::WaitForGatherer()
+bool StandaloneHub::AcceptGatherer(RemoteHubHostConnectMessage& request)
 {
-	if (_gatherer || !_gatherer_client.expired()) return true;
-
-	_gatherer = std::shared_ptr<CommunicationsChannel>(_server->newIncomingConnection());
-
-	if (!_gatherer) return false;
-
 	NetSetDefaultInflater(_gatherer.get());
 
-	auto gatherer_request = std::unique_ptr<RemoteHubHostConnectMessage>(_gatherer->receiveSpecificMessage<RemoteHubHostConnectMessage>(3000u, 3000u));
-
-	if (!gatherer_request)
-	{
-		_gatherer.reset();
-		return false;
-	}
-
-	bool can_use_hub = gatherer_request->version() == kNetworkSetupProtocolID;
+	bool can_use_hub = request.version() == kNetworkSetupProtocolID;
 
 	if (can_use_hub)
 	{
@@ -95,11 +103,20 @@ bool StandaloneHub::WaitForGatherer()
 
 		if (can_use_hub = gatherer_capabilities && CheckGathererCapabilities(gatherer_capabilities->capabilities()))
 		{
-			NetSetCapabilities(gatherer_capabilities->capabilities());
+			// joiners get the gatherer's capabilities from us, except for what's up to the hub
+			Capabilities capabilities = *gatherer_capabilities->capabilities();
+			capabilities[Capabilities::kCompactFlags] = Capabilities::kCompactFlagsVersion;
+			NetSetCapabilities(&capabilities);
 		}
 	}
 
 	_gatherer->enqueueOutgoingMessage(RemoteHubHostResponseMessage(can_use_hub));
+	if (can_use_hub)
+	{
+		Capabilities hub_capabilities;
+		hub_capabilities[Capabilities::kCompactFlags] = Capabilities::kCompactFlagsVersion;
+		_gatherer->enqueueOutgoingMessage(CapabilitiesMessage(hub_capabilities));
+	}
 	_gatherer->pumpSendingSide();
 
 	if (!can_use_hub) _gatherer.reset();
@@ -118,26 +135,48 @@ bool StandaloneHub::CheckGathererCapabilities(const Capabilities* capabilities)
 		gatherer_capabilities[Capabilities::kZippedData] == Capabilities::kZippedDataVersion;
 }
 
+// the game's over (or never got going); its thread is done with the hub
 bool StandaloneHub::Reset()
 {
-	auto port = _instance->_port;
 	delete _instance;
 	_instance = nullptr;
-	return Init(port);
+	return true;
 }
 
 bool StandaloneHub::GatherJoiners()
 {
 	while (!_gatherer_client.expired() && !_start_game_signal && machine_tick_count() - _start_check_timeout_ms < _gathering_timeout_ms)
 	{
+		// the lobby holds on to our joiners for us, but they don't get a hello before the gatherer does
+		if (_gatherer_joined_as_client)
+		{
+			std::vector<std::shared_ptr<CommunicationsChannel>> joiners;
+			{
+				std::lock_guard<std::mutex> lock(_inbox->mutex);
+				joiners.swap(_inbox->joiners);
+			}
+
+			for (auto& joiner : joiners)
+				NetProcessNewJoiner(joiner);
+		}
+
 		prospective_joiner_info player;
-		NetCheckForNewJoiner(player, _server.get(), _gatherer_joined_as_client);
-		sleep_for_machine_ticks(1);
+		NetCheckForNewJoiner(player);
+
+		NetWaitForActivity(_gathering_wait_ms);
 	}
 
 	return _start_game_signal;
 }
 
+void StandaloneHub::DropUngatheredJoiners()
+{
+	_inbox->accepting_joiners = false;
+
+	std::lock_guard<std::mutex> lock(_inbox->mutex);
+	_inbox->joiners.clear();
+}
+
 void StandaloneHub::SendMessageToGatherer(const Message& message)
 {
 	if (auto gatherer = _gatherer_client.lock()) 
@@ -210,4 +249,351 @@ int StandaloneHub::GetLuaData(uint8** data)
 
 	*data = _lua_message->buffer();
 	return _lua_message->length();
-}
\ No newline at end of file
+}
+
+// pack_action_flags() runs can't be longer than 65535 flags
+static void pack_spectator_flags(const action_flags_t* flags, size_t tick_count, int player_count, std::vector<uint8>& packed)
+{
+	packed.clear();
+
+	const size_t max_run_ticks = UINT16_MAX / player_count;
+	for (size_t tick = 0; tick < tick_count; tick += max_run_ticks)
+	{
+		size_t run_ticks = std::min(max_run_ticks, tick_count - tick);
+		pack_action_flags(flags + tick * player_count, run_ticks * player_count, static_cast<uint8>(player_count), packed);
+	}
+}
+
+UninflatedMessage* StandaloneHub::DeflateSpectatorFlags(int32 start_tick, const action_flags_t* flags, size_t tick_count)
+{
+	pack_spectator_flags(flags, tick_count, _spectator_player_count, _spectator_packed_flags);
+	return SpectatorFlagsMessage(start_tick, _spectator_player_count, _spectator_packed_flags.data(), _spectator_packed_flags.size()).deflate();
+}
+
+void StandaloneHub::SendGameToSpectator(CommunicationsChannel* channel)
+{
+	NetSendTopology(channel);
+
+	for (auto& message : _spectator_game_data)
+		channel->enqueueOutgoingMessage(*message);
+	channel->enqueueOutgoingMessage(EndGameDataMessage());
+
+	// The hub doesn't run the game, so it has no state to start a late joiner from: it gets
+	// every tick of the level so far, and fast-forwards through them.  They're kept packed a
+	// minute at a time, so that's a handful of messages rather than every batch since the start.
+	for (auto& history : _spectator_history)
+		channel->enqueueOutgoingMessage(*history);
+
+	if (!_spectator_recent_flags.empty())
+	{
+		std::unique_ptr<UninflatedMessage> recent(DeflateSpectatorFlags(_spectator_recent_start_tick, _spectator_recent_flags.data(), _spectator_recent_flags.size() / _spectator_player_count));
+		channel->enqueueOutgoingMessage(*recent);
+	}
+
+	channel->pumpSendingSide();
+}
+
+void StandaloneHub::StartSpectating()
+{
+	_spectator_player_count = NetGetNumberOfPlayers();
+	_spectator_held_flags.clear();
+	_spectator_recent_flags.clear();
+	_spectator_history.clear();
+
+	// zipping the map once, not once per spectator
+	_spectator_game_data.clear();
+	if (_map_message) _spectator_game_data.emplace_back(_map_message->deflate());
+	if (_physics_message) _spectator_game_data.emplace_back(_physics_message->deflate());
+	if (_lua_message) _spectator_game_data.emplace_back(_lua_message->deflate());
+
+	for (auto& spectator : _spectators)
+		SendGameToSpectator(spectator.get());
+}
+
+void StandaloneHub::CheckForSpectators()
+{
+	// the lobby has already checked their version
+	std::vector<std::unique_ptr<CommunicationsChannel>> channels;
+	{
+		std::lock_guard<std::mutex> lock(_inbox->mutex);
+		channels.swap(_inbox->spectators);
+	}
+
+	for (auto& channel : channels)
+	{
+		// a resumed game starts from the saved game's state, which spectators don't get
+		bool can_watch = !_saved_game && static_cast<int32>(_spectators.size()) < hub_get_max_spectators();
+
+		NetSetDefaultInflater(channel.get());
+		channel->enqueueOutgoingMessage(RemoteHubHostResponseMessage(can_watch));
+
+		if (can_watch)
+		{
+			SendGameToSpectator(channel.get());
+			_spectators.push_back(std::move(channel));
+		}
+		else
+		{
+			channel->pumpSendingSide();
+			channel->disconnect();
+		}
+	}
+}
+
+void StandaloneHub::FeedSpectators(bool game_ended)
+{
+	int32 first_tick;
+	bool have_flags = hub_take_confirmed_flags(first_tick, _spectator_taken_flags);
+
+	if (have_flags && _film)
+		_film->record(_spectator_taken_flags.data(), _spectator_taken_flags.size() / NetGetNumberOfPlayers());
+
+	if (!have_flags && _spectators.empty()) return;
+
+	if (!_spectator_player_count || hub_get_max_spectators() <= 0) return;
+
+	if (!_spectator_taken_flags.empty())
+	{
+		if (_spectator_held_flags.empty()) _spectator_held_start_tick = first_tick;
+		assert(first_tick == _spectator_held_start_tick + static_cast<int32>(_spectator_held_flags.size() / _spectator_player_count));
+		_spectator_held_flags.insert(_spectator_held_flags.end(), _spectator_taken_flags.begin(), _spectator_taken_flags.end());
+	}
+
+	int32 held_ticks = _spectator_held_flags.size() / _spectator_player_count;
+	int32 release_ticks = game_ended ? held_ticks : held_ticks - hub_get_spectator_delay();
+
+	if (release_ticks > 0 && (game_ended || release_ticks >= kSpectatorBatchTicks))
+	{
+		// everyone watching gets the same bytes, so encode them just once
+		std::unique_ptr<UninflatedMessage> batch(DeflateSpectatorFlags(_spectator_held_start_tick, _spectator_held_flags.data(), release_ticks));
+		for (auto& spectator : _spectators)
+			spectator->enqueueOutgoingMessage(*batch);
+
+		auto released_end = _spectator_held_flags.begin() + release_ticks * _spectator_player_count;
+		if (_spectator_recent_flags.empty()) _spectator_recent_start_tick = _spectator_held_start_tick;
+		_spectator_recent_flags.insert(_spectator_recent_flags.end(), _spectator_held_flags.begin(), released_end);
+		_spectator_held_flags.erase(_spectator_held_flags.begin(), released_end);
+		_spectator_held_start_tick += release_ticks;
+
+		if (static_cast<int32>(_spectator_recent_flags.size() / _spectator_player_count) >= kSpectatorHistoryTicks)
+		{
+			_spectator_history.emplace_back(DeflateSpectatorFlags(_spectator_recent_start_tick, _spectator_recent_flags.data(), _spectator_recent_flags.size() / _spectator_player_count));
+			_spectator_recent_flags.clear();
+		}
+	}
+
+	// only what's queued needs pumping; a spectator TCP won't take anything from is dropped
+	for (auto& spectator : _spectators)
+	{
+		if (!spectator->outgoingMessageCount()) continue;
+
+		spectator->pumpSendingSide();
+
+		if (spectator->outgoingMessageCount() && spectator->millisecondsSinceLastSend() > _spectator_send_timeout_ms)
+			spectator->disconnect();
+	}
+
+	_spectators.erase(std::remove_if(_spectators.begin(), _spectators.end(), [](const std::unique_ptr<CommunicationsChannel>& spectator) {
+		return !spectator->isConnected();
+	}), _spectators.end());
+}
+
+void StandaloneHub::StartRecording()
+{
+	if (_film || _saved_game || !hub_get_record_films()) return;
+
+	recording_header header;
+	build_net_recording_header(&header, _topology_message->topology()->game_data);
+
+	FileSpecifier file = hub_film_file(hub_game_number(), header.num_players);
+
+	_film = std::make_unique<HubFilm>();
+	if (!_film->start(file, header))
+	{
+		logWarning("could not start hub film %s", file.GetPath());
+		_film.reset();
+		return;
+	}
+
+	logNote("hub game %d recording to %s", hub_game_number(), file.GetPath());
+}
+
+void StandaloneHub::StopRecording()
+{
+	if (!_film) return;
+
+	if (!_film->stop())
+		logWarning("could not finish hub film");
+
+	_film.reset();
+}
+
+StandaloneHubServer::StandaloneHubServer(uint16 port, GameRunner run_game) : _port(port), _run_game(run_game)
+{
+	_inflater = std::make_unique<MessageInflater>();
+	_inflater->learnPrototype(RemoteHubHostConnectMessage());
+	_inflater->learnPrototype(CapabilitiesMessage());
+	_inflater->learnPrototype(RemoteHubJoinMessage());
+	_inflater->learnPrototype(SpectatorRequestMessage());
+}
+
+StandaloneHubServer::~StandaloneHubServer()
+{
+	_pending.clear();
+
+	// the games hang up on their players once they notice nobody's there
+	for (auto& game : _games)
+	{
+		if (game.thread.joinable())
+			game.thread.join();
+	}
+
+	if (_socket_open)
+		NetDDPCloseSocket(_socket);
+}
+
+bool StandaloneHubServer::Open()
+{
+	_server = std::make_unique<CommunicationsChannelFactory>(_port);
+	if (!_server->isFunctional()) return false;
+
+	_socket = SDL_SwapBE16(_port);
+	_socket_open = NetDDPOpenSocket(&_socket, hub_received_network_packet) == noErr;
+	return _socket_open;
+}
+
+void StandaloneHubServer::Run(uint32 timeout_ms)
+{
+	std::vector<CommunicationsChannel*> channels;
+	for (auto& pending : _pending)
+		channels.push_back(pending.channel.get());
+
+	CommunicationsChannel::waitForActivity(channels, timeout_ms, _server.get());
+
+	AcceptConnections();
+
+	for (auto it = _pending.begin(); it != _pending.end();)
+	{
+		if (Route(*it)) it = _pending.erase(it);
+		else ++it;
+	}
+
+	ReapGames();
+}
+
+void StandaloneHubServer::AcceptConnections()
+{
+	while (auto channel = std::unique_ptr<CommunicationsChannel>(_server->newIncomingConnection()))
+	{
+		channel->setMessageInflater(_inflater.get());
+		_pending.push_back({ std::move(channel), machine_tick_count() });
+	}
+}
+
+// Returns true once the connection has been dealt with, one way or the other
+bool StandaloneHubServer::Route(Pending& pending)
+{
+	if (!pending.channel->isConnected()) return true;
+
+	auto message = std::unique_ptr<Message>(pending.channel->receiveMessage(0u, 0u));
+
+	if (!message)
+	{
+		if (machine_tick_count() - pending.connected_at < _first_message_timeout_ms) return false;
+
+		SendToGame(std::move(pending.channel), 0);
+		return true;
+	}
+
+	switch (message->type())
+	{
+		case kREMOTE_HUB_REQUEST_MESSAGE:
+		{
+			auto inbox = std::make_shared<StandaloneHubInbox>();
+			inbox->game_key = static_cast<RemoteHubHostConnectMessage*>(message.get())->gameKey();
+
+			std::unique_ptr<RemoteHubHostConnectMessage> request(static_cast<RemoteHubHostConnectMessage*>(message.release()));
+			std::shared_ptr<CommunicationsChannel> gatherer(pending.channel.release());
+			_games.push_back({ inbox, std::thread(_run_game, gatherer, std::move(request), inbox) });
+			logNote("new game on the hub (key %u, %d running)", inbox->game_key, static_cast<int>(_games.size()));
+			break;
+		}
+		case kREMOTE_HUB_JOIN_MESSAGE:
+			SendToGame(std::move(pending.channel), static_cast<RemoteHubJoinMessage*>(message.get())->value());
+			break;
+		case kSPECTATOR_REQUEST_MESSAGE:
+			SendToSpectate(std::move(pending.channel), *static_cast<SpectatorRequestMessage*>(message.get()));
+			break;
+		default:
+			logAnomaly("unexpected message type %i received by the hub lobby", message->type());
+			pending.channel->disconnect();
+			break;
+	}
+
+	return true;
+}
+
+// A key nobody has (a joiner that found the hub some other way than through the
+// metaserver, say) still finds the game if there's only the one
+StandaloneHubInbox* StandaloneHubServer::FindGame(uint32 game_key, bool in_progress)
+{
+	StandaloneHubInbox* only_game = nullptr;
+	int candidates = 0;
+
+	for (auto& game : _games)
+	{
+		auto inbox = game.inbox.get();
+		if (inbox->finished || (in_progress ? !inbox->in_progress : !inbox->accepting_joiners)) continue;
+
+		if (game_key && inbox->game_key == game_key) return inbox;
+
+		only_game = inbox;
+		candidates++;
+	}
+
+	return candidates == 1 ? only_game : nullptr;
+}
+
+void StandaloneHubServer::SendToGame(std::unique_ptr<CommunicationsChannel> channel, uint32 game_key)
+{
+	if (auto inbox = FindGame(game_key, false))
+	{
+		std::lock_guard<std::mutex> lock(inbox->mutex);
+		inbox->joiners.emplace_back(channel.release());
+	}
+	else
+	{
+		logNote("no game on the hub for a joiner asking for key %u", game_key);
+		channel->disconnect();
+	}
+}
+
+void StandaloneHubServer::SendToSpectate(std::unique_ptr<CommunicationsChannel> channel, SpectatorRequestMessage& request)
+{
+	auto inbox = request.version() == kNetworkSetupProtocolID ? FindGame(request.gameKey(), true) : nullptr;
+
+	if (inbox)
+	{
+		std::lock_guard<std::mutex> lock(inbox->mutex);
+		inbox->spectators.push_back(std::move(channel));
+	}
+	else
+	{
+		channel->enqueueOutgoingMessage(RemoteHubHostResponseMessage(false));
+		channel->pumpSendingSide();
+		channel->disconnect();
+	}
+}
+
+void StandaloneHubServer::ReapGames()
+{
+	for (auto it = _games.begin(); it != _games.end();)
+	{
+		if (it->inbox->finished)
+		{
+			it->thread.join();
+			it = _games.erase(it);
+		}
+		else ++it;
+	}
+}
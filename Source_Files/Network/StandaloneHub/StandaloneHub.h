@@ -22,46 +22,143 @@
 #include "MessageInflater.h"
 #include "network_messages.h"
 
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+
 #define STANDALONE_HUB_VERSION "01.01"
 
+class HubFilm;
+
+// What the lobby (StandaloneHubServer) and one game's thread share: the connections the lobby
+// has picked out for the game, and how far along the game is
+struct StandaloneHubInbox {
+	uint32 game_key = 0;
+	std::atomic<bool> accepting_joiners{ true }; // until the game starts
+	std::atomic<bool> in_progress{ false };
+	std::atomic<bool> finished{ false };
+
+	std::mutex mutex;
+	std::vector<std::shared_ptr<CommunicationsChannel>> joiners;
+	std::vector<std::unique_ptr<CommunicationsChannel>> spectators;
+};
+
+// One game on the hub; each runs on a thread of its own, so Instance() is that thread's game
 class StandaloneHub {
 private:
-	static StandaloneHub* _instance;
-	std::unique_ptr<CommunicationsChannelFactory> _server;
+	static thread_local StandaloneHub* _instance;
+	std::shared_ptr<StandaloneHubInbox> _inbox;
 	std::shared_ptr<CommunicationsChannel> _gatherer;
 	std::weak_ptr<CommunicationsChannel> _gatherer_client;
 	std::unique_ptr<TopologyMessage> _topology_message;
 	std::unique_ptr<LuaMessage> _lua_message;
 	std::unique_ptr<MapMessage> _map_message;
 	std::unique_ptr<PhysicsMessage> _physics_message;
-	int _port;
+	int32 _tick_count = 0;
 	bool _start_game_signal = false;
 	bool _end_game_signal = false;
 	bool _gatherer_joined_as_client = false;
 	bool _saved_game = false;
 	int _start_check_timeout_ms = 0;
 	static constexpr int _gathering_timeout_ms = 5 * 60 * 1000;
-	StandaloneHub(uint16 port);
+	static constexpr int _gathering_wait_ms = 100;
+
+	// Spectators connect like the gatherer does, but only once a game is under way; they're sent
+	// the game, then the confirmed action flags in batches, held back by the hub's spectator_delay.
+	// None of this touches the star protocol, so they can't hold up the players.
+	std::vector<std::unique_ptr<CommunicationsChannel>> _spectators;
+	std::vector<std::unique_ptr<UninflatedMessage>> _spectator_game_data; // map, physics and Lua, deflated once per level
+	int _spectator_player_count = 0;
+	std::vector<uint32> _spectator_held_flags; // confirmed, but not yet old enough to pass on
+	int32 _spectator_held_start_tick = 0;
+	std::vector<uint32> _spectator_recent_flags; // passed on since the history was last added to
+	int32 _spectator_recent_start_tick = 0;
+	std::vector<std::unique_ptr<UninflatedMessage>> _spectator_history; // everything before _spectator_recent_start_tick, for late joiners
+	std::vector<uint32> _spectator_taken_flags;
+	std::vector<uint8> _spectator_packed_flags;
+	static constexpr int _spectator_send_timeout_ms = 10 * 1000;
+
+	// with the hub's record_films on, every game is also written to a film, across level changes
+	// just as the players' own films are
+	std::unique_ptr<HubFilm> _film;
+
+	StandaloneHub(std::shared_ptr<CommunicationsChannel> gatherer, std::shared_ptr<StandaloneHubInbox> inbox);
 	~StandaloneHub();
 	bool GatherJoiners();
+	void DropUngatheredJoiners();
 	bool CheckGathererCapabilities(const Capabilities* capabilities);
+	UninflatedMessage* DeflateSpectatorFlags(int32 start_tick, const uint32* flags, size_t tick_count);
+	void SendGameToSpectator(CommunicationsChannel* channel);
 public:
 	bool GetGameDataFromGatherer();
 	bool SetupGathererGame(bool& gathering_done);
-	bool WaitForGatherer();
-	static bool Init(uint16 port);
+	bool AcceptGatherer(RemoteHubHostConnectMessage& request);
+	static bool Init(std::shared_ptr<CommunicationsChannel> gatherer, std::shared_ptr<StandaloneHubInbox> inbox);
 	static StandaloneHub* Instance() { return _instance; }
 	static bool Reset();
 	CommunicationsChannel* GetGathererChannel() const { return _gatherer ? _gatherer.get() : _gatherer_client.lock().get(); }
 	void SendMessageToGatherer(const Message& message);
 	void StartGame() { _start_game_signal = true; }
 	void SetGameEnded(bool game_ended) { _end_game_signal = game_ended; }
+	void SetTickCount(int32 tick_count) { _tick_count = tick_count; }
+	int32 GetTickCount() const { return _tick_count; }
 	bool HasGameEnded() const { return _end_game_signal; }
 	void SetSavedGame(bool saved_game) { _saved_game = saved_game; }
 	void GathererJoinedAsClient() { _gatherer_joined_as_client = true; }
 	int GetMapData(uint8** data);
 	int GetPhysicsData(uint8** data);
 	int GetLuaData(uint8** data);
+	void StartSpectating();
+	void CheckForSpectators();
+	void FeedSpectators(bool game_ended);
+	void StartRecording();
+	void StopRecording();
+};
+
+// The lobby: listens on the hub's port for everyone, and opens the UDP socket every game's
+// star protocol shares.  A gatherer gets a new game (and thread); joiners go to the game
+// whose key they ask for, spectators to the game they're watching.
+class StandaloneHubServer {
+public:
+	typedef std::function<void(std::shared_ptr<CommunicationsChannel>, std::unique_ptr<RemoteHubHostConnectMessage>, std::shared_ptr<StandaloneHubInbox>)> GameRunner;
+
+	StandaloneHubServer(uint16 port, GameRunner run_game);
+	~StandaloneHubServer();
+	bool Open();
+	void Run(uint32 timeout_ms);
+	size_t GameCount() const { return _games.size(); }
+
+private:
+	struct Pending {
+		std::unique_ptr<CommunicationsChannel> channel;
+		uint32 connected_at;
+	};
+
+	struct Game {
+		std::shared_ptr<StandaloneHubInbox> inbox;
+		std::thread thread;
+	};
+
+	uint16 _port;
+	GameRunner _run_game;
+	std::unique_ptr<CommunicationsChannelFactory> _server;
+	std::unique_ptr<MessageInflater> _inflater;
+	short _socket = 0;
+	bool _socket_open = false;
+	std::list<Pending> _pending;
+	std::list<Game> _games;
+
+	// joiners from before game keys never say anything until they're sent a hello
+	static constexpr int _first_message_timeout_ms = 2000;
+
+	void AcceptConnections();
+	bool Route(Pending& pending);
+	void SendToGame(std::unique_ptr<CommunicationsChannel> channel, uint32 game_key);
+	void SendToSpectate(std::unique_ptr<CommunicationsChannel> channel, SpectatorRequestMessage& request);
+	StandaloneHubInbox* FindGame(uint32 game_key, bool in_progress);
+	void ReapGames();
 };
 
 #endif
\ No newline at end of file
@@ -26,25 +26,30 @@
 #include "StandaloneHub.h"
 #include "wad.h"
 #include "game_wad.h"
+#include "tags.h"
+#include "player.h"
 #include <iostream>
 
-enum class StandaloneHubState
-{
-	_waiting_for_gatherer,
-	_game_in_progress,
-	_quit
-};
-
 extern DirectorySpecifier log_dir;
+extern DirectorySpecifier recordings_dir;
 
-static void initialize_hub(short port)
+// spectator_delay_seconds and max_spectators keep the defaults when negative
+static void initialize_hub(short port, int32 telemetry_seconds, bool record_films, int32 spectator_delay_seconds, int32 max_spectators)
 {
 	InitDefaultStringSets();
 	log_dir = get_data_path(kPathLogs);
+	recordings_dir = get_data_path(kPathRecordings);
+	recordings_dir.CreateDirectory();
 	network_preferences = new network_preferences_data;
 	network_preferences->game_port = port;
 	network_preferences->game_protocol = _network_game_protocol_star;
 	DefaultHubPreferences();
+	hub_set_telemetry_period(telemetry_seconds * TICKS_PER_SECOND);
+	hub_set_record_films(record_films);
+	if (spectator_delay_seconds >= 0)
+		hub_set_spectator_delay(spectator_delay_seconds * TICKS_PER_SECOND);
+	if (max_spectators >= 0)
+		hub_set_max_spectators(max_spectators);
 
 	if (SDLNet_Init() < 0)
 	{
@@ -63,10 +68,10 @@ static void shutdown_hub()
 	SDLNet_Quit();
 }
 
+// The hub doesn't run the game world, so all it wants from the map is whether it's a saved
+// game, and the tick count to pick the game up at if so
 static bool hub_init_game(void)
 {
-	initialize_map_for_new_game();
-
 	byte* wad = nullptr;
 	int wad_length = StandaloneHub::Instance()->GetMapData(&wad);
 	if (!wad) return false; //something is wrong
@@ -78,10 +83,15 @@ static bool hub_init_game(void)
 	auto wad_data = inflate_flat_data(wad_copy, &header);
 	if (!wad_data) { delete[] wad_copy; return false; }
 
-	bool saved_game = get_dynamic_data_from_wad(wad_data, dynamic_world) && get_player_data_from_wad(wad_data);
+	dynamic_data saved_world = {};
+	size_t player_data_length = 0;
+	bool saved_game = get_dynamic_data_from_wad(wad_data, &saved_world) &&
+		extract_type_from_wad(wad_data, PLAYER_STRUCTURE_TAG, &player_data_length) &&
+		player_data_length && player_data_length % SIZEOF_player_data == 0;
 	free_wad(wad_data);
 
 	StandaloneHub::Instance()->SetSavedGame(saved_game);
+	StandaloneHub::Instance()->SetTickCount(saved_game ? saved_world.tick_count : 0);
 
 	return true;
 }
@@ -93,100 +103,99 @@ static bool hub_game_in_progress(bool& game_is_done)
 	if (hub_is_active() && !StandaloneHub::Instance()->HasGameEnded())
 	{
 		NetProcessMessagesInGame();
+		StandaloneHub::Instance()->CheckForSpectators();
+		StandaloneHub::Instance()->FeedSpectators(false);
 		return true;
 	}
 
+	// nothing left to hide from the players, so spectators get the rest now
+	StandaloneHub::Instance()->FeedSpectators(true);
+
 	if (!NetUnSync()) return false; //should never happen
 
 	bool next_game = false;
 
 	if (StandaloneHub::Instance()->GetGameDataFromGatherer())
 	{
-		initialize_map_for_new_level();
 		next_game = NetChangeMap(nullptr) && NetSync(); //don't stop the server if it fails here
 	}
 
+	if (next_game) StandaloneHub::Instance()->StartSpectating();
+
 	if (!next_game)
 	{
+		StandaloneHub::Instance()->StopRecording();
 		game_is_done = true;
-		return StandaloneHub::Reset();
+		return true;
 	}
 
 	StandaloneHub::Instance()->SetGameEnded(false);
 	return true;
 }
 
-static bool hub_host_game(bool& game_has_started)
+static bool hub_host_game(RemoteHubHostConnectMessage& request, StandaloneHubInbox& inbox)
 {
-	game_has_started = false;
+	if (!StandaloneHub::Instance()->AcceptGatherer(request)) return false;
 
-	if (!StandaloneHub::Init(GAME_PORT))
-	{
-		logError("Error while trying to instantiate Aleph One remote hub");
-		return false;
-	}
-
-	if (!StandaloneHub::Instance()->WaitForGatherer()) return true;
-
-	if (!StandaloneHub::Instance()->GetGameDataFromGatherer() || !hub_init_game())
-	{
-		return StandaloneHub::Reset();
-	}
+	if (!StandaloneHub::Instance()->GetGameDataFromGatherer() || !hub_init_game()) return false;
 
 	bool gathering_done;
-	bool success = StandaloneHub::Instance()->SetupGathererGame(gathering_done);
-
-	if (!success)
+	if (!StandaloneHub::Instance()->SetupGathererGame(gathering_done) || !gathering_done)
 	{
-		logError("Error while trying to gather game on Aleph One remote hub");
+		logNote("hub game %u was never started", inbox.game_key);
 		return false;
 	}
 
-	if (!gathering_done) return true;
-
 	if (NetStart() && NetChangeMap(nullptr) && NetSync())
 	{
-		game_has_started = true;
+		StandaloneHub::Instance()->StartSpectating();
+		StandaloneHub::Instance()->StartRecording();
+		inbox.in_progress = true;
 		return true;
 	}
 
-	return StandaloneHub::Reset();
+	return false;
 }
 
-static void main_loop_hub()
+// Each game runs start to finish on a thread of its own
+static void run_hub_game(std::shared_ptr<CommunicationsChannel> gatherer, std::unique_ptr<RemoteHubHostConnectMessage> request, std::shared_ptr<StandaloneHubInbox> inbox)
 {
-	auto game_state = StandaloneHubState::_waiting_for_gatherer;
-
-	while (game_state != StandaloneHubState::_quit)
+	try
 	{
-		switch (game_state)
+		if (StandaloneHub::Init(gatherer, inbox) && hub_host_game(*request, *inbox))
 		{
-			case StandaloneHubState::_waiting_for_gatherer:
-				{
-					bool game_has_started;
+			bool game_is_done = false;
 
-					if (!hub_host_game(game_has_started))
-						game_state = StandaloneHubState::_quit;
-					else if (game_has_started)
-						game_state = StandaloneHubState::_game_in_progress;
+			while (!game_is_done && hub_game_in_progress(game_is_done))
+				sleep_for_machine_ticks(1);
+		}
+	}
+	catch (std::exception& e)
+	{
+		logError("hub game %u stopped: %s", inbox->game_key, e.what());
+	}
 
-					break;
-				}
+	if (StandaloneHub::Instance())
+		StandaloneHub::Reset();
 
-			case StandaloneHubState::_game_in_progress:
-				{
-					bool game_is_done;
+	inbox->accepting_joiners = false;
+	inbox->in_progress = false;
+	inbox->finished = true;
+}
 
-					if (!hub_game_in_progress(game_is_done))
-						game_state = StandaloneHubState::_quit;
-					else if (game_is_done)
-						game_state = StandaloneHubState::_waiting_for_gatherer;
+static void main_loop_hub()
+{
+	StandaloneHubServer server(GAME_PORT, run_hub_game);
 
-					break;
-				}
-		}
+	if (!server.Open())
+	{
+		logError("Error while trying to instantiate Aleph One remote hub");
+		return;
+	}
 
-		sleep_for_machine_ticks(1);
+	for (;;)
+	{
+		server.Run(100);
 	}
 }
 
@@ -210,10 +219,29 @@ static uint16_t parse_port(char* port_arg)
 	return port > UINT16_MAX ? 0 : port;
 }
 
+// a whole number, zero or more
+static bool parse_count(const char* arg, int32& count)
+{
+	std::string count_str = arg;
+	if (count_str.empty() || count_str.length() > 6) return false;
+
+	for (char c : count_str)
+	{
+		if (!isdigit(c)) return false;
+	}
+
+	count = std::atoi(arg);
+	return true;
+}
+
 int main(int argc, char** argv)
 {
 	auto code = 0;
 	short port = 0;
+	int32 telemetry_seconds = 0;
+	bool record_films = false;
+	int32 spectator_delay_seconds = -1;
+	int32 max_spectators = -1;
 
 	if (argc > 1)
 	{
@@ -226,10 +254,40 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	// --telemetry <seconds> writes each game's HubTelemetry to the log directory that often;
+	// --record-films writes a film of each game to the recordings directory;
+	// --spectator-delay <seconds> keeps spectators that far behind the game;
+	// --max-spectators <n> lets that many watch each game, and 0 turns spectating off
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--telemetry" && i + 1 < argc)
+		{
+			telemetry_seconds = std::atoi(argv[++i]);
+			if (telemetry_seconds > 0) continue;
+		}
+		else if (arg == "--record-films")
+		{
+			record_films = true;
+			continue;
+		}
+		else if (arg == "--spectator-delay" && i + 1 < argc)
+		{
+			if (parse_count(argv[++i], spectator_delay_seconds)) continue;
+		}
+		else if (arg == "--max-spectators" && i + 1 < argc)
+		{
+			if (parse_count(argv[++i], max_spectators)) continue;
+		}
+
+		printf("Invalid argument \"%s\" for network standalone hub", argv[i]);
+		return 1;
+	}
+
 	try {
 
 		// Initialize everything
-		initialize_hub(port);
+		initialize_hub(port, telemetry_seconds, record_films, spectator_delay_seconds, max_spectators);
 
 		// Run the main loop
 		main_loop_hub();
@@ -33,6 +33,7 @@
 #include "StarGameProtocol.h"
 
 #include "network_star.h"
+#include "network_private.h" // NET_GAME_STATE
 #include "TickBasedCircularQueue.h"
 #include "player.h" // GetRealActionQueues
 #include "interface.h" // process_action_flags (despite paf() being defined in vbl.*)
@@ -54,9 +55,9 @@ protected:
 };
 
 
-static WritableTickBasedActionQueue* sStarQueues[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
-static NetTopology*	sTopology = NULL;
-static short*		sNetStatePtr = NULL;
+static NET_GAME_STATE WritableTickBasedActionQueue* sStarQueues[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+static NET_GAME_STATE NetTopology*	sTopology = NULL;
+static NET_GAME_STATE short*		sNetStatePtr = NULL;
 
 #ifdef A1_NETWORK_STANDALONE_HUB
 static constexpr bool sHubIsLocal = true;
@@ -102,10 +103,15 @@ StarGameProtocol::Sync(NetTopology* inTopology, int32 inSmallestGameTick, int in
 
         for(int i = 0; i < sTopology->player_count; i++)
         {
+#ifdef A1_NETWORK_STANDALONE_HUB
+                // no spoke here, so nothing to feed the game world's queues (there's no game world either)
+                sStarQueues[i] = NULL;
+#else
                 if(sTopology->players[i].identifier == NONE)
                         sStarQueues[i] = NULL;
                 else
                         sStarQueues[i] = new LegacyActionQueueToTickBasedQueueAdapter<action_flags_t>(i);
+#endif
 
                 theConnectedPlayerStatus[i] = ((sTopology->players[i].identifier != NONE) && !sTopology->players[i].net_dead);
         }
@@ -121,7 +127,7 @@ StarGameProtocol::Sync(NetTopology* inTopology, int32 inSmallestGameTick, int in
                 for(int i = 0; i < sTopology->player_count; i++)
                         theAddresses[i] = (theConnectedPlayerStatus[i] ? &(sTopology->players[i].ddpAddress) : NULL);
 
-                hub_initialize(inSmallestGameTick, sTopology->player_count, theAddresses, inLocalPlayerIndex);
+                hub_initialize(inSmallestGameTick, sTopology->player_count, theAddresses, inLocalPlayerIndex, NetSessionIdentifier());
         }
 #ifndef A1_NETWORK_STANDALONE_HUB
 	else
@@ -129,7 +135,7 @@ StarGameProtocol::Sync(NetTopology* inTopology, int32 inSmallestGameTick, int in
 
 
         spoke_initialize(sTopology->server.ddpAddress, inSmallestGameTick, sTopology->player_count,
-                         sStarQueues, theConnectedPlayerStatus, inLocalPlayerIndex, sHubIsLocal);
+                         sStarQueues, theConnectedPlayerStatus, inLocalPlayerIndex, sHubIsLocal, NetHubCanPackFlags(), NetSessionIdentifier());
 #endif
 
         *sNetStatePtr = netActive;
@@ -135,11 +135,13 @@ clearly this is all broken until we have packet types
 #include "progress.h"
 #include "extensions.h"
 #include "player.h"
+#include <algorithm>
 #include <memory>
 #include <stdlib.h>
 #include <string.h>
 #include <map>
 #include <vector>
+#include <zlib.h>
 #include "Logging.h"
 
 // ZZZ: moved many struct definitions, constant #defines, etc. to header for (limited) sharing
@@ -157,6 +159,8 @@ clearly this is all broken until we have packet types
 
 #include "ConnectPool.h"
 
+#include "ActionFlagsCodec.h"
+
 #ifdef A1_NETWORK_STANDALONE_HUB
 #include "StandaloneHub.h"
 #endif
@@ -164,58 +168,69 @@ clearly this is all broken until we have packet types
 
 /* ---------- globals */
 
-static short ddpSocket; /* our ddp socket number */
+static NET_GAME_STATE short ddpSocket; /* our ddp socket number */
 
-static short localPlayerIndex;
-static short localPlayerIdentifier;
-static std::string gameSessionIdentifier;
-static NetTopologyPtr topology;
-static StarGameProtocol sCurrentGameProtocol;
+static NET_GAME_STATE short localPlayerIndex;
+static NET_GAME_STATE short localPlayerIdentifier;
+static NET_GAME_STATE std::string gameSessionIdentifier;
+static NET_GAME_STATE NetTopologyPtr topology;
+static NET_GAME_STATE StarGameProtocol sCurrentGameProtocol;
 
-static byte *deferred_script_data = NULL;
-static size_t deferred_script_length = 0;
-static bool do_netscript;
+static NET_GAME_STATE byte *deferred_script_data = NULL;
+static NET_GAME_STATE size_t deferred_script_length = 0;
+static NET_GAME_STATE bool do_netscript;
 
-static CommunicationsChannelFactory *server = NULL;
-static bool use_remote_hub = false;
-static byte* resumed_wad_data_for_remote_hub = NULL;
-static int resumed_wad_size_for_remote_hub = 0;
+static NET_GAME_STATE CommunicationsChannelFactory *server = NULL;
+static NET_GAME_STATE bool use_remote_hub = false;
+static NET_GAME_STATE byte* resumed_wad_data_for_remote_hub = NULL;
+static NET_GAME_STATE int resumed_wad_size_for_remote_hub = 0;
 typedef std::map<int, Client *> client_map_t;
-static client_map_t connections_to_clients;
+static NET_GAME_STATE client_map_t connections_to_clients;
 typedef std::map<int, ClientChatInfo *> client_chat_info_map_t;
-static client_chat_info_map_t client_chat_info;
-static std::unique_ptr<CommunicationsChannel> connection_to_server = NULL;
-static NonblockingConnect *server_nbc = 0;
-static bool nbc_is_resolving = false;
-static int next_stream_id = 1; // 0 is local player
-static IPaddress host_address;
-static bool host_address_specified = false;
-static MessageInflater *inflater = NULL;
-static MessageDispatcher *joinDispatcher = NULL;
-static uint32 next_join_attempt;
-static Capabilities my_capabilities;
-static std::shared_ptr<Pinger> pinger = nullptr; //multithread safety
-static GatherCallbacks *gatherCallbacks = NULL;
-static ChatCallbacks *chatCallbacks = NULL;
+static NET_GAME_STATE client_chat_info_map_t client_chat_info;
+static NET_GAME_STATE std::unique_ptr<CommunicationsChannel> connection_to_server = NULL;
+static NET_GAME_STATE NonblockingConnect *server_nbc = 0;
+static NET_GAME_STATE bool nbc_is_resolving = false;
+static NET_GAME_STATE int next_stream_id = 1; // 0 is local player
+static NET_GAME_STATE IPaddress host_address;
+static NET_GAME_STATE bool host_address_specified = false;
+static NET_GAME_STATE uint32 join_game_key = 0; // which of a standalone hub's games we're joining, if we know
+
+// watching a standalone hub's game (see NetSpectate()): the hub's flags not yet
+// handed to the replay, and the tick the next batch has to start at
+static NET_GAME_STATE bool spectating = false;
+static NET_GAME_STATE bool spectator_level_over = false;
+static NET_GAME_STATE std::vector<uint32> spectator_flags;
+static NET_GAME_STATE size_t spectator_flags_read = 0;
+static NET_GAME_STATE int32 spectator_next_tick = 0;
+static NET_GAME_STATE MessageInflater *inflater = NULL;
+static NET_GAME_STATE MessageDispatcher *joinDispatcher = NULL;
+static NET_GAME_STATE MessageDispatcher *spectatorDispatcher = NULL;
+static NET_GAME_STATE uint32 next_join_attempt;
+static NET_GAME_STATE Capabilities my_capabilities;
+static NET_GAME_STATE Capabilities hub_capabilities; // the gatherer's, or the remote hub's
+static NET_GAME_STATE std::shared_ptr<Pinger> pinger = nullptr; //multithread safety
+static NET_GAME_STATE GatherCallbacks *gatherCallbacks = NULL;
+static NET_GAME_STATE ChatCallbacks *chatCallbacks = NULL;
 
 #ifdef HAVE_MINIUPNPC
-static std::unique_ptr<PortForward> port_forward;
+static NET_GAME_STATE std::unique_ptr<PortForward> port_forward;
 #endif
 
 extern MetaserverClient* gMetaserverClient;
 
-static std::vector<NetworkStats> sNetworkStats;
+static NET_GAME_STATE std::vector<NetworkStats> sNetworkStats;
 const static NetworkStats sInvalidStats = {
 	NetworkStats::invalid,
 	NetworkStats::invalid,
 	NetworkStats::invalid,
 	0
 };
-uint32 last_network_stats_send = 0;
+static NET_GAME_STATE uint32 last_network_stats_send = 0;
 const static int network_stats_send_period = MACHINE_TICKS_PER_SECOND;
 
 // ignore list
-static std::set<int> sIgnoredPlayers;
+static NET_GAME_STATE std::set<int> sIgnoredPlayers;
 
 static bool player_is_ignored(int player_index)
 {
@@ -267,13 +282,13 @@ struct ignore_lua
 // to pack and unpack their own distribution data - we can't be expected to know what they're doing.
 
 // ZZZ note: read this externally with the NetState() function.
-static short netState= netUninitialized;
+static NET_GAME_STATE short netState= netUninitialized;
 
 // ZZZ: are we trying to start a new game or resume a saved-game?
 // This is only valid on the gatherer after NetGather() is called;
 // only valid on a joiner once he receives the final topology (tagRESUME_GAME)
 // Used, at least, on the gatherer to determine whether or not to resort players by address
-static bool resuming_saved_game = false;
+static NET_GAME_STATE bool resuming_saved_game = false;
 
 
 /* ---------- private prototypes */
@@ -318,6 +333,8 @@ Client::Client(std::shared_ptr<CommunicationsChannel> inChannel) : channel(inCha
 	mChangeColorsMessageHandler.reset(newMessageHandlerMethod(this, &Client::handleChangeColorsMessage));
 	mRemoteHubCommandMessageHandler.reset(newMessageHandlerMethod(this, &Client::handleRemoteHubCommandMessage));
 	mRemoteHubHostRequestMessageHandler.reset(newMessageHandlerMethod(this, &Client::handleRemoteHubHostConnectMessage));
+	mPayloadCacheMessageHandler.reset(newMessageHandlerMethod(this, &Client::handlePayloadCacheMessage));
+	mRemoteHubJoinMessageHandler.reset(newMessageHandlerMethod(this, &Client::handleRemoteHubJoinMessage));
 	mUnexpectedMessageHandler.reset(newMessageHandlerMethod(this, &Client::unexpectedMessageHandler));
 	mDispatcher->setDefaultHandler(mUnexpectedMessageHandler.get());
 	mDispatcher->setHandlerForType(mJoinerInfoMessageHandler.get(), JoinerInfoMessage::kType);
@@ -327,6 +344,8 @@ Client::Client(std::shared_ptr<CommunicationsChannel> inChannel) : channel(inCha
 	mDispatcher->setHandlerForType(mChangeColorsMessageHandler.get(), ChangeColorsMessage::kType);
 	mDispatcher->setHandlerForType(mRemoteHubCommandMessageHandler.get(), RemoteHubCommandMessage::kType);
 	mDispatcher->setHandlerForType(mRemoteHubHostRequestMessageHandler.get(), RemoteHubHostConnectMessage::kType);
+	mDispatcher->setHandlerForType(mPayloadCacheMessageHandler.get(), PayloadCacheMessage::kType);
+	mDispatcher->setHandlerForType(mRemoteHubJoinMessageHandler.get(), RemoteHubJoinMessage::kType);
 	channel->setMessageHandler(mDispatcher.get());
 }
 
@@ -684,6 +703,22 @@ void Client::handleChangeColorsMessage(ChangeColorsMessage *changeColorsMessage,
 	}
 }
 
+void Client::handlePayloadCacheMessage(PayloadCacheMessage* payloadCacheMessage, CommunicationsChannel*)
+{
+	if (state == _ingame || state == _disconnect) {
+		logAnomaly("unexpected payload cache message received (state is %i)", state);
+		return;
+	}
+
+	cached_payloads.clear();
+	cached_payloads.insert(payloadCacheMessage->keys().begin(), payloadCacheMessage->keys().end());
+}
+
+void Client::handleRemoteHubJoinMessage(RemoteHubJoinMessage*, CommunicationsChannel*)
+{
+	// only a standalone hub's lobby cares which game a joiner is after, and it's read it already
+}
+
 void Client::handleRemoteHubHostConnectMessage(RemoteHubHostConnectMessage* message, CommunicationsChannel* channel)
 {
 	channel->enqueueOutgoingMessage(RemoteHubHostResponseMessage(false)); // we already have a gatherer using us (the remote hub)
@@ -711,7 +746,7 @@ void Client::handleRemoteHubCommandMessage(RemoteHubCommandMessage* message, Com
 				StandaloneHub::Instance()->StartGame();
 				break;
 			case RemoteHubCommand::kEndGame_Command:
-				dynamic_world->tick_count = message->data();
+				StandaloneHub::Instance()->SetTickCount(message->data());
 				StandaloneHub::Instance()->SetGameEnded(true);
 				break;
 			default:
@@ -783,7 +818,7 @@ void Client::unexpectedMessageHandler(Message *message, CommunicationsChannel *)
 	logAnomaly("unexpected message type %i received (net state)", message->type(), netState);
 }
 
-static short handlerState;
+static NET_GAME_STATE short handlerState;
 
 static void handleHelloMessage(HelloMessage* helloMessage, CommunicationsChannel*)
 {
@@ -826,6 +861,15 @@ static void handleCapabilitiesMessage(CapabilitiesMessage* capabilitiesMessage,
 			// everything else is version 1
 			CapabilitiesMessage capabilitiesMessageReply(my_capabilities);
 			connection_to_server->enqueueOutgoingMessage(capabilitiesMessageReply);
+
+			// a standalone hub passes on the gatherer's, but with its own idea of the star protocol
+			hub_capabilities = capabilities;
+
+			if (capabilities[Capabilities::kPayloadStream] >= Capabilities::kPayloadStreamVersion)
+			{
+				PayloadCacheMessage payloadCacheMessage(PayloadCache::instance()->Keys());
+				connection_to_server->enqueueOutgoingMessage(payloadCacheMessage);
+			}
 		}
 		
 	} else {
@@ -910,8 +954,8 @@ static void handleJoinPlayerMessage(JoinPlayerMessage* joinPlayerMessage, Commun
   }
 }
 
-static byte *handlerLuaBuffer = NULL;
-static size_t handlerLuaLength = 0;
+static NET_GAME_STATE byte *handlerLuaBuffer = NULL;
+static NET_GAME_STATE size_t handlerLuaLength = 0;
 
 static void handleLuaMessage(BigChunkOfDataMessage *luaMessage, CommunicationsChannel *) {
   if (netState == netStartingUp || netState == netDown) {
@@ -929,8 +973,8 @@ static void handleLuaMessage(BigChunkOfDataMessage *luaMessage, CommunicationsCh
   }
 }
 
-static byte *handlerMapBuffer = NULL;
-static size_t handlerMapLength = 0;
+static NET_GAME_STATE byte *handlerMapBuffer = NULL;
+static NET_GAME_STATE size_t handlerMapLength = 0;
 
 static void handleMapMessage(BigChunkOfDataMessage *mapMessage, CommunicationsChannel *) {
 	if (netState == netStartingUp || netState == netDown) {
@@ -991,8 +1035,8 @@ static void handleNetworkStatsMessage(NetworkStatsMessage *statsMessage, Communi
 	}
 }
 
-static byte *handlerPhysicsBuffer = NULL;
-static size_t handlerPhysicsLength = 0;
+static NET_GAME_STATE byte *handlerPhysicsBuffer = NULL;
+static NET_GAME_STATE size_t handlerPhysicsLength = 0;
 
 static void handlePhysicsMessage(BigChunkOfDataMessage *physicsMessage, CommunicationsChannel *) {
 	if (netState == netStartingUp || netState == netDown) {
@@ -1010,6 +1054,136 @@ static void handlePhysicsMessage(BigChunkOfDataMessage *physicsMessage, Communic
 	}
 }
 
+// replaces whatever the server sent last for this kind of payload; takes
+// ownership of buffer
+static void set_handler_payload(int16 kind, byte *buffer, size_t length) {
+	byte **handlerBuffer;
+	size_t *handlerLength;
+	switch (kind) {
+	case kPayloadMap:
+		handlerBuffer = &handlerMapBuffer;
+		handlerLength = &handlerMapLength;
+		break;
+	case kPayloadPhysics:
+		handlerBuffer = &handlerPhysicsBuffer;
+		handlerLength = &handlerPhysicsLength;
+		break;
+	case kPayloadLua:
+		handlerBuffer = &handlerLuaBuffer;
+		handlerLength = &handlerLuaLength;
+		break;
+	default:
+		delete[] buffer;
+		return;
+	}
+
+	delete[] *handlerBuffer;
+	*handlerBuffer = length ? buffer : NULL;
+	*handlerLength = length;
+	if (!length) {
+		delete[] buffer;
+	}
+}
+
+// a payload being inflated as its chunks arrive
+struct incoming_payload {
+	bool active;
+	PayloadKey key;
+	z_stream stream;
+	byte *buffer;
+};
+
+static NET_GAME_STATE incoming_payload incomingPayloads[NUMBER_OF_PAYLOAD_KINDS];
+static NET_GAME_STATE bool handlerPayloadFailed = false;
+
+static void reset_incoming_payload(incoming_payload& payload) {
+	if (payload.active) {
+		inflateEnd(&payload.stream);
+		delete[] payload.buffer;
+		payload.buffer = NULL;
+		payload.active = false;
+	}
+}
+
+static void handlePayloadChunkMessage(PayloadChunkMessage *chunkMessage, CommunicationsChannel *) {
+	if (!(netState == netStartingUp || netState == netDown)) {
+		logAnomaly("unexpected payload chunk message received (netState is %i)", netState);
+		return;
+	}
+
+	int16 kind = chunkMessage->kind();
+	if (kind < 0 || kind >= NUMBER_OF_PAYLOAD_KINDS) {
+		logAnomaly("payload chunk of unknown kind %i received", kind);
+		return;
+	}
+
+	incoming_payload& payload = incomingPayloads[kind];
+	if (payload.active && !(payload.key == chunkMessage->key())) {
+		// assume the last payload the server started sending is right
+		reset_incoming_payload(payload);
+	}
+
+	if (!payload.active) {
+		obj_clear(payload.stream);
+		if (inflateInit(&payload.stream) != Z_OK) {
+			logWarning("could not start inflating payload");
+			handlerPayloadFailed = true;
+			return;
+		}
+		payload.active = true;
+		payload.key = chunkMessage->key();
+		payload.buffer = new byte[std::max<uint32>(payload.key.length, 1)];
+		payload.stream.next_out = payload.buffer;
+		payload.stream.avail_out = std::max<uint32>(payload.key.length, 1);
+	}
+
+	payload.stream.next_in = const_cast<byte *>(chunkMessage->buffer());
+	payload.stream.avail_in = chunkMessage->length();
+	int ret = inflate(&payload.stream, Z_NO_FLUSH);
+	if (ret != Z_OK && ret != Z_STREAM_END && !(ret == Z_BUF_ERROR && chunkMessage->length() == 0)) {
+		logWarning("Error decompressing payload chunk; result is %i", ret);
+		reset_incoming_payload(payload);
+		handlerPayloadFailed = true;
+		return;
+	}
+
+	if (chunkMessage->last()) {
+		if (ret == Z_STREAM_END &&
+		    payload.stream.total_out == payload.key.length &&
+		    PayloadKey::Of(payload.buffer, payload.key.length) == payload.key) {
+			PayloadCache::instance()->Store(payload.key, payload.buffer, payload.key.length);
+			set_handler_payload(kind, payload.buffer, payload.key.length);
+			payload.buffer = NULL;
+		} else {
+			logWarning("streamed payload is incomplete or does not match");
+			handlerPayloadFailed = true;
+		}
+		reset_incoming_payload(payload);
+	}
+}
+
+static void handleCachedPayloadMessage(CachedPayloadMessage *cachedMessage, CommunicationsChannel *) {
+	if (!(netState == netStartingUp || netState == netDown)) {
+		logAnomaly("unexpected cached payload message received (netState is %i)", netState);
+		return;
+	}
+
+	int16 kind = cachedMessage->kind();
+	if (kind < 0 || kind >= NUMBER_OF_PAYLOAD_KINDS) {
+		logAnomaly("cached payload of unknown kind %i requested", kind);
+		return;
+	}
+
+	std::vector<byte> data;
+	if (PayloadCache::instance()->Load(cachedMessage->key(), data)) {
+		byte *buffer = new byte[std::max<size_t>(data.size(), 1)];
+		std::copy(data.begin(), data.end(), buffer);
+		set_handler_payload(kind, buffer, data.size());
+	} else {
+		handlerPayloadFailed = true;
+	}
+}
+
 static void handleServerWarningMessage(ServerWarningMessage *serverWarningMessage, CommunicationsChannel *) {
   char *s = strdup(serverWarningMessage->string()->c_str());
   alert_user(s);
@@ -1117,13 +1291,62 @@ static void handleUnexpectedMessage(Message *inMessage, CommunicationsChannel *)
   }
   logAnomaly("unexpected message ID %i received", inMessage->type());
 }
-    
+
+// a remote hub tells the gatherer what it can do once it's accepted the game (older ones don't)
+static void handleRemoteHubCapabilitiesMessage(CapabilitiesMessage* capabilitiesMessage, CommunicationsChannel *) {
+	if (capabilitiesMessage) {
+		hub_capabilities = *capabilitiesMessage->capabilities();
+	}
+}
+
+static void handleSpectatorTopologyMessage(TopologyMessage* topologyMessage, CommunicationsChannel *) {
+	// the hub has moved on to the next level; everything after this is for that
+	// level, so it stays queued until the replay gets there too
+	*topology = *(topologyMessage->topology());
+	spectator_level_over = true;
+	spectator_next_tick = 0;
+}
+
+static void handleSpectatorFlagsMessage(SpectatorFlagsMessage* flagsMessage, CommunicationsChannel *channel) {
+	if (flagsMessage->playerCount() != topology->player_count) {
+		logError("spectator flags are for %i players, not %i", flagsMessage->playerCount(), topology->player_count);
+		channel->disconnect();
+		return;
+	}
+
+	std::vector<uint32> flags;
+	try {
+		AIStreamBE inputStream(flagsMessage->buffer(), flagsMessage->length());
+		while (inputStream.tellg() < inputStream.maxg())
+			unpack_action_flags(inputStream, flags);
+	} catch (const AStream::failure&) {
+		logError("spectator flags message is truncated");
+		channel->disconnect();
+		return;
+	}
+
+	const int32 player_count = topology->player_count;
+	const int32 tick_count = flags.size() / player_count;
+	if (flagsMessage->startTick() > spectator_next_tick) {
+		logError("spectator flags skip from tick %i to %i", spectator_next_tick, flagsMessage->startTick());
+		channel->disconnect();
+		return;
+	}
+
+	// a batch we've partly seen already (the hub's history overlapping its live feed)
+	const int32 seen_ticks = std::min(spectator_next_tick - flagsMessage->startTick(), tick_count);
+	spectator_flags.insert(spectator_flags.end(), flags.begin() + seen_ticks * player_count, flags.begin() + tick_count * player_count);
+	spectator_next_tick = std::max(spectator_next_tick, flagsMessage->startTick() + tick_count);
+}
+
 static TypedMessageHandlerFunction<HelloMessage> helloMessageHandler(&handleHelloMessage);
 static TypedMessageHandlerFunction<JoinPlayerMessage> joinPlayerMessageHandler(&handleJoinPlayerMessage);
 static TypedMessageHandlerFunction<BigChunkOfDataMessage> luaMessageHandler(&handleLuaMessage);
 static TypedMessageHandlerFunction<BigChunkOfDataMessage> mapMessageHandler(&handleMapMessage);
 static TypedMessageHandlerFunction<NetworkChatMessage> networkChatMessageHandler(&handleNetworkChatMessage);
 static TypedMessageHandlerFunction<BigChunkOfDataMessage> physicsMessageHandler(&handlePhysicsMessage);
+static TypedMessageHandlerFunction<PayloadChunkMessage> payloadChunkMessageHandler(&handlePayloadChunkMessage);
+static TypedMessageHandlerFunction<CachedPayloadMessage> cachedPayloadMessageHandler(&handleCachedPayloadMessage);
 static TypedMessageHandlerFunction<CapabilitiesMessage> capabilitiesMessageHandler(&handleCapabilitiesMessage);
 static TypedMessageHandlerFunction<TopologyMessage> topologyMessageHandler(&handleTopologyMessage);
 static TypedMessageHandlerFunction<ServerWarningMessage> serverWarningMessageHandler(&handleServerWarningMessage);
@@ -1133,6 +1356,9 @@ static TypedMessageHandlerFunction<GameSessionMessage> gameSessionMessageHandler
 static TypedMessageHandlerFunction<AcceptJoinMessage> acceptJoinMessageHandler(&handleAcceptJoinMessage);
 static TypedMessageHandlerFunction<JoinerInfoMessage> joinerInfoMessageHandler(&handleJoinerInfoMessage);
 static TypedMessageHandlerFunction<Message> unexpectedMessageHandler(&handleUnexpectedMessage);
+static TypedMessageHandlerFunction<CapabilitiesMessage> remoteHubCapabilitiesMessageHandler(&handleRemoteHubCapabilitiesMessage);
+static TypedMessageHandlerFunction<TopologyMessage> spectatorTopologyMessageHandler(&handleSpectatorTopologyMessage);
+static TypedMessageHandlerFunction<SpectatorFlagsMessage> spectatorFlagsMessageHandler(&handleSpectatorFlagsMessage);
 
 void NetSetGatherCallbacks(GatherCallbacks *gc) {
   gatherCallbacks = gc;
@@ -1208,12 +1434,14 @@ bool NetEnter(bool use_remote_hub)
   
 	assert(netState==netUninitialized);
   
+#ifndef A1_NETWORK_STANDALONE_HUB // (where each game's thread calls NetExit() itself)
 	{
 		static bool added_exit_procedure= false;
     
 		if (!added_exit_procedure) atexit(NetExit);
 		added_exit_procedure= true;
 	}
+#endif
     
 	topology = (NetTopologyPtr)malloc(sizeof(NetTopology));
 	assert(topology);
@@ -1222,7 +1450,12 @@ bool NetEnter(bool use_remote_hub)
 	// ZZZ: Sorry, if this swapping is not supported on all current A1
 	// platforms, feel free to rewrite it in a way that is.
 	ddpSocket = SDL_SwapBE16(GAME_PORT);
+#ifdef A1_NETWORK_STANDALONE_HUB
+	// the standalone hub's games share one socket, which StandaloneHubServer opens
+	OSErr error = noErr;
+#else
 	auto error = NetDDPOpenSocket(&ddpSocket, NetDDPPacketHandler);
+#endif
 	if (!error) {
 		sCurrentGameProtocol.Enter(&netState);
 		netState = netDown;
@@ -1263,6 +1496,12 @@ bool NetEnter(bool use_remote_hub)
 		inflater->learnPrototype(RemoteHubReadyMessage());
 		inflater->learnPrototype(RemoteHubHostResponseMessage());
 		inflater->learnPrototype(RemoteHubHostConnectMessage());
+		inflater->learnPrototype(PayloadCacheMessage());
+		inflater->learnPrototype(PayloadChunkMessage());
+		inflater->learnPrototype(CachedPayloadMessage());
+		inflater->learnPrototype(SpectatorRequestMessage());
+		inflater->learnPrototype(SpectatorFlagsMessage());
+		inflater->learnPrototype(RemoteHubJoinMessage());
 	}
   
 	if (!joinDispatcher) {
@@ -1278,6 +1517,8 @@ bool NetEnter(bool use_remote_hub)
 		joinDispatcher->setHandlerForType(&networkChatMessageHandler, NetworkChatMessage::kType);
 		joinDispatcher->setHandlerForType(&physicsMessageHandler, PhysicsMessage::kType);
 		joinDispatcher->setHandlerForType(&physicsMessageHandler, ZippedPhysicsMessage::kType);
+		joinDispatcher->setHandlerForType(&payloadChunkMessageHandler, PayloadChunkMessage::kType);
+		joinDispatcher->setHandlerForType(&cachedPayloadMessageHandler, CachedPayloadMessage::kType);
 		joinDispatcher->setHandlerForType(&capabilitiesMessageHandler, CapabilitiesMessage::kType);
 		joinDispatcher->setHandlerForType(&serverWarningMessageHandler, ServerWarningMessage::kType);
 		joinDispatcher->setHandlerForType(&clientInfoMessageHandler, ClientInfoMessage::kType);
@@ -1288,7 +1529,23 @@ bool NetEnter(bool use_remote_hub)
 		joinDispatcher->setHandlerForType(&joinerInfoMessageHandler, JoinerInfoMessage::kType);
 	}
 
+	if (!spectatorDispatcher) {
+		spectatorDispatcher = new MessageDispatcher();
+		spectatorDispatcher->setDefaultHandler(&unexpectedMessageHandler);
+		spectatorDispatcher->setHandlerForType(&luaMessageHandler, LuaMessage::kType);
+		spectatorDispatcher->setHandlerForType(&luaMessageHandler, ZippedLuaMessage::kType);
+		spectatorDispatcher->setHandlerForType(&mapMessageHandler, MapMessage::kType);
+		spectatorDispatcher->setHandlerForType(&mapMessageHandler, ZippedMapMessage::kType);
+		spectatorDispatcher->setHandlerForType(&physicsMessageHandler, PhysicsMessage::kType);
+		spectatorDispatcher->setHandlerForType(&physicsMessageHandler, ZippedPhysicsMessage::kType);
+		spectatorDispatcher->setHandlerForType(&payloadChunkMessageHandler, PayloadChunkMessage::kType);
+		spectatorDispatcher->setHandlerForType(&cachedPayloadMessageHandler, CachedPayloadMessage::kType);
+		spectatorDispatcher->setHandlerForType(&spectatorTopologyMessageHandler, TopologyMessage::kType);
+		spectatorDispatcher->setHandlerForType(&spectatorFlagsMessageHandler, SpectatorFlagsMessage::kType);
+	}
+
 	my_capabilities.clear();
+	hub_capabilities.clear();
 	my_capabilities[Capabilities::kGameworld] = Capabilities::kGameworldVersion;
 	my_capabilities[Capabilities::kGameworldM1] = Capabilities::kGameworldM1Version;
 	if (network_preferences->game_protocol == _network_game_protocol_star) {
@@ -1299,9 +1556,12 @@ bool NetEnter(bool use_remote_hub)
 	my_capabilities[Capabilities::kZippedData] = Capabilities::kZippedDataVersion;
 	my_capabilities[Capabilities::kNetworkStats] = Capabilities::kNetworkStatsVersion;
 	my_capabilities[Capabilities::kRugby] = Capabilities::kRugbyVersion;
+	my_capabilities[Capabilities::kPayloadStream] = Capabilities::kPayloadStreamVersion;
+	my_capabilities[Capabilities::kCompactFlags] = Capabilities::kCompactFlagsVersion;
 
 	// net commands!
 	sIgnoredPlayers.clear();
+#ifndef A1_NETWORK_STANDALONE_HUB
 	CommandParser IgnoreParser;
 	IgnoreParser.register_command("player", ignore_player());
 
@@ -1309,6 +1569,7 @@ bool NetEnter(bool use_remote_hub)
 	IgnoreParser.register_command("lua", ignore_lua());
 
 	Console::instance()->register_command("ignore", IgnoreParser);
+#endif
 
 	next_join_attempt = last_network_stats_send = machine_tick_count();
   
@@ -1328,6 +1589,11 @@ void NetSetDefaultInflater(CommunicationsChannel* channel)
 	channel->setMessageInflater(inflater);
 }
 
+void NetSendTopology(CommunicationsChannel* channel)
+{
+	channel->enqueueOutgoingMessage(TopologyMessage(topology));
+}
+
 void NetDoneGathering(void)
 {
 	if (server) {
@@ -1347,7 +1613,9 @@ void NetExit(
 	myTMCleanup();
   
 	if (netState!=netUninitialized) {
+#ifndef A1_NETWORK_STANDALONE_HUB
 		error= NetDDPCloseSocket(ddpSocket);
+#endif
 		if (!error) {
 			free(topology);
 			topology= NULL;
@@ -1359,6 +1627,10 @@ void NetExit(
   
 	connection_to_server.reset();
 
+	spectating = false;
+	spectator_flags.clear();
+	spectator_flags_read = 0;
+
 	if (server_nbc) {
 		ConnectPool::instance()->abandon(server_nbc);
 		server_nbc = 0;
@@ -1385,17 +1657,38 @@ void NetExit(
 		server = NULL;
 	}
 
+#ifdef A1_NETWORK_STANDALONE_HUB
+	// this thread's game is over, and the next one gets a thread of its own
+	delete joinDispatcher;
+	joinDispatcher = NULL;
+	delete spectatorDispatcher;
+	spectatorDispatcher = NULL;
+	delete inflater;
+	inflater = NULL;
+#else
 	delete gMetaserverClient;
 	gMetaserverClient = new MetaserverClient();
 	
 	Console::instance()->unregister_command("ignore");
+#endif
+
+}
 
+// The standalone hub doesn't run the game world (and hosts several games at once),
+// so each of its games keeps its own tick count
+static int32 game_tick_count()
+{
+#ifdef A1_NETWORK_STANDALONE_HUB
+	return StandaloneHub::Instance()->GetTickCount();
+#else
+	return dynamic_world->tick_count;
+#endif
 }
 
 bool
 NetSync()
 {
-	return sCurrentGameProtocol.Sync(topology, dynamic_world->tick_count, localPlayerIndex, local_is_server());
+	return sCurrentGameProtocol.Sync(topology, game_tick_count(), localPlayerIndex, local_is_server());
 }
 
 
@@ -1405,10 +1698,10 @@ NetUnSync()
 {
 	if (use_remote_hub)
 	{
-		NetRemoteHubSendCommand(RemoteHubCommand::kEndGame_Command, dynamic_world->tick_count);
+		NetRemoteHubSendCommand(RemoteHubCommand::kEndGame_Command, game_tick_count());
 	}
 
-	return sCurrentGameProtocol.UnSync(true, dynamic_world->tick_count);
+	return sCurrentGameProtocol.UnSync(true, game_tick_count());
 }
 
 std::weak_ptr<Pinger>
@@ -1497,12 +1790,13 @@ bool NetGather(
 
 	netState = netGathering;
 
-	// Start listening for joiners
+	// Start listening for joiners (the standalone hub listens for all of its games at once,
+	// and hands each its own)
 	if (!use_remote_hub)
 	{
+#ifndef A1_NETWORK_STANDALONE_HUB
 		server = new CommunicationsChannelFactory(GAME_PORT);
 
-#ifndef A1_NETWORK_STANDALONE_HUB
 		client_chat_info[0] = new ClientChatInfo;
 		client_chat_info[0]->name = player_preferences->name;
 		client_chat_info[0]->color = player_preferences->color;
@@ -1521,8 +1815,11 @@ bool NetConnectRemoteHub(const IPaddress& remote_hub_address)
 	if (!connection_to_server->isConnected()) return false;
 
 	NetSetDefaultInflater(connection_to_server.get());
+	connection_to_server->setMessageHandler(&remoteHubCapabilitiesMessageHandler);
 
-	connection_to_server->enqueueOutgoingMessage(RemoteHubHostConnectMessage(kNetworkSetupProtocolID));
+	// joiners find our game on the hub by our metaserver player id, as the metaserver lists it
+	uint32 game_key = gMetaserverClient && gMetaserverClient->isConnected() ? gMetaserverClient->playerID() : 0;
+	connection_to_server->enqueueOutgoingMessage(RemoteHubHostConnectMessage(kNetworkSetupProtocolID, game_key));
 	connection_to_server->enqueueOutgoingMessage(CapabilitiesMessage(my_capabilities));
 
 	auto response_message = std::unique_ptr<RemoteHubHostResponseMessage>(connection_to_server->receiveSpecificMessage<RemoteHubHostResponseMessage>(3000u, 3000u));
@@ -1581,6 +1878,11 @@ void NetCancelGather(
 	NetDistributeTopology(tagCANCEL_GAME);
 }
 
+bool NetHubCanPackFlags()
+{
+	return hub_capabilities[Capabilities::kCompactFlags] >= Capabilities::kCompactFlagsVersion;
+}
+
 void NetSetCapabilities(const Capabilities* capabilities)
 {
 	my_capabilities = *capabilities;
@@ -1607,6 +1909,11 @@ bool NetStart(
 	return true;
 }
 
+void NetSetJoinGameKey(uint32 key)
+{
+	join_game_key = key;
+}
+
 bool NetGameJoin(
 	void *player_data,
 	short player_data_size,
@@ -1648,6 +1955,98 @@ bool NetGameJoin(
     return true;
 }
 
+bool NetSpectate(const char* hub_address_string, uint32 game_key)
+{
+	uint16 port = DEFAULT_GAME_PORT;
+	std::string host_str = hub_address_string;
+	std::string::size_type pos = host_str.rfind(':');
+	if (pos != std::string::npos)
+	{
+		port = atoi(host_str.substr(pos + 1).c_str());
+		host_str = host_str.substr(0, pos);
+	}
+
+	IPaddress hub_address;
+	if (SDLNet_ResolveHost(&hub_address, host_str.c_str(), port) != 0)
+	{
+		alert_user(infoError, strNETWORK_ERRORS, netErrCouldntResolve, 0);
+		return false;
+	}
+
+	connection_to_server = std::make_unique<CommunicationsChannel>();
+	connection_to_server->connect(hub_address);
+	if (!connection_to_server->isConnected())
+	{
+		alert_user(infoError, strNETWORK_ERRORS, netErrCouldntJoin, 0);
+		return false;
+	}
+
+	NetSetDefaultInflater(connection_to_server.get());
+	connection_to_server->enqueueOutgoingMessage(SpectatorRequestMessage(kNetworkSetupProtocolID, game_key));
+
+	auto response_message = std::unique_ptr<RemoteHubHostResponseMessage>(connection_to_server->receiveSpecificMessage<RemoteHubHostResponseMessage>(3000u, 3000u));
+	auto topology_message = std::unique_ptr<TopologyMessage>(response_message && response_message->accepted() ? connection_to_server->receiveSpecificMessage<TopologyMessage>(3000u, 3000u) : nullptr);
+	if (!topology_message)
+	{
+		connection_to_server->disconnect();
+		alert_user(infoError, strNETWORK_ERRORS, netErrCouldntJoin, 0);
+		return false;
+	}
+
+	*topology = *(topology_message->topology());
+	connection_to_server->setMessageHandler(spectatorDispatcher);
+
+	spectating = true;
+	spectator_level_over = false;
+	spectator_flags.clear();
+	spectator_flags_read = 0;
+	spectator_next_tick = 0;
+	return true;
+}
+
+bool NetIsSpectating()
+{
+	return spectating;
+}
+
+bool NetSpectatorChangeMap()
+{
+	// anything the hub sent past the end of the last level, the world never got to
+	spectator_level_over = false;
+	spectator_flags.clear();
+	spectator_flags_read = 0;
+
+	byte* wad = NetReceiveGameData(true);
+	return wad && process_net_map_data(wad); // (which frees the wad)
+}
+
+int NetSpectatorTakeFlags(uint32* flags, int max_ticks, bool& game_over)
+{
+	connection_to_server->pump();
+	while (!spectator_level_over && connection_to_server->dispatchOneIncomingMessage())
+		;
+
+	const int player_count = topology->player_count;
+	int tick_count = std::min<int>(max_ticks, (spectator_flags.size() - spectator_flags_read) / player_count);
+	std::copy_n(spectator_flags.begin() + spectator_flags_read, tick_count * player_count, flags);
+	spectator_flags_read += tick_count * player_count;
+
+	if (spectator_flags_read == spectator_flags.size())
+	{
+		spectator_flags.clear();
+		spectator_flags_read = 0;
+	}
+
+	// the hub hangs up when the game's over, but what it sent before then still counts
+	game_over = tick_count == 0 && !spectator_level_over && !connection_to_server->isConnected() && !connection_to_server->isMessageAvailable();
+	return tick_count;
+}
+
+int32 NetSpectatorBacklog()
+{
+	return spectating ? (spectator_flags.size() - spectator_flags_read) / topology->player_count : 0;
+}
+
 void NetRetargetJoinAttempts(const IPaddress* inAddress)
 {
 	host_address_specified = (inAddress != NULL);
@@ -2074,6 +2473,74 @@ void SetNetscriptStatus (bool status)
         do_netscript = status;
 }
 
+// deflates a payload once into chunks that can be enqueued for any joiner
+static bool build_payload_chunks(int16 kind, const PayloadKey& key, byte *buffer, size_t length, std::vector<std::unique_ptr<UninflatedMessage>>& chunks)
+{
+	z_stream stream = {};
+	if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		return false;
+	}
+
+	stream.next_in = buffer;
+	stream.avail_in = static_cast<uInt>(length);
+
+	std::vector<byte> out(PayloadChunkMessage::kMaxChunkSize);
+	int ret;
+	do {
+		stream.next_out = &out[0];
+		stream.avail_out = static_cast<uInt>(out.size());
+		ret = deflate(&stream, Z_FINISH);
+		if (ret == Z_OK || ret == Z_STREAM_END)
+		{
+			PayloadChunkMessage chunkMessage(kind, key, ret == Z_STREAM_END, &out[0], out.size() - stream.avail_out);
+			chunks.emplace_back(chunkMessage.deflate());
+		}
+	} while (ret == Z_OK);
+
+	deflateEnd(&stream);
+	return ret == Z_STREAM_END;
+}
+
+// joiners that already have the payload are just told which one to use;
+// the rest get it in chunks they can inflate while the next ones arrive
+static void distribute_payload(int16 kind, byte *buffer, size_t length, const std::vector<Client *>& clients)
+{
+	if (clients.empty())
+	{
+		return;
+	}
+
+	PayloadKey key = PayloadKey::Of(buffer, length);
+	std::vector<std::unique_ptr<UninflatedMessage>> chunks;
+	bool chunks_built = false;
+
+	for (auto client : clients)
+	{
+		if (client->cached_payloads.count(key))
+		{
+			client->channel->enqueueOutgoingMessage(CachedPayloadMessage(kind, key));
+		}
+		else
+		{
+			if (!chunks_built)
+			{
+				if (!build_payload_chunks(kind, key, buffer, length, chunks))
+				{
+					logError("could not compress payload for distribution");
+					chunks.clear();
+				}
+				chunks_built = true;
+			}
+
+			for (auto& chunk : chunks)
+			{
+				client->channel->enqueueOutgoingMessage(*chunk);
+			}
+		}
+	}
+}
+
 // ZZZ this "ought" to distribute to all players simultaneously (by interleaving send calls)
 // in case the server bandwidth is much greater than the others' bandwidths.  But that would
 // take a fair amount of reworking of the streaming system, which only groks talking with one
@@ -2120,6 +2587,9 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 	std::vector<CommunicationsChannel *> zipCapableChannels;
 	std::vector<CommunicationsChannel *> zipIncapableChannels;
 
+	// and who can skip what they have cached, and take the rest streamed
+	std::vector<Client *> streamCapableClients;
+
 	if (remote_hub)
 	{
 		channels.push_back(remote_hub);
@@ -2138,7 +2608,11 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 			{
 				Client* client = connections_to_clients[player.stream_id];
 				channels.push_back(client->channel.get());
-				if (client->capabilities[Capabilities::kZippedData] >= my_capabilities[Capabilities::kZippedData])
+				if (client->capabilities[Capabilities::kPayloadStream] >= Capabilities::kPayloadStreamVersion)
+				{
+					streamCapableClients.push_back(client);
+				}
+				else if (client->capabilities[Capabilities::kZippedData] >= my_capabilities[Capabilities::kZippedData])
 				{
 					zipCapableChannels.push_back(client->channel.get());
 				}
@@ -2161,6 +2635,8 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 	
 	if (physics_buffer)
 	{
+		distribute_payload(kPayloadPhysics, physics_buffer, physics_length, streamCapableClients);
+
 		if (zipCapableChannels.size())
 		{
 			ZippedPhysicsMessage zippedPhysicsMessage(physics_buffer, physics_length);
@@ -2176,6 +2652,8 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 	}
 	
 	{
+		distribute_payload(kPayloadMap, wad_buffer, wad_length, streamCapableClients);
+
 		// send zipped map to anyone who can accept it
 		if (zipCapableChannels.size())
 		{
@@ -2204,6 +2682,8 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 
 	if (do_netscript)
 	{
+		distribute_payload(kPayloadLua, lua_buffer, lua_length, streamCapableClients);
+
 		if (zipCapableChannels.size())
 		{
 			ZippedLuaMessage zippedLuaMessage(lua_buffer, lua_length);
@@ -2274,7 +2754,16 @@ byte *NetReceiveGameData(bool do_physics)
   // handlers will take care of all messages, and when they're done
   // the server will send us this:
   std::unique_ptr<EndGameDataMessage> endGameDataMessage(connection_to_server->receiveSpecificMessage<EndGameDataMessage>((Uint32) 60000, (Uint32) 30000));
-  if (endGameDataMessage.get()) {
+
+  // a payload that didn't arrive whole is as good as no payload at all
+  for (auto& payload : incomingPayloads) {
+    if (payload.active) {
+      handlerPayloadFailed = true;
+      reset_incoming_payload(payload);
+    }
+  }
+
+  if (endGameDataMessage.get() && !handlerPayloadFailed) {
     // game data was received OK
 	  if (do_physics) {
       process_network_physics_model(handlerPhysicsBuffer);
@@ -2321,6 +2810,8 @@ byte *NetReceiveGameData(bool do_physics)
     
     alert_user(infoError, strNETWORK_ERRORS, netErrMapDistribFailed, 1);
   }
+
+  handlerPayloadFailed = false;
   
   return map_buffer;
 }
@@ -2338,6 +2829,7 @@ NetCheckWorldUpdate()
 }
 
 extern const NetworkStats& hub_stats(int player_index);
+extern void hub_check_telemetry(); // writes HubTelemetry to the log directory when it's due
 
 void NetProcessMessagesInGame() {
 	if (connection_to_server) {
@@ -2370,6 +2862,8 @@ void NetProcessMessagesInGame() {
 			last_network_stats_send = machine_tick_count();
 		}
 
+		hub_check_telemetry();
+
 		// pump chat messages
 		client_map_t::iterator it;
 		for (it = connections_to_clients.begin(); it != connections_to_clients.end(); it++) {
@@ -2399,6 +2893,20 @@ bool NetProcessNewJoiner(std::shared_ptr<CommunicationsChannel> new_joiner)
 	return false;
 }
 
+// Sleeps until a client or the server has something for us, or a joiner is waiting
+// on the given server (if any), or until timeout ms pass
+void NetWaitForActivity(uint32 timeout, CommunicationsChannelFactory* joiner_server)
+{
+	std::vector<CommunicationsChannel*> channels;
+	if (connection_to_server)
+		channels.push_back(connection_to_server.get());
+
+	for (client_map_t::iterator it = connections_to_clients.begin(); it != connections_to_clients.end(); it++)
+		channels.push_back(it->second->channel.get());
+
+	CommunicationsChannel::waitForActivity(channels, timeout, joiner_server);
+}
+
 // If a potential joiner has connected to us, handle em
 bool NetCheckForNewJoiner (prospective_joiner_info &info, CommunicationsChannelFactory* server_override, bool process_new_joiners)
 {  
@@ -2407,7 +2915,7 @@ bool NetCheckForNewJoiner (prospective_joiner_info &info, CommunicationsChannelF
 	
 	NetProcessNewJoiner(std::shared_ptr<CommunicationsChannel>(new_joiner));
 	
-	if (actual_server)
+	// (the standalone hub's games have no server of their own, but clients all the same)
 	{
 		client_map_t::iterator it = connections_to_clients.begin();
 		while (it != connections_to_clients.end()) {
@@ -2493,6 +3001,10 @@ short NetUpdateJoinState(
 				    {
 					    connection_to_server->setMessageInflater(inflater);
 					    connection_to_server->setMessageHandler(joinDispatcher);
+
+					    // a standalone hub needs telling which of its games this is
+					    if (join_game_key)
+						    connection_to_server->enqueueOutgoingMessage(RemoteHubJoinMessage(join_game_key));
 				    }
 			    }
 			    else if (server_nbc->status() == NonblockingConnect::ResolutionFailed)
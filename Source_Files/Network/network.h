@@ -213,10 +213,22 @@ CheckPlayerProcPtr check_player);
 void NetHandleUngatheredPlayer(prospective_joiner_info ungathered_player);
 
 // jkvw: replaced SSLP hinting address with host address
+// which of a standalone hub's games the next join is for (the host's metaserver player id), 0 if not known
+void NetSetJoinGameKey(uint32 key);
 bool NetGameJoin(void *player_data, short player_data_size, const char* host_address_string);
 
+// Watching a game on a standalone hub: the hub streams every player's action flags,
+// and the game plays them back as a replay (see setup_for_spectating())
+bool NetSpectate(const char* hub_address_string, uint32 game_key);
+bool NetIsSpectating();
+bool NetSpectatorChangeMap();
+// copies up to max_ticks ticks of every player's flags, tick-major; game_over once the hub's gone
+int NetSpectatorTakeFlags(uint32* flags, int max_ticks, bool& game_over);
+int32 NetSpectatorBacklog(); // ticks received but not yet taken
+
 bool NetCheckForNewJoiner(prospective_joiner_info &info, CommunicationsChannelFactory* server_override = nullptr, bool process_new_joiners = true);
 bool NetProcessNewJoiner(std::shared_ptr<CommunicationsChannel> new_joiner);
+void NetWaitForActivity(uint32 timeout, CommunicationsChannelFactory* joiner_server = nullptr);
 short NetUpdateJoinState(void);
 void NetCancelJoin(void);
 
@@ -245,6 +257,7 @@ struct player_start_data;
 void NetSetupTopologyFromStarts(const player_start_data* inStartArray, short inStartCount);
 
 void NetSetDefaultInflater(CommunicationsChannel* channel);
+void NetSendTopology(CommunicationsChannel* channel); // e.g. to a spectator
 bool NetSync(void);
 bool NetUnSync(void);
 bool NetStart(void);
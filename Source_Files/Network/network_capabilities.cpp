@@ -29,5 +29,7 @@ const string Capabilities::kGatherable = "Gatherable";
 const string Capabilities::kZippedData = "ZippedData";
 const string Capabilities::kNetworkStats = "NetworkStats";
 const string Capabilities::kRugby = "Rugby";
+const string Capabilities::kPayloadStream = "PayloadStream";
+const string Capabilities::kCompactFlags = "CompactFlags";
 
 
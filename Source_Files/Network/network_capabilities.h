@@ -45,6 +45,8 @@ class Capabilities : public capabilities_t
   static const int kZippedDataVersion = 1; // map, lua, physics
   static const int kNetworkStatsVersion = 1; // latency, jitter, errors
   static const int kRugbyVersion = 1; // sane score limit
+  static const int kPayloadStreamVersion = 1; // cached and streamed map, lua, physics
+  static const int kCompactFlagsVersion = 1; // bit-packed hub action_flags
 
   static const string kGameworld;    // the PRNG, physics, etc.
   static const string kGameworldM1;  // like gameworld, but for Marathon 1 compatibility
@@ -55,6 +57,11 @@ class Capabilities : public capabilities_t
   static const string kZippedData;   // can receive zipped data
   static const string kNetworkStats; // can receive network stats
   static const string kRugby;        // rugby version
+  static const string kPayloadStream; // can skip cached payloads and
+                                      // receive the rest in chunks
+  static const string kCompactFlags; // can receive bit-packed action_flags
+                                     // from the hub (or, from a hub, can
+                                     // send them)
   
   uint32& operator[](const string& k) { 
     assert(k.length() < kMaxKeySize);
@@ -609,7 +609,7 @@ int network_join(void)
 
 		join_dialog_result = JoinDialog::Create()->JoinNetworkGameByRunning();
 		
-		if (join_dialog_result == kNetworkJoinedNewGame || join_dialog_result == kNetworkJoinedResumeGame)
+		if (join_dialog_result == kNetworkJoinedNewGame || join_dialog_result == kNetworkJoinedResumeGame || join_dialog_result == kNetworkJoinedSpectator)
 		{
 			write_preferences ();
 		
@@ -646,6 +646,7 @@ JoinDialog::~JoinDialog ()
 	delete m_cancelWidget;
 	delete m_joinWidget;
 	delete m_joinMetaserverWidget;
+	delete m_watchWidget;
 	delete m_joinAddressWidget;
 	delete m_joinByAddressWidget;
 	delete m_nameWidget;
@@ -673,6 +674,7 @@ const int JoinDialog::JoinNetworkGameByRunning ()
 	m_cancelWidget->set_callback(std::bind(&JoinDialog::Stop, this));
 	m_joinWidget->set_callback(std::bind(&JoinDialog::attemptJoin, this));
 	m_joinMetaserverWidget->set_callback(std::bind(&JoinDialog::getJoinAddressFromMetaserver, this));
+	m_watchWidget->set_callback(std::bind(&JoinDialog::attemptWatch, this));
 	
 	m_chatChoiceWidget->set_value (kPregameChat);
 	m_chatChoiceWidget->deactivate ();
@@ -738,6 +740,8 @@ void JoinDialog::attemptJoin ()
 	// jkvw: It may look like we're passing our player name into NetGameJoin,
 	//       but network code will later draw the name directly from prefs.
 	binders.migrate_all_first_to_second ();	
+	bool picked_on_metaserver = m_joinByAddressWidget->get_value() && m_joinAddressWidget->get_text() == m_metaserverJoinAddress;
+	NetSetJoinGameKey(picked_on_metaserver ? m_metaserverGameKey : 0);
 	bool result = NetGameJoin((void *) &myPlayerInfo, sizeof(myPlayerInfo), hintString);
 	
 	if (hintString)
@@ -752,6 +756,7 @@ void JoinDialog::attemptJoin ()
 		m_joinByAddressWidget->deactivate ();
 		m_joinWidget->deactivate ();
 		m_joinMetaserverWidget->deactivate ();
+		m_watchWidget->deactivate ();
 		
 		getcstr(temporary, strJOIN_DIALOG_MESSAGES, _join_dialog_waiting_string);
 		m_messagesWidget->set_text(temporary);
@@ -764,6 +769,22 @@ void JoinDialog::attemptJoin ()
 	}
 }
 
+void JoinDialog::attemptWatch ()
+{
+	// only a standalone hub lets anyone watch, and it doesn't announce itself on the local network
+	if (!m_joinByAddressWidget->get_value()) {
+		m_messagesWidget->set_text("To watch a game, join its hub by address, or find the game on the Internet.");
+		return;
+	}
+
+	binders.migrate_all_first_to_second ();
+	bool picked_on_metaserver = m_joinAddressWidget->get_text() == m_metaserverJoinAddress;
+	if (NetSpectate(m_joinAddressWidget->get_text().c_str(), picked_on_metaserver ? m_metaserverGameKey : 0)) {
+		join_result = kNetworkJoinedSpectator;
+		Stop ();
+	}
+}
+
 void JoinDialog::gathererSearch ()
 {
 	if (skipToMetaserver)
@@ -855,7 +876,8 @@ void JoinDialog::getJoinAddressFromMetaserver ()
 
 	try
 	{
-		IPaddress result = run_network_metaserver_ui();
+		uint32 hostPlayerID;
+		IPaddress result = run_network_metaserver_ui(hostPlayerID);
 		if(result.host != 0)
 		{
 			uint8* hostBytes = reinterpret_cast<uint8*>(&(result.host));
@@ -868,6 +890,8 @@ void JoinDialog::getJoinAddressFromMetaserver ()
 			{
 				s << ':' << result.port;
 			}
+			m_metaserverJoinAddress = s.str();
+			m_metaserverGameKey = hostPlayerID;
 			m_joinByAddressWidget->set_value (true);
 			m_joinAddressWidget->set_text (s.str());
 			m_joinWidget->push ();
@@ -2552,6 +2576,9 @@ public:
 
 		w_button* join_w = new w_button("JOIN LOCAL GAME");
 		prejoin_table->dual_add_row(join_w, m_dialog);
+
+		w_button* watch_w = new w_button("WATCH GAME");
+		prejoin_table->dual_add_row(watch_w, m_dialog);
 		
 		prejoin_placer->add(prejoin_table, true);
 		prejoin_placer->add(new w_spacer(), true);
@@ -2610,6 +2637,7 @@ public:
 		m_joinWidget = new ButtonWidget (join_w);
 	
 		m_joinMetaserverWidget = new ButtonWidget (join_by_metaserver_w);
+		m_watchWidget = new ButtonWidget (watch_w);
 		m_joinAddressWidget = new EditTextWidget (hint_address_w);
 		m_joinByAddressWidget = new ToggleWidget (hint_w);
 	
@@ -316,6 +316,7 @@ protected:
 
 	void gathererSearch ();
 	void attemptJoin ();
+	void attemptWatch ();
 	void changeColours ();
 	void getJoinAddressFromMetaserver ();
 	
@@ -330,6 +331,7 @@ protected:
 	ButtonWidget*		m_joinWidget;
 	
 	ButtonWidget*		m_joinMetaserverWidget;
+	ButtonWidget*		m_watchWidget;
 	EditTextWidget*		m_joinAddressWidget;
 	ToggleWidget*		m_joinByAddressWidget;
 	
@@ -354,6 +356,10 @@ protected:
 	bool got_gathered;
 
 	bool skipToMetaserver;
+
+	// the game picked on the metaserver, for joining it on a standalone hub hosting several
+	std::string m_metaserverJoinAddress;
+	uint32 m_metaserverGameKey = 0;
 };
 
 
@@ -72,6 +72,27 @@ bool NetChangeMap(struct entry_point *entry)
 	return false;
 }
 
+bool NetIsSpectating(void)
+{
+	return false;
+}
+
+bool NetSpectatorChangeMap(void)
+{
+	return false;
+}
+
+int NetSpectatorTakeFlags(uint32 *flags, int max_ticks, bool& game_over)
+{
+	game_over = true;
+	return 0;
+}
+
+int32 NetSpectatorBacklog(void)
+{
+	return 0;
+}
+
 int32 NetGetNetTime(void)
 {
 	return 0;
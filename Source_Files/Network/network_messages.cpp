@@ -142,6 +142,110 @@ UninflatedMessage* BigChunkOfZippedDataMessage::deflate() const
 	return theMessage;
 }
 
+static void deflatePayloadKey(AOStream& outputStream, const PayloadKey& key) {
+  outputStream << key.length;
+  outputStream << key.crc;
+  outputStream << key.adler;
+}
+
+static void inflatePayloadKey(AIStream& inputStream, PayloadKey& key) {
+  inputStream >> key.length;
+  inputStream >> key.crc;
+  inputStream >> key.adler;
+}
+
+bool PayloadChunkMessage::inflateFrom(const UninflatedMessage& inUninflated)
+{
+	enum { kHeaderSize = 2 + 12 + 1 };
+	if (inUninflated.length() < kHeaderSize)
+	{
+		return false;
+	}
+
+	AIStreamBE inputStream(inUninflated.buffer(), kHeaderSize);
+	inputStream >> mKind;
+	inflatePayloadKey(inputStream, mKey);
+	uint8 last;
+	inputStream >> last;
+	mLast = last != 0;
+
+	copyBufferFrom(inUninflated.buffer() + kHeaderSize, inUninflated.length() - kHeaderSize);
+	return true;
+}
+
+UninflatedMessage* PayloadChunkMessage::deflate() const
+{
+	enum { kHeaderSize = 2 + 12 + 1 };
+	UninflatedMessage* theMessage = new UninflatedMessage(type(), kHeaderSize + length());
+	AOStreamBE outputStream(theMessage->buffer(), kHeaderSize);
+	outputStream << mKind;
+	deflatePayloadKey(outputStream, mKey);
+	outputStream << (uint8) mLast;
+	if (length())
+		memcpy(theMessage->buffer() + kHeaderSize, buffer(), length());
+	return theMessage;
+}
+
+bool SpectatorFlagsMessage::inflateFrom(const UninflatedMessage& inUninflated)
+{
+	enum { kHeaderSize = 4 + 2 };
+	if (inUninflated.length() < kHeaderSize)
+	{
+		return false;
+	}
+
+	AIStreamBE inputStream(inUninflated.buffer(), kHeaderSize);
+	inputStream >> mStartTick;
+	inputStream >> mPlayerCount;
+
+	copyBufferFrom(inUninflated.buffer() + kHeaderSize, inUninflated.length() - kHeaderSize);
+	return true;
+}
+
+UninflatedMessage* SpectatorFlagsMessage::deflate() const
+{
+	enum { kHeaderSize = 4 + 2 };
+	UninflatedMessage* theMessage = new UninflatedMessage(type(), kHeaderSize + length());
+	AOStreamBE outputStream(theMessage->buffer(), kHeaderSize);
+	outputStream << mStartTick;
+	outputStream << mPlayerCount;
+	if (length())
+		memcpy(theMessage->buffer() + kHeaderSize, buffer(), length());
+	return theMessage;
+}
+
+void PayloadCacheMessage::reallyDeflateTo(AOStream& outputStream) const {
+  outputStream << (uint16) mKeys.size();
+  for (auto& key : mKeys) {
+    deflatePayloadKey(outputStream, key);
+  }
+}
+
+bool PayloadCacheMessage::reallyInflateFrom(AIStream& inputStream) {
+  uint16 count;
+  inputStream >> count;
+  if (count > kMaxKeys) {
+    return false;
+  }
+
+  mKeys.resize(count);
+  for (auto& key : mKeys) {
+    inflatePayloadKey(inputStream, key);
+  }
+  return true;
+}
+
+void CachedPayloadMessage::reallyDeflateTo(AOStream& outputStream) const {
+  outputStream << mKind;
+  deflatePayloadKey(outputStream, mKey);
+}
+
+bool CachedPayloadMessage::reallyInflateFrom(AIStream& inputStream) {
+  inputStream >> mKind;
+  inflatePayloadKey(inputStream, mKey);
+  return true;
+}
+
 void AcceptJoinMessage::reallyDeflateTo(AOStream& outputStream) const {
   outputStream << (Uint8) mAccepted;
   deflateNetPlayer(outputStream, mPlayer);
@@ -376,5 +480,18 @@ bool RemoteHubHostResponseMessage::reallyInflateFrom(AIStream& inputStream) {
 	return true;
 }
 
+void RemoteHubHelloMessage::reallyDeflateTo(AOStream& outputStream) const {
+	HelloMessage::reallyDeflateTo(outputStream);
+	outputStream << mGameKey;
+}
+
+bool RemoteHubHelloMessage::reallyInflateFrom(AIStream& inputStream) {
+	if (!HelloMessage::reallyInflateFrom(inputStream)) return false;
+	mGameKey = 0;
+	if (inputStream.maxg() > inputStream.tellg())
+		inputStream >> mGameKey;
+	return true;
+}
+
 #endif // !defined(DISABLE_NETWORKING)
 
@@ -31,6 +31,9 @@
 
 #include "network_capabilities.h"
 #include "network_private.h"
+#include "PayloadCache.h"
+
+#include <set>
 
 enum {
   kHELLO_MESSAGE = 700,
@@ -57,6 +60,12 @@ enum {
   kREMOTE_HUB_READY_MESSAGE,
   kREMOTE_HUB_RESPONSE_MESSAGE,
   kREMOTE_HUB_REQUEST_MESSAGE,
+  kPAYLOAD_CACHE_MESSAGE,
+  kPAYLOAD_CHUNK_MESSAGE,
+  kCACHED_PAYLOAD_MESSAGE,
+  kSPECTATOR_REQUEST_MESSAGE,
+  kSPECTATOR_FLAGS_MESSAGE,
+  kREMOTE_HUB_JOIN_MESSAGE,
 };
 
 template <MessageTypeID tMessageType, typename tValueType>
@@ -261,16 +270,39 @@ protected:
 	bool reallyInflateFrom(AIStream& inputStream);
 };
 
-class RemoteHubHostConnectMessage : public HelloMessage
+// A standalone hub hosts many games; the gatherer's key for its game (its metaserver player
+// id, which is how the metaserver lists the game) is what joiners and spectators ask for it
+// by.  Hubs from before that stop reading after the version.
+class RemoteHubHelloMessage : public HelloMessage
+{
+public:
+	RemoteHubHelloMessage() { }
+	RemoteHubHelloMessage(const std::string& version, uint32 gameKey) : HelloMessage(version), mGameKey(gameKey) { }
+
+	uint32 gameKey() const { return mGameKey; }
+
+protected:
+	void reallyDeflateTo(AOStream& outputStream) const;
+	bool reallyInflateFrom(AIStream& inputStream);
+
+private:
+	uint32 mGameKey = 0;
+};
+
+class RemoteHubHostConnectMessage : public RemoteHubHelloMessage
 {
 public:
 	enum { kType = kREMOTE_HUB_REQUEST_MESSAGE };
 	RemoteHubHostConnectMessage() { }
-	RemoteHubHostConnectMessage(const std::string& version) : HelloMessage(version) { }
+	RemoteHubHostConnectMessage(const std::string& version, uint32 gameKey = 0) : RemoteHubHelloMessage(version, gameKey) { }
 	RemoteHubHostConnectMessage* clone() const { return new RemoteHubHostConnectMessage(*this); }
 	MessageTypeID type() const { return kType; }
 };
 
+// sent by a joiner, straight after connecting, to say which of a standalone hub's games it's
+// after; anyone else ignores it
+typedef TemplatizedSimpleMessage<kREMOTE_HUB_JOIN_MESSAGE, uint32> RemoteHubJoinMessage;
+
 typedef TemplatizedSimpleMessage<kJOIN_PLAYER_MESSAGE, int16> JoinPlayerMessage;
 
 class JoinerInfoMessage : public SmallMessageHelper
@@ -344,6 +376,133 @@ typedef TemplatizedDataMessage<kZIPPED_PHYSICS_MESSAGE, BigChunkOfZippedDataMess
 typedef TemplatizedDataMessage<kLUA_MESSAGE, BigChunkOfDataMessage> LuaMessage;
 typedef TemplatizedDataMessage<kZIPPED_LUA_MESSAGE, BigChunkOfZippedDataMessage> ZippedLuaMessage;
 
+enum {
+	kPayloadMap,
+	kPayloadPhysics,
+	kPayloadLua,
+	NUMBER_OF_PAYLOAD_KINDS
+};
+
+// joiner's list of payloads it already has
+class PayloadCacheMessage : public SmallMessageHelper
+{
+public:
+	enum { kType = kPAYLOAD_CACHE_MESSAGE };
+	enum { kMaxKeys = 256 };
+
+	PayloadCacheMessage() : SmallMessageHelper() { }
+	PayloadCacheMessage(const std::vector<PayloadKey>& keys) : SmallMessageHelper(), mKeys(keys) {
+		if (mKeys.size() > kMaxKeys)
+			mKeys.resize(kMaxKeys);
+	}
+
+	PayloadCacheMessage* clone() const {
+		return new PayloadCacheMessage(*this);
+	}
+
+	const std::vector<PayloadKey>& keys() const { return mKeys; }
+
+	MessageTypeID type() const { return kType; }
+
+protected:
+	void reallyDeflateTo(AOStream& outputStream) const;
+	bool reallyInflateFrom(AIStream& inputStream);
+
+private:
+	std::vector<PayloadKey> mKeys;
+};
+
+// tells a joiner to use the payload it advertised instead
+class CachedPayloadMessage : public SmallMessageHelper
+{
+public:
+	enum { kType = kCACHED_PAYLOAD_MESSAGE };
+
+	CachedPayloadMessage() : SmallMessageHelper() { }
+	CachedPayloadMessage(int16 kind, const PayloadKey& key) : SmallMessageHelper(), mKind(kind), mKey(key) { }
+
+	CachedPayloadMessage* clone() const {
+		return new CachedPayloadMessage(*this);
+	}
+
+	int16 kind() const { return mKind; }
+	const PayloadKey& key() const { return mKey; }
+
+	MessageTypeID type() const { return kType; }
+
+protected:
+	void reallyDeflateTo(AOStream& outputStream) const;
+	bool reallyInflateFrom(AIStream& inputStream);
+
+private:
+	int16 mKind = kPayloadMap;
+	PayloadKey mKey = {};
+};
+
+// one piece of a deflate stream; the joiner inflates each piece as it
+// arrives, rather than waiting for the whole payload
+class PayloadChunkMessage : public BigChunkOfDataMessage
+{
+public:
+	enum { kType = kPAYLOAD_CHUNK_MESSAGE };
+	enum { kMaxChunkSize = 32 * 1024 };
+
+	PayloadChunkMessage(int16 kind = kPayloadMap, const PayloadKey& key = PayloadKey(), bool last = false, const Uint8* inBuffer = NULL, size_t inLength = 0) : BigChunkOfDataMessage(kType, inBuffer, inLength), mKind(kind), mKey(key), mLast(last) { }
+	PayloadChunkMessage(const PayloadChunkMessage& other) : BigChunkOfDataMessage(other), mKind(other.mKind), mKey(other.mKey), mLast(other.mLast) { }
+
+	PayloadChunkMessage* clone() const {
+		return new PayloadChunkMessage(*this);
+	}
+
+	int16 kind() const { return mKind; }
+	const PayloadKey& key() const { return mKey; }
+	bool last() const { return mLast; }
+
+	bool inflateFrom(const UninflatedMessage& inUninflated);
+	UninflatedMessage* deflate() const;
+
+private:
+	int16 mKind;
+	PayloadKey mKey;
+	bool mLast;
+};
+
+// asks a standalone hub to watch one of its games in progress
+class SpectatorRequestMessage : public RemoteHubHelloMessage
+{
+public:
+	enum { kType = kSPECTATOR_REQUEST_MESSAGE };
+	SpectatorRequestMessage() { }
+	SpectatorRequestMessage(const std::string& version, uint32 gameKey = 0) : RemoteHubHelloMessage(version, gameKey) { }
+	SpectatorRequestMessage* clone() const { return new SpectatorRequestMessage(*this); }
+	MessageTypeID type() const { return kType; }
+};
+
+// every player's confirmed action_flags, tick-major, from the start tick on, as
+// one or more ActionFlagsCodec runs
+class SpectatorFlagsMessage : public BigChunkOfDataMessage
+{
+public:
+	enum { kType = kSPECTATOR_FLAGS_MESSAGE };
+
+	SpectatorFlagsMessage(int32 startTick = 0, int16 playerCount = 0, const Uint8* inBuffer = NULL, size_t inLength = 0) : BigChunkOfDataMessage(kType, inBuffer, inLength), mStartTick(startTick), mPlayerCount(playerCount) { }
+	SpectatorFlagsMessage(const SpectatorFlagsMessage& other) : BigChunkOfDataMessage(other), mStartTick(other.mStartTick), mPlayerCount(other.mPlayerCount) { }
+
+	SpectatorFlagsMessage* clone() const {
+		return new SpectatorFlagsMessage(*this);
+	}
+
+	int32 startTick() const { return mStartTick; }
+	int16 playerCount() const { return mPlayerCount; }
+
+	bool inflateFrom(const UninflatedMessage& inUninflated);
+	UninflatedMessage* deflate() const;
+
+private:
+	int32 mStartTick;
+	int16 mPlayerCount;
+};
+
 
 class NetworkChatMessage : public SmallMessageHelper
 {
@@ -523,6 +682,7 @@ struct Client {
 	short state;
 	uint16 network_version;
 	Capabilities capabilities;
+	std::set<PayloadKey> cached_payloads;
 	char name[MAX_NET_PLAYER_NAME_LENGTH];
 
 	static CheckPlayerProcPtr check_player;
@@ -544,6 +704,8 @@ struct Client {
 	void handleRemoteHubCommandMessage(RemoteHubCommandMessage*, CommunicationsChannel*);
 	void handleRemoteHubHostConnectMessage(RemoteHubHostConnectMessage*, CommunicationsChannel*);
 	void handleChangeColorsMessage(ChangeColorsMessage*, CommunicationsChannel*);
+	void handlePayloadCacheMessage(PayloadCacheMessage*, CommunicationsChannel*);
+	void handleRemoteHubJoinMessage(RemoteHubJoinMessage*, CommunicationsChannel*);
 
 	std::unique_ptr<MessageDispatcher> mDispatcher;
 	std::unique_ptr<MessageHandler> mJoinerInfoMessageHandler;
@@ -554,6 +716,8 @@ struct Client {
 	std::unique_ptr<MessageHandler> mAcceptJoinMessageHandler;
 	std::unique_ptr<MessageHandler> mChatMessageHandler;
 	std::unique_ptr<MessageHandler> mChangeColorsMessageHandler;
+	std::unique_ptr<MessageHandler> mPayloadCacheMessageHandler;
+	std::unique_ptr<MessageHandler> mRemoteHubJoinMessageHandler;
 };
 
 typedef TemplatizedDataMessage<kGAME_SESSION_MESSAGE, BigChunkOfDataMessage> GameSessionMessage;
@@ -51,6 +51,14 @@ Feb 27, 2002 (Br'fin (Jeremy Parsons)):
 
 #define	GAME_PORT (network_preferences->game_port)
 
+// The standalone hub hosts several games at once, each one set up and run from a thread
+// of its own, so the state network.cpp keeps for "the" game is kept per thread there.
+#ifdef A1_NETWORK_STANDALONE_HUB
+#define NET_GAME_STATE thread_local
+#else
+#define NET_GAME_STATE
+#endif
+
 // (ZZZ:) Moved here from sdl_network.h and macintosh_network.h
 
 /* ---------- constants */
@@ -193,6 +201,9 @@ struct ClientChatInfo
 	int16 team;
 };
 
+// whether the hub our spoke talks to has said it can send bit-packed action_flags
+bool NetHubCanPackFlags();
+
 // "network_dialogs_private.h" follows
 
 class GathererAvailableAnnouncer
@@ -39,16 +39,23 @@ enum {
 #endif
 
 #include <stdio.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 enum {
         kEndOfMessagesMessageType = 0x454d,	// 'EM'
         kTimingAdjustmentMessageType = 0x5441,	// 'TA'
         kPlayerNetDeadMessageType = 0x4e44,	// 'ND'
+	kCompactFlagsMessageType = 0x4346,	// 'CF' spoke can unpack ActionFlagsCodec runs
 
 	kSpokeToHubIdentification = 0x4944,   // 'ID'
 	kSpokeToHubGameDataPacketV1Magic = 0x5331, // 'S1'
 	kHubToSpokeGameDataPacketV1Magic = 0x4831, // 'H1'
 	kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic = 0x4631, // 'F1'
+	kHubToSpokeGameDataPacketV2Magic = 0x4832, // 'H2' like V1, but flags are packed
+	kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic = 0x4632, // 'F2'
 	kPingRequestPacket = 0x5051, // 'PQ'
 	kPingResponsePacket = 0x5052, // 'PR'
 
@@ -65,7 +72,8 @@ typedef WritableTickBasedCircularQueue<action_flags_t> WritableTickBasedActionQu
 
 class InfoTree;
 
-extern void hub_initialize(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, int inLocalPlayerIndex);
+// inSessionIdentifier: how the spokes of this game identify it to a hub running several
+extern void hub_initialize(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, int inLocalPlayerIndex, const std::string& inSessionIdentifier);
 extern void hub_cleanup(bool inGraceful, int32 inSmallestPostGameTick);
 extern void hub_received_network_packet(DDPPacketBufferPtr inPacket);
 extern bool hub_is_active();
@@ -73,7 +81,21 @@ extern void DefaultHubPreferences();
 extern InfoTree HubPreferencesTree();
 extern void HubParsePreferencesTree(InfoTree prefs, std::string version);
 
-extern void spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnectedStatus[], size_t inLocalPlayerIndex, bool inHubIsLocal);
+// A hub without a local player keeps the flags of every real game tick once they're final; this
+// hands over (tick-major, every player) the ones kept since it was last called, for spectators.
+// Players who've gone netdead have NET_DEAD_ACTION_FLAG, as they do at the spokes.
+extern bool hub_take_confirmed_flags(int32& outFirstTick, std::vector<action_flags_t>& outFlags);
+extern void hub_set_telemetry_period(int32 new_period); // in ticks; 0 never writes HubTelemetry
+extern int32 hub_get_spectator_delay(); // in ticks
+extern void hub_set_spectator_delay(int32 new_delay);
+extern int32 hub_get_max_spectators();
+extern void hub_set_max_spectators(int32 new_max); // 0 turns spectating off
+extern bool hub_get_record_films();
+extern void hub_set_record_films(bool record);
+extern int hub_game_number(); // tells the standalone hub's games apart in its logs and files
+
+// inHubCanPackFlags: the hub has said it can send bit-packed action_flags, so it's worth asking for them
+extern void spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnectedStatus[], size_t inLocalPlayerIndex, bool inHubIsLocal, bool inHubCanPackFlags, const std::string& inSessionIdentifier);
 extern void spoke_cleanup(bool inGraceful);
 extern void spoke_received_network_packet(DDPPacketBufferPtr inPacket);
 extern int32 spoke_get_net_time();
@@ -85,4 +107,59 @@ extern void DefaultSpokePreferences();
 extern InfoTree SpokePreferencesTree();
 extern void SpokeParsePreferencesTree(InfoTree prefs, std::string version);
 
+// Where a hub or spoke that isn't the process's own sends its packets; the process's own use the socket
+class StarTransport
+{
+public:
+	virtual ~StarTransport() {}
+	virtual void send(const NetAddrBlock& inAddress, const byte* inData, uint16 inSize) = 0;
+
+	// each datagram in turn, unless overridden
+	virtual void send(const DDPSendBatch& inBatch);
+};
+
+// The network test bench runs a hub and several spokes in one process, and drives them itself: each
+// is ticked by the caller (once per 1/TICKS_PER_SECOND), is handed the packets the caller delivers, and
+// sends through a StarTransport.  These don't touch the process's own hub and spoke.
+class HubGame;
+class SpokeGame;
+struct NetworkStats;
+
+class StarBenchHub
+{
+public:
+	// all players are remote
+	StarBenchHub(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, StarTransport& inTransport);
+	~StarBenchHub();
+
+	void tick();
+	void received_packet(DDPPacketBufferPtr inPacket);
+
+	const NetworkStats& stats(int inPlayerIndex);
+	uint32 flags_made_up();		// for lagging players
+	uint32 late_flags_received();	// after we'd made them up
+	bool take_confirmed_flags(int32& outFirstTick, std::vector<action_flags_t>& outFlags);
+
+private:
+	std::unique_ptr<HubGame> mGame;
+};
+
+class StarBenchSpoke
+{
+public:
+	// inLocalFlags stands in for the local player's input; inPlayerNetDead is told when the
+	// spoke gives up on a player (or, with the hub, on everyone)
+	StarBenchSpoke(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], size_t inLocalPlayerIndex, StarTransport& inTransport, std::function<action_flags_t()> inLocalFlags, std::function<void(size_t)> inPlayerNetDead);
+	~StarBenchSpoke();
+
+	void tick();
+	void received_packet(DDPPacketBufferPtr inPacket);
+
+	int32 net_time();
+	int32 latency(); // in ms
+
+private:
+	std::unique_ptr<SpokeGame> mGame;
+};
+
 #endif // NETWORK_STAR_H
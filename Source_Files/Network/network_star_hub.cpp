@@ -55,6 +55,10 @@
 #include "WindowedNthElementFinder.h"
 #include "CircularByteBuffer.h"
 #include "InfoTree.h"
+#include "ActionFlagsCodec.h"
+#include "network_capabilities.h"
+#include "HubTelemetry.h"
+#include "FileHandler.h"
 
 #include <vector>
 #include <map>
@@ -63,20 +67,23 @@
 #include <numeric>
 #include <cmath>
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include "crc.h"
 #include "player.h" // for masking out action flags triggers :(
 
 #define DEBUG_TIMING_ADJUSTMENTS
 
 #ifdef DEBUG_TIMING_ADJUSTMENTS
-#include "FileHandler.h"
 #include <ctime>
 #include <sstream>
 #include <iomanip>
 #include <boost/iostreams/stream.hpp>
-static OpenedFile dout_file;
-static boost::iostreams::stream<opened_file_device> dout;
-static bool debug_timing_adjustments = false;
+#endif
+
+#ifdef A1_NETWORK_STANDALONE_HUB
+#include <thread>
 #endif
 
 // Synchronization:
@@ -151,7 +158,12 @@ enum {
 	kDefaultMinimumSendPeriod = 3,
 	kLatencyBufferSize = TICKS_PER_SECOND * 5, // store 5 seconds of ping counts
 	kDisplayLatencyWindow = TICKS_PER_SECOND * 1, // display last second's ping
-	kJitterUpdateInterval = TICKS_PER_SECOND * 1 / 2
+	kJitterUpdateInterval = TICKS_PER_SECOND * 1 / 2,
+	kUsageReportInterval = TICKS_PER_SECOND * 60,
+	kDefaultTelemetryPeriod = 0, // never, unless set by telemetry_period or the standalone hub's --telemetry
+	kDefaultSpectatorDelay = TICKS_PER_SECOND * 10,
+	kDefaultMaxSpectators = 128,
+	kSpokePacketHeaderSize = 256 // header, ack, messages and start tick for one spoke
 };
 
 
@@ -166,7 +178,11 @@ struct HubPreferences {
 	int32	mSendPeriod;
 	int32	mRecoverySendPeriod;
 	int32   mMinimumSendPeriod;
+	int32	mTelemetryPeriod;	// how often to write out HubTelemetry; 0 never
+	int32	mSpectatorDelay;	// ticks spectators are kept behind the game
+	int32	mMaxSpectators;		// 0 turns spectating off
 	bool    mBandwidthReduction;
+	bool	mRecordFilms;		// standalone hub only
 };
 
 static HubPreferences sHubPreferences;
@@ -175,39 +191,25 @@ int32& hub_get_minimum_send_period() { return sHubPreferences.mMinimumSendPeriod
 
 void hub_set_minimum_send_period(int32 new_minimum) { sHubPreferences.mMinimumSendPeriod = new_minimum; }
 
-// sNetworkTicker advances even if the game clock doesn't.
-// sLastNetworkTickSent is used to force us to resend packets (at a lower rate) even if we're no longer
-// getting new data.
-static int32 sNetworkTicker;
-static int32 sLastNetworkTickSent;
-
-// We have a pregame startup period to help establish (via standard adjustment mechanism) everyone's
-// timing.  Ticks smaller than sSmallestRealGameTick are part of this startup period.  They smell
-// just like real in-game ticks, except that spokes won't enqueue them on player_queues, and we
-// may have different adjustment window sizes and timeout periods for pre-game and in-game ticks.
-static int32 sSmallestRealGameTick;
-
-// Once everyone ACKs this tick, we're satisfied the game is ended.  (They should all agree on which
-// tick is last due to the symmetric execution model.)
-static int32 sSmallestPostGameTick;
-
-// The sFlagsQueues hold all flags for ticks for which we've received data from at least one
-// station, but for which we haven't received an ACK from all stations.
-// sFlagsQueues[all].getReadIndex() == sPlayerDataDisposition.getReadIndex();
-// max(sFlagsQueues[all].getWriteIndex()) == sPlayerDataDisposition.getWriteIndex();
-// min(sFlagsQueues[all].getWriteIndex()) == sSmallestIncompleteTick;
-typedef std::vector<TickBasedActionQueue> TickBasedActionQueueCollection;
-static TickBasedActionQueueCollection	sFlagsQueues;
+void hub_set_telemetry_period(int32 new_period) { sHubPreferences.mTelemetryPeriod = new_period; }
+
+int32 hub_get_spectator_delay() { return sHubPreferences.mSpectatorDelay; }
+
+void hub_set_spectator_delay(int32 new_delay) { sHubPreferences.mSpectatorDelay = new_delay; }
+
+int32 hub_get_max_spectators() { return sHubPreferences.mMaxSpectators; }
+
+void hub_set_max_spectators(int32 new_max) { sHubPreferences.mMaxSpectators = new_max; }
+
+bool hub_get_record_films() { return sHubPreferences.mRecordFilms; }
 
-// tracks the net ticks each flags tick was *first* sent out at
-static ConcreteTickBasedCircularQueue<int32> sFlagSendTimeQueue(kFlagsQueueSize);
-static int32 sLastRealUpdate;
+void hub_set_record_films(bool record) { sHubPreferences.mRecordFilms = record; }
 
 struct NetworkPlayer_hub {
         NetAddrBlock	mAddress;		// network address of player
 	bool		mAddressKnown;		// did player tell us his address yet?
         bool		mConnected;		// is player still connected?
-        int32		mLastNetworkTickHeard;	// our sNetworkTicker last time we got a packet from them
+        int32		mLastNetworkTickHeard;	// our mNetworkTicker last time we got a packet from them
         int32		mSmallestUnacknowledgedTick;
 
 	WindowedNthElementFinder<int32>	mNthElementFinder;
@@ -216,7 +218,7 @@ struct NetworkPlayer_hub {
 
         // When we decide a timing adjustment is needed, we include the timing adjustment
         // request in every packet outbound to the player until we're sure he's seen it.
-        // In particular, mTimingAdjustmentTick is set to the sSmallestIncompleteTick, so we
+        // In particular, mTimingAdjustmentTick is set to the mSmallestIncompleteTick, so we
         // know nobody's received data for that tick yet.  We continue to send the message
         // until the station ACKs past that tick; at that point we know he must have seen
         // our message.
@@ -237,6 +239,9 @@ struct NetworkPlayer_hub {
 	// the last time a recovery set of flags was sent instead of incremental
 	int32           mLastRecoverySend;
 
+	// did the spoke say it can unpack ActionFlagsCodec runs?
+	bool		mCompactFlags;
+
 	// latency stuff
 	int32 mLatencyTicks; // sum of the latency ticks from the last second
 	std::deque<int32> mLatencyBuffer;
@@ -244,42 +249,6 @@ struct NetworkPlayer_hub {
 	NetworkStats mStats;
 };
 
-// Housekeeping queues:
-// sPlayerDataDisposition holds an element for every tick for which data has been received from
-// someone, but which at least one player has not yet acknowledged.
-// sPlayerDataDisposition.getReadIndex() <= sSmallestIncompleteTick <= sPlayerDataDisposition.getWriteIndex()
-// sSmallestIncompleteTick indexes into sPlayerDataDisposition also; it divides the queue into ticks
-// for which data has been received from someone but not yet everyone (>= sSmallestIncompleteTick) and
-// ticks for which data has been sent out (to everyone) but for which someone hasn't yet acknowledged
-// (< sSmallestIncompleteTick).
-
-// The value of a queue element is a bit-set (indexed by player index) with a 1 bit for each player
-// that we're waiting on.  So, we can mask out successive players' bits as their traffic reaches us;
-// when the value hits 0, all players have checked in and we can advance an index.
-// sConnectedPlayersBitmask has '1' set for every connected player.
-static MutableElementsTickBasedCircularQueue<uint32>	sPlayerDataDisposition(kFlagsQueueSize);
-static int32 sSmallestIncompleteTick;
-static uint32 sConnectedPlayersBitmask;
-static uint32 sLaggingPlayersBitmask;
-
-
-// sPlayerReflectedFlags holds an element for every tick for which data has been
-// sent but at least one player has not yet acknowledged
-//
-// the value of a queue element is a bit-set (indexed by player index) with a 1
-// bit for each player we've altered flags and need to reflect flags for
-static MutableElementsTickBasedCircularQueue<uint32> sPlayerReflectedFlags(kFlagsQueueSize);
-
-// sLateFlagsQueues hold late flags we've received from lagging players
-static TickBasedActionQueueCollection sLateFlagsQueues;
-
-// holds the last real flags we received from this player
-static vector<action_flags_t> sLastFlagsReceived;
-
-// sSmallestUnsentTick is used for reducing the number of packets sent: we won't send a packet unless
-// sSmallestIncompleteTick - sSmallestUnsentTick >= sHubPreferences.mSendPeriod
-static int32 sSmallestUnsentTick;
-
 struct NetAddrBlockCompare
 {
 
@@ -293,63 +262,325 @@ struct NetAddrBlockCompare
 };
 
   typedef std::map<NetAddrBlock, int, NetAddrBlockCompare>	AddressToPlayerIndexType;
-static AddressToPlayerIndexType	sAddressToPlayerIndex;
-
 typedef std::vector<NetworkPlayer_hub>	NetworkPlayerCollection;
-static NetworkPlayerCollection	sNetworkPlayers;
+typedef std::vector<TickBasedActionQueue> TickBasedActionQueueCollection;
+
+// Everything the hub knows about one game.  A client hosting a game has just the one, ticked
+// by its own mytm task; the standalone hub runs many side by side over its one socket, ticked
+// by the HubTickPool, with the packet handler finding each packet's game.
+class HubGame
+{
+public:
+	HubGame(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, int inLocalPlayerIndex);
+	~HubGame();
+
+	// inTickTask: whether hub_tick() runs on its own (mytm task or pool), or the owner calls it
+	void start(bool inTickTask = true);
+	void cleanup(bool inGraceful, int32 inSmallestPostGameTick);
+	bool is_active() const { return mHubActive.load(); }
+	int number() const { return mNumber; }
+
+	// The packet handler, the tick and the owner take turns at the game.  In the standalone
+	// hub each game has its own (recursive) mutex for this; otherwise it's the mytm mutex,
+	// which the packet listener and the tick task already hold when they call in.
+	bool take_mutex();
+	bool try_take_mutex();
+	void release_mutex();
+
+#ifdef A1_NETWORK_STANDALONE_HUB
+	// a packet that came in while the game was busy waits here for its next tick
+	void defer_packet(DDPPacketBufferPtr inPacket);
+	bool pool_tick();
+#endif
+
+#ifdef DEBUG_TIMING_ADJUSTMENTS
+	void open_timing_log();
+#endif
+
+	void received_network_packet(uint16 inPacketMagic, AIStream& ps, DDPPacketBufferPtr inPacket);
+	void received_corrupt_packet(uint16 inPacketMagic, DDPPacketBufferPtr inPacket);
+	bool hub_tick();
+
+	DDPFramePtr outgoing_frame() { return mOutgoingFrame; }
+	void count_received(DDPPacketBufferPtr inPacket);
+	void send_frame(DDPFramePtr inFrame, NetAddrBlock* inAddress);
+	void send_batch();
+	void report_usage(bool inFinal);
 
-// Local player index is used to decide how to send a packet; ref is used for timing.
-static int			sLocalPlayerIndex;
-static int			sReferencePlayerIndex;
+	const NetworkStats& stats(int inPlayerIndex) { return getNetworkPlayer(inPlayerIndex).mStats; }
+	uint32 flags_made_up() const { return mUsage.mFlagsMadeUp; }
+	uint32 late_flags_received() const { return mUsage.mLateFlagsReceived; }
+	const HubTelemetry& telemetry() const { return mTelemetry; }
+	bool take_confirmed_flags(int32& outFirstTick, std::vector<action_flags_t>& outFlags);
 
-static DDPFramePtr	sOutgoingFrame = NULL;
+	// if set, packets go here instead of out the socket
+	StarTransport* mTransport = NULL;
+
+	// wall time spent in the hub on behalf of this game
+	class ProcessingTimer
+	{
+	public:
+		ProcessingTimer(HubGame& inGame) : mGame(inGame), mStart(std::chrono::steady_clock::now()) {}
+		~ProcessingTimer() { mGame.mUsage.mProcessingTime += std::chrono::steady_clock::now() - mStart; }
+	private:
+		HubGame& mGame;
+		std::chrono::steady_clock::time_point mStart;
+	};
+
+private:
+	NetworkPlayer_hub& getNetworkPlayer(size_t inIndex);
+	TickBasedActionQueue& getFlagsQueue(size_t inIndex);
+	TickBasedActionQueue& getLateFlagsQueue(size_t inIndex);
+
+	OSErr send_frame_to_local_spoke(DDPFramePtr frame, NetAddrBlock *address);
+	void check_send_packet_to_spoke();
+
+	void hub_check_for_completion();
+	void player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick);
+	bool make_up_flags_for_first_incomplete_tick();
+	bool player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick);
+	void hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex);
+	void hub_received_identification_packet(AIStream& ps, NetAddrBlock address);
+	void hub_update_player_pregame_state(int inPlayerIndex, int16 state);
+	void process_messages(AIStream& ps, int inSenderIndex);
+	void make_player_netdead(int inPlayerIndex, HubTelemetry::NetDeadReason inReason);
+	void tick_completed(int32 inTick);
+	void send_packets();
+
+	// mNetworkTicker advances even if the game clock doesn't.
+	// mLastNetworkTickSent is used to force us to resend packets (at a lower rate) even if we're no longer
+	// getting new data.
+	int32 mNetworkTicker;
+	int32 mLastNetworkTickSent;
+
+	// We have a pregame startup period to help establish (via standard adjustment mechanism) everyone's
+	// timing.  Ticks smaller than mSmallestRealGameTick are part of this startup period.  They smell
+	// just like real in-game ticks, except that spokes won't enqueue them on player_queues, and we
+	// may have different adjustment window sizes and timeout periods for pre-game and in-game ticks.
+	int32 mSmallestRealGameTick;
+
+	// Once everyone ACKs this tick, we're satisfied the game is ended.  (They should all agree on which
+	// tick is last due to the symmetric execution model.)
+	int32 mSmallestPostGameTick;
+
+	// The mFlagsQueues hold all flags for ticks for which we've received data from at least one
+	// station, but for which we haven't received an ACK from all stations.
+	// mFlagsQueues[all].getReadIndex() == mPlayerDataDisposition.getReadIndex();
+	// max(mFlagsQueues[all].getWriteIndex()) == mPlayerDataDisposition.getWriteIndex();
+	// min(mFlagsQueues[all].getWriteIndex()) == mSmallestIncompleteTick;
+	TickBasedActionQueueCollection	mFlagsQueues;
+
+	// tracks the net ticks each flags tick was *first* sent out at
+	ConcreteTickBasedCircularQueue<int32> mFlagSendTimeQueue{kFlagsQueueSize};
+	int32 mLastRealUpdate;
+
+	// Housekeeping queues:
+	// mPlayerDataDisposition holds an element for every tick for which data has been received from
+	// someone, but which at least one player has not yet acknowledged.
+	// mPlayerDataDisposition.getReadIndex() <= mSmallestIncompleteTick <= mPlayerDataDisposition.getWriteIndex()
+	// mSmallestIncompleteTick indexes into mPlayerDataDisposition also; it divides the queue into ticks
+	// for which data has been received from someone but not yet everyone (>= mSmallestIncompleteTick) and
+	// ticks for which data has been sent out (to everyone) but for which someone hasn't yet acknowledged
+	// (< mSmallestIncompleteTick).
+
+	// The value of a queue element is a bit-set (indexed by player index) with a 1 bit for each player
+	// that we're waiting on.  So, we can mask out successive players' bits as their traffic reaches us;
+	// when the value hits 0, all players have checked in and we can advance an index.
+	// mConnectedPlayersBitmask has '1' set for every connected player.
+	MutableElementsTickBasedCircularQueue<uint32>	mPlayerDataDisposition{kFlagsQueueSize};
+	ConcreteTickBasedCircularQueue<int32> mFirstFlagsTimeQueue{kFlagsQueueSize};	// mNetworkTicker when each tick's first flags came in
+	int32 mSmallestIncompleteTick;
+	uint32 mConnectedPlayersBitmask;
+	uint32 mLaggingPlayersBitmask;
+
+
+	// mPlayerReflectedFlags holds an element for every tick for which data has been
+	// sent but at least one player has not yet acknowledged
+	//
+	// the value of a queue element is a bit-set (indexed by player index) with a 1
+	// bit for each player we've altered flags and need to reflect flags for
+	MutableElementsTickBasedCircularQueue<uint32> mPlayerReflectedFlags{kFlagsQueueSize};
+
+	// mLateFlagsQueues hold late flags we've received from lagging players
+	TickBasedActionQueueCollection mLateFlagsQueues;
+
+	// holds the last real flags we received from this player
+	vector<action_flags_t> mLastFlagsReceived;
+
+	// mSmallestUnsentTick is used for reducing the number of packets sent: we won't send a packet unless
+	// mSmallestIncompleteTick - mSmallestUnsentTick >= sHubPreferences.mSendPeriod
+	int32 mSmallestUnsentTick;
+
+	AddressToPlayerIndexType	mAddressToPlayerIndex;
+
+	NetworkPlayerCollection	mNetworkPlayers;
+
+	// Local player index is used to decide how to send a packet; ref is used for timing.
+	int			mLocalPlayerIndex;
+	int			mReferencePlayerIndex;
+
+	DDPFramePtr	mOutgoingFrame = NULL;
 
 #ifndef A1_NETWORK_STANDALONE_HUB
-static DDPPacketBuffer	sLocalOutgoingBuffer;
-static bool		sNeedToSendLocalOutgoingBuffer = false;
+	DDPPacketBuffer	mLocalOutgoingBuffer;
+	bool		mNeedToSendLocalOutgoingBuffer = false;
+#endif
+
+	// send_packets() scratch space, kept between calls
+	struct SpokePacket {
+		bool mReady;
+		bool mReflectFlags;
+		bool mCompactFlags;
+		int32 mStartTick;
+		int32 mEndTick;
+		uint16 mHeaderSize;
+	};
+	std::vector<SpokePacket> mSpokePackets;
+	std::vector<byte> mSpokeHeaders;	// kSpokePacketHeaderSize bytes per player
+	std::vector<byte> mSharedFlags;		// every player's flags, tick-major
+	std::vector<int32> mSmallestTickWeWontSend;
+	std::vector<uint32> mCompactFlagsToSend;
+	std::vector<std::vector<uint8>> mCompactFlags;	// each compact spoke's packed flags
+	DDPSendBatch mSendBatch;
+
+	myTMTaskPtr	mHubTickTask = NULL;
+	std::atomic_bool	mHubActive = { false };	// used to enable the packet handler
+
+	// totals since the game started, and as of the last periodic report
+	struct Usage {
+		std::chrono::steady_clock::duration mProcessingTime = std::chrono::steady_clock::duration::zero();
+		uint32 mPacketsReceived = 0;
+		uint32 mBytesReceived = 0;
+		uint32 mPacketsSent = 0;
+		uint32 mBytesSent = 0;
+		uint32 mFlagsMadeUp = 0;
+		uint32 mLateFlagsReceived = 0;
+	};
+
+	Usage mUsage;
+	Usage mLastReportUsage;
+	HubTelemetry mTelemetry;
+
+	// Without a local player, the flags of each real game tick are kept once it's complete, for
+	// take_confirmed_flags() (on the main thread) to hand on to spectators.  Only this mutex is
+	// shared with the main thread, and it's never held for longer than an append or a swap.
+	bool mKeepConfirmedFlags;
+	std::mutex mConfirmedFlagsMutex;
+	std::vector<action_flags_t> mConfirmedFlags;	// tick-major, every player
+	int32 mConfirmedFlagsStartTick;
+
+	std::chrono::steady_clock::time_point mStartTime;
+	std::chrono::steady_clock::time_point mLastReportTime;
+
+	int mNumber;	// tells the standalone hub's games apart in its logs and files
+
+public:
+	uint32 mLastTelemetryWrite = 0;
+
+private:
+#ifdef A1_NETWORK_STANDALONE_HUB
+	std::recursive_mutex mMutex;
+	std::mutex mDeferredPacketsMutex;
+	std::vector<DDPPacketBuffer> mDeferredPackets;
+	std::vector<DDPPacketBuffer> mProcessingPackets;
+#endif
+
+#ifdef DEBUG_TIMING_ADJUSTMENTS
+	OpenedFile mTimingFile;
+	boost::iostreams::stream<opened_file_device> mTiming;
+	bool mDebugTimingAdjustments = false;
+	std::vector<std::string> mPlayerNames;	// the tick may not run where NetGetPlayerData() can answer
+#endif
+};
+
+// exception-safe HubGame::take_mutex()
+class HubGameMutexTaker
+{
+public:
+	HubGameMutexTaker(HubGame& inGame) : mGame(inGame) { mRelease = mGame.take_mutex(); }
+	~HubGameMutexTaker() { if (mRelease) mGame.release_mutex(); }
+private:
+	HubGame& mGame;
+	bool mRelease;
+};
+
+// The game hosted from this thread.  On a client the mytm mutex guards it: the packet handler
+// and the tick task both run with it held.  The standalone hub's games each have a thread of
+// their own, and the packet handler and the tick pool find them through the registry below.
+static NET_GAME_STATE std::unique_ptr<HubGame> sHubGame;
+
+static std::atomic<int> sHubGameCount(0);
+
+#ifdef A1_NETWORK_STANDALONE_HUB
+// The standalone hub ticks all of its games from a few worker threads, rather than from a mytm
+// task (and a thread) each; a game stays with the worker it was given, which ticks its games
+// one after the other every tick period.
+class HubTickPool
+{
+public:
+	static HubTickPool* instance();
+
+	void add(HubGame* inGame);
+	// returns once the game's worker is done with it
+	void remove(HubGame* inGame);
+
+private:
+	struct Worker {
+		std::mutex mMutex;	// held for a whole pass
+		std::vector<HubGame*> mGames;
+	};
+
+	HubTickPool();
+	void run(Worker* inWorker);
+
+	std::mutex mMutex;
+	std::vector<std::unique_ptr<Worker>> mWorkers;
+};
+
+// Every game the standalone hub is running, by session (which spokes send in their
+// identification packets), and by the address of each player it's heard from
+static std::mutex sHubGamesMutex;
+static std::map<std::string, HubGame*> sHubGamesBySession;
+static std::map<NetAddrBlock, HubGame*, NetAddrBlockCompare> sHubGamesByAddress;
 #endif
 
-static myTMTaskPtr	sHubTickTask = NULL;
-static std::atomic_bool	sHubActive = { false };	// used to enable the packet handler
-static bool sHubInitialized = false;
+static void register_hub_game(HubGame* inGame, const std::string& inSessionIdentifier);
+static void unregister_hub_game(HubGame* inGame);
+static void register_hub_game_address(HubGame* inGame, const NetAddrBlock& inAddress);
+static void unregister_hub_game_address(const NetAddrBlock& inAddress);
 
+static void hub_write_telemetry();
 
-static void hub_check_for_completion();
-static void player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick);
-static bool player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick);
-static void hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex);
-static void hub_received_identification_packet(AIStream& ps, NetAddrBlock address);
-static void hub_update_player_pregame_state(int inPlayerIndex, int16 state);
-static void hub_received_ping_request(AIStream& ps, NetAddrBlock address);
+#ifndef A1_NETWORK_STANDALONE_HUB
+static bool hub_tick_task();
+#endif
+static void hub_received_network_packet(HubGame* inGame, DDPPacketBufferPtr inPacket);
+static void hub_received_ping_request(HubGame* inGame, AIStream& ps, NetAddrBlock address);
 static void hub_received_ping_response(AIStream& ps, NetAddrBlock address);
-static void process_messages(AIStream& ps, int inSenderIndex);
-static void make_player_netdead(int inPlayerIndex);
-static bool hub_tick();
-static void send_packets();
 
 
 
 // These are excellent candidates for templatization, but MSVC++6.0 has broken function templates.
 // (Actually, they might not be broken if the template parameter is a typename, but... not taking chances.)
-static inline NetworkPlayer_hub&
-getNetworkPlayer(size_t inIndex)
+inline NetworkPlayer_hub&
+HubGame::getNetworkPlayer(size_t inIndex)
 {
-        assert(inIndex < sNetworkPlayers.size());
-        return sNetworkPlayers[inIndex];
+        assert(inIndex < mNetworkPlayers.size());
+        return mNetworkPlayers[inIndex];
 }
 
-static inline TickBasedActionQueue&
-getFlagsQueue(size_t inIndex)
+inline TickBasedActionQueue&
+HubGame::getFlagsQueue(size_t inIndex)
 {
-        assert(inIndex < sFlagsQueues.size());
-        return sFlagsQueues[inIndex];
+        assert(inIndex < mFlagsQueues.size());
+        return mFlagsQueues[inIndex];
 }
 
-static inline TickBasedActionQueue&
-getLateFlagsQueue(size_t inIndex)
+inline TickBasedActionQueue&
+HubGame::getLateFlagsQueue(size_t inIndex)
 {
-	assert(inIndex < sFlagsQueues.size());
-	return sLateFlagsQueues[inIndex];
+	assert(inIndex < mFlagsQueues.size());
+	return mLateFlagsQueues[inIndex];
 }
 
 
@@ -360,14 +591,14 @@ operator <(const NetAddrBlock& a, const NetAddrBlock& b)
 }
 
 
-static OSErr
-send_frame_to_local_spoke(DDPFramePtr frame, NetAddrBlock *address)
+OSErr
+HubGame::send_frame_to_local_spoke(DDPFramePtr frame, NetAddrBlock *address)
 {
 #ifndef A1_NETWORK_STANDALONE_HUB
-        sLocalOutgoingBuffer.datagramSize = frame->data_size;
-        memcpy(sLocalOutgoingBuffer.datagramData, frame->data, frame->data_size);
+        mLocalOutgoingBuffer.datagramSize = frame->data_size;
+        memcpy(mLocalOutgoingBuffer.datagramData, frame->data, frame->data_size);
         // We ignore the 'source address' because the spoke does too.
-        sNeedToSendLocalOutgoingBuffer = true;
+        mNeedToSendLocalOutgoingBuffer = true;
         return noErr;
 #else
 	// Standalone hub should never call this routine
@@ -378,15 +609,15 @@ send_frame_to_local_spoke(DDPFramePtr frame, NetAddrBlock *address)
 
 
 
-static inline void
-check_send_packet_to_spoke()
+inline void
+HubGame::check_send_packet_to_spoke()
 {
 	// Routine exists but has no implementation on standalone hub.
 #ifndef A1_NETWORK_STANDALONE_HUB
-        if(sNeedToSendLocalOutgoingBuffer)
-                spoke_received_network_packet(&sLocalOutgoingBuffer);
+        if(mNeedToSendLocalOutgoingBuffer)
+                spoke_received_network_packet(&mLocalOutgoingBuffer);
 
-        sNeedToSendLocalOutgoingBuffer = false;
+        mNeedToSendLocalOutgoingBuffer = false;
 #endif // A1_NETWORK_STANDALONE_HUB
 }
 
@@ -396,93 +627,58 @@ check_send_packet_to_spoke()
 #define INT32_MAX 0x7fffffff
 #endif
 
-void
-hub_initialize(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, int inLocalPlayerIndex)
+HubGame::HubGame(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, int inLocalPlayerIndex) :
+	mTelemetry(inNumPlayers),
+	mNumber(++sHubGameCount)
 {
-#ifdef DEBUG_TIMING_ADJUSTMENTS
-	FileSpecifier fs;
-	fs.SetToLocalDataDir();
-	fs.AddPart("TimingDebug");
-	if (fs.Exists() && fs.IsDir())
-	{
-		time_t t;
-		struct tm* now;
-		
-		time(&t);
-		now = localtime(&t);
-		
-		char buffer[80];
-		strftime(buffer, 80, "%Y%m%d%H%M%S", now);
-
-		std::stringstream ss;
-		ss << buffer << "_" << inNumPlayers << "P.txt";
-
-		fs.AddPart(ss.str());
-		
-		if (fs.OpenForWritingText(dout_file))
-		{
-			dout.open(dout_file);
-			dout << "Players: " << inNumPlayers << std::endl;
-			dout << "Latency Tolerance: " << sHubPreferences.mMinimumSendPeriod << std::endl;
-			debug_timing_adjustments = true;
-		}
-	}
-	else
-	{
-		debug_timing_adjustments = false;
-	}
-#endif
-
 #ifdef A1_NETWORK_STANDALONE_HUB
 	assert(inLocalPlayerIndex == NONE);
-	sReferencePlayerIndex = NONE;
-#else
-	assert(inLocalPlayerIndex < inNumPlayers);
-	sReferencePlayerIndex = inLocalPlayerIndex;
 #endif
+	assert(inLocalPlayerIndex < inNumPlayers);
+
+	// Without a local player (standalone hub, test bench), the first connected player is the reference
+	mReferencePlayerIndex = inLocalPlayerIndex;
 
-        sLocalPlayerIndex = inLocalPlayerIndex;
+        mLocalPlayerIndex = inLocalPlayerIndex;
 
-	sSmallestPostGameTick = INT32_MAX;
-        sSmallestRealGameTick = inStartingTick;
+	mSmallestPostGameTick = INT32_MAX;
+        mSmallestRealGameTick = inStartingTick;
         int32 theFirstTick = inStartingTick - kPregameTicks;
 
-        if(sOutgoingFrame == NULL)
-                sOutgoingFrame = NetDDPNewFrame();
+        if(mOutgoingFrame == NULL)
+                mOutgoingFrame = NetDDPNewFrame();
 
 #ifndef A1_NETWORK_STANDALONE_HUB
-        sNeedToSendLocalOutgoingBuffer = false;
+        mNeedToSendLocalOutgoingBuffer = false;
 #endif
 
-        sNetworkPlayers.clear();
-        sFlagsQueues.clear();
-	sLateFlagsQueues.clear();
-        sNetworkPlayers.resize(inNumPlayers);
-        sFlagsQueues.resize(inNumPlayers, TickBasedActionQueue(kFlagsQueueSize));
-	sLateFlagsQueues.resize(inNumPlayers, TickBasedActionQueue(kFlagsQueueSize));
+        mNetworkPlayers.clear();
+        mFlagsQueues.clear();
+	mLateFlagsQueues.clear();
+        mNetworkPlayers.resize(inNumPlayers);
+        mFlagsQueues.resize(inNumPlayers, TickBasedActionQueue(kFlagsQueueSize));
+	mLateFlagsQueues.resize(inNumPlayers, TickBasedActionQueue(kFlagsQueueSize));
 
-        sAddressToPlayerIndex.clear();
-        sConnectedPlayersBitmask = 0;
+        mAddressToPlayerIndex.clear();
+        mConnectedPlayersBitmask = 0;
 
         for(size_t i = 0; i < inNumPlayers; i++)
         {
-                NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
+                NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
 
                 if(inPlayerAddresses[i] != NULL)
                 {
-#ifdef A1_NETWORK_STANDALONE_HUB
-					if (sReferencePlayerIndex == NONE) sReferencePlayerIndex = i;
-#endif
+					if (mReferencePlayerIndex == NONE) mReferencePlayerIndex = i;
                         thePlayer.mConnected = true;
-                        sConnectedPlayersBitmask |= (((uint32)1) << i);
+                        mConnectedPlayersBitmask |= (((uint32)1) << i);
 			thePlayer.mAddressKnown = false;
                         // thePlayer.mAddress = *(inPlayerAddresses[i]); (jkvw: see note below)
                         // Currently, all-0 address is cue for local spoke.
 			// jkvw: The "real" addresses for spokes won't be known unti we get some UDP traffic
 			//	 from them - we'll update as they become known.
-                        if(i == sLocalPlayerIndex) { // jkvw: I don't need this, do I?
+                        if(i == mLocalPlayerIndex) { // jkvw: I don't need this, do I?
                                 obj_clear(thePlayer.mAddress);
-				sAddressToPlayerIndex[thePlayer.mAddress] = i;
+				mAddressToPlayerIndex[thePlayer.mAddress] = i;
 				thePlayer.mAddressKnown = true;
 			}
                 }
@@ -493,6 +689,7 @@ hub_initialize(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const
 
                 thePlayer.mLastNetworkTickHeard = 0;
 		thePlayer.mLastRecoverySend = 0;
+		thePlayer.mCompactFlags = false;
                 thePlayer.mSmallestUnacknowledgedTick = theFirstTick;
 		thePlayer.mSmallestUnheardTick = theFirstTick;
 		thePlayer.mNthElementFinder.reset(sHubPreferences.mPregameWindowSize);
@@ -508,131 +705,595 @@ hub_initialize(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const
 		thePlayer.mStats.pregame_state = thePlayer.mConnected ? NetworkStats::invalid : NetworkStats::disconnected;
 		thePlayer.mStats.errors = 0;
 
-                sFlagsQueues[i].reset(theFirstTick);
-		sLateFlagsQueues[i].reset(theFirstTick);
+                mFlagsQueues[i].reset(theFirstTick);
+		mLateFlagsQueues[i].reset(theFirstTick);
         }
 
+		if (mReferencePlayerIndex == NONE) mReferencePlayerIndex = 0; //we have no connected players at this point, but just in case
+        
+        mPlayerDataDisposition.reset(theFirstTick);
+	mFirstFlagsTimeQueue.reset(theFirstTick);
+	mPlayerReflectedFlags.reset(theFirstTick);
+	mLastFlagsReceived.resize(inNumPlayers);
+	mFlagSendTimeQueue.reset(theFirstTick);
+        mSmallestIncompleteTick = theFirstTick;
+	mSmallestUnsentTick = theFirstTick;
+        mNetworkTicker = 0;
+        mLastNetworkTickSent = 0;
+	mLastRealUpdate = 0;
+	mLaggingPlayersBitmask = 0;
+
+	mKeepConfirmedFlags = (mLocalPlayerIndex == NONE);
+	mConfirmedFlagsStartTick = inStartingTick;
+
+	mStartTime = mLastReportTime = std::chrono::steady_clock::now();
+}
+
+HubGame::~HubGame()
+{
+	if (mOutgoingFrame)
+		NetDDPDisposeFrame(mOutgoingFrame);
+
+#ifdef DEBUG_TIMING_ADJUSTMENTS
+	if (mDebugTimingAdjustments)
+	{
+		mTiming.close();
+		mTimingFile.Close();
+	}
+#endif
+}
+
+bool
+HubGame::take_mutex()
+{
 #ifdef A1_NETWORK_STANDALONE_HUB
-		if (sReferencePlayerIndex == NONE) sReferencePlayerIndex = 0; //we have no connected players at this point, but just in case
+	mMutex.lock();
+	return true;
+#else
+	return take_mytm_mutex();
 #endif
-        
-        sPlayerDataDisposition.reset(theFirstTick);
-	sPlayerReflectedFlags.reset(theFirstTick);
-	sLastFlagsReceived.resize(inNumPlayers);
-	sFlagSendTimeQueue.reset(theFirstTick);
-        sSmallestIncompleteTick = theFirstTick;
-	sSmallestUnsentTick = theFirstTick;
-        sNetworkTicker = 0;
-        sLastNetworkTickSent = 0;
-	sLastRealUpdate = 0;
-	sLaggingPlayersBitmask = 0;
-
-        sHubActive = true;
-
-        sHubTickTask = myXTMSetup(1000/TICKS_PER_SECOND, hub_tick);
-
-	sHubInitialized = true;
 }
 
-bool hub_is_active()
+bool
+HubGame::try_take_mutex()
 {
-	return sHubActive.load();
+#ifdef A1_NETWORK_STANDALONE_HUB
+	return mMutex.try_lock();
+#else
+	return try_take_mytm_mutex();
+#endif
 }
 
 void
-hub_cleanup(bool inGraceful, int32 inSmallestPostGameTick)
+HubGame::release_mutex()
+{
+#ifdef A1_NETWORK_STANDALONE_HUB
+	mMutex.unlock();
+#else
+	release_mytm_mutex();
+#endif
+}
+
+#ifdef A1_NETWORK_STANDALONE_HUB
+void
+HubGame::defer_packet(DDPPacketBufferPtr inPacket)
+{
+	std::lock_guard<std::mutex> theLock(mDeferredPacketsMutex);
+	mDeferredPackets.push_back(*inPacket);
+}
+
+bool
+HubGame::pool_tick()
+{
+	HubGameMutexTaker theMutex(*this);
+
+	{
+		std::lock_guard<std::mutex> theLock(mDeferredPacketsMutex);
+		mProcessingPackets.swap(mDeferredPackets);
+	}
+
+	for (auto& thePacket : mProcessingPackets)
+		hub_received_network_packet(this, &thePacket);
+	mProcessingPackets.clear();
+
+	ProcessingTimer theTimer(*this);
+	return hub_tick();
+}
+#endif
+
+#ifdef DEBUG_TIMING_ADJUSTMENTS
+void
+HubGame::open_timing_log()
 {
-	if(sHubInitialized)
+	FileSpecifier fs;
+	fs.SetToLocalDataDir();
+	fs.AddPart("TimingDebug");
+	if (fs.Exists() && fs.IsDir())
 	{
-		if(inGraceful)
+		time_t t;
+		struct tm* now;
+		
+		time(&t);
+		now = localtime(&t);
+		
+		char buffer[80];
+		strftime(buffer, 80, "%Y%m%d%H%M%S", now);
+
+		std::stringstream ss;
+		ss << buffer << "_";
+#ifdef A1_NETWORK_STANDALONE_HUB
+		ss << mNumber << "_";
+#endif
+		ss << mNetworkPlayers.size() << "P.txt";
+
+		fs.AddPart(ss.str());
+		
+		if (fs.OpenForWritingText(mTimingFile))
 		{
-			// Signal our demise
-			sSmallestPostGameTick = inSmallestPostGameTick;
+			mTiming.open(mTimingFile);
+			mTiming << "Players: " << mNetworkPlayers.size() << std::endl;
+			mTiming << "Latency Tolerance: " << sHubPreferences.mMinimumSendPeriod << std::endl;
+			mDebugTimingAdjustments = true;
 
-			// We have to do a check now in case the conditions are already met
-			if(take_mytm_mutex())
-			{
-				hub_check_for_completion();
-				release_mytm_mutex();
-			}
-			
-			// Now we should wait/sleep for the rest of the machinery to wind down
-			// Packet handler will set sHubActive = false once it has acks from all connected players;
-			while(sHubActive)
-			{
-// Here we try to isolate the "Classic" Mac OS (we can only sleep on the others)
-				// TODO: replace with a cond?
-				yield();
-			}
+			for (size_t i = 0; i < mNetworkPlayers.size(); i++)
+				mPlayerNames.push_back(reinterpret_cast<player_info*>(NetGetPlayerData(i))->name);
 		}
-		else
-		{		
-			// Stop processing incoming packets (packet processor won't start processing another packet
-			// due to sHubActive = false, and we know it's not in the middle of processing one because
-			// we take the mutex).
-			if(take_mytm_mutex())
-			{
-				sHubActive = false;
-				release_mytm_mutex();
-			}
+	}
+}
+#endif
+
+void
+HubGame::start(bool inTickTask)
+{
+        mHubActive = true;
+
+	if (inTickTask)
+	{
+#ifdef A1_NETWORK_STANDALONE_HUB
+		HubTickPool::instance()->add(this);
+#else
+		mHubTickTask = myXTMSetup(1000/TICKS_PER_SECOND, hub_tick_task);
+#endif
+	}
+}
+
+void
+HubGame::cleanup(bool inGraceful, int32 inSmallestPostGameTick)
+{
+	if(inGraceful)
+	{
+		// Signal our demise
+		mSmallestPostGameTick = inSmallestPostGameTick;
+
+		// We have to do a check now in case the conditions are already met
+		if(take_mutex())
+		{
+			hub_check_for_completion();
+			release_mutex();
 		}
-	
-		// Mark the tick task for cancellation (it won't start running again after this returns).
-		myTMRemove(sHubTickTask);
-		sHubTickTask = NULL;
-	
-		// This waits for the tick task to actually finish - so we know the tick task isn't in
-		// the middle of processing when we do the rest of the cleanup below.
-		myTMCleanup();
 		
-		sNetworkPlayers.clear();
-		sFlagsQueues.clear();
-		sLateFlagsQueues.clear();
+		// Now we should wait/sleep for the rest of the machinery to wind down
+		// Packet handler will set mHubActive = false once it has acks from all connected players;
+		while(mHubActive)
+		{
+// Here we try to isolate the "Classic" Mac OS (we can only sleep on the others)
+			// TODO: replace with a cond?
+			yield();
+		}
+	}
+	else
+	{		
+		// Stop processing incoming packets (packet processor won't start processing another packet
+		// due to mHubActive = false, and we know it's not in the middle of processing one because
+		// we take the mutex).
+		if(take_mutex())
+		{
+			mHubActive = false;
+			release_mutex();
+		}
+	}
+
+#ifdef A1_NETWORK_STANDALONE_HUB
+	// Once this returns the pool won't tick us again, and isn't in the middle of doing so.
+	HubTickPool::instance()->remove(this);
+#else
+	// Mark the tick task for cancellation (it won't start running again after this returns).
+	myTMRemove(mHubTickTask);
+	mHubTickTask = NULL;
+
+	// This waits for the tick task to actually finish - so we know the tick task isn't in
+	// the middle of processing when we do the rest of the cleanup below.
+	myTMCleanup();
+#endif
+}
+
+void
+HubGame::count_received(DDPPacketBufferPtr inPacket)
+{
+	mUsage.mPacketsReceived++;
+	mUsage.mBytesReceived += inPacket->datagramSize;
+
+	AddressToPlayerIndexType::iterator theEntry = mAddressToPlayerIndex.find(inPacket->sourceAddress);
+	if (theEntry != mAddressToPlayerIndex.end())
+	{
+		HubPlayerTelemetry& thePlayer = mTelemetry.player(theEntry->second);
+		thePlayer.mPacketsIn.fetch_add(1, std::memory_order_relaxed);
+		thePlayer.mBytesIn.fetch_add(inPacket->datagramSize, std::memory_order_relaxed);
+	}
+}
+
+void
+HubGame::send_frame(DDPFramePtr inFrame, NetAddrBlock* inAddress)
+{
+	mUsage.mPacketsSent++;
+	mUsage.mBytesSent += inFrame->data_size;
+	if (mTransport)
+		mTransport->send(*inAddress, inFrame->data, inFrame->data_size);
+	else
+		NetDDPSendFrame(inFrame, inAddress);
+}
+
+void
+HubGame::send_batch()
+{
+	for (auto& datagram : mSendBatch.datagrams)
+	{
+		mUsage.mPacketsSent++;
+		mUsage.mBytesSent += datagram.size;
+
+		AddressToPlayerIndexType::iterator theEntry = mAddressToPlayerIndex.find(datagram.address);
+		if (theEntry != mAddressToPlayerIndex.end())
+		{
+			HubPlayerTelemetry& thePlayer = mTelemetry.player(theEntry->second);
+			thePlayer.mPacketsOut.fetch_add(1, std::memory_order_relaxed);
+			thePlayer.mBytesOut.fetch_add(datagram.size, std::memory_order_relaxed);
+		}
+	}
+
+	if (mSendBatch.datagrams.empty())
+		return;
 
-		sAddressToPlayerIndex.clear();
-		NetDDPDisposeFrame(sOutgoingFrame);
-		sOutgoingFrame = NULL;
+	if (mTransport)
+		mTransport->send(mSendBatch);
+	else
+		NetDDPSendBatch(mSendBatch);
+}
 
+void
+HubGame::report_usage(bool inFinal)
+{
+	auto now = std::chrono::steady_clock::now();
+	const Usage& since = inFinal ? Usage() : mLastReportUsage;
+	auto elapsed = now - (inFinal ? mStartTime : mLastReportTime);
+
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	double processing = std::chrono::duration<double>(mUsage.mProcessingTime - since.mProcessingTime).count();
+	uint32 bytesReceived = mUsage.mBytesReceived - since.mBytesReceived;
+	uint32 bytesSent = mUsage.mBytesSent - since.mBytesSent;
+
+	if (seconds <= 0)
+		return;
+
+	// may be called from the tick task
+	logNoteNMT("hub game %d (%d players) %s %.0f s: %.3f s processing (%.2f%% of a core); received %u packets, %.1f KB/s; sent %u packets, %.1f KB/s; made up %u flags, %u arrived late",
+		   mNumber,
+		   static_cast<int>(mNetworkPlayers.size()),
+		   inFinal ? "ended after" : "usage over last",
+		   seconds,
+		   processing,
+		   processing * 100.0 / seconds,
+		   mUsage.mPacketsReceived - since.mPacketsReceived,
+		   bytesReceived / 1024.0 / seconds,
+		   mUsage.mPacketsSent - since.mPacketsSent,
+		   bytesSent / 1024.0 / seconds,
+		   mUsage.mFlagsMadeUp - since.mFlagsMadeUp,
+		   mUsage.mLateFlagsReceived - since.mLateFlagsReceived);
+
+	mLastReportUsage = mUsage;
+	mLastReportTime = now;
+}
+
+void
+hub_initialize(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, int inLocalPlayerIndex, const std::string& inSessionIdentifier)
+{
+	std::unique_ptr<HubGame> theGame(new HubGame(inStartingTick, inNumPlayers, inPlayerAddresses, inLocalPlayerIndex));
 #ifdef DEBUG_TIMING_ADJUSTMENTS
-		if (debug_timing_adjustments)
+	theGame->open_timing_log();
+#endif
+	theGame->mLastTelemetryWrite = machine_tick_count();
+
+	{
+		MyTMMutexTaker mutex;
+		sHubGame = std::move(theGame);
+	}
+	register_hub_game(sHubGame.get(), inSessionIdentifier);
+
+	sHubGame->start();
+}
+
+bool hub_is_active()
+{
+	return sHubGame && sHubGame->is_active();
+}
+
+void
+hub_cleanup(bool inGraceful, int32 inSmallestPostGameTick)
+{
+	if(sHubGame)
+	{
+		sHubGame->cleanup(inGraceful, inSmallestPostGameTick);
+		sHubGame->report_usage(true);
+		if (sHubPreferences.mTelemetryPeriod > 0)
+			hub_write_telemetry();
+
+		// The packet handler may still be called (e.g. for pings) - make sure it's not
+		// looking at the game while it goes away.
+		unregister_hub_game(sHubGame.get());
+#ifdef A1_NETWORK_STANDALONE_HUB
+		// nothing can find the game now, so once we've had our turn at it, nothing has it
 		{
-			dout.close();
-			dout_file.Close();
+			HubGameMutexTaker mutex(*sHubGame);
+		}
+		sHubGame.reset();
+#else
+		{
+			MyTMMutexTaker mutex;
+			sHubGame.reset();
 		}
 #endif
 	}
 }
 
+#ifndef A1_NETWORK_STANDALONE_HUB
+static bool
+hub_tick_task()
+{
+	NetDDPDispatchPackets();
+
+	if (!sHubGame)
+		return false;
+
+	HubGame::ProcessingTimer timer(*sHubGame);
+	return sHubGame->hub_tick();
+}
+#endif
+
 
 
-static void
-hub_check_for_completion()
+void
+HubGame::hub_check_for_completion()
 {
-	// When all players (including the local spoke) have either ACKed up to sSmallestPostGameTick
+	// When all players (including the local spoke) have either ACKed up to mSmallestPostGameTick
 	// or become disconnected, we're clear to cleanup.  (In other words, we should avoid cleaning
 	// up if there are connected players that haven't ACKed up to the game's end tick.)
 	bool someoneStillActive = false;
-	for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+	for(size_t i = 0; i < mNetworkPlayers.size(); i++)
 	{
-		NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
-		if(thePlayer.mConnected && thePlayer.mSmallestUnacknowledgedTick < sSmallestPostGameTick)
+		NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
+		if(thePlayer.mConnected && thePlayer.mSmallestUnacknowledgedTick < mSmallestPostGameTick)
 		{
 			someoneStillActive = true;
 			break;
 		}
 	}
 
-	if (!someoneStillActive) 
-		sHubActive = false;
-}
-		
+	if (!someoneStillActive) 
+		mHubActive = false;
+}
+		
+
+
+#ifdef A1_NETWORK_STANDALONE_HUB
+HubTickPool*
+HubTickPool::instance()
+{
+	// never destroyed: its workers run for as long as the hub does
+	static HubTickPool* sPool = new HubTickPool();
+	return sPool;
+}
+
+HubTickPool::HubTickPool()
+{
+	int theWorkerCount = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 0; i < theWorkerCount; i++)
+	{
+		mWorkers.emplace_back(new Worker());
+		std::thread(&HubTickPool::run, this, mWorkers.back().get()).detach();
+	}
+}
+
+void
+HubTickPool::add(HubGame* inGame)
+{
+	std::lock_guard<std::mutex> thePoolLock(mMutex);
+
+	Worker* theWorker = NULL;
+	size_t theFewestGames = SIZE_MAX;
+	for (auto& worker : mWorkers)
+	{
+		std::lock_guard<std::mutex> theWorkerLock(worker->mMutex);
+		if (worker->mGames.size() < theFewestGames)
+		{
+			theWorker = worker.get();
+			theFewestGames = worker->mGames.size();
+		}
+	}
+
+	std::lock_guard<std::mutex> theWorkerLock(theWorker->mMutex);
+	theWorker->mGames.push_back(inGame);
+}
+
+void
+HubTickPool::remove(HubGame* inGame)
+{
+	std::lock_guard<std::mutex> thePoolLock(mMutex);
+
+	for (auto& worker : mWorkers)
+	{
+		std::lock_guard<std::mutex> theWorkerLock(worker->mMutex);
+		worker->mGames.erase(std::remove(worker->mGames.begin(), worker->mGames.end(), inGame), worker->mGames.end());
+	}
+}
+
+void
+HubTickPool::run(Worker* inWorker)
+{
+	// like a mytm task, keep to the schedule, catching up if a pass ran late
+	const auto thePeriod = std::chrono::milliseconds(1000 / TICKS_PER_SECOND);
+	auto theNextPass = std::chrono::steady_clock::now() + thePeriod;
+
+	while (true)
+	{
+		std::this_thread::sleep_until(theNextPass);
+		theNextPass += thePeriod;
+
+		std::lock_guard<std::mutex> theWorkerLock(inWorker->mMutex);
+
+		// a game whose tick says it's done isn't ticked again
+		inWorker->mGames.erase(std::remove_if(inWorker->mGames.begin(), inWorker->mGames.end(), [](HubGame* game) {
+			return !game->pool_tick();
+		}), inWorker->mGames.end());
+	}
+}
+
+// Finds the game a packet is for: the one that's heard from its sender, or else, for an
+// identification packet, the one with its session.  Spokes from before session ids only
+// find their game while it's the hub's only one.  Caller must hold sHubGamesMutex.
+static HubGame*
+find_hub_game(DDPPacketBufferPtr inPacket)
+{
+	auto theEntry = sHubGamesByAddress.find(inPacket->sourceAddress);
+	if (theEntry != sHubGamesByAddress.end())
+		return theEntry->second;
+
+	std::string theSessionIdentifier;
+	try {
+		AIStreamBE ps(inPacket->datagramData, inPacket->datagramSize);
+
+		uint16 thePacketMagic;
+		uint16 thePacketCRC;
+		ps >> thePacketMagic >> thePacketCRC;
+
+		if (thePacketMagic == kSpokeToHubIdentification)
+		{
+			int16 theSenderIndex;
+			ps >> theSenderIndex;
+
+			if (ps.maxg() > ps.tellg())
+			{
+				uint8 theLength;
+				ps >> theLength;
+				theSessionIdentifier.resize(theLength);
+				if (theLength)
+					ps.read(&theSessionIdentifier[0], theLength);
+			}
+		}
+	}
+	catch (...)
+	{
+		theSessionIdentifier.clear();
+	}
+
+	if (!theSessionIdentifier.empty())
+	{
+		auto theGame = sHubGamesBySession.find(theSessionIdentifier);
+		if (theGame != sHubGamesBySession.end())
+			return theGame->second;
+	}
+
+	return sHubGamesBySession.size() == 1 ? sHubGamesBySession.begin()->second : NULL;
+}
+#endif
+
+static void
+register_hub_game(HubGame* inGame, const std::string& inSessionIdentifier)
+{
+#ifdef A1_NETWORK_STANDALONE_HUB
+	std::lock_guard<std::mutex> theLock(sHubGamesMutex);
+	sHubGamesBySession[inSessionIdentifier] = inGame;
+#endif
+}
+
+static void
+unregister_hub_game(HubGame* inGame)
+{
+#ifdef A1_NETWORK_STANDALONE_HUB
+	std::lock_guard<std::mutex> theLock(sHubGamesMutex);
+
+	for (auto it = sHubGamesBySession.begin(); it != sHubGamesBySession.end();)
+	{
+		if (it->second == inGame)
+			it = sHubGamesBySession.erase(it);
+		else
+			++it;
+	}
+
+	for (auto it = sHubGamesByAddress.begin(); it != sHubGamesByAddress.end();)
+	{
+		if (it->second == inGame)
+			it = sHubGamesByAddress.erase(it);
+		else
+			++it;
+	}
+#endif
+}
+
+static void
+register_hub_game_address(HubGame* inGame, const NetAddrBlock& inAddress)
+{
+#ifdef A1_NETWORK_STANDALONE_HUB
+	std::lock_guard<std::mutex> theLock(sHubGamesMutex);
+	sHubGamesByAddress[inAddress] = inGame;
+#endif
+}
+
+static void
+unregister_hub_game_address(const NetAddrBlock& inAddress)
+{
+#ifdef A1_NETWORK_STANDALONE_HUB
+	std::lock_guard<std::mutex> theLock(sHubGamesMutex);
+	sHubGamesByAddress.erase(inAddress);
+#endif
+}
+
+void
+hub_received_network_packet(DDPPacketBufferPtr inPacket)
+{
+#ifdef A1_NETWORK_STANDALONE_HUB
+	// The games share the socket, so find this packet's game.  If the game's busy (ticking,
+	// most likely), the packet waits for its next tick rather than holding up everyone else's.
+	HubGame* theGame;
+	{
+		std::lock_guard<std::mutex> theLock(sHubGamesMutex);
+		theGame = find_hub_game(inPacket);
+		if (theGame && !theGame->try_take_mutex())
+		{
+			theGame->defer_packet(inPacket);
+			return;
+		}
+	}
+
+	hub_received_network_packet(theGame, inPacket);
 
+	if (theGame)
+		theGame->release_mutex();
+#else
+	hub_received_network_packet(sHubGame.get(), inPacket);
+#endif
+}
 
-void
-hub_received_network_packet(DDPPacketBufferPtr inPacket)
+static void
+hub_received_network_packet(HubGame* theGame, DDPPacketBufferPtr inPacket)
 {
 	logContextNMT("hub processing a received packet");
 	
+	std::unique_ptr<HubGame::ProcessingTimer> theTimer;
+	if (theGame)
+	{
+		theTimer.reset(new HubGame::ProcessingTimer(*theGame));
+		theGame->count_received(inPacket);
+	}
+
         AIStreamBE ps(inPacket->datagramData, inPacket->datagramSize);
 
 	try {
@@ -640,7 +1301,7 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 		ps >> thePacketMagic;
 
 		// Processing packets?
-		if(!sHubActive &&
+		if((!theGame || !theGame->is_active()) &&
 		   thePacketMagic != kPingRequestPacket &&
 		   thePacketMagic != kPingResponsePacket)
 			return;
@@ -654,25 +1315,57 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 
 		if (thePacketCRC != calculate_data_crc_ccitt(inPacket->datagramData, inPacket->datagramSize))
 		{
-			if (thePacketMagic == kSpokeToHubGameDataPacketV1Magic)
-			{
-				AddressToPlayerIndexType::iterator theEntry = sAddressToPlayerIndex.find(inPacket->sourceAddress);
-				if (theEntry != sAddressToPlayerIndex.end())
-				{
-					int theSenderIndex = theEntry->second;
-					getNetworkPlayer(theSenderIndex).mStats.errors++;
-				}
-			}
+			if (theGame)
+				theGame->received_corrupt_packet(thePacketMagic, inPacket);
 			return;
 		}
 		
                 switch(thePacketMagic)
+                {
+					case kPingRequestPacket:
+						hub_received_ping_request(theGame, ps, inPacket->sourceAddress);
+						break;
+						
+					case kPingResponsePacket:
+						hub_received_ping_response(ps, inPacket->sourceAddress);
+						break;
+						
+                        default:
+				theGame->received_network_packet(thePacketMagic, ps, inPacket);
+			break;
+                }
+	}
+        catch (...)
+	{
+		// ignore errors - we just discard the packet, effectively.
+	}
+}
+
+void
+HubGame::received_corrupt_packet(uint16 inPacketMagic, DDPPacketBufferPtr inPacket)
+{
+	if (inPacketMagic == kSpokeToHubGameDataPacketV1Magic)
+	{
+		AddressToPlayerIndexType::iterator theEntry = mAddressToPlayerIndex.find(inPacket->sourceAddress);
+		if (theEntry != mAddressToPlayerIndex.end())
+		{
+			int theSenderIndex = theEntry->second;
+			getNetworkPlayer(theSenderIndex).mStats.errors++;
+		}
+	}
+}
+
+void
+HubGame::received_network_packet(uint16 inPacketMagic, AIStream& ps, DDPPacketBufferPtr inPacket)
+{
+	try {
+                switch(inPacketMagic)
                 {
                         case kSpokeToHubGameDataPacketV1Magic:
 			{
 				// Find sender
-				AddressToPlayerIndexType::iterator theEntry = sAddressToPlayerIndex.find(inPacket->sourceAddress);
-				if(theEntry == sAddressToPlayerIndex.end())
+				AddressToPlayerIndexType::iterator theEntry = mAddressToPlayerIndex.find(inPacket->sourceAddress);
+				if(theEntry == mAddressToPlayerIndex.end())
 					return;
 				
 				int theSenderIndex = theEntry->second;
@@ -684,7 +1377,7 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 				}
 				else
 				{
-					// Unconnected players should not have entries in sAddressToPlayerIndex
+					// Unconnected players should not have entries in mAddressToPlayerIndex
 					logWarningNMT("received game data packet from disconnected player %i; ignoring", theSenderIndex);
 				}
 			}
@@ -694,14 +1387,6 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 				hub_received_identification_packet(ps, inPacket->sourceAddress);
 			break;
 
-					case kPingRequestPacket:
-						hub_received_ping_request(ps, inPacket->sourceAddress);
-						break;
-						
-					case kPingResponsePacket:
-						hub_received_ping_response(ps, inPacket->sourceAddress);
-						break;
-						
                         default:
 			break;
                 }
@@ -714,69 +1399,73 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
         check_send_packet_to_spoke();
 }
 
-static void 
-hub_update_player_pregame_state(int inPlayerIndex, int16 state)
+void
+HubGame::hub_update_player_pregame_state(int inPlayerIndex, int16 state)
 {
-	if (sNetworkPlayers[inPlayerIndex].mStats.pregame_state == NetworkStats::invalid && sSmallestUnsentTick < sSmallestRealGameTick)
+	if (mNetworkPlayers[inPlayerIndex].mStats.pregame_state == NetworkStats::invalid && mSmallestUnsentTick < mSmallestRealGameTick)
 	{
-		sNetworkPlayers[inPlayerIndex].mStats.pregame_state = state;
+		mNetworkPlayers[inPlayerIndex].mStats.pregame_state = state;
 	}
 }
 
-static void
-hub_received_identification_packet(AIStream& ps, NetAddrBlock address)
+void
+HubGame::hub_received_identification_packet(AIStream& ps, NetAddrBlock address)
 {
 	int16 theSenderIndex;
 	ps >> theSenderIndex;
 	
-	if (!sNetworkPlayers[theSenderIndex].mAddressKnown) {
-		sAddressToPlayerIndex[address] = theSenderIndex;
-		sNetworkPlayers[theSenderIndex].mAddressKnown = true;
-		sNetworkPlayers[theSenderIndex].mAddress = address;
+	if (!mNetworkPlayers[theSenderIndex].mAddressKnown) {
+		mAddressToPlayerIndex[address] = theSenderIndex;
+		mNetworkPlayers[theSenderIndex].mAddressKnown = true;
+		mNetworkPlayers[theSenderIndex].mAddress = address;
+		register_hub_game_address(this, address);
 	}
 
 } // hub_received_idetification_packet()
 
 
 static void
-hub_received_ping_request(AIStream& ps, NetAddrBlock address)
+hub_received_ping_request(HubGame* inGame, AIStream& ps, NetAddrBlock address)
 {
 	uint16 pingIdentifier;
 	ps >> pingIdentifier;
 	
 	// respond back to requestor
+	DDPFramePtr theFrame = inGame ? inGame->outgoing_frame() : NULL;
 	bool initedFrame = false;
-	if (!sOutgoingFrame)
+	if (!theFrame)
 	{
-		sOutgoingFrame = NetDDPNewFrame();
+		theFrame = NetDDPNewFrame();
 		initedFrame = true;
 	}
 	
-	AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-	AOStreamBE ops(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+	AOStreamBE hdr(theFrame->data, kStarPacketHeaderSize);
+	AOStreamBE ops(theFrame->data, ddpMaxData, kStarPacketHeaderSize);
 	
 	try {
 		hdr << (uint16)kPingResponsePacket;
 		ops << pingIdentifier;
 		
 		// blank out the CRC field before calculating
-		sOutgoingFrame->data[2] = 0;
-		sOutgoingFrame->data[3] = 0;
+		theFrame->data[2] = 0;
+		theFrame->data[3] = 0;
 		
-		uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ops.tellp());
+		uint16 crc = calculate_data_crc_ccitt(theFrame->data, ops.tellp());
 		hdr << crc;
 		
 		// Send the packet
-		sOutgoingFrame->data_size = ops.tellp();
-		NetDDPSendFrame(sOutgoingFrame, &address);
+		theFrame->data_size = ops.tellp();
+		if (inGame)
+			inGame->send_frame(theFrame, &address);
+		else
+			NetDDPSendFrame(theFrame, &address);
 	} catch (...) {
 		logWarningNMT("Caught exception while constructing/sending ping response packet");
 	}
 	
 	if (initedFrame)
 	{
-		NetDDPDisposeFrame(sOutgoingFrame);
-		sOutgoingFrame = NULL;
+		NetDDPDisposeFrame(theFrame);
 	}
 } // hub_received_ping_request()
 
@@ -796,17 +1485,17 @@ hub_received_ping_response(AIStream& ps, NetAddrBlock address)
 // I suppose to be safer, this should check the entire packet before acting on any of it.
 // As it stands, a malformed packet could have have a well-formed prefix of it interpreted
 // before the remainder is discarded.
-static void
-hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
+void
+HubGame::hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 {
         // Process the piggybacked acknowledgement
         int32	theSmallestUnacknowledgedTick;
         ps >> theSmallestUnacknowledgedTick;
 
         // If ack is too soon we throw out the entire packet to be safer
-        if(theSmallestUnacknowledgedTick > sSmallestIncompleteTick)
+        if(theSmallestUnacknowledgedTick > mSmallestIncompleteTick)
         {
-                logAnomalyNMT("received ack from player %d for tick %d; have only sent up to %d", inSenderIndex, theSmallestUnacknowledgedTick, sSmallestIncompleteTick);
+                logAnomalyNMT("received ack from player %d for tick %d; have only sent up to %d", inSenderIndex, theSmallestUnacknowledgedTick, mSmallestIncompleteTick);
                 return;
         }                
 
@@ -847,7 +1536,7 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 	{
 		while (theLateQueue.getWriteTick() < theQueue.getWriteTick())
 		{
-			theLateQueue.enqueue(sLastFlagsReceived[inSenderIndex]);
+			theLateQueue.enqueue(mLastFlagsReceived[inSenderIndex]);
 			theLateQueue.dequeue();
 		}
 	}
@@ -868,11 +1557,13 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 		// we consume these faster than we enqueue them (hopefully)
 		// so, not checking for capacity though we probably should
 		theLateQueue.enqueue(theActionFlags);
-		sLastFlagsReceived[inSenderIndex] = theActionFlags;
+		mLastFlagsReceived[inSenderIndex] = theActionFlags;
 	}
+	mUsage.mLateFlagsReceived += theLateActionFlagsCount;
+	mTelemetry.player(inSenderIndex).mLateFlags.fetch_add(theLateActionFlagsCount, std::memory_order_relaxed);
 
         // Enqueue flags that are new to us
-        int	theRemainingQueueSpace = (sPlayerDataDisposition.getReadTick() < sSmallestRealGameTick && theQueue.size() > sHubPreferences.mPregameWindowSize) ? 0 : theQueue.availableCapacity();
+        int	theRemainingQueueSpace = (mPlayerDataDisposition.getReadTick() < mSmallestRealGameTick && theQueue.size() > sHubPreferences.mPregameWindowSize) ? 0 : theQueue.availableCapacity();
 	int theUsefulActionFlagsCount = theActionFlagsCount - theRedundantActionFlagsCount - theLateActionFlagsCount;
         int	theEnqueueableFlagsCount = std::min(theUsefulActionFlagsCount, theRemainingQueueSpace);
 
@@ -884,12 +1575,12 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
                 ps >> theActionFlags;
                 theQueue.enqueue(theActionFlags);
 		theLateQueue.enqueue(theActionFlags);
-		sLastFlagsReceived[inSenderIndex] = theActionFlags;
+		mLastFlagsReceived[inSenderIndex] = theActionFlags;
         }
 
 	// Update timing data
 	NetworkPlayer_hub& thePlayer = getNetworkPlayer(inSenderIndex);
-	NetworkPlayer_hub& theReferencePlayer = getNetworkPlayer(sReferencePlayerIndex);
+	NetworkPlayer_hub& theReferencePlayer = getNetworkPlayer(mReferencePlayerIndex);
 	while(thePlayer.mSmallestUnheardTick < theStartTick + theActionFlagsCount)
 	{
 		int32 theReferenceTick = theReferencePlayer.mSmallestUnheardTick;
@@ -900,28 +1591,28 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 	}
 
         // Make the pregame -> ingame transition
-        if(thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick && static_cast<int32>(thePlayer.mNthElementFinder.window_size()) != sHubPreferences.mInGameWindowSize)
+        if(thePlayer.mSmallestUnheardTick >= mSmallestRealGameTick && static_cast<int32>(thePlayer.mNthElementFinder.window_size()) != sHubPreferences.mInGameWindowSize)
 		thePlayer.mNthElementFinder.reset(sHubPreferences.mInGameWindowSize);
 
 	if(thePlayer.mOutstandingTimingAdjustment == 0 && thePlayer.mNthElementFinder.window_full())
 	{
-		thePlayer.mOutstandingTimingAdjustment = thePlayer.mNthElementFinder.nth_smallest_element((thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick) ? sHubPreferences.mInGameNthElement : sHubPreferences.mPregameNthElement);
+		thePlayer.mOutstandingTimingAdjustment = thePlayer.mNthElementFinder.nth_smallest_element((thePlayer.mSmallestUnheardTick >= mSmallestRealGameTick) ? sHubPreferences.mInGameNthElement : sHubPreferences.mPregameNthElement);
 
 		if(thePlayer.mOutstandingTimingAdjustment != 0)
 		{
-			thePlayer.mTimingAdjustmentTick = sSmallestIncompleteTick;
-			logTraceNMT("tick %d: asking player %d to adjust timing by %d", sSmallestIncompleteTick, inSenderIndex, thePlayer.mOutstandingTimingAdjustment);
+			thePlayer.mTimingAdjustmentTick = mSmallestIncompleteTick;
+			logTraceNMT("tick %d: asking player %d to adjust timing by %d", mSmallestIncompleteTick, inSenderIndex, thePlayer.mOutstandingTimingAdjustment);
 
 #ifdef DEBUG_TIMING_ADJUSTMENTS
-			if (debug_timing_adjustments && thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick)
+			if (mDebugTimingAdjustments && thePlayer.mSmallestUnheardTick >= mSmallestRealGameTick)
 			{
-				dout << sNetworkTicker
+				mTiming << mNetworkTicker
 				     << ": "
 				     << "P" << inSenderIndex
 				     << " "
 				     << "H" << thePlayer.mLastNetworkTickHeard
 				     << " "
-				     << "T" << sSmallestIncompleteTick
+				     << "T" << mSmallestIncompleteTick
 				     << " "
 				     << "A" << thePlayer.mSmallestUnacknowledgedTick
 				     << " "
@@ -932,30 +1623,30 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 				     << thePlayer.mStats.latency 
 				     << "/"
 				     << thePlayer.mStats.jitter
-				     << " " << reinterpret_cast<player_info*>(NetGetPlayerData(inSenderIndex))->name
+				     << " " << mPlayerNames[inSenderIndex]
 				     << std::endl;
-				dout << "S";
+				mTiming << "S";
 				for (int i = 0; i < 20; ++i)
 				{
-					dout << std::setw(3) 
+					mTiming << std::setw(3) 
 					     << thePlayer.mNthElementFinder.nth_smallest_element(i)
 					     << " ";
 				}
-				dout << "M";
+				mTiming << "M";
 				for (int i = kDefaultInGameWindowSize / 2 - 10; i < kDefaultInGameWindowSize / 2 + 10; ++i)
 				{
-					dout << std::setw(3)
+					mTiming << std::setw(3)
 					     << thePlayer.mNthElementFinder.nth_smallest_element(i)
 					     << " ";
 				}
-				dout << "L";
+				mTiming << "L";
 				for (int i = 19; i >= 0; --i)
 				{
-					dout << std::setw(3)
+					mTiming << std::setw(3)
 					     << thePlayer.mNthElementFinder.nth_largest_element(i)
 					     << " ";
 				}
-				dout << std::endl;
+				mTiming << std::endl;
 			}
 #endif
 		}
@@ -964,16 +1655,16 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
         // Do any needed post-processing
         if(theEnqueueableFlagsCount > 0)
         {
-		// Actually the shouldSend business is probably unnecessary now with sSmallestUnsentTick
+		// Actually the shouldSend business is probably unnecessary now with mSmallestUnsentTick
                 bool shouldSend = player_provided_flags_from_tick_to_tick(inSenderIndex, theStartTick + theRedundantActionFlagsCount + theLateActionFlagsCount, theStartTick + theRedundantActionFlagsCount + theEnqueueableFlagsCount + theLateActionFlagsCount);
-                if(shouldSend && (sSmallestIncompleteTick - sSmallestUnsentTick >= sHubPreferences.mSendPeriod))
+                if(shouldSend && (mSmallestIncompleteTick - mSmallestUnsentTick >= sHubPreferences.mSendPeriod))
                         send_packets();
         }
 } // hub_received_game_data_packet_v1()
 
 
-static void
-player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick)
+void
+HubGame::player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick)
 {
 	logTraceNMT("player_acknowledged_up_to_tick(%d, %d)", inPlayerIndex, inSmallestUnacknowledgedTick);
 	
@@ -984,18 +1675,18 @@ player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowled
                 return;
 
         // We've heard from this player
-        thePlayer.mLastNetworkTickHeard = sNetworkTicker;
+        thePlayer.mLastNetworkTickHeard = mNetworkTicker;
 
         // Mark us ACKed for each intermediate tick
         for(int theTick = thePlayer.mSmallestUnacknowledgedTick; theTick < inSmallestUnacknowledgedTick; theTick++)
         {
-		logDumpNMT("tick %d: sPlayerDataDisposition=%d", theTick, sPlayerDataDisposition[theTick]);
+		logDumpNMT("tick %d: mPlayerDataDisposition=%d", theTick, mPlayerDataDisposition[theTick]);
 		
-                assert(sPlayerDataDisposition[theTick] & (((uint32)1) << inPlayerIndex));
-                sPlayerDataDisposition[theTick] &= ~(((uint32)1) << inPlayerIndex);
-		if (inPlayerIndex != sLocalPlayerIndex) 
+                assert(mPlayerDataDisposition[theTick] & (((uint32)1) << inPlayerIndex));
+                mPlayerDataDisposition[theTick] &= ~(((uint32)1) << inPlayerIndex);
+		if (inPlayerIndex != mLocalPlayerIndex) 
 		{
-			assert(theTick < sFlagSendTimeQueue.getWriteTick());
+			assert(theTick < mFlagSendTimeQueue.getWriteTick());
 
 			// update the latency calculations
 			if (thePlayer.mLatencyBuffer.size() >= kDisplayLatencyWindow)
@@ -1007,27 +1698,31 @@ player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowled
 			{
 				thePlayer.mLatencyBuffer.pop_back();
 			}
-			int32 latency = sNetworkTicker - sFlagSendTimeQueue.peek(theTick);
+			int32 latency = mNetworkTicker - mFlagSendTimeQueue.peek(theTick);
 			thePlayer.mLatencyBuffer.push_front(latency);
 			thePlayer.mLatencyTicks += latency;
+			// (not the pretend ACKs of a netdead player)
+			if (thePlayer.mConnected)
+				mTelemetry.player(inPlayerIndex).mLatency.record(latency * 1000 / TICKS_PER_SECOND);
 
 		}
 			
-                if(sPlayerDataDisposition[theTick] == 0)
+                if(mPlayerDataDisposition[theTick] == 0)
                 {
-                        assert(theTick == sPlayerDataDisposition.getReadTick());
-			assert(theTick == sFlagSendTimeQueue.getReadTick());
-			assert(theTick == sPlayerReflectedFlags.getReadTick());
+                        assert(theTick == mPlayerDataDisposition.getReadTick());
+			assert(theTick == mFlagSendTimeQueue.getReadTick());
+			assert(theTick == mPlayerReflectedFlags.getReadTick());
                         
-                        sPlayerDataDisposition.dequeue();
-			sFlagSendTimeQueue.dequeue();
-			sPlayerReflectedFlags.dequeue();
-                        for(size_t i = 0; i < sFlagsQueues.size(); i++)
+                        mPlayerDataDisposition.dequeue();
+			mFirstFlagsTimeQueue.dequeue();
+			mFlagSendTimeQueue.dequeue();
+			mPlayerReflectedFlags.dequeue();
+                        for(size_t i = 0; i < mFlagsQueues.size(); i++)
                         {
-                                if(sFlagsQueues[i].size() > 0)
+                                if(mFlagsQueues[i].size() > 0)
                                 {
-                                        assert(sFlagsQueues[i].getReadTick() == theTick);
-                                        sFlagsQueues[i].dequeue();
+                                        assert(mFlagsQueues[i].getReadTick() == theTick);
+                                        mFlagsQueues[i].dequeue();
                                 }
                         }
                 }
@@ -1047,37 +1742,35 @@ player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowled
 	
 } // player_acknowledged_up_to_tick()
 
-static bool make_up_flags_for_first_incomplete_tick()
+bool HubGame::make_up_flags_for_first_incomplete_tick()
 {
 	// find the smallest incomplete tick, and make up flags for anybody in that tick!
 	
-	if (sPlayerDataDisposition.getWriteTick() == sSmallestIncompleteTick) 
+	if (mPlayerDataDisposition.getWriteTick() == mSmallestIncompleteTick) 
 		// we don't have flags for anybody!
 		return false;
 
 	// never make up flags for ourself
-#ifndef A1_NETWORK_STANDALONE_HUB
-	if (getFlagsQueue(sLocalPlayerIndex).getWriteTick() == sSmallestIncompleteTick)
+	if (mLocalPlayerIndex != NONE && getFlagsQueue(mLocalPlayerIndex).getWriteTick() == mSmallestIncompleteTick)
 		return false;
-#endif
 
 	// check to make sure everyone we want to make up flags for is in the lagging players bitmask
-	for (int i = 0; i < sNetworkPlayers.size(); i++)
+	for (int i = 0; i < mNetworkPlayers.size(); i++)
 	{
-		if (getFlagsQueue(i).getWriteTick() == sSmallestIncompleteTick && !(sLaggingPlayersBitmask & (1 << i)))
+		if (getFlagsQueue(i).getWriteTick() == mSmallestIncompleteTick && !(mLaggingPlayersBitmask & (1 << i)))
 			return false;
 	}
 
-	logTraceNMT("making up flags for tick %i", sSmallestIncompleteTick);
+	logTraceNMT("making up flags for tick %i", mSmallestIncompleteTick);
 
-	for (int i = 0; i < sNetworkPlayers.size(); i++)
+	for (int i = 0; i < mNetworkPlayers.size(); i++)
 	{
-		if (getFlagsQueue(i).getWriteTick() == sSmallestIncompleteTick)
+		if (getFlagsQueue(i).getWriteTick() == mSmallestIncompleteTick)
 		{
 			// network code shouldn't figure this out, someone else should
 			action_flags_t motionFlags;
 			TickBasedActionQueue& theLateQueue = getLateFlagsQueue(i);
-			if (sLaggingPlayersBitmask & (1 << i) && theLateQueue.getWriteTick() > theLateQueue.getReadTick())
+			if (mLaggingPlayersBitmask & (1 << i) && theLateQueue.getWriteTick() > theLateQueue.getReadTick())
 			{
 				uint32 midpoint = ((theLateQueue.getWriteTick() - theLateQueue.getReadTick()) / 2 + theLateQueue.getReadTick());
 				// collapse the queue up to the midpoint
@@ -1095,59 +1788,64 @@ static bool make_up_flags_for_first_incomplete_tick()
 			} 
 			else
 			{
-				motionFlags = sLastFlagsReceived[i] & (_moving | _sidestepping);
-				if (local_random() % 10 > 8) sLastFlagsReceived[i] = 0;
+				motionFlags = mLastFlagsReceived[i] & (_moving | _sidestepping);
+				if (local_random() % 10 > 8) mLastFlagsReceived[i] = 0;
 			}
-			sPlayerReflectedFlags[sSmallestIncompleteTick] |= (1 << i);
+			mPlayerReflectedFlags[mSmallestIncompleteTick] |= (1 << i);
 			getFlagsQueue(i).enqueue(motionFlags);
+			mUsage.mFlagsMadeUp++;
+			mTelemetry.player(i).mFlagsMadeUp.fetch_add(1, std::memory_order_relaxed);
 		}
 	}
-	sPlayerDataDisposition[sSmallestIncompleteTick] = sConnectedPlayersBitmask;
-	sSmallestIncompleteTick++;
-	sLastRealUpdate = sNetworkTicker;
+	mPlayerDataDisposition[mSmallestIncompleteTick] = mConnectedPlayersBitmask;
+	tick_completed(mSmallestIncompleteTick);
+	mSmallestIncompleteTick++;
+	mLastRealUpdate = mNetworkTicker;
 	return true;
 }
 
 // Returns true if we now have enough data to send at least one new tick
-static bool
-player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick)
+bool
+HubGame::player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick)
 {
 	logTraceNMT("player_provided_flags_from_tick_to_tick(%d, %d, %d)", inPlayerIndex, inFirstNewTick, inSmallestUnreceivedTick);
 	
         bool shouldSend = false;
 
-	assert(sPlayerDataDisposition.getWriteTick() == sPlayerReflectedFlags.getWriteTick());
+	assert(mPlayerDataDisposition.getWriteTick() == mPlayerReflectedFlags.getWriteTick());
 
-        for(int i = sPlayerDataDisposition.getWriteTick(); i < inSmallestUnreceivedTick; i++)
+        for(int i = mPlayerDataDisposition.getWriteTick(); i < inSmallestUnreceivedTick; i++)
         {
-		logDumpNMT("tick %d: enqueueing sPlayerDataDisposition %d", i, sConnectedPlayersBitmask);
-                sPlayerDataDisposition.enqueue(sConnectedPlayersBitmask);
-		sPlayerReflectedFlags.enqueue(0);
+		logDumpNMT("tick %d: enqueueing mPlayerDataDisposition %d", i, mConnectedPlayersBitmask);
+                mPlayerDataDisposition.enqueue(mConnectedPlayersBitmask);
+		mFirstFlagsTimeQueue.enqueue(mNetworkTicker);
+		mPlayerReflectedFlags.enqueue(0);
         }
 
         for(int i = inFirstNewTick; i < inSmallestUnreceivedTick; i++)
         {
-		logDumpNMT("tick %d: sPlayerDataDisposition=%d", i, sPlayerDataDisposition[i]);
+		logDumpNMT("tick %d: mPlayerDataDisposition=%d", i, mPlayerDataDisposition[i]);
 		
-                assert(sPlayerDataDisposition[i] & (((uint32)1) << inPlayerIndex));
-                sPlayerDataDisposition[i] &= ~(((uint32)1) << inPlayerIndex);
+                assert(mPlayerDataDisposition[i] & (((uint32)1) << inPlayerIndex));
+                mPlayerDataDisposition[i] &= ~(((uint32)1) << inPlayerIndex);
 		
 		// remove the player from the list of lagging players, and
 		// dequeue his late flags
-		sLaggingPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
+		mLaggingPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
 		TickBasedActionQueue& theLateQueue = getLateFlagsQueue(inPlayerIndex);
 		while (theLateQueue.getReadTick() < theLateQueue.getWriteTick())
 			theLateQueue.dequeue();
 
-                if(sPlayerDataDisposition[i] == 0)
+                if(mPlayerDataDisposition[i] == 0)
                 {
-                        assert(sSmallestIncompleteTick == i);
-                        sSmallestIncompleteTick++;
-			sLastRealUpdate = sNetworkTicker;
+                        assert(mSmallestIncompleteTick == i);
+			tick_completed(i);
+                        mSmallestIncompleteTick++;
+			mLastRealUpdate = mNetworkTicker;
                         shouldSend = true;
 
                         // Now people need to ACK
-                        sPlayerDataDisposition[i] = sConnectedPlayersBitmask;
+                        mPlayerDataDisposition[i] = mConnectedPlayersBitmask;
                 }
 
         } // loop over ticks with new data
@@ -1156,10 +1854,48 @@ player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTi
 
 } // player_provided_flags_from_tick_to_tick()
 
+void
+HubGame::tick_completed(int32 inTick)
+{
+	mTelemetry.mTickCompletionLag.record((mNetworkTicker - mFirstFlagsTimeQueue.peek(inTick)) * 1000 / TICKS_PER_SECOND);
 
+	if (!mKeepConfirmedFlags || inTick < mSmallestRealGameTick)
+		return;
 
-static void
-process_messages(AIStream& ps, int inSenderIndex)
+	std::lock_guard<std::mutex> theLock(mConfirmedFlagsMutex);
+	if (mConfirmedFlags.empty())
+		mConfirmedFlagsStartTick = inTick;
+
+	for (size_t i = 0; i < mNetworkPlayers.size(); i++)
+	{
+		// what the spokes will have: netdead players' flags stop being sent at their mNetDeadTick
+		NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
+		TickBasedActionQueue& theQueue = getFlagsQueue(i);
+		if ((!thePlayer.mConnected && inTick >= thePlayer.mNetDeadTick) || inTick < theQueue.getReadTick() || inTick >= theQueue.getWriteTick())
+			mConfirmedFlags.push_back(static_cast<action_flags_t>(NET_DEAD_ACTION_FLAG));
+		else
+			mConfirmedFlags.push_back(theQueue.peek(inTick));
+	}
+}
+
+bool
+HubGame::take_confirmed_flags(int32& outFirstTick, std::vector<action_flags_t>& outFlags)
+{
+	outFlags.clear();
+
+	std::lock_guard<std::mutex> theLock(mConfirmedFlagsMutex);
+	if (mConfirmedFlags.empty())
+		return false;
+
+	outFirstTick = mConfirmedFlagsStartTick;
+	outFlags.swap(mConfirmedFlags);
+	return true;
+}
+
+
+
+void
+HubGame::process_messages(AIStream& ps, int inSenderIndex)
 {
         bool done = false;
 
@@ -1174,59 +1910,73 @@ process_messages(AIStream& ps, int inSenderIndex)
                                 done = true;
                                 break;
 
+			case kCompactFlagsMessageType:
+			{
+				uint16 theVersion;
+				ps >> theVersion;
+				if(theVersion >= Capabilities::kCompactFlagsVersion && !mNetworkPlayers[inSenderIndex].mCompactFlags)
+				{
+					logNoteNMT("player %d can take packed flags", inSenderIndex);
+					mNetworkPlayers[inSenderIndex].mCompactFlags = true;
+				}
+			}
+				break;
+
                         default:
                                 break;
                 }
         }
 }
 
-static void
-make_player_netdead(int inPlayerIndex)
+void
+HubGame::make_player_netdead(int inPlayerIndex, HubTelemetry::NetDeadReason inReason)
 {
 	logContextNMT("making player %d netdead", inPlayerIndex);
+
+	mTelemetry.net_dead(inPlayerIndex, inReason, mSmallestIncompleteTick);
 	
         NetworkPlayer_hub& thePlayer = getNetworkPlayer(inPlayerIndex);
 
-#ifdef A1_NETWORK_STANDALONE_HUB
 		int nbRemainingPlayers = 0, remainingPlayerIndex = 0;
-#endif
 
 	// make sure we're not processing a packet
 	{
-		MyTMMutexTaker mutex;
-		thePlayer.mNetDeadTick = sSmallestIncompleteTick;
+		HubGameMutexTaker mutex(*this);
+		thePlayer.mNetDeadTick = mSmallestIncompleteTick;
 		thePlayer.mConnected = false;
-		sConnectedPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
-		sAddressToPlayerIndex.erase(thePlayer.mAddress);
+		mConnectedPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
+		mAddressToPlayerIndex.erase(thePlayer.mAddress);
+		if (thePlayer.mAddressKnown)
+			unregister_hub_game_address(thePlayer.mAddress);
 		hub_update_player_pregame_state(inPlayerIndex, NetworkStats::disconnected);
 
-#ifdef A1_NETWORK_STANDALONE_HUB
-		for (size_t i = 0; i < sNetworkPlayers.size(); i++)
+		// Without a local player, the reference player can leave
+		if (mLocalPlayerIndex == NONE)
 		{
-			if (sNetworkPlayers[i].mConnected)
+			for (size_t i = 0; i < mNetworkPlayers.size(); i++)
 			{
-				nbRemainingPlayers++;
-				remainingPlayerIndex = i;
+				if (mNetworkPlayers[i].mConnected)
+				{
+					nbRemainingPlayers++;
+					remainingPlayerIndex = i;
+				}
 			}
-		}
 
-		if (sReferencePlayerIndex == inPlayerIndex) //fallback to someone else to be the player of reference
-			sReferencePlayerIndex = remainingPlayerIndex;
-#endif
+			if (mReferencePlayerIndex == inPlayerIndex) //fallback to someone else to be the player of reference
+				mReferencePlayerIndex = remainingPlayerIndex;
+		}
 	}
 
-#ifdef A1_NETWORK_STANDALONE_HUB
-	if (nbRemainingPlayers == 1)
-		make_player_netdead(remainingPlayerIndex);
-#endif
+	if (mLocalPlayerIndex == NONE && nbRemainingPlayers == 1)
+		make_player_netdead(remainingPlayerIndex, HubTelemetry::kLastPlayerLeft);
 
 	// We save this off because player_provided... call below may change it.
-	int32 theSavedIncompleteTick = sSmallestIncompleteTick;
+	int32 theSavedIncompleteTick = mSmallestIncompleteTick;
 	
         // Pretend for housekeeping that he's provided data for all currently known ticks
         // We go from the first tick for which we don't actually have his data through the last
         // tick we actually know about.
-        player_provided_flags_from_tick_to_tick(inPlayerIndex, getFlagsQueue(inPlayerIndex).getWriteTick(), sPlayerDataDisposition.getWriteTick());
+        player_provided_flags_from_tick_to_tick(inPlayerIndex, getFlagsQueue(inPlayerIndex).getWriteTick(), mPlayerDataDisposition.getWriteTick());
 
         // Pretend for housekeeping that he's already acknowledged all sent ticks
         player_acknowledged_up_to_tick(inPlayerIndex, theSavedIncompleteTick);
@@ -1234,28 +1984,29 @@ make_player_netdead(int inPlayerIndex)
 
 static int add_squares(int x, int y) { return x + y * y; }
 
-static bool
-hub_tick()
+bool
+HubGame::hub_tick()
 {
-        sNetworkTicker++;
+        mNetworkTicker++;
+	mTelemetry.mNetworkTicks.store(mNetworkTicker, std::memory_order_relaxed);
 
-	logContextNMT("performing hub_tick %d", sNetworkTicker);
+	logContextNMT("performing hub_tick %d", mNetworkTicker);
 
         // Check for newly netdead players
         bool shouldSend = false;
-        for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
         {
-                int theSilentTicksBeforeNetDeath = (sNetworkPlayers[i].mSmallestUnacknowledgedTick < sSmallestRealGameTick) ? sHubPreferences.mPregameTicksBeforeNetDeath : sHubPreferences.mInGameTicksBeforeNetDeath;
-                if (sNetworkPlayers[i].mConnected && sNetworkTicker - sNetworkPlayers[i].mLastNetworkTickHeard > theSilentTicksBeforeNetDeath)
+                int theSilentTicksBeforeNetDeath = (mNetworkPlayers[i].mSmallestUnacknowledgedTick < mSmallestRealGameTick) ? sHubPreferences.mPregameTicksBeforeNetDeath : sHubPreferences.mInGameTicksBeforeNetDeath;
+                if (mNetworkPlayers[i].mConnected && mNetworkTicker - mNetworkPlayers[i].mLastNetworkTickHeard > theSilentTicksBeforeNetDeath)
                 {
-                        make_player_netdead(i);
+                        make_player_netdead(i, (mNetworkPlayers[i].mSmallestUnacknowledgedTick < mSmallestRealGameTick) ? HubTelemetry::kSilentInPregame : HubTelemetry::kSilentInGame);
                         shouldSend = true;
                 }
 		// if this guy's last ACK was longer ago than the queues have space to store things, I guess dump him
-		else if (i != sLocalPlayerIndex && sNetworkPlayers[i].mConnected && sNetworkPlayers[i].mSmallestUnacknowledgedTick >= sSmallestRealGameTick && (sNetworkPlayers[sReferencePlayerIndex].mSmallestUnacknowledgedTick - sNetworkPlayers[i].mSmallestUnacknowledgedTick) >= kFlagsQueueSize) {
+		else if (i != mLocalPlayerIndex && mNetworkPlayers[i].mConnected && mNetworkPlayers[i].mSmallestUnacknowledgedTick >= mSmallestRealGameTick && (mNetworkPlayers[mReferencePlayerIndex].mSmallestUnacknowledgedTick - mNetworkPlayers[i].mSmallestUnacknowledgedTick) >= kFlagsQueueSize) {
 			{
-				logWarningNMT("Disconnecting player %i for late ACKs (last ACK %i, reference ACK %i", i, sNetworkPlayers[i].mSmallestUnacknowledgedTick, sNetworkPlayers[sReferencePlayerIndex].mSmallestUnacknowledgedTick);
-				make_player_netdead(i);
+				logWarningNMT("Disconnecting player %i for late ACKs (last ACK %i, reference ACK %i", i, mNetworkPlayers[i].mSmallestUnacknowledgedTick, mNetworkPlayers[mReferencePlayerIndex].mSmallestUnacknowledgedTick);
+				make_player_netdead(i, HubTelemetry::kLateAcks);
 				shouldSend = true;
 			}
 		}
@@ -1264,33 +2015,33 @@ hub_tick()
 			
 	// if we're getting behind, make up flags
 	
-	if (sHubPreferences.mBandwidthReduction && sPlayerDataDisposition.getReadTick() >= sSmallestRealGameTick)
+	if (sHubPreferences.mBandwidthReduction && mPlayerDataDisposition.getReadTick() >= mSmallestRealGameTick)
 	{
-		if (sHubPreferences.mMinimumSendPeriod >= sHubPreferences.mSendPeriod && sSmallestIncompleteTick < sPlayerDataDisposition.getWriteTick())
+		if (sHubPreferences.mMinimumSendPeriod >= sHubPreferences.mSendPeriod && mSmallestIncompleteTick < mPlayerDataDisposition.getWriteTick())
 		{
 			
-			if (sNetworkTicker - sLastRealUpdate >= sHubPreferences.mMinimumSendPeriod)
+			if (mNetworkTicker - mLastRealUpdate >= sHubPreferences.mMinimumSendPeriod)
 			{
 				// add anybody holding us back to the lagging player bitmask
-				for (int i = 0; i < sNetworkPlayers.size(); i++)
+				for (int i = 0; i < mNetworkPlayers.size(); i++)
 				{
-					if (i != sLocalPlayerIndex && sNetworkPlayers[i].mConnected && sSmallestRealGameTick > sNetworkPlayers[i].mNetDeadTick)
+					if (i != mLocalPlayerIndex && mNetworkPlayers[i].mConnected && mSmallestRealGameTick > mNetworkPlayers[i].mNetDeadTick)
 					{
-						if (sPlayerDataDisposition[sSmallestIncompleteTick] & (1 << i))
-							sLaggingPlayersBitmask |= (1 << i);
+						if (mPlayerDataDisposition[mSmallestIncompleteTick] & (1 << i))
+							mLaggingPlayersBitmask |= (1 << i);
 					}
 				}
 			}
 			
-			if (sLaggingPlayersBitmask) {
+			if (mLaggingPlayersBitmask) {
 				// make up flags if a majority of players are ready to go
 				int readyPlayers = 0;
 				int nonReadyPlayers = 0;
-				for (int i = 0; i < sNetworkPlayers.size(); i++)
+				for (int i = 0; i < mNetworkPlayers.size(); i++)
 				{
-					if (sNetworkPlayers[i].mConnected && sSmallestRealGameTick > sNetworkPlayers[i].mNetDeadTick)
+					if (mNetworkPlayers[i].mConnected && mSmallestRealGameTick > mNetworkPlayers[i].mNetDeadTick)
 					{
-						if (sPlayerDataDisposition[sSmallestIncompleteTick] & (1 << i))
+						if (mPlayerDataDisposition[mSmallestIncompleteTick] & (1 << i))
 							nonReadyPlayers++;
 						else
 							readyPlayers++;
@@ -1312,7 +2063,7 @@ hub_tick()
 		else
 		{
 			// Make sure we send at least every once in a while to keep things going
-			if(sNetworkTicker > sLastNetworkTickSent && (sNetworkTicker - sLastNetworkTickSent) >= sHubPreferences.mRecoverySendPeriod)
+			if(mNetworkTicker > mLastNetworkTickSent && (mNetworkTicker - mLastNetworkTickSent) >= sHubPreferences.mRecoverySendPeriod)
 				send_packets();
 		}
 		
@@ -1320,13 +2071,13 @@ hub_tick()
         check_send_packet_to_spoke();
 
 	// calculate standard deviation
-	if (sNetworkTicker % kJitterUpdateInterval == 0)
+	if (mNetworkTicker % kJitterUpdateInterval == 0)
 	{
-		for (int i = 0; i < sNetworkPlayers.size(); ++i)
+		for (int i = 0; i < mNetworkPlayers.size(); ++i)
 		{
-			if (i != sLocalPlayerIndex)
+			if (i != mLocalPlayerIndex)
 			{
-				NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
+				NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
 				if (thePlayer.mConnected)
 				{
 					if (thePlayer.mLatencyBuffer.size())
@@ -1336,6 +2087,7 @@ hub_tick()
 						
 						double deviation = std::sqrt(squares / thePlayer.mLatencyBuffer.size() - average * average);
 						thePlayer.mStats.jitter = static_cast<int16>(std::floor(deviation * 1000 / TICKS_PER_SECOND));
+						mTelemetry.player(i).mJitter.record(thePlayer.mStats.jitter);
 					} 
 				}
 				else if (thePlayer.mStats.jitter != NetworkStats::disconnected)
@@ -1347,17 +2099,17 @@ hub_tick()
 	}
 
 	// calculate ping
-	for (int i = 0; i < sNetworkPlayers.size(); ++i)
+	for (int i = 0; i < mNetworkPlayers.size(); ++i)
 	{
-		NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
-		if (i != sLocalPlayerIndex)
+		NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
+		if (i != mLocalPlayerIndex)
 		{
 			if (thePlayer.mConnected)
 			{
 				if (thePlayer.mLatencyBuffer.size())
 				{
 					int32 samples = std::min(thePlayer.mLatencyBuffer.size(), static_cast<size_t>(kDisplayLatencyWindow));
-					int32 latency_ticks = std::max(thePlayer.mLatencyTicks, ((sNetworkTicker - thePlayer.mLastNetworkTickHeard) * samples));
+					int32 latency_ticks = std::max(thePlayer.mLatencyTicks, ((mNetworkTicker - thePlayer.mLastNetworkTickHeard) * samples));
 					thePlayer.mStats.latency = (latency_ticks * 1000 / TICKS_PER_SECOND / samples);
 				}
 			}
@@ -1368,6 +2120,9 @@ hub_tick()
 		}
 	}
 
+	if (mNetworkTicker % kUsageReportInterval == 0)
+		report_usage(false);
+
         // We want to run again.
         return true;
 }
@@ -1379,22 +2134,32 @@ hub_tick()
 #define INT8_MIN -128
 #endif
 
-static void
-send_packets()
+void
+HubGame::send_packets()
 {
 	// remember when we sent flags for the first time
-	for (int32 i = sFlagSendTimeQueue.getWriteTick(); i < sSmallestIncompleteTick; i++) 
+	for (int32 i = mFlagSendTimeQueue.getWriteTick(); i < mSmallestIncompleteTick; i++) 
 	{
-		sFlagSendTimeQueue.enqueue(sNetworkTicker);
+		mFlagSendTimeQueue.enqueue(mNetworkTicker);
 	}
-		
-        for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+
+	// First, the part of each spoke's packet that's just for him: acknowledgement, messages,
+	// and which ticks he's getting
+	mSpokePackets.resize(mNetworkPlayers.size());
+	mSpokeHeaders.resize(mNetworkPlayers.size() * kSpokePacketHeaderSize);
+	int32 theFirstSharedTick = mSmallestIncompleteTick;
+
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
         {
-                NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
+                NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
+		SpokePacket& thePacket = mSpokePackets[i];
+		thePacket.mReady = false;
+
                 if(thePlayer.mConnected && thePlayer.mAddressKnown)
                 {
-			AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-                        AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+			byte* theHeader = &mSpokeHeaders[i * kSpokePacketHeaderSize];
+			AOStreamBE hdr(theHeader, kStarPacketHeaderSize);
+                        AOStreamBE ps(theHeader, kSpokePacketHeaderSize, kStarPacketHeaderSize);
 
                         try {
                                 // acknowledgement
@@ -1410,28 +2175,24 @@ send_packets()
                                 }
         
                                 // Netdead players?
-                                for(size_t j = 0; j < sNetworkPlayers.size(); j++)
+                                for(size_t j = 0; j < mNetworkPlayers.size(); j++)
                                 {
-                                        if(thePlayer.mSmallestUnacknowledgedTick <= sNetworkPlayers[j].mNetDeadTick)
+                                        if(thePlayer.mSmallestUnacknowledgedTick <= mNetworkPlayers[j].mNetDeadTick)
                                         {
                                                 ps << (uint16)kPlayerNetDeadMessageType
                                                         << (uint8)j	// dead player index
-                                                        << sNetworkPlayers[j].mNetDeadTick;
+                                                        << mNetworkPlayers[j].mNetDeadTick;
                                         }
                                 }
         
                                 // End of messages
                                 ps << (uint16)kEndOfMessagesMessageType;
         
-                                // We use this flag to make sure we encode the start tick at most once, and
-                                // only if we're actually sending action_flags.
-                                bool haveSentStartTick = false;
-
 				// are we sending an incremental update or a recovery update?
 				int32 startTick;
 				int32 endTick;
 
-				if (sHubPreferences.mBandwidthReduction && sPlayerDataDisposition.getReadTick() >= sSmallestRealGameTick)
+				if (sHubPreferences.mBandwidthReduction && mPlayerDataDisposition.getReadTick() >= mSmallestRealGameTick)
 				{
 					// never send fewer than 2 full updates per second, or more than 15
 					int32 latencyCount = std::min(thePlayer.mLatencyBuffer.size(), static_cast<size_t>(kDisplayLatencyWindow));
@@ -1445,118 +2206,367 @@ send_packets()
 						effectiveLatency = TICKS_PER_SECOND / 2;
 					}
 					
-					if (sNetworkTicker - thePlayer.mLastRecoverySend >= effectiveLatency)
+					if (mNetworkTicker - thePlayer.mLastRecoverySend >= effectiveLatency)
 					{
 						// send a large update
-						thePlayer.mLastRecoverySend = sNetworkTicker;
+						thePlayer.mLastRecoverySend = mNetworkTicker;
+						mTelemetry.player(i).mRecoverySends.fetch_add(1, std::memory_order_relaxed);
 						
 						// we want to send 4 seconds worth of flags per second
 						int maxTicks = 4 * effectiveLatency;
 
-						int bytesAvailableForFlags = ps.maxp() - ps.tellp() - 4; // have to encode the tick
-						// don't run out of room in the packet, though
-						if (maxTicks * sNetworkPlayers.size() * 4 > bytesAvailableForFlags) 
+						int bytesAvailableForFlags = ddpMaxData - ps.tellp() - 4; // have to encode the tick
+						// don't run out of room in the packet, though (packed flags are
+						// cut to fit once we know how well they packed)
+						if (!thePlayer.mCompactFlags && maxTicks * mNetworkPlayers.size() * 4 > bytesAvailableForFlags) 
 						{
-							int maximumBytesPerTick = sNetworkPlayers.size() * 4;
+							int maximumBytesPerTick = mNetworkPlayers.size() * 4;
 							maxTicks = bytesAvailableForFlags / maximumBytesPerTick;
 						}
 
 						startTick = thePlayer.mSmallestUnacknowledgedTick;
-						endTick = (startTick + maxTicks < sSmallestIncompleteTick) ? startTick + maxTicks : sSmallestIncompleteTick;
+						endTick = (startTick + maxTicks < mSmallestIncompleteTick) ? startTick + maxTicks : mSmallestIncompleteTick;
 					}
 					else
 					{
 						// send the last 3 flags
-						startTick = std::max(sSmallestIncompleteTick - 3, thePlayer.mSmallestUnacknowledgedTick);
-						endTick = sSmallestIncompleteTick;
+						startTick = std::max(mSmallestIncompleteTick - 3, thePlayer.mSmallestUnacknowledgedTick);
+						endTick = mSmallestIncompleteTick;
 					}
 				}
 				else 
 				{
 					startTick = thePlayer.mSmallestUnacknowledgedTick;
-					endTick = sSmallestIncompleteTick;
+					endTick = mSmallestIncompleteTick;
 				}
 
 				bool reflectFlags = false;
 				// find out if we need to reflect flags
 				for (int32 tick = startTick; tick < endTick && !reflectFlags; tick++)
 				{
-					if (sPlayerReflectedFlags.peek(tick) & (1 << i)) reflectFlags = true;
+					if (mPlayerReflectedFlags.peek(tick) & (1 << i)) reflectFlags = true;
 				}
-        
-                                // Action_flags!!
-                                // First, preprocess the players to figure out at what tick they'll each stop
-                                // contributing
-				std::vector<int32> theSmallestTickWeWontSend;
-                                theSmallestTickWeWontSend.resize(sNetworkPlayers.size());
-                                for(size_t j = 0; j < sNetworkPlayers.size(); j++)
-                                {
-                                        // Don't encode our own flags
-                                        if(j == i && !reflectFlags)
-                                        {
-                                                theSmallestTickWeWontSend[j] = thePlayer.mSmallestUnacknowledgedTick - 1;
-                                                continue;
-                                        }
-        
-                                        theSmallestTickWeWontSend[j] = sSmallestIncompleteTick;
-                                        NetworkPlayer_hub& theOtherPlayer = sNetworkPlayers[j];
-        
-                                        // Don't send flags for netdead people
-                                        if(!theOtherPlayer.mConnected && theSmallestTickWeWontSend[j] > theOtherPlayer.mNetDeadTick)
-                                                theSmallestTickWeWontSend[j] = theOtherPlayer.mNetDeadTick;
-                                }
-        
-                                // Now, encode the flags in tick-major order (this is much easier to decode
-                                // at the other end)
-                                for(int32 tick = startTick; tick < endTick; tick++)
-                                {
-                                        for(size_t j = 0; j < sNetworkPlayers.size(); j++)
-                                        {
-                                                if(tick < theSmallestTickWeWontSend[j])
-                                                {
-                                                        if(!haveSentStartTick)
-                                                        {
-                                                                ps << tick;
-                                                                haveSentStartTick = true;
-                                                        }
-                                                        ps << getFlagsQueue(j).peek(tick);
-                                                }
-                                        }
-                                }
-				
-				hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic : kHubToSpokeGameDataPacketV1Magic);
 
-				// blank out the CRC field before calculating
-				sOutgoingFrame->data[2] = 0;
-				sOutgoingFrame->data[3] = 0;
+				if (thePlayer.mCompactFlags)
+					hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic : kHubToSpokeGameDataPacketV2Magic);
+				else
+					hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic : kHubToSpokeGameDataPacketV1Magic);
+
+				thePacket.mStartTick = startTick;
+				thePacket.mEndTick = endTick;
+				thePacket.mReflectFlags = reflectFlags;
+				thePacket.mCompactFlags = thePlayer.mCompactFlags;
+				thePacket.mHeaderSize = ps.tellp();
+				thePacket.mReady = true;
 
-				uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ps.tellp());
-				hdr << crc;
-        
-                                // Send the packet
-                                sOutgoingFrame->data_size = ps.tellp();
-                                if(i == sLocalPlayerIndex)
-                                        send_frame_to_local_spoke(sOutgoingFrame, &thePlayer.mAddress);
-                                else
-                                        NetDDPSendFrame(sOutgoingFrame, &thePlayer.mAddress);
+				if (startTick < theFirstSharedTick)
+					theFirstSharedTick = startTick;
                         } // try
                         catch (...)
                         {
-				logWarningNMT("Caught exception while constructing/sending outgoing packet");
+				logWarningNMT("Caught exception while constructing outgoing packet");
                         }
                         
                 } // if(connected)
 
         } // iterate over players
 
-        sLastNetworkTickSent = sNetworkTicker;
-	sSmallestUnsentTick = sSmallestIncompleteTick;
+	// Everyone is sent (some of) the same action_flags, so serialize each tick's worth just once,
+	// in tick-major order (this is much easier to decode at the other end)
+	int32 theSharedTickCount = std::max(mSmallestIncompleteTick - theFirstSharedTick, 0);
+	mSharedFlags.resize(theSharedTickCount * mNetworkPlayers.size() * kActionFlagsSerializedLength);
+	if (!mSharedFlags.empty())
+	{
+		AOStreamBE fs(mSharedFlags.data(), mSharedFlags.size());
+		for (int32 tick = theFirstSharedTick; tick < mSmallestIncompleteTick; tick++)
+		{
+			for (size_t j = 0; j < mNetworkPlayers.size(); j++)
+			{
+				TickBasedActionQueue& theQueue = getFlagsQueue(j);
+				// (netdead players have nothing to send)
+				action_flags_t theFlags = (tick >= theQueue.getReadTick() && tick < theQueue.getWriteTick()) ? theQueue.peek(tick) : 0;
+				fs << theFlags;
+			}
+		}
+	}
+
+	// Now put each spoke's packet together out of his own header and the flags he needs
+	mSendBatch.clear();
+	std::vector<int32>& theSmallestTickWeWontSend = mSmallestTickWeWontSend;
+	theSmallestTickWeWontSend.resize(mNetworkPlayers.size());
+	mCompactFlags.resize(mNetworkPlayers.size());
+
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
+        {
+                NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
+		SpokePacket& thePacket = mSpokePackets[i];
+		if(!thePacket.mReady)
+			continue;
+
+                // First, preprocess the players to figure out at what tick they'll each stop
+                // contributing
+                for(size_t j = 0; j < mNetworkPlayers.size(); j++)
+                {
+                        // Don't encode our own flags
+                        if(j == i && !thePacket.mReflectFlags)
+                        {
+                                theSmallestTickWeWontSend[j] = thePlayer.mSmallestUnacknowledgedTick - 1;
+                                continue;
+                        }
+
+                        theSmallestTickWeWontSend[j] = mSmallestIncompleteTick;
+                        NetworkPlayer_hub& theOtherPlayer = mNetworkPlayers[j];
+
+                        // Don't send flags for netdead people
+                        if(!theOtherPlayer.mConnected && theSmallestTickWeWontSend[j] > theOtherPlayer.mNetDeadTick)
+                                theSmallestTickWeWontSend[j] = theOtherPlayer.mNetDeadTick;
+                }
+
+		// We encode the start tick once, and only if we're actually sending action_flags
+		int32 theFlagsStartTick = thePacket.mEndTick;
+		int theFlagsCount = 0;
+		for(int32 tick = thePacket.mStartTick; tick < thePacket.mEndTick; tick++)
+		{
+			for(size_t j = 0; j < mNetworkPlayers.size(); j++)
+			{
+				if(tick < theSmallestTickWeWontSend[j])
+				{
+					theFlagsStartTick = std::min(theFlagsStartTick, tick);
+					theFlagsCount++;
+				}
+			}
+		}
+
+		byte* theHeader = &mSpokeHeaders[i * kSpokePacketHeaderSize];
+		uint16 theHeaderSize = thePacket.mHeaderSize;
+		if(theFlagsCount > 0)
+		{
+			AOStreamBE ps(theHeader, kSpokePacketHeaderSize, theHeaderSize);
+			ps << theFlagsStartTick;
+			theHeaderSize = ps.tellp();
+		}
+
+		if(thePacket.mCompactFlags)
+		{
+			// Pack the same flags, in the same order; if they still don't fit, send fewer ticks
+			std::vector<uint8>& thePacked = mCompactFlags[i];
+			int32 theFlagsEndTick = thePacket.mEndTick;
+			for(;;)
+			{
+				mCompactFlagsToSend.clear();
+				uint8 theStride = 0;
+				for(int32 tick = theFlagsStartTick; tick < theFlagsEndTick; tick++)
+				{
+					for(size_t j = 0; j < mNetworkPlayers.size(); j++)
+					{
+						if(tick < theSmallestTickWeWontSend[j])
+						{
+							TickBasedActionQueue& theQueue = getFlagsQueue(j);
+							mCompactFlagsToSend.push_back((tick >= theQueue.getReadTick() && tick < theQueue.getWriteTick()) ? theQueue.peek(tick) : 0);
+							if(tick == theFlagsStartTick)
+								theStride++;
+						}
+					}
+				}
+
+				thePacked.clear();
+				if(!mCompactFlagsToSend.empty())
+					pack_action_flags(mCompactFlagsToSend.data(), mCompactFlagsToSend.size(), theStride, thePacked);
+
+				if(theHeaderSize + thePacked.size() <= ddpMaxData || theFlagsEndTick <= theFlagsStartTick + 1)
+					break;
+
+				int32 theFittingTicks = (theFlagsEndTick - theFlagsStartTick) * (ddpMaxData - theHeaderSize) / thePacked.size();
+				theFlagsEndTick = std::min(theFlagsEndTick - 1, theFlagsStartTick + std::max(theFittingTicks, 1));
+			}
+
+			if(theHeaderSize + thePacked.size() > ddpMaxData)
+			{
+				logWarningNMT("outgoing packet for player %d would be too large; not sending it", static_cast<int>(i));
+				continue;
+			}
+
+			// blank out the CRC field before calculating
+			theHeader[2] = 0;
+			theHeader[3] = 0;
+
+			mSendBatch.add_datagram(thePlayer.mAddress);
+			mSendBatch.add_piece(theHeader, theHeaderSize);
+			if(!thePacked.empty())
+				mSendBatch.add_piece(thePacked.data(), thePacked.size());
+		}
+		else
+		{
+			if(theHeaderSize + theFlagsCount * kActionFlagsSerializedLength > ddpMaxData)
+			{
+				logWarningNMT("outgoing packet for player %d would be too large; not sending it", static_cast<int>(i));
+				continue;
+			}
+
+			// blank out the CRC field before calculating
+			theHeader[2] = 0;
+			theHeader[3] = 0;
+
+			mSendBatch.add_datagram(thePlayer.mAddress);
+			mSendBatch.add_piece(theHeader, theHeaderSize);
+			for(int32 tick = theFlagsStartTick; tick < thePacket.mEndTick; tick++)
+			{
+				const byte* theRow = &mSharedFlags[(tick - theFirstSharedTick) * mNetworkPlayers.size() * kActionFlagsSerializedLength];
+				for(size_t j = 0; j < mNetworkPlayers.size(); j++)
+				{
+					if(tick < theSmallestTickWeWontSend[j])
+						mSendBatch.add_piece(theRow + j * kActionFlagsSerializedLength, kActionFlagsSerializedLength);
+				}
+			}
+		}
+
+		const DDPSendBatch::Datagram& theDatagram = mSendBatch.datagrams.back();
+		uint16 crc = 0xffff;
+		for(size_t piece = theDatagram.first_piece; piece < theDatagram.first_piece + theDatagram.piece_count; piece++)
+			crc = update_data_crc_ccitt(crc, mSendBatch.pieces[piece].data, mSendBatch.pieces[piece].size);
+		AOStreamBE hdr(theHeader, kStarPacketHeaderSize, 2);
+		hdr << crc;
+
+		if(i == mLocalPlayerIndex)
+		{
+			// the local spoke gets his straight away, in one piece
+			mOutgoingFrame->data_size = 0;
+			for(size_t piece = theDatagram.first_piece; piece < theDatagram.first_piece + theDatagram.piece_count; piece++)
+			{
+				memcpy(mOutgoingFrame->data + mOutgoingFrame->data_size, mSendBatch.pieces[piece].data, mSendBatch.pieces[piece].size);
+				mOutgoingFrame->data_size += mSendBatch.pieces[piece].size;
+			}
+			send_frame_to_local_spoke(mOutgoingFrame, &thePlayer.mAddress);
+
+			mSendBatch.pieces.resize(theDatagram.first_piece);
+			mSendBatch.datagrams.pop_back();
+		}
+
+        } // iterate over players
+
+	// Send the packets
+	send_batch();
+
+        mLastNetworkTickSent = mNetworkTicker;
+	mSmallestUnsentTick = mSmallestIncompleteTick;
 	
 } // send_packets()
 
 const NetworkStats& hub_stats(int player_index)
 {
-	return getNetworkPlayer(player_index).mStats;
+	assert(sHubGame);
+	return sHubGame->stats(player_index);
+}
+
+static void
+hub_write_telemetry()
+{
+	assert(sHubGame);
+
+	extern DirectorySpecifier log_dir;
+#ifdef A1_NETWORK_STANDALONE_HUB
+	FileSpecifier theFile = log_dir + ("Hub Telemetry " + std::to_string(sHubGame->number()) + ".xml");
+#else
+	FileSpecifier theFile = log_dir + "Hub Telemetry.xml";
+#endif
+	if (!sHubGame->telemetry().write(theFile))
+		logWarning("could not write hub telemetry to %s", theFile.GetPath());
+
+	sHubGame->mLastTelemetryWrite = machine_tick_count();
+}
+
+int
+hub_game_number()
+{
+	return sHubGame ? sHubGame->number() : 0;
+}
+
+bool
+hub_take_confirmed_flags(int32& outFirstTick, std::vector<action_flags_t>& outFlags)
+{
+	if (!sHubGame)
+	{
+		outFlags.clear();
+		return false;
+	}
+
+	return sHubGame->take_confirmed_flags(outFirstTick, outFlags);
+}
+
+void
+hub_check_telemetry()
+{
+	if (sHubGame && sHubPreferences.mTelemetryPeriod > 0 && machine_tick_count() - sHubGame->mLastTelemetryWrite >= static_cast<uint32>(sHubPreferences.mTelemetryPeriod) * MACHINE_TICKS_PER_SECOND / TICKS_PER_SECOND)
+		hub_write_telemetry();
+}
+
+
+
+void
+StarTransport::send(const DDPSendBatch& inBatch)
+{
+	byte theData[ddpMaxData];
+	for (auto& datagram : inBatch.datagrams)
+	{
+		uint16 theSize = 0;
+		for (size_t i = datagram.first_piece; i < datagram.first_piece + datagram.piece_count; i++)
+		{
+			const DDPSendBatch::Piece& thePiece = inBatch.pieces[i];
+			assert(theSize + thePiece.size <= ddpMaxData);
+			memcpy(theData + theSize, thePiece.data, thePiece.size);
+			theSize += thePiece.size;
+		}
+
+		send(datagram.address, theData, theSize);
+	}
+}
+
+StarBenchHub::StarBenchHub(int32 inStartingTick, int inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, StarTransport& inTransport)
+	: mGame(new HubGame(inStartingTick, inNumPlayers, inPlayerAddresses, NONE))
+{
+	mGame->mTransport = &inTransport;
+	mGame->start(false);
+}
+
+StarBenchHub::~StarBenchHub()
+{
+}
+
+void
+StarBenchHub::tick()
+{
+	HubGame::ProcessingTimer timer(*mGame);
+	mGame->hub_tick();
+}
+
+void
+StarBenchHub::received_packet(DDPPacketBufferPtr inPacket)
+{
+	hub_received_network_packet(mGame.get(), inPacket);
+}
+
+const NetworkStats&
+StarBenchHub::stats(int inPlayerIndex)
+{
+	return mGame->stats(inPlayerIndex);
+}
+
+uint32
+StarBenchHub::flags_made_up()
+{
+	return mGame->flags_made_up();
+}
+
+uint32
+StarBenchHub::late_flags_received()
+{
+	return mGame->late_flags_received();
+}
+
+bool
+StarBenchHub::take_confirmed_flags(int32& outFirstTick, std::vector<action_flags_t>& outFlags)
+{
+	return mGame->take_confirmed_flags(outFirstTick, outFlags);
 }
 
 enum {
@@ -1570,6 +2580,9 @@ enum {
 	kSendPeriodAttribute,
 	kRecoverySendPeriodAttribute,
 	kMinimumSendPeriodAttribute,
+	kTelemetryPeriodAttribute,
+	kSpectatorDelayAttribute,
+	kMaxSpectatorsAttribute,
 	kNumAttributes,
 };
 
@@ -1585,6 +2598,9 @@ static const char* sAttributeStrings[kNumAttributes] =
 	"send_period",
 	"recovery_send_period",
 	"latency_tolerance",
+	"telemetry_period",
+	"spectator_delay",
+	"max_spectators",
 };
 
 static int32* sAttributeDestinations[kNumAttributes] =
@@ -1599,6 +2615,9 @@ static int32* sAttributeDestinations[kNumAttributes] =
 	&sHubPreferences.mSendPeriod,
 	&sHubPreferences.mRecoverySendPeriod,
 	&sHubPreferences.mMinimumSendPeriod,
+	&sHubPreferences.mTelemetryPeriod,
+	&sHubPreferences.mSpectatorDelay,
+	&sHubPreferences.mMaxSpectators,
 };
 
 static const int32 sDefaultHubPreferences[kNumAttributes] = {
@@ -1611,6 +2630,9 @@ static const int32 sDefaultHubPreferences[kNumAttributes] = {
 	kDefaultSendPeriod,
 	kDefaultRecoverySendPeriod,
 	kDefaultMinimumSendPeriod,
+	kDefaultTelemetryPeriod,
+	kDefaultSpectatorDelay,
+	kDefaultMaxSpectators,
 };
 
 
@@ -1634,6 +2656,9 @@ void HubParsePreferencesTree(InfoTree prefs, std::string version)
 				case kPregameNthElementAttribute:
 				case kInGameNthElementAttribute:
 				case kMinimumSendPeriodAttribute:
+				case kTelemetryPeriodAttribute:
+				case kSpectatorDelayAttribute:
+				case kMaxSpectatorsAttribute:
 					min = 0;
 					break;
 			}
@@ -1645,6 +2670,7 @@ void HubParsePreferencesTree(InfoTree prefs, std::string version)
 	}
 
 	prefs.read_attr("use_bandwidth_reduction", sHubPreferences.mBandwidthReduction);
+	prefs.read_attr("record_films", sHubPreferences.mRecordFilms);
 
 		
 	// The checks above are not sufficient to catch all bad cases; if user specified a window size
@@ -1669,6 +2695,7 @@ InfoTree HubPreferencesTree()
 	for (size_t i = 0; i < kNumAttributes; ++i)
 		root.put_attr(sAttributeStrings[i], *(sAttributeDestinations[i]));
 	root.put_attr("use_bandwidth_reduction", sHubPreferences.mBandwidthReduction);
+	root.put_attr("record_films", sHubPreferences.mRecordFilms);
 	
 	return root;
 }
@@ -1681,6 +2708,7 @@ DefaultHubPreferences()
 	for(size_t i = 0; i < kNumAttributes; i++)
 		*(sAttributeDestinations[i]) = sDefaultHubPreferences[i];
 	sHubPreferences.mBandwidthReduction = true;
+	sHubPreferences.mRecordFilms = false;
 /*
 	sHubPreferences.mPregameWindowSize = kDefaultPregameWindowSize;
 	sHubPreferences.mInGameWindowSize = kDefaultInGameWindowSize;
@@ -40,13 +40,17 @@
 #include "mytm.h"
 #include "network_private.h" // kPROTOCOL_TYPE
 #include "WindowedNthElementFinder.h"
+#include "AdaptiveJitterBuffer.h"
 #include "vbl.h" // parse_keymap
 #include "CircularByteBuffer.h"
 #include "Logging.h"
 #include "crc.h"
 #include "player.h"
 #include "InfoTree.h"
+#include "ActionFlagsCodec.h"
+#include "network_capabilities.h"
 #include <map>
+#include <memory>
 
 extern void make_player_really_net_dead(size_t inPlayerIndex);
 
@@ -56,7 +60,9 @@ enum {
         kDefaultOutgoingFlagsQueueSize = TICKS_PER_SECOND / 2,
         kDefaultRecoverySendPeriod = TICKS_PER_SECOND / 2,
 	kDefaultTimingWindowSize = 3 * TICKS_PER_SECOND,
-	kDefaultTimingNthElement = kDefaultTimingWindowSize / 2
+	kDefaultTimingNthElement = kDefaultTimingWindowSize / 2,
+	kDefaultAdaptiveTimingPercentile = 90,
+	kDefaultAdaptiveTimingHalfLife = 2 * TICKS_PER_SECOND
 };
 
 struct SpokePreferences
@@ -67,16 +73,14 @@ struct SpokePreferences
 	int32	mRecoverySendPeriod;
 	int32	mTimingWindowSize;
 	int32	mTimingNthElement;
+	int32	mAdaptiveTimingPercentile;	// of ticks that should arrive before the game needs them
+	int32	mAdaptiveTimingHalfLife;	// ticks
 	bool	mAdjustTiming;
+	bool	mAdaptiveTiming;		// AdaptiveJitterBuffer rather than the windowed nth element
 };
 
 static SpokePreferences sSpokePreferences;
 
-static TickBasedActionQueue sOutgoingFlags(kDefaultOutgoingFlagsQueueSize);
-static TickBasedActionQueue sUnconfirmedFlags(kDefaultOutgoingFlagsQueueSize);
-static DuplicatingTickBasedCircularQueue<action_flags_t> sLocallyGeneratedFlags;
-static int32 sSmallestRealGameTick;
-
 struct IncomingGameDataPacketProcessingContext {
         bool mMessagesDone;
         bool mGotTimingAdjustmentMessage;
@@ -84,14 +88,6 @@ struct IncomingGameDataPacketProcessingContext {
         IncomingGameDataPacketProcessingContext() : mMessagesDone(false), mGotTimingAdjustmentMessage(false) {}
 };
 
-typedef void (*StarMessageHandler)(AIStream& s, IncomingGameDataPacketProcessingContext& c);
-typedef std::map<uint16, StarMessageHandler> MessageTypeToMessageHandler;
-
-static MessageTypeToMessageHandler sMessageTypeToMessageHandler;
-
-static int8 sRequestedTimingAdjustment;
-static int8 sOutstandingTimingAdjustment;
-
 struct NetworkPlayer_spoke {
         bool				mZombie;
         bool				mConnected;
@@ -99,50 +95,108 @@ struct NetworkPlayer_spoke {
         WritableTickBasedActionQueue* 	mQueue;
 };
 
-static vector<NetworkPlayer_spoke> sNetworkPlayers;
-static int32 sNetworkTicker;
-static int32 sLastNetworkTickHeard;
-static int32 sLastNetworkTickSent;
-static bool sConnected = false;
-static bool sSpokeActive = false;
-static myTMTaskPtr sSpokeTickTask = NULL;
-static DDPFramePtr sOutgoingFrame = NULL;
-static DDPPacketBuffer sLocalOutgoingBuffer;
-static bool sNeedToSendLocalOutgoingBuffer = false;
-static bool sHubIsLocal = false;
-static NetAddrBlock sHubAddress;
-static size_t sLocalPlayerIndex;
-static int32 sSmallestUnreceivedTick;
-static WindowedNthElementFinder<int32> sNthElementFinder(kDefaultTimingWindowSize);
-static bool sTimingMeasurementValid;
-static int32 sTimingMeasurement;
-static bool sHeardFromHub = false;
-static bool sWorldUpdate = false;
-
-static vector<int32> sDisplayLatencyBuffer; // stores the last 30 latency calculations, in ticks
-static uint32 sDisplayLatencyCount = 0;
-static int32 sDisplayLatencyTicks = 0; // sum of the latency ticks from the last 30 seconds, using above two
-
-static int32 sSmallestUnconfirmedTick;
-
-static void spoke_became_disconnected();
-static void spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags);
-static void spoke_received_ping_request(AIStream& ps, NetAddrBlock address);
+// Everything one player's machine knows about the game.  The process's own spoke is sSpokeGame,
+// ticked by a mytm task and fed by the packet handler; the test bench runs others (StarBenchSpoke).
+class SpokeGame
+{
+public:
+	SpokeGame();
+	~SpokeGame();
+
+	void initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal, bool inHubCanPackFlags, const std::string& inSessionIdentifier);
+	void start(bool inTickTask = true);
+	void cleanup(bool inGraceful);
+
+	void received_network_packet(DDPPacketBufferPtr inPacket);
+	bool spoke_tick();
+
+	int32 get_net_time();
+	int32 latency();
+	TickBasedActionQueue* get_unconfirmed_flags_queue() { return &mUnconfirmedFlags; }
+	int32 get_smallest_unconfirmed_tick() { return mSmallestUnconfirmedTick; }
+	bool check_world_update();
+
+	// the process's own spoke reads the local player's input, and takes players out of the world;
+	// bench spokes make up their own flags, and just count the netdead
+	std::function<action_flags_t()> mLocalFlags;
+	std::function<void(size_t)> mPlayerNetDead;
+
+	// NULL to use the socket
+	StarTransport* mTransport = NULL;
+
+private:
+	typedef void (SpokeGame::*StarMessageHandler)(AIStream& s, IncomingGameDataPacketProcessingContext& c);
+	typedef std::map<uint16, StarMessageHandler> MessageTypeToMessageHandler;
+
+	NetworkPlayer_spoke& getNetworkPlayer(size_t inIndex);
+
+	OSErr send_frame_to_local_hub(DDPFramePtr frame, NetAddrBlock *address);
+	void check_send_packet_to_hub();
+	void send_frame(DDPFramePtr inFrame, NetAddrBlock* inAddress);
+
+	void spoke_became_disconnected();
+	void spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags, bool compact_flags);
+	void spoke_received_ping_request(AIStream& ps, NetAddrBlock address);
+	void process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+	void handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+	void handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+	void handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+	void send_packet();
+	void send_identification_packet();
+
+	TickBasedActionQueue mOutgoingFlags{kDefaultOutgoingFlagsQueueSize};
+	TickBasedActionQueue mUnconfirmedFlags{kDefaultOutgoingFlagsQueueSize};
+	DuplicatingTickBasedCircularQueue<action_flags_t> mLocallyGeneratedFlags;
+	int32 mSmallestRealGameTick;
+
+	MessageTypeToMessageHandler mMessageTypeToMessageHandler;
+
+	int8 mRequestedTimingAdjustment;
+	int8 mOutstandingTimingAdjustment;
+
+	vector<NetworkPlayer_spoke> mNetworkPlayers;
+	int32 mNetworkTicker;
+	int32 mLastNetworkTickHeard;
+	int32 mLastNetworkTickSent;
+	bool mConnected = false;
+	bool mSpokeActive = false;
+	myTMTaskPtr mSpokeTickTask = NULL;
+	DDPFramePtr mOutgoingFrame = NULL;
+	DDPPacketBuffer mLocalOutgoingBuffer;
+	bool mNeedToSendLocalOutgoingBuffer = false;
+	bool mHubIsLocal = false;
+	NetAddrBlock mHubAddress;
+	std::string mSessionIdentifier;
+	size_t mLocalPlayerIndex;
+	int32 mSmallestUnreceivedTick;
+	WindowedNthElementFinder<int32> mNthElementFinder{kDefaultTimingWindowSize};
+	AdaptiveJitterBuffer mJitterBuffer{kDefaultAdaptiveTimingPercentile / 100.0, kDefaultAdaptiveTimingHalfLife};
+	bool mTimingMeasurementValid;
+	int32 mTimingMeasurement;
+	int32 mPreviousDelay = -1;
+	bool mHeardFromHub = false;
+	bool mWorldUpdate = false;
+	bool mHubSendsCompactFlags = false;
+	bool mHubCanPackFlags = false;
+
+	vector<int32> mDisplayLatencyBuffer; // stores the last 30 latency calculations, in ticks
+	uint32 mDisplayLatencyCount = 0;
+	int32 mDisplayLatencyTicks = 0; // sum of the latency ticks from the last 30 seconds, using above two
+
+	int32 mSmallestUnconfirmedTick;
+};
+
+static SpokeGame sSpokeGame;
+
+static bool spoke_tick_task();
 static void spoke_received_ping_response(AIStream& ps, NetAddrBlock address);
-static void process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static void handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static void handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static void handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static bool spoke_tick();
-static void send_packet();
-static void send_identification_packet();
 
 
-static inline NetworkPlayer_spoke&
-getNetworkPlayer(size_t inIndex)
+inline NetworkPlayer_spoke&
+SpokeGame::getNetworkPlayer(size_t inIndex)
 {
-        assert(inIndex < sNetworkPlayers.size());
-        return sNetworkPlayers[inIndex];
+        assert(inIndex < mNetworkPlayers.size());
+        return mNetworkPlayers[inIndex];
 }
 
 
@@ -155,35 +209,58 @@ operator !=(const NetAddrBlock& a, const NetAddrBlock& b)
 
 
 
-static OSErr
-send_frame_to_local_hub(DDPFramePtr frame, NetAddrBlock *address)
+OSErr
+SpokeGame::send_frame_to_local_hub(DDPFramePtr frame, NetAddrBlock *address)
 {
-        sLocalOutgoingBuffer.datagramSize = frame->data_size;
-        memcpy(sLocalOutgoingBuffer.datagramData, frame->data, frame->data_size);
+        mLocalOutgoingBuffer.datagramSize = frame->data_size;
+        memcpy(mLocalOutgoingBuffer.datagramData, frame->data, frame->data_size);
         // An all-0 sourceAddress is the cue for "local spoke" currently.
-        obj_clear(sLocalOutgoingBuffer.sourceAddress);
-        sNeedToSendLocalOutgoingBuffer = true;
+        obj_clear(mLocalOutgoingBuffer.sourceAddress);
+        mNeedToSendLocalOutgoingBuffer = true;
         return noErr;
 }
 
 
 
-static inline void
-check_send_packet_to_hub()
+inline void
+SpokeGame::check_send_packet_to_hub()
 {
-        if(sNeedToSendLocalOutgoingBuffer)
+        if(mNeedToSendLocalOutgoingBuffer)
 	{
 		logContextNMT("delivering stored packet to local hub");
-                hub_received_network_packet(&sLocalOutgoingBuffer);
+                hub_received_network_packet(&mLocalOutgoingBuffer);
 	}
 
-        sNeedToSendLocalOutgoingBuffer = false;
+        mNeedToSendLocalOutgoingBuffer = false;
 }
 
 
 
 void
-spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal)
+SpokeGame::send_frame(DDPFramePtr inFrame, NetAddrBlock* inAddress)
+{
+	if (mTransport)
+		mTransport->send(*inAddress, inFrame->data, inFrame->data_size);
+	else
+		NetDDPSendFrame(inFrame, inAddress);
+}
+
+
+
+SpokeGame::SpokeGame() :
+	mLocalFlags(parse_keymap),
+	mPlayerNetDead(make_player_really_net_dead)
+{
+}
+
+SpokeGame::~SpokeGame()
+{
+	if (mOutgoingFrame)
+		NetDDPDisposeFrame(mOutgoingFrame);
+}
+
+void
+SpokeGame::initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal, bool inHubCanPackFlags, const std::string& inSessionIdentifier)
 {
         assert(inLocalPlayerIndex != NONE);
         assert(inNumberOfPlayers >= 1);
@@ -191,81 +268,92 @@ spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inN
         assert(inPlayerQueues[inLocalPlayerIndex] != NULL);
         assert(inPlayerConnected[inLocalPlayerIndex]);
 
-        sHubIsLocal = inHubIsLocal;
-        sHubAddress = inHubAddress;
+        mHubIsLocal = inHubIsLocal;
+        mHubCanPackFlags = inHubCanPackFlags;
+        mHubAddress = inHubAddress;
+	mSessionIdentifier = inSessionIdentifier;
 
-        sLocalPlayerIndex = inLocalPlayerIndex;
+        mLocalPlayerIndex = inLocalPlayerIndex;
 
-        sOutgoingFrame = NetDDPNewFrame();
+        mOutgoingFrame = NetDDPNewFrame();
 
-        sSmallestRealGameTick = inFirstTick;
+        mSmallestRealGameTick = inFirstTick;
         int32 theFirstPregameTick = inFirstTick - kPregameTicks;
-        sOutgoingFlags.reset(theFirstPregameTick);
-	sUnconfirmedFlags.reset(sSmallestRealGameTick);
-	sSmallestUnconfirmedTick = sSmallestRealGameTick;
-        sSmallestUnreceivedTick = theFirstPregameTick;
+        mOutgoingFlags.reset(theFirstPregameTick);
+	mUnconfirmedFlags.reset(mSmallestRealGameTick);
+	mSmallestUnconfirmedTick = mSmallestRealGameTick;
+        mSmallestUnreceivedTick = theFirstPregameTick;
         
-        sNetworkPlayers.clear();
-        sNetworkPlayers.resize(inNumberOfPlayers);
+        mNetworkPlayers.clear();
+        mNetworkPlayers.resize(inNumberOfPlayers);
 
-        sLocallyGeneratedFlags.children().clear();
-        sLocallyGeneratedFlags.children().insert(&sOutgoingFlags);
-	sLocallyGeneratedFlags.children().insert(&sUnconfirmedFlags);
+        mLocallyGeneratedFlags.children().clear();
+        mLocallyGeneratedFlags.children().insert(&mOutgoingFlags);
+	mLocallyGeneratedFlags.children().insert(&mUnconfirmedFlags);
 
         for(size_t i = 0; i < inNumberOfPlayers; i++)
         {
-                sNetworkPlayers[i].mZombie = (inPlayerQueues[i] == NULL);
-                sNetworkPlayers[i].mConnected = inPlayerConnected[i];
-                sNetworkPlayers[i].mNetDeadTick = theFirstPregameTick - 1;
-                sNetworkPlayers[i].mQueue = inPlayerQueues[i];
-                if(sNetworkPlayers[i].mConnected)
+                mNetworkPlayers[i].mZombie = (inPlayerQueues[i] == NULL);
+                mNetworkPlayers[i].mConnected = inPlayerConnected[i];
+                mNetworkPlayers[i].mNetDeadTick = theFirstPregameTick - 1;
+                mNetworkPlayers[i].mQueue = inPlayerQueues[i];
+                if(mNetworkPlayers[i].mConnected)
                 {
-                        sNetworkPlayers[i].mQueue->reset(sSmallestRealGameTick);
+                        mNetworkPlayers[i].mQueue->reset(mSmallestRealGameTick);
                 }
         }
 
-        sRequestedTimingAdjustment = 0;
-        sOutstandingTimingAdjustment = 0;
-
-        sNetworkTicker = 0;
-		sWorldUpdate = false;
-        sLastNetworkTickHeard = 0;
-        sLastNetworkTickSent = 0;
-        sConnected = true;
-	sNthElementFinder.reset(sSpokePreferences.mTimingWindowSize);
-	sTimingMeasurementValid = false;
-
-        sMessageTypeToMessageHandler.clear();
-        sMessageTypeToMessageHandler[kEndOfMessagesMessageType] = handle_end_of_messages_message;
-        sMessageTypeToMessageHandler[kTimingAdjustmentMessageType] = handle_timing_adjustment_message;
-        sMessageTypeToMessageHandler[kPlayerNetDeadMessageType] = handle_player_net_dead_message;
-        sNeedToSendLocalOutgoingBuffer = false;
-
-        sSpokeActive = true;
-        sSpokeTickTask = myXTMSetup(1000/TICKS_PER_SECOND, spoke_tick);
-
-	sDisplayLatencyBuffer.resize(TICKS_PER_SECOND, 0);
-	sDisplayLatencyCount = 0;
-	sDisplayLatencyTicks = 0;
+        mRequestedTimingAdjustment = 0;
+        mOutstandingTimingAdjustment = 0;
+
+        mNetworkTicker = 0;
+		mWorldUpdate = false;
+        mLastNetworkTickHeard = 0;
+        mLastNetworkTickSent = 0;
+        mConnected = true;
+	mNthElementFinder.reset(sSpokePreferences.mTimingWindowSize);
+	mJitterBuffer.reset(sSpokePreferences.mAdaptiveTimingPercentile / 100.0, sSpokePreferences.mAdaptiveTimingHalfLife);
+	mTimingMeasurementValid = false;
+
+        mMessageTypeToMessageHandler.clear();
+        mMessageTypeToMessageHandler[kEndOfMessagesMessageType] = &SpokeGame::handle_end_of_messages_message;
+        mMessageTypeToMessageHandler[kTimingAdjustmentMessageType] = &SpokeGame::handle_timing_adjustment_message;
+        mMessageTypeToMessageHandler[kPlayerNetDeadMessageType] = &SpokeGame::handle_player_net_dead_message;
+        mNeedToSendLocalOutgoingBuffer = false;
+
+	mDisplayLatencyBuffer.resize(TICKS_PER_SECOND, 0);
+	mDisplayLatencyCount = 0;
+	mDisplayLatencyTicks = 0;
 	
-	sHeardFromHub = false;
+	mHeardFromHub = false;
+	mHubSendsCompactFlags = false;
 }
 
 
 
 void
-spoke_cleanup(bool inGraceful)
+SpokeGame::start(bool inTickTask)
+{
+        mSpokeActive = true;
+	if (inTickTask)
+		mSpokeTickTask = myXTMSetup(1000/TICKS_PER_SECOND, spoke_tick_task);
+}
+
+
+
+void
+SpokeGame::cleanup(bool inGraceful)
 {
         // Stop processing incoming packets (packet processor won't start processing another packet
-        // due to sSpokeActive = false, and we know it's not in the middle of processing one because
+        // due to mSpokeActive = false, and we know it's not in the middle of processing one because
         // we take the mutex).
         if(take_mytm_mutex())
         {
 		// Mark the tick task for cancellation (it won't start running again after this returns).
-		myTMRemove(sSpokeTickTask);
-		sSpokeTickTask = NULL;
+		myTMRemove(mSpokeTickTask);
+		mSpokeTickTask = NULL;
 
-                sSpokeActive = false;
+                mSpokeActive = false;
 
 		// We send one last packet here to try to not leave the hub hanging on our ACK.
 		send_packet();
@@ -277,52 +365,50 @@ spoke_cleanup(bool inGraceful)
         // This waits for the tick task to actually finish
         myTMCleanup();
         
-        sMessageTypeToMessageHandler.clear();
-        sNetworkPlayers.clear();
-        sLocallyGeneratedFlags.children().clear();
-	sDisplayLatencyBuffer.clear();
-        NetDDPDisposeFrame(sOutgoingFrame);
-        sOutgoingFrame = NULL;
+        mMessageTypeToMessageHandler.clear();
+        mNetworkPlayers.clear();
+        mLocallyGeneratedFlags.children().clear();
+	mDisplayLatencyBuffer.clear();
+        NetDDPDisposeFrame(mOutgoingFrame);
+        mOutgoingFrame = NULL;
 }
 
 
 
 int32
-spoke_get_net_time()
+SpokeGame::get_net_time()
 {
-	static int32 sPreviousDelay = -1;
-
-	int32 theDelay = (sSpokePreferences.mAdjustTiming && sTimingMeasurementValid) ? sTimingMeasurement : 0;
+	int32 theDelay = (sSpokePreferences.mAdjustTiming && mTimingMeasurementValid) ? mTimingMeasurement : 0;
 
-	if(theDelay != sPreviousDelay)
+	if(theDelay != mPreviousDelay)
 	{
 		logDump("local delay is now %d", theDelay);
-		sPreviousDelay = theDelay;
+		mPreviousDelay = theDelay;
 	}
 
-	return (sConnected ? sOutgoingFlags.getWriteTick() - theDelay : getNetworkPlayer(sLocalPlayerIndex).mQueue->getWriteTick());
+	return (mConnected ? mOutgoingFlags.getWriteTick() - theDelay : getNetworkPlayer(mLocalPlayerIndex).mQueue->getWriteTick());
 }
 
-static void
-spoke_became_disconnected()
+void
+SpokeGame::spoke_became_disconnected()
 {
-        sConnected = false;
-        for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+        mConnected = false;
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
         {
-                if(sNetworkPlayers[i].mConnected)
-                        make_player_really_net_dead(i);
+                if(mNetworkPlayers[i].mConnected)
+                        mPlayerNetDead(i);
         }
 }
 
 
 
 void
-spoke_received_network_packet(DDPPacketBufferPtr inPacket)
+SpokeGame::received_network_packet(DDPPacketBufferPtr inPacket)
 {
 	logContextNMT("spoke processing a received packet");
 	
         // Ignore packets not from our hub
-//        if(inPacket->sourceAddress != sHubAddress)
+//        if(inPacket->sourceAddress != mHubAddress)
 //                return;
 
         try {
@@ -332,7 +418,7 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
 		ps >> thePacketMagic;
 			
 		// If we've already given up on the connection, ignore non-ping packets.
-		if((!sConnected || !sSpokeActive) &&
+		if((!mConnected || !mSpokeActive) &&
 		   thePacketMagic != kPingRequestPacket &&
 		   thePacketMagic != kPingResponsePacket)
 			return;
@@ -353,11 +439,19 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
                 switch(thePacketMagic)
                 {
 		case kHubToSpokeGameDataPacketV1Magic:
-			spoke_received_game_data_packet_v1(ps, false);
+			spoke_received_game_data_packet_v1(ps, false, false);
 			break;
 
 		case kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic:
-			spoke_received_game_data_packet_v1(ps, true);
+			spoke_received_game_data_packet_v1(ps, true, false);
+			break;
+
+		case kHubToSpokeGameDataPacketV2Magic:
+			spoke_received_game_data_packet_v1(ps, false, true);
+			break;
+
+		case kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic:
+			spoke_received_game_data_packet_v1(ps, true, true);
 			break;
 		
 		case kPingRequestPacket:
@@ -382,10 +476,12 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
 
 
 
-static void
-spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
+void
+SpokeGame::spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags, bool compact_flags)
 {
-	sHeardFromHub = true;
+	mHeardFromHub = true;
+	if (compact_flags)
+		mHubSendsCompactFlags = true;
 
         IncomingGameDataPacketProcessingContext context;
         
@@ -394,28 +490,28 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
         ps >> theSmallestUnacknowledgedTick;
 
 	// we can get an early ACK only if the server made up flags for us...
-	if (theSmallestUnacknowledgedTick > sOutgoingFlags.getWriteTick())
+	if (theSmallestUnacknowledgedTick > mOutgoingFlags.getWriteTick())
 	{
 		if (reflected_flags) 
 		{
-			theSmallestUnacknowledgedTick = sOutgoingFlags.getWriteTick();
+			theSmallestUnacknowledgedTick = mOutgoingFlags.getWriteTick();
 		}
 		else
 		{
-			logTraceNMT("early ack (%d > %d)", theSmallestUnacknowledgedTick, sOutgoingFlags.getWriteTick());
+			logTraceNMT("early ack (%d > %d)", theSmallestUnacknowledgedTick, mOutgoingFlags.getWriteTick());
 			return;
 		}
 	}
 
 
         // Heard from hub
-        sLastNetworkTickHeard = sNetworkTicker;
+        mLastNetworkTickHeard = mNetworkTicker;
 
         // Remove acknowledged elements from outgoing queue
-        for(int tick = sOutgoingFlags.getReadTick(); tick < theSmallestUnacknowledgedTick; tick++)
+        for(int tick = mOutgoingFlags.getReadTick(); tick < theSmallestUnacknowledgedTick; tick++)
 	{
-		logTraceNMT("dequeueing tick %d from sOutgoingFlags", tick);
-                sOutgoingFlags.dequeue();
+		logTraceNMT("dequeueing tick %d from mOutgoingFlags", tick);
+                mOutgoingFlags.dequeue();
 	}
 
         // Process messages
@@ -423,10 +519,10 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 
         if(!context.mGotTimingAdjustmentMessage)
 	{
-		if(sRequestedTimingAdjustment != 0)
+		if(mRequestedTimingAdjustment != 0)
 			logTraceNMT("timing adjustment no longer requested");
 		
-                sRequestedTimingAdjustment = 0;
+                mRequestedTimingAdjustment = 0;
 	}
 
         // Action_flags!!!
@@ -444,10 +540,10 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 		// sometime in the future.  (If their NetDeadTick is greater than the ACKed tick, we expect
 		// that the hub will be sending actual flags in the future to make up the difference.)
 		bool weAreAlone = true;
-		int32 theSmallestUnacknowledgedTick = sOutgoingFlags.getReadTick();
-		for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+		int32 theSmallestUnacknowledgedTick = mOutgoingFlags.getReadTick();
+		for(size_t i = 0; i < mNetworkPlayers.size(); i++)
 		{
-			if(i != sLocalPlayerIndex && (sNetworkPlayers[i].mConnected || sNetworkPlayers[i].mNetDeadTick > theSmallestUnacknowledgedTick))
+			if(i != mLocalPlayerIndex && (mNetworkPlayers[i].mConnected || mNetworkPlayers[i].mNetDeadTick > theSmallestUnacknowledgedTick))
 			{
 				weAreAlone = false;
 				break;
@@ -458,14 +554,14 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 		{
 			logContextNMT("handling special \"we are alone\" case");
 			
-			for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+			for(size_t i = 0; i < mNetworkPlayers.size(); i++)
 			{
-				NetworkPlayer_spoke& thePlayer = sNetworkPlayers[i];
-				if (i == sLocalPlayerIndex)
+				NetworkPlayer_spoke& thePlayer = mNetworkPlayers[i];
+				if (i == mLocalPlayerIndex)
 				{
-					while (sSmallestUnconfirmedTick < sUnconfirmedFlags.getWriteTick())
+					while (mSmallestUnconfirmedTick < mUnconfirmedFlags.getWriteTick())
 					{
-						sNetworkPlayers[i].mQueue->enqueue(sUnconfirmedFlags.peek(sSmallestUnconfirmedTick++));
+						mNetworkPlayers[i].mQueue->enqueue(mUnconfirmedFlags.peek(mSmallestUnconfirmedTick++));
 					}
 				} 
 				else if (!thePlayer.mZombie)
@@ -478,8 +574,8 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 				}
 			}
 
-			sSmallestUnreceivedTick = theSmallestUnacknowledgedTick;
-			logDumpNMT("sSmallestUnreceivedTick is now %d", sSmallestUnreceivedTick);
+			mSmallestUnreceivedTick = theSmallestUnacknowledgedTick;
+			logDumpNMT("mSmallestUnreceivedTick is now %d", mSmallestUnreceivedTick);
 		}
 		
                 return;
@@ -489,31 +585,50 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
         ps >> theSmallestUnreadTick;
 
         // Can't accept packets that skip ticks
-        if(theSmallestUnreadTick > sSmallestUnreceivedTick)
+        if(theSmallestUnreadTick > mSmallestUnreceivedTick)
 	{
-		logTraceNMT("early flags (%d > %d)", theSmallestUnreadTick, sSmallestUnreceivedTick);
+		logTraceNMT("early flags (%d > %d)", theSmallestUnreadTick, mSmallestUnreceivedTick);
                 return;
 	}
 
+	// Packed flags are unpacked up front, so the loop below can read either kind the same way
+	std::vector<uint32> theUnpackedFlags;
+	if (compact_flags)
+	{
+		try
+		{
+			unpack_action_flags(ps, theUnpackedFlags);
+		}
+		catch (const AStream::failure& f)
+		{
+			logWarningNMT("AStream exception (%s) unpacking flags at theSmallestUnreadTick %i\n", f.what(), theSmallestUnreadTick);
+			return;
+		}
+	}
+	size_t theNextUnpackedFlags = 0;
+	auto theFlagsRemain = [&]() {
+		return compact_flags ? theNextUnpackedFlags < theUnpackedFlags.size() : ps.tellg() < ps.maxg();
+	};
+
         // Figure out how many ticks of flags we can actually enqueue
         // We want to stock all queues evenly, since we ACK everyone's flags for a tick together.
         int theSmallestQueueSpace = INT_MAX;
-        for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
         {
 		// we'll never get flags for zombies, and we're not expected 
 		// to enqueue flags for zombies
-                if(sNetworkPlayers[i].mZombie)
+                if(mNetworkPlayers[i].mZombie)
                         continue;
 
-                int theQueueSpace = sNetworkPlayers[i].mQueue->availableCapacity();
+                int theQueueSpace = mNetworkPlayers[i].mQueue->availableCapacity();
 
                 /*
                         hmm, taking this exemption out, because we will start enqueueing PLAYER_NET_DEAD_FLAG onto the queue.
                 // If player is netdead or will become netdead before queue fills,
                 // player's queue space will not limit us
-                if(!sNetworkPlayers[i].mConnected)
+                if(!mNetworkPlayers[i].mConnected)
                 {
-                        int theRemainingLiveTicks = sNetworkPlayers[i].mNetDeadTick - sSmallestUnreceivedTick;
+                        int theRemainingLiveTicks = mNetworkPlayers[i].mNetDeadTick - mSmallestUnreceivedTick;
                         if(theRemainingLiveTicks < theQueueSpace)
                                 continue;
                 }
@@ -529,32 +644,32 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
         // The body of this loop is a bit more convoluted than you might
         // expect, because the same loop is used to skip already-seen action_flags
         // and to enqueue new ones.
-	while(ps.tellg() < ps.maxg())
+	while(theFlagsRemain())
         {
                 // If we've no room to enqueue stuff, no point in finishing reading the packet.
                 if(theSmallestQueueSpace <= 0)
                         break;
                 
-                for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+                for(size_t i = 0; i < mNetworkPlayers.size(); i++)
                 {
 
 			// We'll never get flags for zombies
-			if (sNetworkPlayers[i].mZombie)
+			if (mNetworkPlayers[i].mZombie)
 				continue;
 
 			// if our own flags are not sent back to us,
 			// confirm the ones we have in our unconfirmed queue,
 			// and do not read any from the packet
-			if (i == sLocalPlayerIndex && !reflected_flags)
+			if (i == mLocalPlayerIndex && !reflected_flags)
 			{
-				if (theSmallestUnreadTick == sSmallestUnreceivedTick && theSmallestUnreadTick >= sSmallestRealGameTick)
+				if (theSmallestUnreadTick == mSmallestUnreceivedTick && theSmallestUnreadTick >= mSmallestRealGameTick)
 				{
-					assert(sNetworkPlayers[i].mQueue->getWriteTick() == sSmallestUnconfirmedTick);
-					assert(sSmallestUnconfirmedTick >= sUnconfirmedFlags.getReadTick());
-					assert(sSmallestUnconfirmedTick < sUnconfirmedFlags.getWriteTick());
+					assert(mNetworkPlayers[i].mQueue->getWriteTick() == mSmallestUnconfirmedTick);
+					assert(mSmallestUnconfirmedTick >= mUnconfirmedFlags.getReadTick());
+					assert(mSmallestUnconfirmedTick < mUnconfirmedFlags.getWriteTick());
 					// confirm this flag
-					sNetworkPlayers[i].mQueue->enqueue(sUnconfirmedFlags.peek(sSmallestUnconfirmedTick));
-					sSmallestUnconfirmedTick++;
+					mNetworkPlayers[i].mQueue->enqueue(mUnconfirmedFlags.peek(mSmallestUnconfirmedTick));
+					mSmallestUnconfirmedTick++;
 				}
 				
 				continue;
@@ -563,7 +678,7 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
                         bool shouldEnqueueNetDeadFlags = false;
 
                         // We won't get flags for netdead players
-                        NetworkPlayer_spoke& thePlayer = sNetworkPlayers[i];
+                        NetworkPlayer_spoke& thePlayer = mNetworkPlayers[i];
                         if(!thePlayer.mConnected)
                         {
                                 if(thePlayer.mNetDeadTick < theSmallestUnreadTick)
@@ -572,8 +687,8 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
                                 if(thePlayer.mNetDeadTick == theSmallestUnreadTick)
                                 {
                                         // Only actually act if this tick is new to us
-                                        if(theSmallestUnreadTick == sSmallestUnreceivedTick)
-                                                make_player_really_net_dead(i);
+                                        if(theSmallestUnreadTick == mSmallestUnreceivedTick)
+                                                mPlayerNetDead(i);
                                         shouldEnqueueNetDeadFlags = true;
                                 }
                         }
@@ -588,7 +703,12 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
                                 // We should have a flag for this player for this tick!
 				try 
 				{
-					ps >> theFlags;
+					if (!compact_flags)
+						ps >> theFlags;
+					else if (theNextUnpackedFlags < theUnpackedFlags.size())
+						theFlags = theUnpackedFlags[theNextUnpackedFlags++];
+					else
+						throw AStream::failure("ran out of unpacked flags");
 				}
 				catch (const AStream::failure& f)
 				{
@@ -599,40 +719,50 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 
 
                         // Now, we've gotten flags, probably from the packet... should we enqueue them?
-                        if(theSmallestUnreadTick == sSmallestUnreceivedTick)
+                        if(theSmallestUnreadTick == mSmallestUnreceivedTick)
                         {
-				if(theSmallestUnreadTick >= sSmallestRealGameTick)
+				if(theSmallestUnreadTick >= mSmallestRealGameTick)
 				{
-					WritableTickBasedActionQueue& theQueue = *(sNetworkPlayers[i].mQueue);
-					assert(!sNetworkPlayers[i].mConnected || theQueue.getWriteTick() == sSmallestUnreceivedTick);
+					WritableTickBasedActionQueue& theQueue = *(mNetworkPlayers[i].mQueue);
+					assert(!mNetworkPlayers[i].mConnected || theQueue.getWriteTick() == mSmallestUnreceivedTick);
 					assert(theQueue.availableCapacity() > 0);
 					logTraceNMT("enqueueing flags %x for player %d tick %d", theFlags, i, theQueue.getWriteTick());
 					theQueue.enqueue(theFlags);
-					if (i == sLocalPlayerIndex) sSmallestUnconfirmedTick++;
+					if (i == mLocalPlayerIndex) mSmallestUnconfirmedTick++;
 				}
                         }
 
                 } // iterate over players
 
 		theSmallestUnreadTick++;
-		if(sSmallestUnreceivedTick < theSmallestUnreadTick)
+		if(mSmallestUnreceivedTick < theSmallestUnreadTick)
 		{
 			theSmallestQueueSpace--;
-			sSmallestUnreceivedTick = theSmallestUnreadTick;
+			mSmallestUnreceivedTick = theSmallestUnreadTick;
 
-			int32 theLatencyMeasurement = sOutgoingFlags.getWriteTick() - sSmallestUnreceivedTick;
+			int32 theLatencyMeasurement = mOutgoingFlags.getWriteTick() - mSmallestUnreceivedTick;
 			logDumpNMT("latency measurement: %d", theLatencyMeasurement);
 
-			sNthElementFinder.insert(theLatencyMeasurement);
 			// We capture these values here so we don't have to take a lock in GetNetTime.
-			sTimingMeasurementValid = sNthElementFinder.window_full();
-			if(sTimingMeasurementValid)
-				sTimingMeasurement = sNthElementFinder.nth_largest_element(sSpokePreferences.mTimingNthElement);
+			if(sSpokePreferences.mAdaptiveTiming)
+			{
+				mJitterBuffer.insert(theLatencyMeasurement);
+				mTimingMeasurementValid = mJitterBuffer.ready();
+				if(mTimingMeasurementValid)
+					mTimingMeasurement = mJitterBuffer.lead();
+			}
+			else
+			{
+				mNthElementFinder.insert(theLatencyMeasurement);
+				mTimingMeasurementValid = mNthElementFinder.window_full();
+				if(mTimingMeasurementValid)
+					mTimingMeasurement = mNthElementFinder.nth_largest_element(sSpokePreferences.mTimingNthElement);
+			}
 
 			// update the latency display
-			sDisplayLatencyTicks -= sDisplayLatencyBuffer[sDisplayLatencyCount % sDisplayLatencyBuffer.size()];
-			sDisplayLatencyBuffer[sDisplayLatencyCount++ % sDisplayLatencyBuffer.size()] = theLatencyMeasurement;
-			sDisplayLatencyTicks += theLatencyMeasurement;
+			mDisplayLatencyTicks -= mDisplayLatencyBuffer[mDisplayLatencyCount % mDisplayLatencyBuffer.size()];
+			mDisplayLatencyBuffer[mDisplayLatencyCount++ % mDisplayLatencyBuffer.size()] = theLatencyMeasurement;
+			mDisplayLatencyTicks += theLatencyMeasurement;
 		}
 
 	} // loop while there's packet data left
@@ -640,45 +770,45 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 }
 
 
-static void
-spoke_received_ping_request(AIStream& ps, NetAddrBlock address)
+void
+SpokeGame::spoke_received_ping_request(AIStream& ps, NetAddrBlock address)
 {
 	uint16 pingIdentifier;
 	ps >> pingIdentifier;
 	
 	// respond back to requestor
 	bool initedFrame = false;
-	if (!sOutgoingFrame)
+	if (!mOutgoingFrame)
 	{
-		sOutgoingFrame = NetDDPNewFrame();
+		mOutgoingFrame = NetDDPNewFrame();
 		initedFrame = true;
 	}
 	
-	AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-	AOStreamBE ops(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+	AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+	AOStreamBE ops(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
 	
 	try {
 		hdr << (uint16)kPingResponsePacket;
 		ops << pingIdentifier;
 		
 		// blank out the CRC field before calculating
-		sOutgoingFrame->data[2] = 0;
-		sOutgoingFrame->data[3] = 0;
+		mOutgoingFrame->data[2] = 0;
+		mOutgoingFrame->data[3] = 0;
 		
-		uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ops.tellp());
+		uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ops.tellp());
 		hdr << crc;
 		
 		// Send the packet
-		sOutgoingFrame->data_size = ops.tellp();
-		NetDDPSendFrame(sOutgoingFrame, &address);
+		mOutgoingFrame->data_size = ops.tellp();
+		send_frame(mOutgoingFrame, &address);
 	} catch (...) {
 		logWarningNMT("Caught exception while constructing/sending ping response packet");
 	}
 	
 	if (initedFrame)
 	{
-		NetDDPDisposeFrame(sOutgoingFrame);
-		sOutgoingFrame = NULL;
+		NetDDPDisposeFrame(mOutgoingFrame);
+		mOutgoingFrame = NULL;
 	}
 } // spoke_received_ping_request()
 
@@ -696,79 +826,79 @@ spoke_received_ping_response(AIStream& ps, NetAddrBlock address)
 } // spoke_received_ping_response()
 
 
-static void
-process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+void
+SpokeGame::process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
 {
     while(!context.mMessagesDone)
     {
         uint16 theMessageType;
         ps >> theMessageType;
 
-        MessageTypeToMessageHandler::iterator i = sMessageTypeToMessageHandler.find(theMessageType);
+        MessageTypeToMessageHandler::iterator i = mMessageTypeToMessageHandler.find(theMessageType);
 
-        if(i != sMessageTypeToMessageHandler.end())
-            i->second(ps, context);
+        if(i != mMessageTypeToMessageHandler.end())
+            (this->*(i->second))(ps, context);
     }
 }
 
 
 
-static void
-handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+void
+SpokeGame::handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
 {
         context.mMessagesDone = true;
 }
 
 
 
-static void
-handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+void
+SpokeGame::handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
 {
         uint8 thePlayerIndex;
         int32 theTick;
 
         ps >> thePlayerIndex >> theTick;
 
-        if(thePlayerIndex > sNetworkPlayers.size())
+        if(thePlayerIndex > mNetworkPlayers.size())
                 return;
 
-        sNetworkPlayers[thePlayerIndex].mConnected = false;
-        sNetworkPlayers[thePlayerIndex].mNetDeadTick = theTick;
+        mNetworkPlayers[thePlayerIndex].mConnected = false;
+        mNetworkPlayers[thePlayerIndex].mNetDeadTick = theTick;
 
 	logDumpNMT("netDead message: player %d in tick %d", thePlayerIndex, theTick);
 }
 
 
 
-static void
-handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+void
+SpokeGame::handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
 {
         int8 theAdjustment;
 
         ps >> theAdjustment;
 
-        if(theAdjustment != sRequestedTimingAdjustment)
+        if(theAdjustment != mRequestedTimingAdjustment)
         {
-                sOutstandingTimingAdjustment = theAdjustment;
-                sRequestedTimingAdjustment = theAdjustment;
-		logTraceNMT("new timing adjustment message; requested: %d outstanding: %d", sRequestedTimingAdjustment, sOutstandingTimingAdjustment);
+                mOutstandingTimingAdjustment = theAdjustment;
+                mRequestedTimingAdjustment = theAdjustment;
+		logTraceNMT("new timing adjustment message; requested: %d outstanding: %d", mRequestedTimingAdjustment, mOutstandingTimingAdjustment);
         }
 
         context.mGotTimingAdjustmentMessage = true;
 }
 
-static bool
-spoke_tick()
+bool
+SpokeGame::spoke_tick()
 {
-	logContextNMT("processing spoke_tick %d", sNetworkTicker);
+	logContextNMT("processing spoke_tick %d", mNetworkTicker);
 	
-        sNetworkTicker++;
+        mNetworkTicker++;
 
-        if(sConnected)
+        if(mConnected)
         {
-                int32 theSilentTicksBeforeNetDeath = (sOutgoingFlags.getReadTick() >= sSmallestRealGameTick) ? sSpokePreferences.mInGameTicksBeforeNetDeath : sSpokePreferences.mPregameTicksBeforeNetDeath;
+                int32 theSilentTicksBeforeNetDeath = (mOutgoingFlags.getReadTick() >= mSmallestRealGameTick) ? sSpokePreferences.mInGameTicksBeforeNetDeath : sSpokePreferences.mPregameTicksBeforeNetDeath;
         
-                if(sNetworkTicker - sLastNetworkTickHeard > theSilentTicksBeforeNetDeath)
+                if(mNetworkTicker - mLastNetworkTickHeard > theSilentTicksBeforeNetDeath)
                 {
 			logTraceNMT("giving up on hub; disconnecting");
                         spoke_became_disconnected();
@@ -780,9 +910,9 @@ spoke_tick()
 
         // Negative timing adjustment means we need to provide extra ticks because we're late.
         // We let this cover the normal timing adjustment = 0 case too.
-        if(sOutstandingTimingAdjustment <= 0)
+        if(mOutstandingTimingAdjustment <= 0)
         {
-                int theNumberOfFlagsToProvide = -sOutstandingTimingAdjustment + 1;
+                int theNumberOfFlagsToProvide = -mOutstandingTimingAdjustment + 1;
 
 		logDumpNMT("want to provide %d flags", theNumberOfFlagsToProvide);
 
@@ -795,67 +925,67 @@ spoke_tick()
 			//	else (if pregame), write only to the outbound flags queue.
 
 			WritableTickBasedActionQueue& theTargetQueue =
-				sConnected ?
-					((sOutgoingFlags.getWriteTick() >= sSmallestRealGameTick) ?
-						static_cast<WritableTickBasedActionQueue&>(sLocallyGeneratedFlags)
-						: static_cast<WritableTickBasedActionQueue&>(sOutgoingFlags))
-					: *(sNetworkPlayers[sLocalPlayerIndex].mQueue);
+				mConnected ?
+					((mOutgoingFlags.getWriteTick() >= mSmallestRealGameTick) ?
+						static_cast<WritableTickBasedActionQueue&>(mLocallyGeneratedFlags)
+						: static_cast<WritableTickBasedActionQueue&>(mOutgoingFlags))
+					: *(mNetworkPlayers[mLocalPlayerIndex].mQueue);
 
 			if(theTargetQueue.availableCapacity() <= 0)
 				break;
 
 			logDumpNMT("enqueueing flags for tick %d", theTargetQueue.getWriteTick());
 
-			theTargetQueue.enqueue(parse_keymap());
+			theTargetQueue.enqueue(mLocalFlags());
 			shouldSend = true;
 			theNumberOfFlagsToProvide--;
 		}
 		
 		// Prevent creeping timing adjustment during "lulls"; OTOH remember to
 		// finish next time if we made progress but couldn't complete our obligation.
-		if(theNumberOfFlagsToProvide != -sOutstandingTimingAdjustment + 1)
-			sOutstandingTimingAdjustment = -theNumberOfFlagsToProvide;
+		if(theNumberOfFlagsToProvide != -mOutstandingTimingAdjustment + 1)
+			mOutstandingTimingAdjustment = -theNumberOfFlagsToProvide;
 	}
         // Positive timing adjustment means we should delay sending for a while,
         // so we just throw away this local tick.
         else
 	{
 		logDumpNMT("ignoring this tick for timing adjustment"); 
-                sOutstandingTimingAdjustment--;
+                mOutstandingTimingAdjustment--;
 	}
 
-	logDumpNMT("sOutstandingTimingAdjustment is now %d", sOutstandingTimingAdjustment);
+	logDumpNMT("mOutstandingTimingAdjustment is now %d", mOutstandingTimingAdjustment);
 
         // If we're connected and (we generated new data or if it's been long enough since we last sent), send.
-        if(sConnected)
+        if(mConnected)
 	{
-		if (sHeardFromHub) {
-			if(shouldSend || (sNetworkTicker - sLastNetworkTickSent) >= sSpokePreferences.mRecoverySendPeriod)
+		if (mHeardFromHub) {
+			if(shouldSend || (mNetworkTicker - mLastNetworkTickSent) >= sSpokePreferences.mRecoverySendPeriod)
 				send_packet();
 		} else {
-			if (!(sNetworkTicker % 30))
+			if (!(mNetworkTicker % 30))
 				send_identification_packet();
 		}
 	}
 	else
 	{
-		int32 theLocalPlayerWriteTick = getNetworkPlayer(sLocalPlayerIndex).mQueue->getWriteTick();
+		int32 theLocalPlayerWriteTick = getNetworkPlayer(mLocalPlayerIndex).mQueue->getWriteTick();
 
 		// Since we're not connected, we won't be enqueueing flags for the other players in the packet handler.
 		// So, we do it here to keep the game moving.
-		for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+		for(size_t i = 0; i < mNetworkPlayers.size(); i++)
 		{
-			if(i == sLocalPlayerIndex)
+			if(i == mLocalPlayerIndex)
 			{
 				// move our flags from sent queue to player queue
-				while (sSmallestUnconfirmedTick < sUnconfirmedFlags.getWriteTick())
+				while (mSmallestUnconfirmedTick < mUnconfirmedFlags.getWriteTick())
 				{
-					sNetworkPlayers[i].mQueue->enqueue(sUnconfirmedFlags.peek(sSmallestUnconfirmedTick++));
+					mNetworkPlayers[i].mQueue->enqueue(mUnconfirmedFlags.peek(mSmallestUnconfirmedTick++));
 				}
 				continue;
 			}
 			
-			NetworkPlayer_spoke& thePlayer = sNetworkPlayers[i];
+			NetworkPlayer_spoke& thePlayer = mNetworkPlayers[i];
 			
 			if(!thePlayer.mZombie)
 			{
@@ -870,65 +1000,74 @@ spoke_tick()
 
         check_send_packet_to_hub();
 
-		sWorldUpdate = true;
+		mWorldUpdate = true;
 
         // We want to run again.
         return true;
 }
 
-bool spoke_check_world_update()
+bool
+SpokeGame::check_world_update()
 {
-	if (sWorldUpdate)
+	if (mWorldUpdate)
 	{
-		sWorldUpdate = false;
+		mWorldUpdate = false;
 		return true;
 	}
 
 	return false;
 }
 
-static void
-send_packet()
+void
+SpokeGame::send_packet()
 {
         try {
-		AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-                AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+		AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+                AOStreamBE ps(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
         
                 // Packet type
                 hdr << (uint16)kSpokeToHubGameDataPacketV1Magic;
 
                 // Acknowledgement
-                ps << sSmallestUnreceivedTick;
+                ps << mSmallestUnreceivedTick;
+
+		// Let the hub know we can take packed flags, if it's said it can pack them (older
+		// hubs would misread the message).  Once the game is under way it either has, or never will
+		if(!mHubIsLocal && mHubCanPackFlags && !mHubSendsCompactFlags && mOutgoingFlags.getReadTick() < mSmallestRealGameTick)
+		{
+			ps << (uint16)kCompactFlagsMessageType
+			   << (uint16)Capabilities::kCompactFlagsVersion;
+		}
 
                 // No more messages
                 ps << (uint16)kEndOfMessagesMessageType;
         
                 // Action_flags!!!
-                if(sOutgoingFlags.size() > 0)
+                if(mOutgoingFlags.size() > 0)
                 {
-                        ps << sOutgoingFlags.getReadTick();
-                        for(int32 tick = sOutgoingFlags.getReadTick(); tick < sOutgoingFlags.getWriteTick(); tick++)
-                                ps << sOutgoingFlags.peek(tick);
+                        ps << mOutgoingFlags.getReadTick();
+                        for(int32 tick = mOutgoingFlags.getReadTick(); tick < mOutgoingFlags.getWriteTick(); tick++)
+                                ps << mOutgoingFlags.peek(tick);
                 }
 
-		logDumpNMT("preparing to send packet: ACK %d, flags [%d,%d)", sSmallestUnreceivedTick, sOutgoingFlags.getReadTick(), sOutgoingFlags.getWriteTick());
+		logDumpNMT("preparing to send packet: ACK %d, flags [%d,%d)", mSmallestUnreceivedTick, mOutgoingFlags.getReadTick(), mOutgoingFlags.getWriteTick());
 
 		// blank out the CRC before calculating it
-		sOutgoingFrame->data[2] = 0;
-		sOutgoingFrame->data[3] = 0;
+		mOutgoingFrame->data[2] = 0;
+		mOutgoingFrame->data[3] = 0;
 
-		uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ps.tellp());
+		uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ps.tellp());
 		hdr << crc;
 
                 // Send the packet
-                sOutgoingFrame->data_size = ps.tellp();
+                mOutgoingFrame->data_size = ps.tellp();
 
-                if(sHubIsLocal)
-                        send_frame_to_local_hub(sOutgoingFrame, &sHubAddress);
+                if(mHubIsLocal)
+                        send_frame_to_local_hub(mOutgoingFrame, &mHubAddress);
                 else
-                        NetDDPSendFrame(sOutgoingFrame, &sHubAddress);
+                        send_frame(mOutgoingFrame, &mHubAddress);
 
-                sLastNetworkTickSent = sNetworkTicker;
+                mLastNetworkTickSent = mNetworkTicker;
         }
         catch (...) {
         }
@@ -936,51 +1075,156 @@ send_packet()
 
 
 
-static void
-send_identification_packet()
+void
+SpokeGame::send_identification_packet()
 {
         try {
-		AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-                AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+		AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+                AOStreamBE ps(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
         
 		// Message type
 		hdr << (uint16) kSpokeToHubIdentification;
         
                 // ID
-                ps << (uint16)sLocalPlayerIndex;
+                ps << (uint16)mLocalPlayerIndex;
+
+		// and which game it's in, for a hub running several (older hubs stop reading before this)
+		ps << (uint8)mSessionIdentifier.size();
+		if (!mSessionIdentifier.empty())
+			ps.write(&mSessionIdentifier[0], mSessionIdentifier.size());
 
 		// blank out the CRC field before calculating
-		sOutgoingFrame->data[2] = 0;
-		sOutgoingFrame->data[3] = 0;
+		mOutgoingFrame->data[2] = 0;
+		mOutgoingFrame->data[3] = 0;
 
-		uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ps.tellp());
+		uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ps.tellp());
 		hdr << crc;
 
                 // Send the packet
-                sOutgoingFrame->data_size = ps.tellp();
-                if(sHubIsLocal)
-                        send_frame_to_local_hub(sOutgoingFrame, &sHubAddress);
+                mOutgoingFrame->data_size = ps.tellp();
+                if(mHubIsLocal)
+                        send_frame_to_local_hub(mOutgoingFrame, &mHubAddress);
                 else
-                        NetDDPSendFrame(sOutgoingFrame, &sHubAddress);
+                        send_frame(mOutgoingFrame, &mHubAddress);
         }
         catch (...) {
         }
 }
 
-int32 spoke_latency()
+int32
+SpokeGame::latency()
+{
+	return (mDisplayLatencyCount >= TICKS_PER_SECOND) ? mDisplayLatencyTicks * 1000 / TICKS_PER_SECOND / mDisplayLatencyBuffer.size() : NetworkStats::invalid;
+}
+
+
+
+static bool
+spoke_tick_task()
+{
+	NetDDPDispatchPackets();
+
+	return sSpokeGame.spoke_tick();
+}
+
+void
+spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal, bool inHubCanPackFlags, const std::string& inSessionIdentifier)
+{
+	sSpokeGame.initialize(inHubAddress, inFirstTick, inNumberOfPlayers, inPlayerQueues, inPlayerConnected, inLocalPlayerIndex, inHubIsLocal, inHubCanPackFlags, inSessionIdentifier);
+	sSpokeGame.start();
+}
+
+void
+spoke_cleanup(bool inGraceful)
+{
+	sSpokeGame.cleanup(inGraceful);
+}
+
+void
+spoke_received_network_packet(DDPPacketBufferPtr inPacket)
+{
+	sSpokeGame.received_network_packet(inPacket);
+}
+
+int32
+spoke_get_net_time()
+{
+	return sSpokeGame.get_net_time();
+}
+
+int32
+spoke_latency()
+{
+	return sSpokeGame.latency();
+}
+
+TickBasedActionQueue*
+spoke_get_unconfirmed_flags_queue()
+{
+	return sSpokeGame.get_unconfirmed_flags_queue();
+}
+
+int32
+spoke_get_smallest_unconfirmed_tick()
+{
+	return sSpokeGame.get_smallest_unconfirmed_tick();
+}
+
+bool
+spoke_check_world_update()
+{
+	return sSpokeGame.check_world_update();
+}
+
+
+
+StarBenchSpoke::StarBenchSpoke(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], size_t inLocalPlayerIndex, StarTransport& inTransport, std::function<action_flags_t()> inLocalFlags, std::function<void(size_t)> inPlayerNetDead) :
+	mGame(new SpokeGame)
+{
+	std::unique_ptr<bool[]> theConnected(new bool[inNumberOfPlayers]);
+	for (size_t i = 0; i < inNumberOfPlayers; i++)
+		theConnected[i] = (inPlayerQueues[i] != NULL);
+
+	mGame->mLocalFlags = inLocalFlags;
+	mGame->mPlayerNetDead = inPlayerNetDead;
+	mGame->mTransport = &inTransport;
+	mGame->initialize(inHubAddress, inFirstTick, inNumberOfPlayers, inPlayerQueues, theConnected.get(), inLocalPlayerIndex, false, true, "");
+	mGame->start(false);
+}
+
+StarBenchSpoke::~StarBenchSpoke()
 {
-	return (sDisplayLatencyCount >= TICKS_PER_SECOND) ? sDisplayLatencyTicks * 1000 / TICKS_PER_SECOND / sDisplayLatencyBuffer.size() : NetworkStats::invalid;
 }
 
-TickBasedActionQueue* spoke_get_unconfirmed_flags_queue()
+void
+StarBenchSpoke::tick()
 {
-	return &sUnconfirmedFlags;
+	mGame->spoke_tick();
+
+	// there's no prediction to hold on to our unconfirmed flags
+	TickBasedActionQueue* theQueue = mGame->get_unconfirmed_flags_queue();
+	while (theQueue->getReadTick() < mGame->get_smallest_unconfirmed_tick() && theQueue->getReadTick() < theQueue->getWriteTick())
+		theQueue->dequeue();
 }
 
-int32 spoke_get_smallest_unconfirmed_tick()
+void
+StarBenchSpoke::received_packet(DDPPacketBufferPtr inPacket)
 {
-	return sSmallestUnconfirmedTick;
+	mGame->received_network_packet(inPacket);
 }
+
+int32
+StarBenchSpoke::net_time()
+{
+	return mGame->get_net_time();
+}
+
+int32
+StarBenchSpoke::latency()
+{
+	return mGame->latency();
+}
+
 		
 
 enum {
@@ -990,6 +1234,8 @@ enum {
 	kRecoverySendPeriodAttribute,
 	kTimingWindowSizeAttribute,
 	kTimingNthElementAttribute,
+	kAdaptiveTimingPercentileAttribute,
+	kAdaptiveTimingHalfLifeAttribute,
 	kNumInt32Attributes,
 	kAdjustTimingAttribute = kNumInt32Attributes,
 	kNumAttributes
@@ -1002,7 +1248,9 @@ static const char* sAttributeStrings[kNumInt32Attributes] =
 //	"outgoing_flags_queue_size",
 	"recovery_send_period",
 	"timing_window_size",
-	"timing_nth_element"
+	"timing_nth_element",
+	"adaptive_timing_percentile",
+	"adaptive_timing_half_life"
 };
 
 static int32* sAttributeDestinations[kNumInt32Attributes] =
@@ -1012,7 +1260,9 @@ static int32* sAttributeDestinations[kNumInt32Attributes] =
 //	&sSpokePreferences.mOutgoingFlagsQueueSize,
 	&sSpokePreferences.mRecoverySendPeriod,
 	&sSpokePreferences.mTimingWindowSize,
-	&sSpokePreferences.mTimingNthElement
+	&sSpokePreferences.mTimingNthElement,
+	&sSpokePreferences.mAdaptiveTimingPercentile,
+	&sSpokePreferences.mAdaptiveTimingHalfLife
 };
 
 
@@ -1029,6 +1279,8 @@ void SpokeParsePreferencesTree(InfoTree prefs, std::string version)
 				case kInGameTicksBeforeNetDeathAttribute:
 				case kRecoverySendPeriodAttribute:
 				case kTimingWindowSizeAttribute:
+				case kAdaptiveTimingPercentileAttribute:
+				case kAdaptiveTimingHalfLifeAttribute:
 					min = 1;
 					break;
 				case kTimingNthElementAttribute:
@@ -1043,6 +1295,7 @@ void SpokeParsePreferencesTree(InfoTree prefs, std::string version)
 	}
 
 	prefs.read_attr("adjust_timing", sSpokePreferences.mAdjustTiming);
+	prefs.read_attr("adaptive_timing", sSpokePreferences.mAdaptiveTiming);
 	
 	
 	// The checks above are not sufficient to catch all bad cases; if user specified a window size
@@ -1053,6 +1306,13 @@ void SpokeParsePreferencesTree(InfoTree prefs, std::string version)
 		
 		sSpokePreferences.mTimingNthElement = sSpokePreferences.mTimingWindowSize - 1;
 	}
+
+	if(sSpokePreferences.mAdaptiveTimingPercentile > 100)
+	{
+		logWarning("value for <spoke> attribute %s (%d) must be at most 100.  using 100", sAttributeStrings[kAdaptiveTimingPercentileAttribute], sSpokePreferences.mAdaptiveTimingPercentile);
+
+		sSpokePreferences.mAdaptiveTimingPercentile = 100;
+	}
 }
 
 
@@ -1063,6 +1323,7 @@ InfoTree SpokePreferencesTree()
 	for (size_t i = 0; i < kNumInt32Attributes; ++i)
 		root.put_attr(sAttributeStrings[i], *(sAttributeDestinations[i]));
 	root.put_attr("adjust_timing", sSpokePreferences.mAdjustTiming);
+	root.put_attr("adaptive_timing", sSpokePreferences.mAdaptiveTiming);
 	
 	return root;
 }
@@ -1078,7 +1339,10 @@ DefaultSpokePreferences()
 	sSpokePreferences.mRecoverySendPeriod = kDefaultRecoverySendPeriod;
 	sSpokePreferences.mTimingWindowSize = kDefaultTimingWindowSize;
 	sSpokePreferences.mTimingNthElement = kDefaultTimingNthElement;
+	sSpokePreferences.mAdaptiveTimingPercentile = kDefaultAdaptiveTimingPercentile;
+	sSpokePreferences.mAdaptiveTimingHalfLife = kDefaultAdaptiveTimingHalfLife;
 	sSpokePreferences.mAdjustTiming = true;
+	sSpokePreferences.mAdaptiveTiming = false;
 }
 
 #endif // !defined(DISABLE_NETWORKING)
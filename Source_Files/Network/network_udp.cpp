@@ -39,17 +39,55 @@
 
 #include "thread_priority_sdl.h"
 #include "mytm.h" // mytm_mutex stuff
+#include "Logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+enum {
+	kReceiveQueueSize = 256,	// packets; must be a power of two
+	kReceiveBatchSize = 32		// most datagrams we take off the socket per wakeup
+};
 
 // Global variables (most comments and "sSomething" variables are ZZZ)
-// Storage for incoming packet data
+// Storage for outgoing packet data
 static UDPpacket*		sUDPPacketBuffer	= NULL;
 
-// Storage for the DDP packet we pass back to the handler proc
-static DDPPacketBuffer		ddpPacketBuffer;
+// The standalone hub's games send from threads of their own; sending through SDL_net copies
+// each datagram into sUDPPacketBuffer first, so they take turns at it
+static std::mutex		sUDPPacketBufferMutex;
+
+// Used by the receiving thread when it reads through SDL_net; its data pointer is aimed
+// straight at the queue slot being filled
+static UDPpacket*		sReceivePacket		= NULL;
+static Uint8*			sReceivePacketData	= NULL;
+
+// Received packets wait here for the packet handler.  The receiving thread is the only
+// producer; packets are consumed by whoever holds the mytm mutex (the receiving thread
+// itself when the mutex is free, otherwise the hub or spoke tick), so there is only ever
+// one consumer at a time.  Slots aren't reused until the handler is done with them.
+static DDPPacketBuffer*		sReceiveQueue		= NULL;
+static std::atomic<uint32>	sReceiveQueueRead(0);
+static std::atomic<uint32>	sReceiveQueueWrite(0);
 
 // Keep track of our one sending/receiving socket
 static UDPsocket 		sSocket			= NULL;
 
+#ifdef __linux__
+// On Linux we open and own the socket ourselves, so we can use recvmmsg()/sendmmsg() on it;
+// sSocket stays NULL then.  If that fails we fall back to SDL_net.
+static int			sSocketDescriptor	= -1;
+#endif
+
 // Keep track of the socket-set the receiving thread uses (so we don't have to allocate/free it in that thread)
 static SDLNet_SocketSet	sSocketSet		= NULL;
 
@@ -62,6 +100,189 @@ static SDL_Thread*		sReceivingThread	= NULL;
 // See if the receiving thread should exit
 static volatile bool		sKeepListening		= false;
 
+// Receive statistics, logged when the socket is closed
+static struct {
+	std::atomic<uint32> wakeups;
+	std::atomic<uint32> packets;
+	std::atomic<uint32> largest_batch;
+	std::atomic<uint32> queue_full;
+	std::atomic<uint32> dispatches;
+	std::atomic<uint32> dispatched_by_tick;
+	std::atomic<uint64_t> lock_held_us;
+	std::atomic<uint32> longest_lock_held_us;
+} sReceiveStats;
+
+
+#ifdef __linux__
+// Opens a UDP socket bound to inPort (network byte order) on all interfaces, set up the
+// way SDLNet_UDP_Open() sets up its own.  Returns -1 on failure.
+static int
+open_socket_descriptor(uint16 inPort)
+{
+	int theDescriptor = socket(AF_INET, SOCK_DGRAM, 0);
+	if (theDescriptor == -1)
+		return -1;
+
+	struct sockaddr_in theAddress;
+	obj_clear(theAddress);
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+	theAddress.sin_port = inPort;
+
+	int theBroadcast = 1;
+	if (bind(theDescriptor, reinterpret_cast<struct sockaddr*>(&theAddress), sizeof(theAddress)) != 0 ||
+	    setsockopt(theDescriptor, SOL_SOCKET, SO_BROADCAST, &theBroadcast, sizeof(theBroadcast)) != 0)
+	{
+		close(theDescriptor);
+		return -1;
+	}
+
+	return theDescriptor;
+}
+
+static int
+send_to_descriptor(const void* inData, size_t inSize, const NetAddrBlock& inAddress)
+{
+	struct sockaddr_in theAddress;
+	obj_clear(theAddress);
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = inAddress.host;
+	theAddress.sin_port = inAddress.port;
+
+	return sendto(sSocketDescriptor, inData, inSize, 0, reinterpret_cast<struct sockaddr*>(&theAddress), sizeof(theAddress)) < 0 ? -1 : 0;
+}
+#endif
+
+
+static inline bool
+receive_queue_empty()
+{
+	return sReceiveQueueRead.load(std::memory_order_acquire) == sReceiveQueueWrite.load(std::memory_order_acquire);
+}
+
+// Takes up to kReceiveBatchSize waiting datagrams off the socket, straight into free queue slots.
+// Returns how many it got.
+static int
+receive_packets()
+{
+	uint32 theWriteIndex = sReceiveQueueWrite.load(std::memory_order_relaxed);
+	uint32 theFreeSlots = kReceiveQueueSize - (theWriteIndex - sReceiveQueueRead.load(std::memory_order_acquire));
+	int theWanted = std::min<uint32>(theFreeSlots, kReceiveBatchSize);
+	int theCount = 0;
+
+	if (theWanted == 0)
+	{
+		// leave them with the OS until the handler catches up
+		sReceiveStats.queue_full++;
+		return 0;
+	}
+
+#ifdef __linux__
+	if (sSocketDescriptor != -1)
+	{
+		struct mmsghdr theMessages[kReceiveBatchSize];
+		struct iovec theBuffers[kReceiveBatchSize];
+		struct sockaddr_in theAddresses[kReceiveBatchSize];
+
+		for (int i = 0; i < theWanted; ++i)
+		{
+			DDPPacketBuffer& theSlot = sReceiveQueue[(theWriteIndex + i) & (kReceiveQueueSize - 1)];
+			theBuffers[i].iov_base = theSlot.datagramData;
+			theBuffers[i].iov_len = ddpMaxData;
+
+			obj_clear(theMessages[i]);
+			theMessages[i].msg_hdr.msg_name = &theAddresses[i];
+			theMessages[i].msg_hdr.msg_namelen = sizeof(theAddresses[i]);
+			theMessages[i].msg_hdr.msg_iov = &theBuffers[i];
+			theMessages[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		theCount = recvmmsg(sSocketDescriptor, theMessages, theWanted, MSG_DONTWAIT, NULL);
+		if (theCount < 0)
+			theCount = 0;
+
+		for (int i = 0; i < theCount; ++i)
+		{
+			DDPPacketBuffer& theSlot = sReceiveQueue[(theWriteIndex + i) & (kReceiveQueueSize - 1)];
+			theSlot.sourceAddress.host = theAddresses[i].sin_addr.s_addr;
+			theSlot.sourceAddress.port = theAddresses[i].sin_port;
+			theSlot.datagramSize = theMessages[i].msg_len;
+		}
+	}
+	else
+#endif
+	{
+		while (theCount < theWanted)
+		{
+			DDPPacketBuffer& theSlot = sReceiveQueue[(theWriteIndex + theCount) & (kReceiveQueueSize - 1)];
+			sReceivePacket->data = theSlot.datagramData;
+			sReceivePacket->maxlen = ddpMaxData;
+
+			if (SDLNet_UDP_Recv(sSocket, sReceivePacket) <= 0)
+				break;
+
+			theSlot.sourceAddress = sReceivePacket->address;
+			theSlot.datagramSize = sReceivePacket->len;
+			++theCount;
+		}
+	}
+
+	if (theCount > 0)
+	{
+		sReceiveQueueWrite.store(theWriteIndex + theCount, std::memory_order_release);
+	}
+
+	return theCount;
+}
+
+// The standalone hub's packet handler finds each packet's game and takes that game's own lock,
+// so the receiving thread hands its packets straight over there, and is their only consumer.
+// Otherwise packets are handed over with the mytm mutex held.
+static inline bool
+try_take_dispatch_mutex()
+{
+#ifdef A1_NETWORK_STANDALONE_HUB
+	return true;
+#else
+	return try_take_mytm_mutex();
+#endif
+}
+
+static inline void
+release_dispatch_mutex()
+{
+#ifndef A1_NETWORK_STANDALONE_HUB
+	release_mytm_mutex();
+#endif
+}
+
+// Hands queued packets to the packet handler.  Caller must hold the dispatch mutex.
+static void
+dispatch_packets()
+{
+	uint32 theReadIndex = sReceiveQueueRead.load(std::memory_order_relaxed);
+	uint32 theWriteIndex = sReceiveQueueWrite.load(std::memory_order_acquire);
+
+	while (theReadIndex != theWriteIndex)
+	{
+		sPacketHandler(&sReceiveQueue[theReadIndex & (kReceiveQueueSize - 1)]);
+		sReceiveQueueRead.store(++theReadIndex, std::memory_order_release);
+	}
+}
+
+void
+NetDDPDispatchPackets()
+{
+	// (the standalone hub's receiving thread doesn't leave anything for the ticks to pick up)
+#ifndef A1_NETWORK_STANDALONE_HUB
+	if (sReceiveQueue && !receive_queue_empty())
+	{
+		sReceiveStats.dispatched_by_tick++;
+		dispatch_packets();
+	}
+#endif
+}
+
 
 // ZZZ: the socket listening thread loops in this function.  It calls the registered
 // packet handler when it gets something.
@@ -69,24 +290,46 @@ static int
 receive_thread_function(void*) {
     while(true) {
         // We listen with a timeout so we can shut ourselves down when needed.
-        int theResult = SDLNet_CheckSockets(sSocketSet, 1000);
+        // If packets are still waiting for the mutex, come back soon to try again.
+        int theTimeout = receive_queue_empty() ? 1000 : 1;
+        int theResult;
+#ifdef __linux__
+        if(sSocketDescriptor != -1) {
+                struct pollfd thePollDescriptor = { sSocketDescriptor, POLLIN, 0 };
+                theResult = poll(&thePollDescriptor, 1, theTimeout);
+        }
+        else
+#endif
+        theResult = SDLNet_CheckSockets(sSocketSet, theTimeout);
         
         if(!sKeepListening)
             break;
         
-        if(theResult > 0 && take_mytm_mutex()) {
-                theResult = SDLNet_UDP_Recv(sSocket, sUDPPacketBuffer);
-                if(theResult > 0) {
-                        ddpPacketBuffer.sourceAddress	= sUDPPacketBuffer->address;
-                        ddpPacketBuffer.datagramSize	= sUDPPacketBuffer->len;
-                    
-                        // Hope the other guy is done using whatever's in there!
-                        // (As I recall, all uses happen in sPacketHandler and its progeny, so we should be fine.)
-                        memcpy(ddpPacketBuffer.datagramData, sUDPPacketBuffer->data, sUDPPacketBuffer->len);
-                    
-                        sPacketHandler(&ddpPacketBuffer);
-                    }
-           release_mytm_mutex();
+        if(theResult > 0) {
+                int theCount = receive_packets();
+                if(theCount > 0) {
+                        sReceiveStats.wakeups++;
+                        sReceiveStats.packets += theCount;
+                        if(theCount > sReceiveStats.largest_batch)
+                                sReceiveStats.largest_batch = theCount;
+                }
+                else if(!receive_queue_empty()) {
+                        // queue is full; don't spin on a readable socket
+                        sleep_for_machine_ticks(1);
+                }
+        }
+
+        // Don't wait on the mutex; if a tick task has it, it will pick the packets up
+        if(!receive_queue_empty() && try_take_dispatch_mutex()) {
+                auto theStart = std::chrono::steady_clock::now();
+                dispatch_packets();
+                uint32 theHeld = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - theStart).count();
+                release_dispatch_mutex();
+
+                sReceiveStats.dispatches++;
+                sReceiveStats.lock_held_us += theHeld;
+                if(theHeld > sReceiveStats.longest_lock_held_us)
+                        sReceiveStats.longest_lock_held_us = theHeld;
         }
     }
     
@@ -94,6 +337,55 @@ receive_thread_function(void*) {
 }
 
 
+// Opens our socket, and the socket set the receiving thread waits on if it's an SDL_net one.
+// Port number is in network byte order.
+static bool
+open_socket(short inPortNumber)
+{
+#ifdef __linux__
+	sSocketDescriptor = open_socket_descriptor(inPortNumber);
+	if (sSocketDescriptor != -1)
+		return true;
+
+	logNote("could not open our own UDP socket; receiving one datagram at a time through SDL_net");
+#endif
+
+        //PORTGUESS
+	// Open socket (SDLNet_Open seems to like port in host byte order)
+        // NOTE: only SDLNet_UDP_Open wants port in host byte order.  All other uses of port in SDL_net
+        // are in network byte order.
+	sSocket = SDLNet_UDP_Open(SDL_SwapBE16(inPortNumber));
+	if (sSocket == NULL)
+		return false;
+
+        // Set up socket set
+        sSocketSet = SDLNet_AllocSocketSet(1);
+        SDLNet_UDP_AddSocket(sSocketSet, sSocket);
+	return true;
+}
+
+static void
+close_socket()
+{
+#ifdef __linux__
+	if (sSocketDescriptor != -1) {
+		close(sSocketDescriptor);
+		sSocketDescriptor = -1;
+	}
+#endif
+
+        if(sSocketSet) {
+            SDLNet_FreeSocketSet(sSocketSet);
+            sSocketSet = NULL;
+        }
+
+	if (sSocket) {
+		SDLNet_UDP_Close(sSocket);
+		sSocket = NULL;
+	}
+}
+
+
 /*
  *  Open socket
  */
@@ -109,21 +401,35 @@ OSErr NetDDPOpenSocket(short *ioPortNumber, PacketHandlerProcPtr packetHandler)
 	if (sUDPPacketBuffer == NULL)
 		return -1;
 
-        //PORTGUESS
-	// Open socket (SDLNet_Open seems to like port in host byte order)
-        // NOTE: only SDLNet_UDP_Open wants port in host byte order.  All other uses of port in SDL_net
-        // are in network byte order.
-	sSocket = SDLNet_UDP_Open(SDL_SwapBE16(*ioPortNumber));
-	if (sSocket == NULL) {
+	if (!open_socket(*ioPortNumber)) {
 		SDLNet_FreePacket(sUDPPacketBuffer);
 		sUDPPacketBuffer = NULL;
 		return -1;
 	}
 
-        // Set up socket set
-        sSocketSet = SDLNet_AllocSocketSet(1);
-        SDLNet_UDP_AddSocket(sSocketSet, sSocket);
-        
+	// Set up the receive queue
+	sReceivePacket = SDLNet_AllocPacket(ddpMaxData);
+	if (sReceivePacket == NULL) {
+		close_socket();
+		SDLNet_FreePacket(sUDPPacketBuffer);
+		sUDPPacketBuffer = NULL;
+		return -1;
+	}
+	sReceivePacketData = sReceivePacket->data;
+
+	sReceiveQueue = new DDPPacketBuffer[kReceiveQueueSize];
+	sReceiveQueueRead = 0;
+	sReceiveQueueWrite = 0;
+
+	sReceiveStats.wakeups = 0;
+	sReceiveStats.packets = 0;
+	sReceiveStats.largest_batch = 0;
+	sReceiveStats.queue_full = 0;
+	sReceiveStats.dispatches = 0;
+	sReceiveStats.dispatched_by_tick = 0;
+	sReceiveStats.lock_held_us = 0;
+	sReceiveStats.longest_lock_held_us = 0;
+
         // Set up receiver
         sKeepListening		= true;
         sPacketHandler		= packetHandler;
@@ -155,18 +461,36 @@ OSErr NetDDPCloseSocket(short portNumber)
             sReceivingThread	= NULL;
         }
 
-        if(sSocketSet) {
-            SDLNet_FreeSocketSet(sSocketSet);
-            sSocketSet = NULL;
-        }
+	if (sReceiveQueue) {
+		if (sReceiveStats.wakeups > 0)
+		{
+			logNote("UDP receive: %u packets in %u wakeups (%.1f per wakeup, at most %u); queue full %u times; "
+				"dispatched %u times by the receiving thread holding the mutex %.1f us on average (at most %u us), %u times by tick tasks",
+				sReceiveStats.packets.load(), sReceiveStats.wakeups.load(),
+				static_cast<double>(sReceiveStats.packets) / sReceiveStats.wakeups, sReceiveStats.largest_batch.load(),
+				sReceiveStats.queue_full.load(),
+				sReceiveStats.dispatches.load(),
+				sReceiveStats.dispatches ? static_cast<double>(sReceiveStats.lock_held_us) / sReceiveStats.dispatches : 0.0,
+				sReceiveStats.longest_lock_held_us.load(),
+				sReceiveStats.dispatched_by_tick.load());
+		}
+
+		delete[] sReceiveQueue;
+		sReceiveQueue = NULL;
+	}
+
+	if (sReceivePacket) {
+		sReceivePacket->data = sReceivePacketData;
+		SDLNet_FreePacket(sReceivePacket);
+		sReceivePacket = NULL;
+	}
     
         // (CB's code follows)
 	if (sUDPPacketBuffer) {
 		SDLNet_FreePacket(sUDPPacketBuffer);
 		sUDPPacketBuffer = NULL;
 
-		SDLNet_UDP_Close(sSocket);
-		sSocket = NULL;
+		close_socket();
 	}
 	return 0;
 }
@@ -206,6 +530,12 @@ OSErr NetDDPSendFrame(DDPFramePtr frame, const NetAddrBlock *address)
 {
 	assert(frame->data_size <= ddpMaxData);
 
+#ifdef __linux__
+	if (sSocketDescriptor != -1)
+		return send_to_descriptor(frame->data, frame->data_size, *address);
+#endif
+
+	std::lock_guard<std::mutex> theLock(sUDPPacketBufferMutex);
 	sUDPPacketBuffer->channel = -1;
 	memcpy(sUDPPacketBuffer->data, frame->data, frame->data_size);
 	sUDPPacketBuffer->len = frame->data_size;
@@ -213,4 +543,115 @@ OSErr NetDDPSendFrame(DDPFramePtr frame, const NetAddrBlock *address)
 	return SDLNet_UDP_Send(sSocket, -1, sUDPPacketBuffer) ? 0 : -1;
 }
 
+
+void DDPSendBatch::add_datagram(const NetAddrBlock& address)
+{
+	Datagram datagram;
+	datagram.address = address;
+	datagram.first_piece = pieces.size();
+	datagram.piece_count = 0;
+	datagram.size = 0;
+	datagrams.push_back(datagram);
+}
+
+void DDPSendBatch::add_piece(const byte* data, uint16 size)
+{
+	assert(!datagrams.empty());
+	Datagram& datagram = datagrams.back();
+	assert(datagram.size + size <= ddpMaxData);
+
+	// pieces that happen to be adjacent go out as one
+	if (datagram.piece_count > 0 && pieces.back().data + pieces.back().size == data)
+	{
+		pieces.back().size += size;
+	}
+	else
+	{
+		Piece piece;
+		piece.data = data;
+		piece.size = size;
+		pieces.push_back(piece);
+		datagram.piece_count++;
+	}
+
+	datagram.size += size;
+}
+
+
+/*
+ *  Send a batch of frames
+ */
+
+OSErr NetDDPSendBatch(const DDPSendBatch& batch)
+{
+	OSErr error = 0;
+
+#ifdef __linux__
+	if (sSocketDescriptor != -1)
+	{
+		std::vector<struct iovec> theBuffers(batch.pieces.size());
+		for (size_t i = 0; i < batch.pieces.size(); ++i)
+		{
+			theBuffers[i].iov_base = const_cast<byte*>(batch.pieces[i].data);
+			theBuffers[i].iov_len = batch.pieces[i].size;
+		}
+
+		std::vector<struct sockaddr_in> theAddresses(batch.datagrams.size());
+		std::vector<struct mmsghdr> theMessages(batch.datagrams.size());
+		for (size_t i = 0; i < batch.datagrams.size(); ++i)
+		{
+			const DDPSendBatch::Datagram& theDatagram = batch.datagrams[i];
+
+			obj_clear(theAddresses[i]);
+			theAddresses[i].sin_family = AF_INET;
+			theAddresses[i].sin_addr.s_addr = theDatagram.address.host;
+			theAddresses[i].sin_port = theDatagram.address.port;
+
+			obj_clear(theMessages[i]);
+			theMessages[i].msg_hdr.msg_name = &theAddresses[i];
+			theMessages[i].msg_hdr.msg_namelen = sizeof(theAddresses[i]);
+			theMessages[i].msg_hdr.msg_iov = theBuffers.data() + theDatagram.first_piece;
+			theMessages[i].msg_hdr.msg_iovlen = theDatagram.piece_count;
+		}
+
+		size_t theSent = 0;
+		while (theSent < theMessages.size())
+		{
+			int theResult = sendmmsg(sSocketDescriptor, theMessages.data() + theSent, theMessages.size() - theSent, 0);
+			if (theResult <= 0)
+			{
+				// like SDLNet_UDP_Send(), give up on this datagram and carry on
+				error = -1;
+				++theSent;
+			}
+			else
+			{
+				theSent += theResult;
+			}
+		}
+
+		return error;
+	}
+#endif
+
+	std::lock_guard<std::mutex> theLock(sUDPPacketBufferMutex);
+	for (auto& theDatagram : batch.datagrams)
+	{
+		uint16 theSize = 0;
+		for (size_t i = theDatagram.first_piece; i < theDatagram.first_piece + theDatagram.piece_count; ++i)
+		{
+			memcpy(sUDPPacketBuffer->data + theSize, batch.pieces[i].data, batch.pieces[i].size);
+			theSize += batch.pieces[i].size;
+		}
+
+		sUDPPacketBuffer->channel = -1;
+		sUDPPacketBuffer->len = theSize;
+		sUDPPacketBuffer->address = theDatagram.address;
+		if (!SDLNet_UDP_Send(sSocket, -1, sUDPPacketBuffer))
+			error = -1;
+	}
+
+	return error;
+}
+
 #endif // !defined(DISABLE_NETWORKING)
@@ -499,6 +499,7 @@ void OGL_ModelData::Load()
 		Model.TransformPos.M[0][3] = XShift;
 		Model.TransformPos.M[1][3] = YShift;
 		Model.TransformPos.M[2][3] = ZShift;
+		Model.InvalidatePoses();
 		
 		// Find the transformed bounding box:
 		bool RestOfCorners = false;
@@ -8,7 +8,9 @@
 
 #include "OGL_Headers.h"
 
+#include <chrono>
 #include <iostream>
+#include <unordered_map>
 
 #include "RenderRasterize_Shader.h"
 
@@ -23,6 +25,7 @@
 #include "ChaseCam.h"
 #include "preferences.h"
 #include "screen.h"
+#include "WorkerPool.h"
 
 #ifdef HAVE_OPENGL
 
@@ -88,9 +91,235 @@ public:
 };
 
 
-RenderRasterize_Shader::RenderRasterize_Shader() = default;
+// counted as the current frame is drawn
+static render_stats frame_stats;
+
+/*
+ * floors, ceilings and liquid surfaces keep their vertices in one buffer
+ * for the whole level; a surface is only written again when its height
+ * or texture placement changes (platforms and liquids moving, sliding
+ * transfer modes), and is otherwise drawn without sending any vertices
+ */
+class StaticSurfaceBuffer {
+
+public:
+
+	enum {
+		kFloor,
+		kCeiling,
+		kLiquidFromAbove,
+		kLiquidFromBelow,
+		NUMBER_OF_SURFACE_KINDS
+	};
+
+	// what the vertices of a surface were written for
+	struct surface_key {
+		world_distance height;
+		world_point2d origin;
+		world_distance x, y;
+		float scale;
+
+		bool operator==(const surface_key& other) const {
+			return height == other.height && origin.x == other.origin.x && origin.y == other.origin.y &&
+				x == other.x && y == other.y && scale == other.scale;
+		}
+	};
+
+	// x, y, z, s, t
+	static const int kFloatsPerVertex = 5;
+
+	StaticSurfaceBuffer() : _buffer(0), _stale(true) {}
+
+	// the buffer belongs to the last context, if any
+	void release() {
+		if (_buffer) {
+			glDeleteBuffers(1, &_buffer);
+		}
+		_buffer = 0;
+		_slots.clear();
+		_stale = true;
+	}
+
+	void invalidate() { _stale = true; }
+
+	// finds where the surface's vertices go; stale is set if they need to
+	// be written again before drawing; false if the polygon isn't in the map
+	bool find(short polygon_index, int kind, const surface_key& key, GLint& first, bool& stale) {
+		if (_stale) {
+			build();
+		}
+
+		if (polygon_index < 0 || static_cast<size_t>(polygon_index) * NUMBER_OF_SURFACE_KINDS >= _slots.size()) {
+			return false;
+		}
+
+		slot& s = _slots[polygon_index * NUMBER_OF_SURFACE_KINDS + kind];
+		first = s.first;
+		stale = !s.written || !(s.key == key);
+		s.key = key;
+		s.written = true;
+		return true;
+	}
+
+	void write(GLint first, const GLfloat* vertices, short vertex_count) {
+		glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, first * kFloatsPerVertex * sizeof(GLfloat), vertex_count * kFloatsPerVertex * sizeof(GLfloat), vertices);
+	}
+
+	// the pointers keep referring to the buffer after it's unbound
+	void set_pointers() {
+		const GLsizei stride = kFloatsPerVertex * sizeof(GLfloat);
+		glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+		glVertexPointer(3, GL_FLOAT, stride, reinterpret_cast<const GLvoid*>(0));
+		glTexCoordPointer(2, GL_FLOAT, stride, reinterpret_cast<const GLvoid*>(3 * sizeof(GLfloat)));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+private:
+
+	struct slot {
+		GLint first;
+		bool written;
+		surface_key key;
+	};
+
+	void build() {
+		_slots.resize(dynamic_world->polygon_count * NUMBER_OF_SURFACE_KINDS);
+
+		GLint vertices = 0;
+		for (short i = 0; i < dynamic_world->polygon_count; ++i) {
+			short vertex_count = get_polygon_data(i)->vertex_count;
+			for (int kind = 0; kind < NUMBER_OF_SURFACE_KINDS; ++kind) {
+				slot& s = _slots[i * NUMBER_OF_SURFACE_KINDS + kind];
+				s.first = vertices;
+				s.written = false;
+				vertices += vertex_count;
+			}
+		}
+
+		if (!_buffer) {
+			glGenBuffers(1, &_buffer);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+		glBufferData(GL_ARRAY_BUFFER, std::max<GLint>(vertices, 1) * kFloatsPerVertex * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		_stale = false;
+	}
+
+	GLuint _buffer;
+	bool _stale;
+	std::vector<slot> _slots;
+};
+
+/*
+ * walls seen through the same clipping window, with the same texture,
+ * light and transfer mode, share one texture and shader setup and are
+ * drawn together; the batch is drawn before anything else is, so nothing
+ * is drawn in a different order than before
+ *
+ * a change of texture still ends a batch, since textures aren't gathered
+ * into arrays or atlases, and sprites are still drawn one at a time
+ */
+class WallBatch {
+
+public:
+
+	// what the walls in a batch have in common
+	struct wall_key {
+		clipping_window_data* window;
+		shape_descriptor texture;
+		int16 transfer_mode;
+		float intensity;
+		bool void_present;
+
+		bool operator==(const wall_key& other) const {
+			return window == other.window && texture == other.texture && transfer_mode == other.transfer_mode &&
+				intensity == other.intensity && void_present == other.void_present;
+		}
+	};
+
+	// x, y, z, s, t, normal, tangent and its sign
+	static const int kFloatsPerVertex = 12;
+
+	WallBatch() : _walls(0) {}
+
+	bool empty() const { return _walls == 0; }
+	bool matches(const wall_key& key) const { return _walls && _key == key; }
+
+	void start(const wall_key& key, std::unique_ptr<TextureManager> texture, float wobble, float offset, RenderStep renderStep) {
+		_key = key;
+		_texture = std::move(texture);
+		_wobble = wobble;
+		_offset = offset;
+		_render_step = renderStep;
+		_walls = 0;
+		_vertices.clear();
+	}
+
+	void add_vertex(const GLfloat* position, GLfloat s, GLfloat t, const vec3& N, const vec3& T) {
+		_vertices.insert(_vertices.end(), position, position + 3);
+		_vertices.push_back(s);
+		_vertices.push_back(t);
+		_vertices.insert(_vertices.end(), { N[0], N[1], N[2], T[0], T[1], T[2], 1 });
+	}
+
+	void end_wall() { ++_walls; }
+
+	void clear() {
+		_walls = 0;
+		_vertices.clear();
+		_texture.reset();
+	}
+
+	void set_pointers() {
+		const GLsizei stride = kFloatsPerVertex * sizeof(GLfloat);
+		const GLfloat* base = _vertices.data();
+		glVertexPointer(3, GL_FLOAT, stride, base);
+		glTexCoordPointer(2, GL_FLOAT, stride, base + 3);
+
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glNormalPointer(GL_FLOAT, stride, base + 5);
+
+		glClientActiveTextureARB(GL_TEXTURE1_ARB);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(4, GL_FLOAT, stride, base + 8);
+		glClientActiveTextureARB(GL_TEXTURE0_ARB);
+	}
+
+	void reset_pointers() {
+		glDisableClientState(GL_NORMAL_ARRAY);
+		glClientActiveTextureARB(GL_TEXTURE1_ARB);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glClientActiveTextureARB(GL_TEXTURE0_ARB);
+	}
+
+	std::unique_ptr<TextureManager>& texture() { return _texture; }
+	const wall_key& key() const { return _key; }
+	int walls() const { return _walls; }
+	GLsizei vertex_count() const { return static_cast<GLsizei>(_vertices.size() / kFloatsPerVertex); }
+	float wobble() const { return _wobble; }
+	float offset() const { return _offset; }
+	RenderStep render_step() const { return _render_step; }
+
+private:
+
+	wall_key _key;
+	std::unique_ptr<TextureManager> _texture;
+	float _wobble;
+	float _offset;
+	RenderStep _render_step;
+	int _walls;
+	std::vector<GLfloat> _vertices;
+};
+
+RenderRasterize_Shader::RenderRasterize_Shader() : static_surfaces(new StaticSurfaceBuffer), walls(new WallBatch), stats() {}
 RenderRasterize_Shader::~RenderRasterize_Shader() = default;
 
+void RenderRasterize_Shader::invalidate_geometry() {
+	static_surfaces->invalidate();
+}
+
 /*
  * initialize some stuff
  * happens once after opengl, shaders and textures are setup
@@ -101,6 +330,8 @@ void RenderRasterize_Shader::setupGL(Rasterizer_Shader_Class& Rasterizer) {
 
 	Shader::loadAll();
 
+	static_surfaces->release();
+
 	Shader* s_blur = Shader::get(Shader::S_Blur);
 	Shader* s_bloom = Shader::get(Shader::S_Bloom);
 
@@ -126,6 +357,9 @@ const float FixedAngleToDegrees = 360.0/(float(FIXED_ONE)*float(FULL_CIRCLE));
 
 void RenderRasterize_Shader::render_tree() {
 
+	auto start = std::chrono::steady_clock::now();
+	frame_stats = render_stats();
+
 	weaponFlare = PIN(view->maximum_depth_intensity - NATURAL_LIGHT_INTENSITY, 0, FIXED_ONE)/float(FIXED_ONE);
 	selfLuminosity = PIN(NATURAL_LIGHT_INTENSITY, 0, FIXED_ONE)/float(FIXED_ONE);
 
@@ -229,6 +463,9 @@ void RenderRasterize_Shader::render_tree() {
 	}
 
 	glAlphaFunc(GL_GREATER, 0.5);
+
+	frame_stats.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	stats = frame_stats;
 }
 
 void RenderRasterize_Shader::render_node(sorted_node_data *node, bool SeeThruLiquids, RenderStep renderStep)
@@ -238,6 +475,7 @@ void RenderRasterize_Shader::render_node(sorted_node_data *node, bool SeeThruLiq
     objectY = 0;
 
     RenderRasterizerClass::render_node(node, SeeThruLiquids, renderStep);
+	flush_walls();
 
 	// turn off clipping planes
 	glDisable(GL_CLIP_PLANE0);
@@ -662,6 +900,8 @@ bool setupGlow(struct view_data *view, std::unique_ptr<TextureManager>& TMgr, fl
 void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *window,
 	polygon_data *polygon, horizontal_surface_data *surface, bool void_present, bool ceil, RenderStep renderStep) {
 
+	flush_walls();
+
 	float offset = 0;
 
 	const shape_descriptor& texture = AnimTxtr_Translate(surface->texture);
@@ -711,11 +951,6 @@ void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *
 		glNormal3f(N[0], N[1], N[2]);
 		glMultiTexCoord4fARB(GL_TEXTURE1_ARB, T[0], T[1], T[2], sign);
 
-		GLfloat vertex_array[MAXIMUM_VERTICES_PER_POLYGON * 3];
-		GLfloat texcoord_array[MAXIMUM_VERTICES_PER_POLYGON * 2];
-
-		GLfloat* vp = vertex_array;
-		GLfloat* tp = texcoord_array;
 		float scale;
 
 		switch (surface->transfer_mode)
@@ -731,36 +966,55 @@ void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *
 				break;
 		}
 
-		if (ceil)
-		{
+		// a liquid surface comes without the void behind it; from under the
+		// liquid, it takes the place of the polygon's own floor or ceiling
+		int kind;
+		if (void_present) {
+			kind = ceil ? StaticSurfaceBuffer::kCeiling : StaticSurfaceBuffer::kFloor;
+		} else {
+			kind = ceil ? StaticSurfaceBuffer::kLiquidFromBelow : StaticSurfaceBuffer::kLiquidFromAbove;
+		}
+		StaticSurfaceBuffer::surface_key key = { surface->height, surface->origin, x, y, scale };
+		GLint first = 0;
+		bool stale = true;
+		bool buffered = static_surfaces->find(polygon - map_polygons, kind, key, first, stale);
+
+		GLfloat vertex_array[MAXIMUM_VERTICES_PER_POLYGON * StaticSurfaceBuffer::kFloatsPerVertex];
+		if (stale) {
+			GLfloat* vp = vertex_array;
 			for(short i = 0; i < vertex_count; ++i) {
-				world_point2d vertex = get_endpoint_data(polygon->endpoint_indexes[vertex_count - 1 - i])->vertex;
+				// ceilings face the other way
+				short endpoint_index = polygon->endpoint_indexes[ceil ? vertex_count - 1 - i : i];
+				world_point2d vertex = get_endpoint_data(endpoint_index)->vertex;
 				*vp++ = vertex.x;
 				*vp++ = vertex.y;
 				*vp++ = surface->height;
-				*tp++ = (vertex.x + surface->origin.x + x) / scale;
-				*tp++ = (vertex.y + surface->origin.y + y) / scale;
+				*vp++ = (vertex.x + surface->origin.x + x) / scale;
+				*vp++ = (vertex.y + surface->origin.y + y) / scale;
 			}
+			frame_stats.sent_vertices += vertex_count;
 		}
-		else
-		{
-			for(short i=0; i<vertex_count; ++i) {
-				world_point2d vertex = get_endpoint_data(polygon->endpoint_indexes[i])->vertex;
-				*vp++ = vertex.x;
-				*vp++ = vertex.y;
-				*vp++ = surface->height;
-				*tp++ = (vertex.x + surface->origin.x + x) / scale;
-				*tp++ = (vertex.y + surface->origin.y + y) / scale;
+
+		if (buffered) {
+			if (stale) {
+				static_surfaces->write(first, vertex_array, vertex_count);
 			}
+			static_surfaces->set_pointers();
+			frame_stats.buffered_surfaces++;
+		} else {
+			const GLsizei stride = StaticSurfaceBuffer::kFloatsPerVertex * sizeof(GLfloat);
+			glVertexPointer(3, GL_FLOAT, stride, vertex_array);
+			glTexCoordPointer(2, GL_FLOAT, stride, vertex_array + 3);
+			first = 0;
 		}
-		glVertexPointer(3, GL_FLOAT, 0, vertex_array);
-		glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
 
-		glDrawArrays(GL_POLYGON, 0, vertex_count);
+		glDrawArrays(GL_POLYGON, first, vertex_count);
+		frame_stats.draw_calls++;
 
 		// see note 2 above; pulsate uniform should stay set from setupWall call
 		if (setupGlow(view, TMgr, 0, intensity, weaponFlare, selfLuminosity, offset, renderStep)) {
-			glDrawArrays(GL_POLYGON, 0, vertex_count);
+			glDrawArrays(GL_POLYGON, first, vertex_count);
+			frame_stats.draw_calls++;
 		}
 
 		Shader::disable();
@@ -772,6 +1026,9 @@ void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *
 
 void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vertical_surface_data *surface, bool void_present, RenderStep renderStep) {
 
+	world_distance h= MIN(surface->h1, surface->hmax);
+	if (h <= surface->h0) { return; }
+
 	float offset = 0;
 	if (!void_present) {
 		offset = -2.0;
@@ -779,125 +1036,200 @@ void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vert
 
 	const shape_descriptor& texture = AnimTxtr_Translate(surface->texture_definition->texture);
 	float intensity = (get_light_intensity(surface->lightsource_index) + surface->ambient_delta) / float(FIXED_ONE - 1);
-	float wobble = calcWobble(surface->transfer_mode, view->tick_count);
-	float pulsate = 0;
-	if (surface->transfer_mode == _xfer_pulsate) {
-		pulsate = wobble;
-		wobble = 0;
-	}
-	auto TMgr = setupWallTexture(texture, surface->transfer_mode, pulsate, wobble, intensity, offset, renderStep);
-	if(TMgr->ShapeDesc == UNONE) { return; }
 
-	if (TMgr->IsBlended()) {
-		glEnable(GL_BLEND);
-		setupBlendFunc(TMgr->NormalBlend());
-		glEnable(GL_ALPHA_TEST);
-		glAlphaFunc(GL_GREATER, 0.001);
-	} else {
-		glDisable(GL_BLEND);
-		glEnable(GL_ALPHA_TEST);
-		glAlphaFunc(GL_GREATER, 0.5);
+	WallBatch::wall_key key = { window, texture, surface->transfer_mode, intensity, void_present };
+	if (!walls->matches(key)) {
+		flush_walls();
+
+		float wobble = calcWobble(surface->transfer_mode, view->tick_count);
+		float pulsate = 0;
+		if (surface->transfer_mode == _xfer_pulsate) {
+			pulsate = wobble;
+			wobble = 0;
+		}
+		auto TMgr = setupWallTexture(texture, surface->transfer_mode, pulsate, wobble, intensity, offset, renderStep);
+		if(TMgr->ShapeDesc == UNONE) { return; }
+
+		if (TMgr->IsBlended()) {
+			glEnable(GL_BLEND);
+			setupBlendFunc(TMgr->NormalBlend());
+			glEnable(GL_ALPHA_TEST);
+			glAlphaFunc(GL_GREATER, 0.001);
+		} else {
+			glDisable(GL_BLEND);
+			glEnable(GL_ALPHA_TEST);
+			glAlphaFunc(GL_GREATER, 0.5);
+		}
+
+		if (void_present && TMgr->IsBlended()) {
+			glDisable(GL_BLEND);
+			glDisable(GL_ALPHA_TEST);
+		}
+
+		clip_to_window(window);
+		walls->start(key, std::move(TMgr), wobble, offset, renderStep);
 	}
 
-	if (void_present && TMgr->IsBlended()) {
-		glDisable(GL_BLEND);
-		glDisable(GL_ALPHA_TEST);
+	world_point2d vertex[2];
+	uint16 flags;
+	flagged_world_point3d vertices[MAXIMUM_VERTICES_PER_WORLD_POLYGON];
+	short vertex_count;
+
+	/* initialize the two posts of our trapezoid */
+	vertex_count= 2;
+	long_to_overflow_short_2d(surface->p0, vertex[0], flags);
+	long_to_overflow_short_2d(surface->p1, vertex[1], flags);
+
+	vertex_count= 4;
+	vertices[0].z= vertices[1].z= h + view->origin.z;
+	vertices[2].z= vertices[3].z= surface->h0 + view->origin.z;
+	vertices[0].x= vertices[3].x= vertex[0].x, vertices[0].y= vertices[3].y= vertex[0].y;
+	vertices[1].x= vertices[2].x= vertex[1].x, vertices[1].y= vertices[2].y= vertex[1].y;
+	vertices[0].flags = vertices[3].flags = 0;
+	vertices[1].flags = vertices[2].flags = 0;
+
+	auto& TMgr = walls->texture();
+	uint16 div;
+	switch (surface->transfer_mode)
+	{
+		case _xfer_2x:
+			div = 2 * WORLD_ONE * TMgr->TileRatio();
+			break;
+		case _xfer_4x:
+			div = 4 * WORLD_ONE * TMgr->TileRatio();
+			break;
+		default:
+			div = WORLD_ONE * TMgr->TileRatio();;
+			break;
 	}
 
-	world_distance h= MIN(surface->h1, surface->hmax);
+	double dx = (surface->p1.i - surface->p0.i) / double(surface->length);
+	double dy = (surface->p1.j - surface->p0.j) / double(surface->length);
 
-	if (h>surface->h0) {
-
-		world_point2d vertex[2];
-		uint16 flags;
-		flagged_world_point3d vertices[MAXIMUM_VERTICES_PER_WORLD_POLYGON];
-		short vertex_count;
-
-		/* initialize the two posts of our trapezoid */
-		vertex_count= 2;
-		long_to_overflow_short_2d(surface->p0, vertex[0], flags);
-		long_to_overflow_short_2d(surface->p1, vertex[1], flags);
-
-		if (vertex_count) {
-            clip_to_window(window);
-
-			vertex_count= 4;
-			vertices[0].z= vertices[1].z= h + view->origin.z;
-			vertices[2].z= vertices[3].z= surface->h0 + view->origin.z;
-			vertices[0].x= vertices[3].x= vertex[0].x, vertices[0].y= vertices[3].y= vertex[0].y;
-			vertices[1].x= vertices[2].x= vertex[1].x, vertices[1].y= vertices[2].y= vertex[1].y;
-			vertices[0].flags = vertices[3].flags = 0;
-			vertices[1].flags = vertices[2].flags = 0;
-
-			uint16 div;
-			switch (surface->transfer_mode)
-			{
-				case _xfer_2x:
-					div = 2 * WORLD_ONE * TMgr->TileRatio();
-					break;
-				case _xfer_4x:
-					div = 4 * WORLD_ONE * TMgr->TileRatio();
-					break;
-				default:
-					div = WORLD_ONE * TMgr->TileRatio();;
-					break;
-			}
-			
-			double dx = (surface->p1.i - surface->p0.i) / double(surface->length);
-			double dy = (surface->p1.j - surface->p0.j) / double(surface->length);
+	world_distance x0 = surface->texture_definition->x0 % div;
+	world_distance y0 = surface->texture_definition->y0 % div;
 
-			world_distance x0 = surface->texture_definition->x0 % div;
-			world_distance y0 = surface->texture_definition->y0 % div;
+	double tOffset = surface->h1 + view->origin.z + y0;
 
-			double tOffset = surface->h1 + view->origin.z + y0;
+	vec3 N(-dy, dx, 0);
+	vec3 T(dx, dy, 0);
 
-			vec3 N(-dy, dx, 0);
-			vec3 T(dx, dy, 0);
-			float sign = 1;
-			glNormal3f(N[0], N[1], N[2]);
-			glMultiTexCoord4fARB(GL_TEXTURE1_ARB, T[0], T[1], T[2], sign);
+	world_distance x = 0.0, y = 0.0;
+	instantiate_transfer_mode(view, surface->transfer_mode, x, y);
 
-			world_distance x = 0.0, y = 0.0;
-			instantiate_transfer_mode(view, surface->transfer_mode, x, y);
+	x0 -= x;
+	tOffset -= y;
 
-			x0 -= x;
-			tOffset -= y;
+	for(int i = 0; i < vertex_count; ++i) {
+		float p2 = 0;
+		if(i == 1 || i == 2) { p2 = surface->length; }
 
-			GLfloat vertex_array[12];
-			GLfloat texcoord_array[8];
+		GLfloat position[3] = { GLfloat(vertices[i].x), GLfloat(vertices[i].y), GLfloat(vertices[i].z) };
+		walls->add_vertex(position, (tOffset - vertices[i].z) / static_cast<float>(div), (x0+p2) / static_cast<float>(div), N, T);
+	}
+	walls->end_wall();
+}
 
-			GLfloat* vp = vertex_array;
-			GLfloat* tp = texcoord_array;
+// draws the walls set aside by render_node_side()
+void RenderRasterize_Shader::flush_walls() {
 
-			for(int i = 0; i < vertex_count; ++i) {
-				float p2 = 0;
-				if(i == 1 || i == 2) { p2 = surface->length; }
+	if (walls->empty()) { return; }
 
-				*vp++ = vertices[i].x;
-				*vp++ = vertices[i].y;
-				*vp++ = vertices[i].z;
-				*tp++ = (tOffset - vertices[i].z) / static_cast<float>(div);
-				*tp++ = (x0+p2) / static_cast<float>(div);
-			}
-			glVertexPointer(3, GL_FLOAT, 0, vertex_array);
-			glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
-			
-			glDrawArrays(GL_QUADS, 0, vertex_count);
+	const WallBatch::wall_key& key = walls->key();
+	GLsizei vertex_count = walls->vertex_count();
 
-			if (setupGlow(view, TMgr, wobble, intensity, weaponFlare, selfLuminosity, offset, renderStep)) {
-				glDrawArrays(GL_QUADS, 0, vertex_count);
-			}
+	walls->set_pointers();
+	glDrawArrays(GL_QUADS, 0, vertex_count);
+	frame_stats.draw_calls++;
+	frame_stats.sent_vertices += vertex_count;
+	frame_stats.batched_walls += walls->walls() - 1;
 
-			Shader::disable();
-			glMatrixMode(GL_TEXTURE);
-			glLoadIdentity();
-			glMatrixMode(GL_MODELVIEW);
-		}
+	if (setupGlow(view, walls->texture(), walls->wobble(), key.intensity, weaponFlare, selfLuminosity, walls->offset(), walls->render_step())) {
+		glDrawArrays(GL_QUADS, 0, vertex_count);
+		frame_stats.draw_calls++;
 	}
+	walls->reset_pointers();
+	walls->clear();
+
+	Shader::disable();
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
 }
 
 extern void FlatBumpTexture(); // from OGL_Textures.cpp
 
+// Find an animated model's vertex positions and normals
+static void FindModelPositions(rectangle_definition& RenderRectangle) {
+
+	Model3D& Model = RenderRectangle.ModelPtr->Model;
+	short ModelSequence = RenderRectangle.ModelSequence;
+	if (ModelSequence >= 0)
+	{
+		int NumFrames = Model.NumSeqFrames(ModelSequence);
+		if (NumFrames > 0)
+		{
+			short ModelFrame = PIN(RenderRectangle.ModelFrame, 0, NumFrames - 1);
+			short NextModelFrame = PIN(RenderRectangle.NextModelFrame, 0, NumFrames - 1);
+			float MixFrac = RenderRectangle.MixFrac;
+			Model.FindPositions_Sequence(true,
+				ModelSequence, ModelFrame, MixFrac, NextModelFrame);
+		}
+		else
+			Model.FindPositions_Neutral(true);	// Fallback: neutral
+	}
+	else
+		Model.FindPositions_Neutral(true);	// Fallback: neutral (will do nothing for static models)
+}
+
+/*
+ * finds the positions of all the visible models before any is drawn,
+ * a job per model, shared out among the worker pool's threads;
+ * the models keep those poses, so drawing one only swaps its pose back in
+ */
+void RenderRasterize_Shader::find_model_positions(vector<render_object_data>& render_objects) {
+
+	// a model's positions are found in its own arrays, so objects
+	// showing the same model go in the same job
+	std::vector<std::vector<rectangle_definition*>> jobs;
+	std::unordered_map<OGL_ModelData*, size_t> job_indexes;
+	size_t vertices = 0;
+	for (auto& object : render_objects) {
+		rectangle_definition& rect = object.rectangle;
+		if (!rect.ModelPtr) continue;
+
+		auto it = job_indexes.emplace(rect.ModelPtr, jobs.size());
+		if (it.second) jobs.emplace_back();
+
+		// any more poses than the model keeps would push out the first
+		auto& job = jobs[it.first->second];
+		if (job.size() < Model3D::PoseCacheSize) {
+			job.push_back(&rect);
+			vertices += rect.ModelPtr->Model.VtxSrcIndices.size();
+		}
+	}
+
+	if (jobs.empty())
+		return;
+
+	auto job = [&jobs](size_t i) {
+		for (auto rect : jobs[i]) {
+			FindModelPositions(*rect);
+		}
+	};
+
+	// below this, waking the pool's threads takes longer than the work
+	static const size_t kMinimumThreadedVertices = 4096;
+
+	if (vertices < kMinimumThreadedVertices) {
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			job(i);
+		}
+	} else {
+		WorkerPool::instance()->run(jobs.size(), job);
+	}
+}
+
 bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short CLUT, float flare, float selfLuminosity, RenderStep renderStep) {
 
 	OGL_ModelData *ModelPtr = RenderRectangle.ModelPtr;
@@ -995,24 +1327,8 @@ bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short
 	s->setFloat(Shader::U_Glow, 0);
 	glColor4f(color[0], color[1], color[2], 1);
 
-	// Find an animated model's vertex positions and normals:
-	short ModelSequence = RenderRectangle.ModelSequence;
-	if (ModelSequence >= 0)
-	{
-		int NumFrames = ModelPtr->Model.NumSeqFrames(ModelSequence);
-		if (NumFrames > 0)
-		{
-			short ModelFrame = PIN(RenderRectangle.ModelFrame, 0, NumFrames - 1);
-			short NextModelFrame = PIN(RenderRectangle.NextModelFrame, 0, NumFrames - 1);
-			float MixFrac = RenderRectangle.MixFrac;
-			ModelPtr->Model.FindPositions_Sequence(true,
-				ModelSequence, ModelFrame, MixFrac, NextModelFrame);
-		}
-		else
-			ModelPtr->Model.FindPositions_Neutral(true);	// Fallback: neutral
-	}
-	else
-		ModelPtr->Model.FindPositions_Neutral(true);	// Fallback: neutral (will do nothing for static models)
+	// usually found already, by find_model_positions()
+	FindModelPositions(RenderRectangle);
 
 	glVertexPointer(3,GL_FLOAT,0,ModelPtr->Model.PosBase());
 	glClientActiveTextureARB(GL_TEXTURE0_ARB);
@@ -1045,6 +1361,8 @@ bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short
 	}
 
 	glDrawElements(GL_TRIANGLES,(GLsizei)ModelPtr->Model.NumVI(),GL_UNSIGNED_SHORT,ModelPtr->Model.VIBase());
+	frame_stats.draw_calls++;
+	frame_stats.sent_vertices += ModelPtr->Model.NumVI();
 
 	if (canGlow && SkinPtr->GlowImg.IsPresent()) {
 		glEnable(GL_BLEND);
@@ -1063,6 +1381,7 @@ bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short
 			LoadModelSkin(SkinPtr->GlowImg, Collection, CLUT);
 		}
 		glDrawElements(GL_TRIANGLES,(GLsizei)ModelPtr->Model.NumVI(),GL_UNSIGNED_SHORT,ModelPtr->Model.VIBase());
+		frame_stats.draw_calls++;
 	}
 
 	glDisableClientState(GL_NORMAL_ARRAY);
@@ -1081,6 +1400,8 @@ bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short
 
 void RenderRasterize_Shader::render_node_object(render_object_data *object, bool other_side_of_media, RenderStep renderStep) {
 
+	flush_walls();
+
     if (!object->clipping_windows)
         return;
 
@@ -1218,9 +1539,12 @@ void RenderRasterize_Shader::_render_node_object_helper(render_object_data *obje
 	glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
 
 	glDrawArrays(GL_QUADS, 0, 4);
+	frame_stats.draw_calls++;
+	frame_stats.sent_vertices += 4;
 
 	if (setupGlow(view, TMgr, 0, 1, weaponFlare, selfLuminosity, offset, renderStep)) {
 		glDrawArrays(GL_QUADS, 0, 4);
+		frame_stats.draw_calls++;
 	}
         
 	glEnable(GL_DEPTH_TEST);
@@ -1420,9 +1744,12 @@ void RenderRasterize_Shader::render_viewer_sprite(rectangle_definition& RenderRe
 		
 	// Go!
         glDrawArrays(GL_POLYGON,0,4);
+        frame_stats.draw_calls++;
+        frame_stats.sent_vertices += 4;
 
         if (setupGlow(view, TMgr, 0, 1, weaponFlare, selfLuminosity, 0, renderStep)) {
             glDrawArrays(GL_QUADS, 0, 4);
+            frame_stats.draw_calls++;
 	}
 	
 	glEnable(GL_DEPTH_TEST);
@@ -22,9 +22,14 @@
 #ifdef HAVE_OPENGL
 
 class Blur;
+class StaticSurfaceBuffer;
+class WallBatch;
 class RenderRasterize_Shader : public RenderRasterizerClass {
 
 	std::unique_ptr<Blur> blur;
+	std::unique_ptr<StaticSurfaceBuffer> static_surfaces;
+	std::unique_ptr<WallBatch> walls;
+	render_stats stats;
 	Rasterizer_Shader_Class *RasPtr;
 	
 	int objectCount;
@@ -44,6 +49,7 @@ protected:
 	virtual void render_node_side(
 		  clipping_window_data *window, vertical_surface_data *surface,
 		  bool void_present, RenderStep renderStep);
+	void flush_walls();
 
 	virtual void render_node_object(render_object_data *object, bool other_side_of_media, RenderStep renderStep);
 	
@@ -63,6 +69,10 @@ public:
 	virtual void render_tree(void);
         bool renders_viewer_sprites_in_tree() { return true; }
 
+	void invalidate_geometry();
+	void find_model_positions(vector<render_object_data>& render_objects);
+	const render_stats& last_frame_stats() const { return stats; }
+
 	std::unique_ptr<TextureManager> setupWallTexture(const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep);
 	std::unique_ptr<TextureManager> setupSpriteTexture(const rectangle_definition& rect, short type, float offset, RenderStep renderStep);
 };
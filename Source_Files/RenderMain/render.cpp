@@ -491,6 +491,10 @@ void render_view(
 				it to the texture-mapping code */
 			RenPtr->view = view;
 			RenPtr->RasPtr = RasPtr;
+#ifdef HAVE_OPENGL
+			if (RenPtr == &Render_Shader)
+				Render_Shader.find_model_positions(RenderPlaceObjs.RenderObjects);
+#endif
 			RenPtr->render_tree();
 			
 			// LP: won't put this into a separate class
@@ -511,6 +515,25 @@ void render_view(
 	}
 }
 
+void invalidate_render_geometry(void)
+{
+#ifdef HAVE_OPENGL
+	Render_Shader.invalidate_geometry();
+#endif
+}
+
+bool get_render_stats(render_stats& stats)
+{
+#ifdef HAVE_OPENGL
+	if (OGL_IsActive() && graphics_preferences->screen_mode.acceleration == _opengl_acceleration)
+	{
+		stats = Render_Shader.last_frame_stats();
+		return true;
+	}
+#endif
+	return false;
+}
+
 void start_render_effect(
 	struct view_data *view,
 	short effect)
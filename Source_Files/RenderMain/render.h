@@ -188,6 +188,21 @@ void start_render_effect(struct view_data *view, short effect);
 
 void check_m1_exploration(void);
 
+// the map was replaced; renderers drop what they kept of the old level's geometry
+void invalidate_render_geometry(void);
+
+struct render_stats
+{
+	int draw_calls;			// world, sprites and models, the last frame
+	int buffered_surfaces;	// floors, ceilings and liquids drawn from the level's vertex buffer
+	int batched_walls;		// walls drawn in the same draw as the wall before them
+	int sent_vertices;		// vertices sent from client memory or written to that buffer
+	float milliseconds;		// issuing the last frame
+};
+
+// false if the renderer in use doesn't count these
+bool get_render_stats(render_stats& stats);
+
 
 /* ----------- prototypes/SCREEN.C */
 void render_overhead_map(struct view_data *view);
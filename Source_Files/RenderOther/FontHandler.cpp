@@ -188,7 +188,7 @@ void FontSpecifier::OGL_Reset(bool IsStarting)
         return;
 	
 	// Put some padding around each glyph so as to avoid clipping it
-	const int Pad = 1;
+	const int Pad = GlyphPad;
 	int ascent_p = Ascent + Pad, descent_p = Descent + Pad;
 	int widths_p[256];
 	for (int i=0; i<256; i++) {
@@ -310,6 +310,10 @@ void FontSpecifier::OGL_Reset(bool IsStarting)
  			int NewPos = Pos + Width;
  			GLfloat Left = TWidNorm*Pos;
  			GLfloat Right = TWidNorm*NewPos;
+			GlyphTexCoords[Which][0] = Left;
+			GlyphTexCoords[Which][1] = Top;
+			GlyphTexCoords[Which][2] = Right;
+			GlyphTexCoords[Which][3] = Bottom;
  			
  			glNewList(DispList + Which, GL_COMPILE);
  			
@@ -365,6 +369,38 @@ void FontSpecifier::OGL_Render(const char *Text)
 	glPopAttrib();
 }
 
+// The same glyph rectangles OGL_Render() draws, scaled and with the left
+// baseline point at (x, y), added as triangles to draw in one go
+void FontSpecifier::OGL_AppendText(const char *Text, float x, float y, float scale,
+								   std::vector<GLfloat>& Vertices, std::vector<GLfloat>& TexCoords)
+{
+	const float Top = -(Ascent + GlyphPad) * scale;
+	const float Bottom = (Descent + GlyphPad) * scale;
+
+	float Pos = x;
+	size_t Len = MIN(strlen(Text),255);
+	for (size_t k=0; k<Len; k++)
+	{
+		unsigned char c = Text[k];
+		float Left = Pos - GlyphPad * scale;
+		float Right = Left + (Widths[c] + 2*GlyphPad) * scale;
+		const GLfloat *T = GlyphTexCoords[c];
+
+		GLfloat V[12] = {
+			Left, y + Top, Right, y + Top, Right, y + Bottom,
+			Left, y + Top, Right, y + Bottom, Left, y + Bottom
+		};
+		GLfloat C[12] = {
+			T[0], T[1], T[2], T[1], T[2], T[3],
+			T[0], T[1], T[2], T[3], T[0], T[3]
+		};
+		Vertices.insert(Vertices.end(), V, V + 12);
+		TexCoords.insert(TexCoords.end(), C, C + 12);
+
+		Pos += Widths[c] * scale;
+	}
+}
+
 
 // Renders text a la _draw_screen_text() (see screen_drawing.h), with
 // alignment and wrapping. Modelview matrix is unaffected.
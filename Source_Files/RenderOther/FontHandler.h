@@ -41,6 +41,7 @@ Jan 14, 2001 (Loren Petrich):
 #include "OGL_Headers.h"
 
 #include <set>
+#include <vector>
 
 struct screen_rectangle;
 
@@ -92,6 +93,12 @@ public:
 	// One can surround it with glPushMatrix() and glPopMatrix() to remember the original.
 	void OGL_Render(const char *Text);
 
+	// Adds what OGL_Render() would draw, scaled and with the left baseline
+	// point at (x, y), as triangles to the arrays, for drawing several
+	// strings with one call; OGL_Texture must be there
+	void OGL_AppendText(const char *Text, float x, float y, float scale,
+						std::vector<GLfloat>& Vertices, std::vector<GLfloat>& TexCoords);
+
 	// Renders text a la _draw_screen_text() (see screen_drawing.h), with
 	// alignment and wrapping. Modelview matrix is unaffected.
 	void OGL_DrawText(const char *Text, const screen_rectangle &r, short flags);
@@ -132,6 +139,8 @@ public:
 	GLuint TxtrID;
 	GLuint NearFilter = GL_LINEAR;
 	uint32 DispList;
+	GLfloat GlyphTexCoords[256][4];	// left, top, right, bottom
+	static const int GlyphPad = 1;
 	static std::set<FontSpecifier*> *m_font_registry;
 #endif
 };
@@ -38,6 +38,8 @@ HUD_RENDERER_LUA.CPP
 
 #include <math.h>
 
+#include <algorithm>
+
 extern bool MotionSensorActive;
 
 
@@ -144,6 +146,12 @@ void HUD_Lua_Class::start_draw(void)
 	}
 	
 	
+	m_commands.clear();
+	m_text.clear();
+	m_partial_flush = false;
+	m_frame_hash = FNV1A_OFFSET_BASIS;
+	m_drawn_masking_mode = _mask_disabled;
+
 	m_drawing = true;
 	clear_mask();
 }
@@ -151,6 +159,20 @@ void HUD_Lua_Class::start_draw(void)
 void HUD_Lua_Class::end_draw(void)
 {
 	m_drawing = false;
+
+	// the same draws as last frame batch the same way and make the same
+	// triangles, so last frame's plan and geometry are kept
+	bool unchanged = !m_partial_flush && m_frame_hash == m_last_frame_hash;
+	m_last_frame_hash = m_partial_flush ? 0 : m_frame_hash;
+
+	if (!unchanged || m_order.size() != m_commands.size())
+	{
+		plan_batches();
+		unchanged = false;
+	}
+	m_reuse_geometry = unchanged;
+	flush();
+	m_reuse_geometry = false;
 	
 #ifdef HAVE_OPENGL
 	if (m_opengl)
@@ -162,15 +184,196 @@ void HUD_Lua_Class::end_draw(void)
 #endif
 }
 
-void HUD_Lua_Class::apply_clip(void)
+template<typename T>
+static uint64_t hash_value(uint64_t hash, T value)
+{
+	return fnv1a_hash(hash, &value, sizeof(value));
+}
+
+void HUD_Lua_Class::record(command& c)
+{
+	c.clip = alephone::Screen::instance()->lua_clip_rect;
+
+	uint64_t hash = m_frame_hash;
+	hash = hash_value(hash, c.type);
+	hash = hash_value(hash, c.masking_mode);
+	hash = hash_value(hash, c.clip.x);
+	hash = hash_value(hash, c.clip.y);
+	hash = hash_value(hash, c.clip.w);
+	hash = hash_value(hash, c.clip.h);
+	const float values[] = { c.x, c.y, c.w, c.h, c.r, c.g, c.b, c.a, c.t, c.crop_x, c.crop_y, c.crop_w, c.crop_h };
+	for (float value : values)
+		hash = hash_value(hash, value);
+	hash = hash_value(hash, c.object);
+	m_frame_hash = fnv1a_hash(hash, m_text.data() + c.text, c.text_length);
+
+	m_commands.push_back(c);
+}
+
+void HUD_Lua_Class::draw_pending(const void *object)
+{
+	// the object may be about to change, or go and leave its address to
+	// another, so last frame's geometry can't be trusted
+	m_last_frame_hash = 0;
+
+	if (!m_drawing)
+		return;
+
+	for (const auto& c : m_commands)
+	{
+		if (c.object == object)
+		{
+			m_partial_flush = true;
+			plan_batches();
+			flush();
+			return;
+		}
+	}
+}
+
+// batches further back than this aren't looked at for one a draw could join
+static const size_t kBatchLookback = 16;
+
+void HUD_Lua_Class::plan_batches(void)
+{
+	struct planned_batch {
+		size_t leader;
+		float left, top, right, bottom;
+	};
+	auto is_barrier = [](short type) {
+		return type == _command_set_masking_mode || type == _command_clear_mask;
+	};
+
+	std::vector<planned_batch> planned;
+	std::vector<size_t> batch_of(m_commands.size());
+
+	// a draw joins an earlier batch that uses the same texture, font and
+	// clip, if nothing drawn in between might overlap it; it's never moved
+	// across a masking change
+	size_t first_open = 0;
+	for (size_t i = 0; i < m_commands.size(); ++i)
+	{
+		const command& c = m_commands[i];
+		size_t joined = planned.size();
+		if (!is_barrier(c.type))
+		{
+			for (size_t j = planned.size(); j > first_open && planned.size() - j < kBatchLookback; --j)
+			{
+				const planned_batch& candidate = planned[j - 1];
+				const command& leader = m_commands[candidate.leader];
+				bool rects = (leader.type == _command_fill_rect || leader.type == _command_frame_rect) &&
+					(c.type == _command_fill_rect || c.type == _command_frame_rect);
+				if ((rects || (leader.type == c.type && leader.object == c.object)) &&
+				    leader.clip.x == c.clip.x && leader.clip.y == c.clip.y &&
+				    leader.clip.w == c.clip.w && leader.clip.h == c.clip.h)
+				{
+					joined = j - 1;
+					break;
+				}
+
+				if (c.left < candidate.right && candidate.left < c.right &&
+				    c.top < candidate.bottom && candidate.top < c.bottom)
+					break;
+			}
+		}
+
+		if (joined == planned.size())
+		{
+			planned.push_back({i, c.left, c.top, c.right, c.bottom});
+			if (is_barrier(c.type))
+				first_open = planned.size();
+		}
+		else
+		{
+			planned_batch& b = planned[joined];
+			b.left = std::min(b.left, c.left);
+			b.top = std::min(b.top, c.top);
+			b.right = std::max(b.right, c.right);
+			b.bottom = std::max(b.bottom, c.bottom);
+		}
+		batch_of[i] = joined;
+	}
+
+	m_batches.assign(planned.size(), batch{0, 0});
+	m_geometry.resize(m_batches.size());
+	for (size_t i = 0; i < m_commands.size(); ++i)
+		++m_batches[batch_of[i]].count;
+
+	size_t first = 0;
+	for (auto& b : m_batches)
+	{
+		b.first = first;
+		first += b.count;
+		b.count = 0;
+	}
+
+	m_order.resize(m_commands.size());
+	for (size_t i = 0; i < m_commands.size(); ++i)
+	{
+		batch& b = m_batches[batch_of[i]];
+		m_order[b.first + b.count++] = i;
+	}
+}
+
+void HUD_Lua_Class::flush(void)
+{
+	for (size_t i = 0; i < m_batches.size(); ++i)
+		draw_batch(m_batches[i], m_geometry[i]);
+
+	m_commands.clear();
+	m_text.clear();
+}
+
+void HUD_Lua_Class::draw_batch(const batch& b, batch_geometry& geometry)
+{
+	const command& first = m_commands[m_order[b.first]];
+	switch (first.type)
+	{
+		case _command_set_masking_mode:
+			apply_masking_mode(first.masking_mode);
+			return;
+		case _command_clear_mask:
+#ifdef HAVE_OPENGL
+			if (m_opengl)
+			{
+				glClearStencil(0);
+				glClear(GL_STENCIL_BUFFER_BIT);
+			}
+#endif
+			return;
+	}
+
+	apply_clip(first.clip);
+	switch (first.type)
+	{
+		case _command_fill_rect:
+		case _command_frame_rect:
+			draw_rects(b, geometry);
+			break;
+		case _command_draw_text:
+			draw_text_batch(b, geometry);
+			break;
+		case _command_draw_image:
+			for (size_t i = b.first; i < b.first + b.count; ++i)
+				draw_image_command(m_commands[m_order[i]]);
+			break;
+		case _command_draw_shape:
+			for (size_t i = b.first; i < b.first + b.count; ++i)
+				draw_shape_command(m_commands[m_order[i]]);
+			break;
+	}
+	SDL_SetClipRect(MainScreenSurface(), NULL);
+}
+
+void HUD_Lua_Class::apply_clip(const SDL_Rect& clip)
 {
 	alephone::Screen *scr = alephone::Screen::instance();
 	
     SDL_Rect r;
-    r.x = m_wr.x + scr->lua_clip_rect.x;
-    r.y = m_wr.y + scr->lua_clip_rect.y;
-    r.w = MIN(scr->lua_clip_rect.w, m_wr.w - scr->lua_clip_rect.x);
-    r.h = MIN(scr->lua_clip_rect.h, m_wr.h - scr->lua_clip_rect.y);
+    r.x = m_wr.x + clip.x;
+    r.y = m_wr.y + clip.y;
+    r.w = MIN(clip.w, m_wr.w - clip.x);
+    r.h = MIN(clip.h, m_wr.h - clip.y);
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
@@ -197,19 +400,31 @@ void HUD_Lua_Class::set_masking_mode(short masking_mode)
 		masking_mode >= NUMBER_OF_LUA_MASKING_MODES)
 		return;
 	
-	if (m_masking_mode == _mask_drawing)
+	m_masking_mode = masking_mode;
+	if (!m_drawing)
+		return;
+
+	command c = command();
+	c.type = _command_set_masking_mode;
+	c.masking_mode = masking_mode;
+	record(c);
+}
+
+void HUD_Lua_Class::apply_masking_mode(short masking_mode)
+{
+	if (m_drawn_masking_mode == _mask_drawing)
 		end_drawing_mask();
-	else if (m_masking_mode == _mask_erasing)
+	else if (m_drawn_masking_mode == _mask_erasing)
 		end_drawing_mask();
-	else if (m_masking_mode == _mask_enabled)
+	else if (m_drawn_masking_mode == _mask_enabled)
 		end_using_mask();
 	
-	m_masking_mode = masking_mode;
-	if (m_masking_mode == _mask_drawing)
+	m_drawn_masking_mode = masking_mode;
+	if (m_drawn_masking_mode == _mask_drawing)
 		start_drawing_mask(false);
-	else if (m_masking_mode == _mask_erasing)
+	else if (m_drawn_masking_mode == _mask_erasing)
 		start_drawing_mask(true);
-	else if (m_masking_mode == _mask_enabled)
+	else if (m_drawn_masking_mode == _mask_enabled)
 		start_using_mask();
 }
 	
@@ -218,13 +433,9 @@ void HUD_Lua_Class::clear_mask(void)
 	if (!m_drawing)
 		return;
 	
-#ifdef HAVE_OPENGL
-	if (m_opengl)
-	{
-		glClearStencil(0);
-		glClear(GL_STENCIL_BUFFER_BIT);
-	}
-#endif
+	command c = command();
+	c.type = _command_clear_mask;
+	record(c);
 }
 
 void HUD_Lua_Class::start_using_mask(void)
@@ -287,27 +498,21 @@ void HUD_Lua_Class::fill_rect(float x, float y, float w, float h,
 	if (!w || !h)
 		return;
 	
-	apply_clip();
-#ifdef HAVE_OPENGL
-	if (m_opengl)
-	{
-		glColor4f(r, g, b, a);
-		OGL_RenderRect(x, y, w, h);
-	}
-	else
-#endif
-	if (m_surface)
-	{
-		SDL_Rect rect;
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.y = static_cast<Sint16>(y) + m_wr.y;
-		rect.w = static_cast<Uint16>(w);
-		rect.h = static_cast<Uint16>(h);
-		SDL_FillRect(m_surface, &rect,
-								 SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(r * 255), static_cast<unsigned char>(g * 255), static_cast<unsigned char>(b * 255), static_cast<unsigned char>(a * 255)));
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		SDL_SetClipRect(MainScreenSurface(), NULL);
-	}
+	command c = command();
+	c.type = _command_fill_rect;
+	c.x = x;
+	c.y = y;
+	c.w = w;
+	c.h = h;
+	c.r = r;
+	c.g = g;
+	c.b = b;
+	c.a = a;
+	c.left = std::min(x, x + w);
+	c.top = std::min(y, y + h);
+	c.right = std::max(x, x + w);
+	c.bottom = std::max(y, y + h);
+	record(c);
 }	
 
 void HUD_Lua_Class::frame_rect(float x, float y, float w, float h,
@@ -317,46 +522,146 @@ void HUD_Lua_Class::frame_rect(float x, float y, float w, float h,
 	if (!m_drawing)
 		return;
 		
-	apply_clip();
+	command c = command();
+	c.type = _command_frame_rect;
+	c.x = x;
+	c.y = y;
+	c.w = w;
+	c.h = h;
+	c.r = r;
+	c.g = g;
+	c.b = b;
+	c.a = a;
+	c.t = t;
+	c.left = std::min(x, x + w);
+	c.top = std::min(y, y + h);
+	c.right = std::max(x, x + w);
+	c.bottom = std::max(y, y + h);
+	record(c);
+}	
+
+void HUD_Lua_Class::draw_rects(const batch& b, batch_geometry& geometry)
+{
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
-		glColor4f(r, g, b, a);
-		OGL_RenderFrame(x, y, w, h, t);
+		// the whole batch in one draw, with a color for each vertex
+		std::vector<GLfloat>& vertices = geometry.vertices;
+		std::vector<GLfloat>& colors = geometry.colors;
+		if (!m_reuse_geometry)
+		{
+			vertices.clear();
+			colors.clear();
+
+			for (size_t i = b.first; i < b.first + b.count; ++i)
+			{
+				const command& c = m_commands[m_order[i]];
+				float x = c.x, y = c.y, w = c.w, h = c.h, t = c.t;
+				size_t first_vertex = vertices.size() / 2;
+				if (c.type == _command_fill_rect)
+				{
+					// as OGL_RenderRect() does, but as triangles
+					GLfloat rect[12] = { x, y, x + w, y, x + w, y + h, x, y, x + w, y + h, x, y + h };
+					vertices.insert(vertices.end(), rect, rect + 12);
+				}
+				else
+				{
+					// as OGL_RenderFrame() does, with its strip unwound into
+					// triangles facing the same way
+					GLfloat strip[20] = {
+						x,         y,
+						x + t,     y + t,
+						x,         y + h,
+						x + t,     y + h - t,
+						x + w,	   y + h,
+						x + w - t, y + h - t,
+						x + w,     y,
+						x + w - t, y + t,
+						x,		   y,
+						x + t,	   y + t
+					};
+					for (int k = 0; k < 8; ++k)
+					{
+						int first = (k % 2) ? k + 1 : k;
+						int second = (k % 2) ? k : k + 1;
+						vertices.insert(vertices.end(), strip + first * 2, strip + first * 2 + 2);
+						vertices.insert(vertices.end(), strip + second * 2, strip + second * 2 + 2);
+						vertices.insert(vertices.end(), strip + (k + 2) * 2, strip + (k + 2) * 2 + 2);
+					}
+				}
+
+				for (size_t v = first_vertex; v < vertices.size() / 2; ++v)
+				{
+					GLfloat color[4] = { c.r, c.g, c.b, c.a };
+					colors.insert(colors.end(), color, color + 4);
+				}
+			}
+		}
+
+		glDisable(GL_TEXTURE_2D);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glEnableClientState(GL_COLOR_ARRAY);
+
+		glVertexPointer(2, GL_FLOAT, 0, &vertices.front());
+		glColorPointer(4, GL_FLOAT, 0, &colors.front());
+		glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size() / 2));
+
+		glDisableClientState(GL_COLOR_ARRAY);
+		glEnable(GL_TEXTURE_2D);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+		// where drawing them one at a time would have left it
+		const command& last = m_commands[m_order[b.first + b.count - 1]];
+		glColor4f(last.r, last.g, last.b, last.a);
 	}
 	else
 #endif
 	if (m_surface)
 	{
-		Uint32 color = SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(r * 255), static_cast<unsigned char>(g * 255), static_cast<unsigned char>(b * 255), static_cast<unsigned char>(a * 255));
-		SDL_Rect rect;
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.w = static_cast<Uint16>(w);
-		rect.y = static_cast<Sint16>(y) + m_wr.y;
-		rect.h = static_cast<Uint16>(t);
-		SDL_FillRect(m_surface, &rect, color);
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.w = static_cast<Uint16>(w);
-		rect.y = static_cast<Sint16>(y + h - t) + m_wr.y;
-		rect.h = static_cast<Uint16>(t);
-		SDL_FillRect(m_surface, &rect, color);
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.w = static_cast<Uint16>(t);
-		rect.y = static_cast<Sint16>(y + t) + m_wr.y;
-		rect.h = static_cast<Uint16>(h - t - t);
-		SDL_FillRect(m_surface, &rect, color);
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		rect.x = static_cast<Sint16>(x + w - t) + m_wr.x;
-		rect.w = static_cast<Uint16>(t);
-		rect.y = static_cast<Sint16>(y + t) + m_wr.y;
-		rect.h = static_cast<Uint16>(h - t - t);
-		SDL_FillRect(m_surface, &rect, color);
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		SDL_SetClipRect(MainScreenSurface(), NULL);
+		for (size_t i = b.first; i < b.first + b.count; ++i)
+		{
+			const command& c = m_commands[m_order[i]];
+			float x = c.x, y = c.y, w = c.w, h = c.h, t = c.t;
+			Uint32 color = SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(c.r * 255), static_cast<unsigned char>(c.g * 255), static_cast<unsigned char>(c.b * 255), static_cast<unsigned char>(c.a * 255));
+			SDL_Rect rect;
+			if (c.type == _command_fill_rect)
+			{
+				rect.x = static_cast<Sint16>(x) + m_wr.x;
+				rect.y = static_cast<Sint16>(y) + m_wr.y;
+				rect.w = static_cast<Uint16>(w);
+				rect.h = static_cast<Uint16>(h);
+				SDL_FillRect(m_surface, &rect, color);
+				SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
+				continue;
+			}
+
+			rect.x = static_cast<Sint16>(x) + m_wr.x;
+			rect.w = static_cast<Uint16>(w);
+			rect.y = static_cast<Sint16>(y) + m_wr.y;
+			rect.h = static_cast<Uint16>(t);
+			SDL_FillRect(m_surface, &rect, color);
+			SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
+			rect.x = static_cast<Sint16>(x) + m_wr.x;
+			rect.w = static_cast<Uint16>(w);
+			rect.y = static_cast<Sint16>(y + h - t) + m_wr.y;
+			rect.h = static_cast<Uint16>(t);
+			SDL_FillRect(m_surface, &rect, color);
+			SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
+			rect.x = static_cast<Sint16>(x) + m_wr.x;
+			rect.w = static_cast<Uint16>(t);
+			rect.y = static_cast<Sint16>(y + t) + m_wr.y;
+			rect.h = static_cast<Uint16>(h - t - t);
+			SDL_FillRect(m_surface, &rect, color);
+			SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
+			rect.x = static_cast<Sint16>(x + w - t) + m_wr.x;
+			rect.w = static_cast<Uint16>(t);
+			rect.y = static_cast<Sint16>(y + t) + m_wr.y;
+			rect.h = static_cast<Uint16>(h - t - t);
+			SDL_FillRect(m_surface, &rect, color);
+			SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
+		}
 	}
-}	
+}
 
 void HUD_Lua_Class::draw_text(FontSpecifier *font, const char *text,
 															float x, float y,
@@ -369,7 +674,96 @@ void HUD_Lua_Class::draw_text(FontSpecifier *font, const char *text,
 	if (!text || !strlen(text))
 		return;
 	
-	apply_clip();
+	command c = command();
+	c.type = _command_draw_text;
+	c.object = font;
+	c.text = m_text.size();
+	c.text_length = strlen(text);
+	m_text.append(text, c.text_length);
+	c.x = x;
+	c.y = y;
+	c.r = r;
+	c.g = g;
+	c.b = b;
+	c.a = a;
+	c.t = scale;
+
+	// glyphs can reach past their advance and line spacing, so leave room
+	float margin = font->Height * scale;
+	c.left = x - margin;
+	c.top = y - margin;
+	c.right = x + font->TextWidth(text) * scale + margin;
+	c.bottom = y + font->LineSpacing * scale + margin;
+	record(c);
+}
+
+void HUD_Lua_Class::draw_text_batch(const batch& b, batch_geometry& geometry)
+{
+#ifdef HAVE_OPENGL
+	if (m_opengl)
+	{
+		// a batch's text is all in the one font, so it's all in one
+		// texture and goes out in one draw, with a color for each vertex
+		FontSpecifier *font = static_cast<FontSpecifier *>(m_commands[m_order[b.first]].object);
+		if (!font->OGL_Texture)
+		{
+			font->OGL_Reset(true);
+			if (!font->OGL_Texture) return;
+		}
+
+		std::vector<GLfloat>& vertices = geometry.vertices;
+		std::vector<GLfloat>& texcoords = geometry.texcoords;
+		std::vector<GLfloat>& colors = geometry.colors;
+		if (!m_reuse_geometry)
+		{
+			vertices.clear();
+			texcoords.clear();
+			colors.clear();
+
+			for (size_t i = b.first; i < b.first + b.count; ++i)
+			{
+				const command& c = m_commands[m_order[i]];
+				std::string s(m_text, c.text, c.text_length);
+				size_t first_vertex = vertices.size() / 2;
+
+				// as draw_text_command() places it
+				font->OGL_AppendText(s.c_str(), c.x, c.y + (font->Height * c.t), c.t, vertices, texcoords);
+
+				for (size_t v = first_vertex; v < vertices.size() / 2; ++v)
+				{
+					GLfloat color[4] = { c.r, c.g, c.b, c.a };
+					colors.insert(colors.end(), color, color + 4);
+				}
+			}
+		}
+
+		if (vertices.empty())
+			return;
+
+		glBindTexture(GL_TEXTURE_2D, font->TxtrID);
+		glEnableClientState(GL_COLOR_ARRAY);
+
+		glVertexPointer(2, GL_FLOAT, 0, &vertices.front());
+		glTexCoordPointer(2, GL_FLOAT, 0, &texcoords.front());
+		glColorPointer(4, GL_FLOAT, 0, &colors.front());
+		glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size() / 2));
+
+		glDisableClientState(GL_COLOR_ARRAY);
+		glColor4f(1, 1, 1, 1);
+		return;
+	}
+#endif
+	for (size_t i = b.first; i < b.first + b.count; ++i)
+		draw_text_command(m_commands[m_order[i]]);
+}
+
+void HUD_Lua_Class::draw_text_command(const command& c)
+{
+	FontSpecifier *font = static_cast<FontSpecifier *>(c.object);
+	std::string s(m_text, c.text, c.text_length);
+	const char *text = s.c_str();
+	float x = c.x, y = c.y, r = c.r, g = c.g, b = c.b, a = c.a, scale = c.t;
+
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
@@ -434,11 +828,30 @@ void HUD_Lua_Class::draw_text(FontSpecifier *font, const char *text,
                                               static_cast<unsigned char>(a * 255)),
                                   font->Style);
             SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-			SDL_SetClipRect(MainScreenSurface(), NULL);
         }
 	}
 }
 
+// what an image or shape drawn at x, y might cover, rotated about its center
+static void rotated_bounds(float x, float y, float w, float h, float rotation,
+			   float& left, float& top, float& right, float& bottom)
+{
+	if (rotation == 0)
+	{
+		left = std::min(x, x + w);
+		top = std::min(y, y + h);
+		right = std::max(x, x + w);
+		bottom = std::max(y, y + h);
+		return;
+	}
+
+	float radius = sqrtf(w * w + h * h) / 2;
+	left = x + w / 2 - radius;
+	top = y + h / 2 - radius;
+	right = x + w / 2 + radius;
+	bottom = y + h / 2 + radius;
+}
+
 void HUD_Lua_Class::draw_image(Image_Blitter *image, float x, float y)
 {
 	if (!m_drawing)
@@ -449,14 +862,71 @@ void HUD_Lua_Class::draw_image(Image_Blitter *image, float x, float y)
 	if (!r.w || !r.h)
 		return;
 
-	apply_clip();
+	// what Lua can change before the batch is drawn goes along with it
+	command c = command();
+	c.type = _command_draw_image;
+	c.object = image;
+	c.x = x;
+	c.y = y;
+	c.w = r.w;
+	c.h = r.h;
+	c.r = image->tint_color_r;
+	c.g = image->tint_color_g;
+	c.b = image->tint_color_b;
+	c.a = image->tint_color_a;
+	c.t = image->rotation;
+	c.crop_x = image->crop_rect.x;
+	c.crop_y = image->crop_rect.y;
+	c.crop_w = image->crop_rect.w;
+	c.crop_h = image->crop_rect.h;
+	rotated_bounds(x, y, r.w, r.h, c.t, c.left, c.top, c.right, c.bottom);
+	record(c);
+}
+
+// sets the tint, rotation and crop an image or shape had when its draw was
+// recorded, and puts back what it has now after
+template<class T>
+class recorded_draw_state
+{
+public:
+	recorded_draw_state(T *blitter, const float tint[4], float rotation, const Image_Rect& crop_rect) : m_blitter(blitter), m_tint{blitter->tint_color_r, blitter->tint_color_g, blitter->tint_color_b, blitter->tint_color_a}, m_rotation(blitter->rotation), m_crop_rect(blitter->crop_rect) {
+		blitter->tint_color_r = tint[0];
+		blitter->tint_color_g = tint[1];
+		blitter->tint_color_b = tint[2];
+		blitter->tint_color_a = tint[3];
+		blitter->rotation = rotation;
+		blitter->crop_rect = crop_rect;
+	}
+
+	~recorded_draw_state() {
+		m_blitter->tint_color_r = m_tint[0];
+		m_blitter->tint_color_g = m_tint[1];
+		m_blitter->tint_color_b = m_tint[2];
+		m_blitter->tint_color_a = m_tint[3];
+		m_blitter->rotation = m_rotation;
+		m_blitter->crop_rect = m_crop_rect;
+	}
+
+private:
+	T *m_blitter;
+	float m_tint[4];
+	float m_rotation;
+	Image_Rect m_crop_rect;
+};
+
+void HUD_Lua_Class::draw_image_command(const command& c)
+{
+	Image_Blitter *image = static_cast<Image_Blitter *>(c.object);
+	const float tint[4] = { c.r, c.g, c.b, c.a };
+	recorded_draw_state<Image_Blitter> state(image, tint, c.t, Image_Rect(c.crop_x, c.crop_y, c.crop_w, c.crop_h));
+
+	Image_Rect r{ c.x, c.y, c.w, c.h };
     if (m_surface)
     {
         r.x += m_wr.x;
         r.y += m_wr.y;
     }
 	image->Draw(MainScreenSurface(), r);
-	SDL_SetClipRect(MainScreenSurface(), NULL);
 }
 
 void HUD_Lua_Class::draw_shape(Shape_Blitter *shape, float x, float y)
@@ -473,7 +943,33 @@ void HUD_Lua_Class::draw_shape(Shape_Blitter *shape, float x, float y)
 	if (!r.w || !r.h)
 		return;
     
-	apply_clip();
+	command c = command();
+	c.type = _command_draw_shape;
+	c.object = shape;
+	c.x = x;
+	c.y = y;
+	c.w = r.w;
+	c.h = r.h;
+	c.r = shape->tint_color_r;
+	c.g = shape->tint_color_g;
+	c.b = shape->tint_color_b;
+	c.a = shape->tint_color_a;
+	c.t = shape->rotation;
+	c.crop_x = shape->crop_rect.x;
+	c.crop_y = shape->crop_rect.y;
+	c.crop_w = shape->crop_rect.w;
+	c.crop_h = shape->crop_rect.h;
+	rotated_bounds(x, y, r.w, r.h, c.t, c.left, c.top, c.right, c.bottom);
+	record(c);
+}
+
+void HUD_Lua_Class::draw_shape_command(const command& c)
+{
+	Shape_Blitter *shape = static_cast<Shape_Blitter *>(c.object);
+	const float tint[4] = { c.r, c.g, c.b, c.a };
+	recorded_draw_state<Shape_Blitter> state(shape, tint, c.t, Image_Rect(c.crop_x, c.crop_y, c.crop_w, c.crop_h));
+
+	Image_Rect r{ c.x, c.y, c.w, c.h };
 #ifdef HAVE_OPENGL
     if (m_opengl)
     {
@@ -486,6 +982,5 @@ void HUD_Lua_Class::draw_shape(Shape_Blitter *shape, float x, float y)
         r.x += m_wr.x;
         r.y += m_wr.y;
         shape->SDL_Draw(MainScreenSurface(), r);
-		SDL_SetClipRect(MainScreenSurface(), NULL);
     }
 }
@@ -25,6 +25,8 @@ HUD_RENDERER_LUA.H
 #include "HUDRenderer.h"
 
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 struct blip_info {
 	short mtype;
@@ -49,7 +51,7 @@ class Shape_Blitter;
 class HUD_Lua_Class : public HUD_Class
 {
 public:
-	HUD_Lua_Class() : m_drawing(false) {}
+	HUD_Lua_Class() : m_partial_flush(false), m_reuse_geometry(false), m_frame_hash(0), m_last_frame_hash(0), m_drawing(false) {}
 	~HUD_Lua_Class() {}
 
 	void update_motion_sensor(short time_elapsed);
@@ -61,7 +63,6 @@ public:
 	
 	void start_draw(void);
 	void end_draw(void);
-	void apply_clip(void);
 	
 	short masking_mode(void);
 	void set_masking_mode(short masking_mode);
@@ -78,8 +79,70 @@ public:
                    float scale);
 	void draw_image(Image_Blitter *image, float x, float y);
 	void draw_shape(Shape_Blitter *shape, float x, float y);
+
+	// draws everything recorded so far, if any of it uses object; call
+	// before object is changed in ways a draw doesn't record, or deleted
+	void draw_pending(const void *object);
 	
 protected:
+	// draws are recorded as Lua makes them, then drawn by end_draw(),
+	// grouped into batches that share a texture or font; rects and text in
+	// a batch go out in one draw, images and shapes still one at a time
+	enum {
+		_command_fill_rect,
+		_command_frame_rect,
+		_command_draw_text,
+		_command_draw_image,
+		_command_draw_shape,
+		_command_set_masking_mode,
+		_command_clear_mask
+	};
+
+	struct command {
+		short type;
+		short masking_mode;
+		SDL_Rect clip;
+		float x, y, w, h;
+		float r, g, b, a;	// color, or tint for images and shapes
+		float t;		// frame thickness, text scale or rotation
+		float crop_x, crop_y, crop_w, crop_h;
+		void *object;		// the font, image or shape
+		size_t text, text_length;	// in m_text
+		float left, top, right, bottom;	// what it might cover
+	};
+
+	struct batch {
+		size_t first, count;	// in m_order
+	};
+
+	// what a batch drew with, kept for the next frame if it's the same
+	struct batch_geometry {
+		std::vector<float> vertices, texcoords, colors;
+	};
+
+	std::vector<command> m_commands;
+	std::string m_text;
+	std::vector<size_t> m_order;
+	std::vector<batch> m_batches;
+	std::vector<batch_geometry> m_geometry;
+	bool m_partial_flush;
+	bool m_reuse_geometry;
+	uint64_t m_frame_hash;
+	uint64_t m_last_frame_hash;
+	short m_drawn_masking_mode;
+
+	void record(command& c);
+	void plan_batches(void);
+	void flush(void);
+	void draw_batch(const batch& b, batch_geometry& geometry);
+	void draw_rects(const batch& b, batch_geometry& geometry);
+	void draw_text_batch(const batch& b, batch_geometry& geometry);
+	void draw_text_command(const command& c);
+	void draw_image_command(const command& c);
+	void draw_shape_command(const command& c);
+	void apply_clip(const SDL_Rect& clip);
+	void apply_masking_mode(short masking_mode);
+
 	std::vector<blip_info> m_blips;
 	bool m_drawing;
 	bool m_opengl;
@@ -536,7 +536,7 @@ static void update_fps_display(SDL_Surface *s)
 {
 	if (displaying_fps && !player_in_terminal_mode(current_player_index))
 	{
-		char fps[sizeof("1000 fps (10000 ms)")];
+		char fps[sizeof("1000 fps (10000 ms), 100000 draws (100000 buffered), 1000000 vertices, 1000.0 ms")];
 		char ms[sizeof("(10000 ms)")];
 
 		fps_counter.update();
@@ -555,6 +555,15 @@ static void update_fps_display(SDL_Surface *s)
 				ms[0] = '\0';
 			
 			sprintf(fps, "%0.f fps %s", fps_counter.get(), ms);
+
+			render_stats stats;
+			if (get_render_stats(stats))
+			{
+				size_t length = strlen(fps);
+				if (fps[length - 1] == ' ')
+					--length;
+				snprintf(fps + length, sizeof(fps) - length, ", %i draws (%i buffered, %i walls batched), %i vertices, %.1f ms", stats.draw_calls, stats.buffered_surfaces, stats.batched_walls, stats.sent_vertices, stats.milliseconds);
+			}
 		}
 
 		FontSpecifier& Font = GetOnScreenFont();
@@ -22,6 +22,8 @@ SOUND.C
 
 #include <iostream>
 #include <functional>
+#include <algorithm>
+#include <deque>
 
 #include "SoundManager.h"
 #include "ReplacementSounds.h"
@@ -61,10 +63,15 @@ public:
 	void Release(short index); // sound must be loaded
 
 private:
+	// a sound's play count is halved every this many ticks it goes
+	// unplayed, so sounds that were only popular long ago age out
+	static const uint32 HIT_HALF_LIFE = 30 * MACHINE_TICKS_PER_SECOND;
+
 	struct Entry {
-		Entry() : data(5), last_played(0) { }
+		Entry() : data(5), last_played(0), hits(0) { }
 		std::vector<std::shared_ptr<SoundData> > data;
 		uint32 last_played;
+		uint32 hits;
 
 		std::size_t size() {
 			std::size_t n = 0;
@@ -78,9 +85,14 @@ private:
 			
 			return n;
 		}
+
+		uint32 score(uint32 now) const {
+			uint32 half_lives = (now - last_played) / HIT_HALF_LIFE;
+			return half_lives >= 32 ? 0 : hits >> half_lives;
+		}
 	};
 
-	void ReleaseOldestSound();
+	void ReleaseLeastValuableSound(short keep_index);
 	std::map<short, Entry> m_entries;
 	std::size_t m_size;
 	std::size_t m_max_size;
@@ -88,15 +100,21 @@ private:
 
 void SoundMemoryManager::Add(std::shared_ptr<SoundData> data, short index, short slot)
 {
-	m_entries[index].data[slot] = data;
-	m_entries[index].last_played = machine_tick_count();
+	Entry& entry = m_entries[index];
+	if (entry.data[slot].get())
+	{
+		m_size -= entry.data[slot]->size();
+	}
+
+	entry.data[slot] = data;
+	entry.last_played = machine_tick_count();
 
 	m_size += data->size();
 
-	while (m_size > m_max_size)
+	while (m_size > m_max_size && m_entries.size() > 1)
 	{
 		std::cerr << "Size is too big (" << m_size << ">" << m_max_size << ")" << std::endl;
-		ReleaseOldestSound();
+		ReleaseLeastValuableSound(index);
 	}
 }
 
@@ -110,33 +128,241 @@ void SoundMemoryManager::Release(short index)
 	m_entries.erase(index);
 }
 
-void SoundMemoryManager::ReleaseOldestSound()
+// evict the sound with the lowest decayed play count, so frequently
+// heard weapon and monster sounds survive a burst of one-off sounds;
+// ties go to the least recently played
+void SoundMemoryManager::ReleaseLeastValuableSound(short keep_index)
 {
-	if (!m_entries.size())
+	uint32 now = machine_tick_count();
+
+	std::map<short, Entry>::iterator victim = m_entries.end();
+	uint32 victim_score = 0;
+	for (std::map<short, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		if (it->first == keep_index)
+		{
+			continue;
+		}
+
+		uint32 score = it->second.score(now);
+		if (victim == m_entries.end() ||
+		    score < victim_score ||
+		    (score == victim_score && it->second.last_played < victim->second.last_played))
+		{
+			victim = it;
+			victim_score = score;
+		}
+	}
+
+	if (victim == m_entries.end())
 	{
 		return;
 	}
-	
-	std::map<short, Entry>::iterator oldest_sound = m_entries.begin();
-	std::map<short, Entry>::iterator it = oldest_sound;
-	++it;
-	for (; it != m_entries.end(); ++it)
+
+	std::cerr << "Dropping sound " << victim->first << std::endl;
+	Release(victim->first);
+}
+
+void SoundMemoryManager::Update(short index)
+{
+	Entry& entry = m_entries[index];
+	entry.hits = entry.score(machine_tick_count()) + 1;
+	entry.last_played = machine_tick_count();
+}
+
+// Decodes external (MML / plugin) replacement sounds on a background
+// thread, so level loads don't stall on libsndfile; results are picked
+// up by the main thread in SoundManager::ProcessDecodedSounds()
+class SoundDecodeQueue {
+public:
+	struct Result {
+		short index;
+		short slot;
+		uint32 id;
+		ExternalSoundHeader header;
+		std::shared_ptr<SoundData> data;
+	};
+
+	SoundDecodeQueue();
+	~SoundDecodeQueue();
+
+	// the rest of the interface is main thread only
+	void Push(short index, short slot, const FileSpecifier& file);
+	bool IsPending(short index) const { return m_pending_slots.count(index); }
+	bool IsPending(short index, short slot) const { return m_outstanding.count(std::make_pair(index, slot)); }
+
+	// returns finished decodes that haven't been cancelled since
+	void TakeResults(std::vector<Result>& results);
+
+	void Cancel(short index);
+	void CancelAll();
+
+private:
+	struct Request {
+		short index;
+		short slot;
+		uint32 id;
+		FileSpecifier file;
+	};
+
+	static int Run(void* pv);
+
+	// shared with the decode thread
+	SDL_Thread* m_thread;
+	SDL_mutex* m_mutex;
+	SDL_cond* m_cond;
+	bool m_run;
+	std::deque<Request> m_requests;
+	std::vector<Result> m_results;
+
+	// main thread only
+	uint32 m_next_id;
+	std::map<std::pair<short, short>, uint32> m_outstanding;
+	std::map<short, int> m_pending_slots;
+};
+
+SoundDecodeQueue::SoundDecodeQueue() : m_thread(0), m_run(true), m_next_id(0)
+{
+	m_mutex = SDL_CreateMutex();
+	m_cond = SDL_CreateCond();
+	m_thread = SDL_CreateThread(Run, "SoundDecodeQueue_decodeThread", this);
+}
+
+SoundDecodeQueue::~SoundDecodeQueue()
+{
+	SDL_LockMutex(m_mutex);
+	m_run = false;
+	m_requests.clear();
+	SDL_CondSignal(m_cond);
+	SDL_UnlockMutex(m_mutex);
+
+	if (m_thread)
+	{
+		SDL_WaitThread(m_thread, NULL);
+	}
+
+	SDL_DestroyCond(m_cond);
+	SDL_DestroyMutex(m_mutex);
+}
+
+void SoundDecodeQueue::Push(short index, short slot, const FileSpecifier& file)
+{
+	auto key = std::make_pair(index, slot);
+	if (m_outstanding.count(key))
+	{
+		return;
+	}
+
+	Request request;
+	request.index = index;
+	request.slot = slot;
+	request.id = ++m_next_id;
+	request.file = file;
+
+	m_outstanding[key] = request.id;
+	++m_pending_slots[index];
+
+	SDL_LockMutex(m_mutex);
+	m_requests.push_back(request);
+	SDL_CondSignal(m_cond);
+	SDL_UnlockMutex(m_mutex);
+}
+
+void SoundDecodeQueue::TakeResults(std::vector<Result>& results)
+{
+	results.clear();
+	if (m_outstanding.empty())
+	{
+		return;
+	}
+
+	SDL_LockMutex(m_mutex);
+	results.swap(m_results);
+	SDL_UnlockMutex(m_mutex);
+
+	// drop results for requests that were cancelled while decoding
+	auto it = std::remove_if(results.begin(), results.end(), [this](const Result& result) {
+		auto outstanding = m_outstanding.find(std::make_pair(result.index, result.slot));
+		if (outstanding == m_outstanding.end() || outstanding->second != result.id)
+		{
+			return true;
+		}
+
+		m_outstanding.erase(outstanding);
+		if (--m_pending_slots[result.index] == 0)
+		{
+			m_pending_slots.erase(result.index);
+		}
+		return false;
+	});
+	results.erase(it, results.end());
+}
+
+void SoundDecodeQueue::Cancel(short index)
+{
+	if (!m_pending_slots.erase(index))
 	{
-		if (it->second.last_played < oldest_sound->second.last_played)
+		return;
+	}
+
+	for (auto it = m_outstanding.begin(); it != m_outstanding.end(); )
+	{
+		if (it->first.first == index)
+		{
+			it = m_outstanding.erase(it);
+		}
+		else
 		{
-			oldest_sound = it;
+			++it;
 		}
 	}
 
-	std::cerr << "Dropping sound " << oldest_sound->first << std::endl;
-	Release(oldest_sound->first);
+	SDL_LockMutex(m_mutex);
+	m_requests.erase(std::remove_if(m_requests.begin(), m_requests.end(), [index](const Request& request) { return request.index == index; }), m_requests.end());
+	SDL_UnlockMutex(m_mutex);
 }
 
-void SoundMemoryManager::Update(short index)
+void SoundDecodeQueue::CancelAll()
 {
-	m_entries[index].last_played = machine_tick_count();
+	m_outstanding.clear();
+	m_pending_slots.clear();
+
+	SDL_LockMutex(m_mutex);
+	m_requests.clear();
+	m_results.clear();
+	SDL_UnlockMutex(m_mutex);
 }
 
+int SoundDecodeQueue::Run(void* pv)
+{
+	SoundDecodeQueue* queue = reinterpret_cast<SoundDecodeQueue*>(pv);
+
+	SDL_LockMutex(queue->m_mutex);
+	while (queue->m_run)
+	{
+		if (queue->m_requests.empty())
+		{
+			SDL_CondWait(queue->m_cond, queue->m_mutex);
+			continue;
+		}
+
+		Request request = queue->m_requests.front();
+		queue->m_requests.pop_front();
+		SDL_UnlockMutex(queue->m_mutex);
+
+		Result result;
+		result.index = request.index;
+		result.slot = request.slot;
+		result.id = request.id;
+		result.data = result.header.LoadExternal(request.file);
+
+		SDL_LockMutex(queue->m_mutex);
+		queue->m_results.push_back(result);
+	}
+	SDL_UnlockMutex(queue->m_mutex);
+
+	return 0;
+}
 
 static void Shutdown()
 {
@@ -158,6 +384,7 @@ void SoundManager::Initialize(const Parameters& new_parameters)
 		parameters.flags = 0;
 		initialized = true;
 		active = false;
+		decode_queue = new SoundDecodeQueue;
 		SetParameters(new_parameters);
 	}
 }
@@ -175,6 +402,8 @@ void SoundManager::SetParameters(const Parameters& parameters)
 void SoundManager::Shutdown()
 {
 	instance()->SetStatus(false);
+	delete instance()->decode_queue;
+	instance()->decode_queue = nullptr;
 	instance()->CloseSoundFile();
 }
 
@@ -242,6 +471,22 @@ bool SoundManager::LoadSound(short sound_index)
 {
 	if (!active) return false;
 
+	ProcessDecodedSounds();
+	if (decode_queue && decode_queue->IsPending(sound_index))
+	{
+		// don't stall the game waiting on the decode thread; whatever
+		// permutations aren't ready yet simply won't play
+		if (!sounds->IsLoaded(sound_index)) return false;
+
+		sounds->Update(sound_index);
+		return true;
+	}
+
+	return LoadSound(sound_index, false);
+}
+
+bool SoundManager::LoadSound(short sound_index, bool async)
+{
 	SoundDefinition *definition = GetSoundDefinition(sound_index);
 	if (!definition) return false;
 
@@ -267,16 +512,25 @@ bool SoundManager::LoadSound(short sound_index)
 	{
 		for (int i = 0; i < NumSlots; ++i)
 		{
-			auto p = sound_file->GetSoundData(definition, i);
+			std::shared_ptr<SoundData> p;
 
 			SoundOptions *SndOpts = SoundReplacements::instance()->GetSoundOptions(sound_index, i);
 			if (SndOpts)
 			{
-				auto x = SndOpts->Sound.LoadExternal(SndOpts->File);
-				if (x.get()) 
+				if (async && decode_queue)
 				{
-					p = x;
+					// ProcessDecodedSounds() falls back to the
+					// sounds file if this fails to decode
+					decode_queue->Push(sound_index, i, SndOpts->File);
+					continue;
 				}
+
+				p = SndOpts->Sound.LoadExternal(SndOpts->File);
+			}
+
+			if (!p.get())
+			{
+				p = sound_file->GetSoundData(definition, i);
 			}
 
 			if (p.get())
@@ -286,14 +540,53 @@ bool SoundManager::LoadSound(short sound_index)
 		}
 	}
 
-	return sounds->IsLoaded(sound_index);
+	return sounds->IsLoaded(sound_index) || (decode_queue && decode_queue->IsPending(sound_index));
 }
 
 void SoundManager::LoadSounds(short *sounds, short count)
 {
+	if (!active) return;
+
+	ProcessDecodedSounds();
 	for (short i = 0; i < count; i++)
 	{
-		LoadSound(sounds[i]);
+		if (sounds[i] != NONE)
+		{
+			LoadSound(sounds[i], true);
+		}
+	}
+}
+
+void SoundManager::ProcessDecodedSounds()
+{
+	if (!decode_queue) return;
+
+	std::vector<SoundDecodeQueue::Result> results;
+	decode_queue->TakeResults(results);
+
+	for (auto& result : results)
+	{
+		std::shared_ptr<SoundData> p = result.data;
+
+		SoundOptions *SndOpts = SoundReplacements::instance()->GetSoundOptions(result.index, result.slot);
+		if (SndOpts)
+		{
+			SndOpts->Sound = result.header;
+		}
+
+		if (!p.get())
+		{
+			SoundDefinition *definition = GetSoundDefinition(result.index);
+			if (definition)
+			{
+				p = sound_file->GetSoundData(definition, result.slot);
+			}
+		}
+
+		if (p.get())
+		{
+			sounds->Add(p, result.index, result.slot);
+		}
 	}
 }
 
@@ -309,6 +602,10 @@ void SoundManager::StopSound(short identifier, short sound_index)
 void SoundManager::UnloadSound(short sound_index)
 {
 	StopSound(NONE, sound_index);
+	if (decode_queue)
+	{
+		decode_queue->Cancel(sound_index);
+	}
 	if (sounds->IsLoaded(sound_index))
 	{
 		sounds->Release(sound_index);
@@ -317,6 +614,10 @@ void SoundManager::UnloadSound(short sound_index)
 
 void SoundManager::UnloadAllSounds()
 {
+	if (decode_queue)
+	{
+		decode_queue->CancelAll();
+	}
 	if (active)
 	{
 		sounds->Clear();
@@ -483,7 +784,10 @@ void SoundManager::UpdateListener() {
 
 void SoundManager::Idle()
 {
-	if (!active || OpenALManager::Get()->IsPaused()) return;
+	if (!active) return;
+
+	ProcessDecodedSounds();
+	if (OpenALManager::Get()->IsPaused()) return;
 
 	UpdateListener();
 	CauseAmbientSoundSourceUpdate();
@@ -715,7 +1019,7 @@ bool SoundManager::Parameters::Verify()
 	return true;
 }
 
-SoundManager::SoundManager() : active(false), initialized(false), sounds(new SoundMemoryManager(10 << 20)) 
+SoundManager::SoundManager() : active(false), initialized(false), sounds(new SoundMemoryManager(10 << 20)), decode_queue(nullptr)
 { 
 	
 }
@@ -727,6 +1031,7 @@ void SoundManager::SetStatus(bool active)
 	if (active) 
 	{
 		sounds->Clear();
+		if (decode_queue) decode_queue->CancelAll();
 		uint32 total_buffer_size;
 
 		if (parameters.flags & _more_sounds_flag)
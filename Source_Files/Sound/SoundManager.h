@@ -32,6 +32,7 @@
 struct ambient_sound_data;
 
 class SoundMemoryManager;
+class SoundDecodeQueue;
 
 class SoundManager
 {
@@ -62,6 +63,7 @@ public:
 	bool AdjustVolumeDown(short sound_index = NONE);
 
 	bool LoadSound(short sound);
+	// external replacement sounds are decoded in the background
 	void LoadSounds(short *sounds, short count);
 
 	void UnloadSound(short sound);
@@ -127,6 +129,8 @@ private:
 	SoundManager();
 	void SetStatus(bool active);
 	SoundDefinition* GetSoundDefinition(short sound_index);
+	bool LoadSound(short sound_index, bool async);
+	void ProcessDecodedSounds();
 	std::shared_ptr<SoundPlayer> BufferSound(SoundParameters& parameters);
 	float CalculatePitchModifier(short sound_index, _fixed pitch_modifier);
 	void AngleAndVolumeToStereoVolume(angle delta, short volume, short *right_volume, short *left_volume);
@@ -148,6 +152,7 @@ private:
 	
 	std::unique_ptr<SoundFile> sound_file;
 	SoundMemoryManager* sounds;
+	SoundDecodeQueue* decode_queue;
 
 	// buffer sizes
 	static const int MINIMUM_SOUND_BUFFER_SIZE = 300*KILO;
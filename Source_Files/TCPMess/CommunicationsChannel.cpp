@@ -43,26 +43,31 @@
 #define NOMINMAX
 #endif
 #include <winsock2.h> // hacky non-cross-platform setting of nonblocking
+#define poll WSAPoll
 #else
 #include <fcntl.h> // hacky non-cross-platform setting of nonblocking
+#include <poll.h>
 #endif
 #include <algorithm>
+#include <climits>
 
 enum
 {
 	// If any incoming message claims to be longer than this, we bail
 	kMaximumMessageLength = 4 * 1024 * 1024,
 
-	// Milliseconds we wait between pump() calls during receive[Specific]Message()
-	kSSRPumpInterval = 50,
-
-	// Milliseconds we wait between pump() calls during flushOutgoingMessages()
-	kFlushPumpInterval = kSSRPumpInterval,
 };
 
-// if you really want to read what this does, scroll down
+// if you really want to read what these do, scroll down
+static int TCPsocketDescriptor(TCPsocket socket);
 static void MakeTCPsocketNonBlocking(TCPsocket *socket); 
 
+// ticks from now until inDeadline, or 0 if it's passed
+static Uint32 ticksUntil(Uint32 inDeadline, Uint32 inNow)
+{
+	return inDeadline > inNow ? inDeadline - inNow : 0;
+}
+
 CommunicationsChannel::CommunicationsChannel()
 	: mConnected(false),
 	mSocket(NULL),
@@ -542,12 +547,14 @@ CommunicationsChannel::receiveMessage(Uint32 inOverallTimeout, Uint32 inInactivi
 
 	pump();
 
-	while(machine_tick_count() - std::max(mTicksAtLastReceive, theTicksAtStart) < inInactivityTimeout
-		&& machine_tick_count() < theDeadline
-		&& isConnected()
-		&& mIncomingMessages.empty())
+	while(isConnected() && mIncomingMessages.empty())
 	{
-		sleep_for_machine_ticks(kSSRPumpInterval);
+		Uint32 theNow = machine_tick_count();
+		Uint32 theInactivity = theNow - std::max(mTicksAtLastReceive, theTicksAtStart);
+		if(theInactivity >= inInactivityTimeout || theNow >= theDeadline)
+			break;
+
+		waitForActivity(std::vector<CommunicationsChannel*>(1, this), std::min(theDeadline - theNow, inInactivityTimeout - theInactivity));
 		pump();
 	}
 
@@ -577,7 +584,7 @@ CommunicationsChannel::receiveSpecificMessage(
 
 	while(machine_tick_count() < theDeadline)
 	{
-		theMessage = receiveMessage(theDeadline - machine_tick_count(), inInactivityTimeout);
+		theMessage = receiveMessage(ticksUntil(theDeadline, machine_tick_count()), inInactivityTimeout);
 		
 		if(theMessage)
 		{
@@ -613,12 +620,14 @@ CommunicationsChannel::flushOutgoingMessages(bool shouldDispatchIncomingMessages
 	Uint32	theDeadline = machine_tick_count() + inOverallTimeout;
 	Uint32	theTicksAtStart = machine_tick_count();
 
-	while(isConnected()
-		&& !mOutgoingMessages.empty()
-		&& machine_tick_count() < theDeadline
-		&& machine_tick_count() - std::max(mTicksAtLastSend, theTicksAtStart) < inInactivityTimeout)
+	while(isConnected() && !mOutgoingMessages.empty())
 	{
-		sleep_for_machine_ticks(kFlushPumpInterval);
+		Uint32 theNow = machine_tick_count();
+		Uint32 theInactivity = theNow - std::max(mTicksAtLastSend, theTicksAtStart);
+		if(theInactivity >= inInactivityTimeout || theNow >= theDeadline)
+			break;
+
+		waitForActivity(std::vector<CommunicationsChannel*>(1, this), std::min(theDeadline - theNow, inInactivityTimeout - theInactivity));
 		pump();
 		if(shouldDispatchIncomingMessages)
 			dispatchIncomingMessages();
@@ -635,31 +644,80 @@ void CommunicationsChannel::multipleFlushOutgoingMessages(
 	Uint32 theDeadline = machine_tick_count() + inOverallTimeout;
 	Uint32 theTicksAtStart = machine_tick_count();
 
-	bool someoneIsStillActive = true;
-
-	while (machine_tick_count() < theDeadline && someoneIsStillActive)
+	while (true)
 	{
-		someoneIsStillActive = false;
+		for (std::vector<CommunicationsChannel*>::iterator it = channels.begin(); it != channels.end(); it++)
+		{
+			(*it)->pump();
+			if (shouldDispatchIncomingMessages)
+				(*it)->dispatchIncomingMessages();
+		}
 
-		sleep_for_machine_ticks(kFlushPumpInterval);
+		// wait only on the channels that still have something to send, until
+		// one of them can make progress or in time to notice its inactivity
+		Uint32 theNow = machine_tick_count();
+		if (theNow >= theDeadline)
+			break;
 
+		std::vector<CommunicationsChannel*> theActiveChannels;
+		Uint32 theWait = theDeadline - theNow;
 		for (std::vector<CommunicationsChannel*>::iterator it = channels.begin(); it != channels.end(); it++)
 		{
-			if (!(*it)->mOutgoingMessages.empty() && machine_tick_count() - std::max((*it)->mTicksAtLastSend, theTicksAtStart) < inInactivityTimeout)
+			Uint32 theInactivity = theNow - std::max((*it)->mTicksAtLastSend, theTicksAtStart);
+			if ((*it)->isConnected() && !(*it)->mOutgoingMessages.empty() && theInactivity < inInactivityTimeout)
 			{
-				someoneIsStillActive = true;
+				theActiveChannels.push_back(*it);
+				theWait = std::min(theWait, inInactivityTimeout - theInactivity);
 			}
-
-			(*it)->pump();
-			if (shouldDispatchIncomingMessages)
-				(*it)->dispatchIncomingMessages();
 		}
 
+		if (theActiveChannels.empty())
+			break;
+
+		waitForActivity(theActiveChannels, theWait);
 	}
 
 }
 
 
+bool
+CommunicationsChannel::waitForActivity(const std::vector<CommunicationsChannel*>& inChannels,
+	Uint32 inTimeout,
+	const CommunicationsChannelFactory* inServer)
+{
+	std::vector<pollfd> theDescriptors;
+	theDescriptors.reserve(inChannels.size() + 1);
+
+	for (std::vector<CommunicationsChannel*>::const_iterator it = inChannels.begin(); it != inChannels.end(); it++)
+	{
+		if (!(*it)->isConnected())
+			continue;
+
+		pollfd theDescriptor = {};
+		theDescriptor.fd = TCPsocketDescriptor((*it)->mSocket);
+		theDescriptor.events = POLLIN;
+		if (!(*it)->mOutgoingMessages.empty())
+			theDescriptor.events |= POLLOUT;
+		theDescriptors.push_back(theDescriptor);
+	}
+
+	if (inServer && inServer->isFunctional())
+	{
+		pollfd theDescriptor = {};
+		theDescriptor.fd = TCPsocketDescriptor(inServer->mSocket);
+		theDescriptor.events = POLLIN;
+		theDescriptors.push_back(theDescriptor);
+	}
+
+	// (nothing could wake us)
+	if (theDescriptors.empty())
+		return false;
+
+	return poll(theDescriptors.data(), theDescriptors.size(), static_cast<int>(std::min<Uint32>(inTimeout, INT_MAX))) > 0;
+}
+
+
+
 CommunicationsChannelFactory::CommunicationsChannelFactory(uint16 inPort)
 {
 	IPaddress theAddress;
@@ -700,16 +758,20 @@ CommunicationsChannelFactory::~CommunicationsChannelFactory()
 	SDLNet_TCP_Close(mSocket);
 }
 
-void MakeTCPsocketNonBlocking(TCPsocket *socket) {
-  // SET NONBLOCKING MODE
-  // XXX: this depends on intimate carnal knowledge of the SDL_net struct _UDPsocket
+int TCPsocketDescriptor(TCPsocket socket) {
+  // XXX: this depends on intimate carnal knowledge of the SDL_net struct _TCPsocket
   // if it changes that structure, we are hosed.
 
 #ifdef WIN64
-  int fd = ((int *) (*socket))[2];
+  return ((int *) socket)[2];
 #else
-  int fd = ((int *) (*socket))[1];
+  return ((int *) socket)[1];
 #endif
+}
+
+void MakeTCPsocketNonBlocking(TCPsocket *socket) {
+  // SET NONBLOCKING MODE
+  int fd = TCPsocketDescriptor(*socket);
 #if defined(WIN32)
   u_long val = 1;
   ioctlsocket(fd, FIONBIO, &val);
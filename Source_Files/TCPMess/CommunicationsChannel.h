@@ -55,6 +55,7 @@ public:
 
 class MessageInflater;
 class MessageHandler;
+class CommunicationsChannelFactory;
 
 
 class CommunicationsChannel
@@ -164,12 +165,23 @@ public:
 		bool dispatchIncomingMessages,
 		Uint32 inOverallTimeout = kOutgoingInactivityTimeout,
 		Uint32 inInactivityTimeout = kOutgoingInactivityTimeout);
+
+	// Sleeps until one of the channels has incoming data (or has been closed), or
+	// can take some of the outgoing data it has queued, or a connection is waiting
+	// on inServer - or until inTimeout ms pass.  Returns false if it timed out.
+	// Nothing is pumped; the caller does that for whoever it's interested in.
+	static bool	waitForActivity(const std::vector<CommunicationsChannel*>& inChannels,
+		Uint32 inTimeout,
+		const CommunicationsChannelFactory* inServer = NULL);
 	
 	// Copies the given message (or at least its bytes) to make use less error-prone
 	void		enqueueOutgoingMessage(const Message& inMessage);
 
 	bool		isConnected() const { return mConnected; }
 
+	// messages enqueued but not yet wholly handed to TCP
+	size_t		outgoingMessageCount() const { return mOutgoingMessages.size(); }
+
 	// inPort should be in host byte order
 	void		connect(const std::string& inAddressString, Uint16 inPort);
 
@@ -254,6 +266,7 @@ public:
 	~CommunicationsChannelFactory();
 	
 private:
+	friend class CommunicationsChannel; // waitForActivity()
 	TCPsocket	mSocket;
 };
 
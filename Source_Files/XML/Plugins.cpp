@@ -33,6 +33,11 @@
 #include "InfoTree.h"
 #include "XML_ParseTreeRoot.h"
 #include "Scenario.h"
+
+#ifdef HAVE_ZZIP
+#include "ZipArchive.h"
+#endif
+
 #ifdef HAVE_STEAM
 #include "steamshim_child.h"
 #endif
@@ -85,35 +90,23 @@ bool Plugin::valid() const {
 	return !overridden;
 }
 
-bool Plugin::get_resource(uint32_t checksum, uint32_t type, int id, LoadedResource& rsrc) const
+bool Plugin::read_resource(const std::string& path, LoadedResource& rsrc) const
 {
-	for (auto it = map_patches.rbegin(); it != map_patches.rend(); ++it)
+	ScopedSearchPath ssp(directory);
+	FileSpecifier file;
+	if (file.SetNameWithPath(path.c_str()))
 	{
-		if (it->parent_checksums.count(checksum))
+		OpenedFile ofile;
+		if (file.Open(ofile))
 		{
-			auto key = std::make_pair(type, id);
-			auto rsrc_it = it->resource_map.find(key);
-			if (rsrc_it != it->resource_map.end())
+			int32 length;
+			if (ofile.GetLength(length))
 			{
-				auto path = rsrc_it->second;
-				ScopedSearchPath ssp(directory);
-				FileSpecifier file;
-				if (file.SetNameWithPath(path.c_str()))
-				{
-					OpenedFile ofile;
-					if (file.Open(ofile))
-					{
-						int32 length;
-						if (ofile.GetLength(length))
-						{
-							void *data = malloc(length);
-							ofile.Read(length, data);
-							rsrc.SetData(data, length);
-							
-							return true;
-						}
-					}
-				}
+				void *data = malloc(length);
+				ofile.Read(length, data);
+				rsrc.SetData(data, length);
+
+				return true;
 			}
 		}
 	}
@@ -135,6 +128,7 @@ bool Plugins::disable(const boost::filesystem::path& path) { //std path is not s
 		if (it->directory.GetPath() == path) {
 			it->enabled = false;
 			m_validated = false;
+			m_resource_index_valid = false;
 			return true;
 		}
 	}
@@ -150,6 +144,7 @@ bool Plugins::enable(const boost::filesystem::path& path)
 		{
 			p.enabled = true;
 			m_validated = false;
+			m_resource_index_valid = false;
 			return true;
 		}
 	}
@@ -160,18 +155,25 @@ bool Plugins::enable(const boost::filesystem::path& path)
 static void load_mmls(const Plugin& plugin, bool load_menu_mml_only)
 {
 	ScopedSearchPath ssp(plugin.directory);
+	std::vector<FileSpecifier> files;
 	for (std::vector<std::string>::const_iterator it = plugin.mmls.begin(); it != plugin.mmls.end(); ++it) 
 	{
 		FileSpecifier file;
 		if (file.SetNameWithPath(it->c_str()))
 		{
-			ParseMMLFromFile(file, load_menu_mml_only);
+			files.push_back(file);
 		}
 		else
 		{
 			logWarning("%s Plugin: %s not found; ignoring", plugin.name.c_str(), it->c_str());
 		}
 	}
+
+	FileSpecifier::Prefetch(files);
+	for (auto& file : files)
+	{
+		ParseMMLFromFile(file, load_menu_mml_only);
+	}
 }
 
 void Plugins::load_mml(bool load_menu_mml_only) {
@@ -197,6 +199,7 @@ void Plugins::load_shapes_patches(bool is_opengl)
 		{
 			ScopedSearchPath ssp(it->directory);
 
+			std::vector<FileSpecifier> files;
 			for (std::vector<ShapesPatch>::iterator shapes_patch = it->shapes_patches.begin(); shapes_patch != it->shapes_patches.end(); ++shapes_patch)
 			{
 				if (is_opengl || !shapes_patch->requires_opengl)
@@ -204,12 +207,7 @@ void Plugins::load_shapes_patches(bool is_opengl)
 					FileSpecifier file;
 					if (file.SetNameWithPath(shapes_patch->path.c_str()))
 					{
-						OpenedFile ofile;
-						if (file.Open(ofile))
-						{
-							load_shapes_patch(ofile.GetRWops(), false);
-						}
-						
+						files.push_back(file);
 					}
 					else
 					{
@@ -217,6 +215,16 @@ void Plugins::load_shapes_patches(bool is_opengl)
 					}
 				}
 			}
+
+			FileSpecifier::Prefetch(files);
+			for (auto& file : files)
+			{
+				OpenedFile ofile;
+				if (file.Open(ofile))
+				{
+					load_shapes_patch(ofile.GetRWops(), false);
+				}
+			}
 		}
 	}
 }
@@ -495,6 +503,11 @@ void Plugins::enumerate() {
 	logContext("parsing plugins");
 	PluginLoader loader;
 
+#ifdef HAVE_ZZIP
+	// archives may have been added, removed or replaced since last time
+	ZipArchive::FlushCache();
+#endif
+
 #ifdef HAVE_STEAM
 	for (const auto& item : subscribed_workshop_items)
 	{
@@ -513,26 +526,52 @@ void Plugins::enumerate() {
 	std::sort(m_plugins.begin(), m_plugins.end());
 	clear_game_error();
 	m_validated = false;
+	m_resource_index_valid = false;
 }
 
-bool Plugins::get_resource(uint32_t type, int id, LoadedResource& rsrc)
+// later plugins, and later patches within a plugin, take precedence
+void Plugins::build_resource_index()
 {
-	for (auto it = m_plugins.rbegin(); it != m_plugins.rend(); ++it)
+	m_resource_index.clear();
+
+	for (size_t i = m_plugins.size(); i-- > 0; )
 	{
-		if (it->enabled &&
-			it->compatible() &&
-			it->get_resource(m_map_checksum, type, id, rsrc))
+		const Plugin& plugin = m_plugins[i];
+		if (!plugin.enabled || !plugin.compatible())
+			continue;
+
+		for (auto it = plugin.map_patches.rbegin(); it != plugin.map_patches.rend(); ++it)
 		{
-			return true;
+			if (!it->parent_checksums.count(m_map_checksum))
+				continue;
+
+			for (auto& resource : it->resource_map)
+			{
+				// emplace won't replace a higher precedence entry
+				m_resource_index.emplace(resource.first, std::make_pair(i, resource.second));
+			}
 		}
 	}
 
-	return false;
+	m_resource_index_valid = true;
+}
+
+bool Plugins::get_resource(uint32_t type, int id, LoadedResource& rsrc)
+{
+	if (!m_resource_index_valid)
+		build_resource_index();
+
+	auto it = m_resource_index.find(std::make_pair(type, id));
+	if (it == m_resource_index.end())
+		return false;
+
+	return m_plugins[it->second.first].read_resource(it->second.second, rsrc);
 }
 
 void Plugins::set_map_checksum(uint32_t checksum)
 {
 	m_map_checksum = checksum;
+	m_resource_index_valid = false;
 
 	// Prepend any plugins with patches that use this checksum to the search
 	// path. This isn't the ideal solution: ideally, MML and Lua should use the
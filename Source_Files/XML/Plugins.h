@@ -31,6 +31,7 @@
 #include <vector>
 
 #include <boost/filesystem.hpp>
+#include <boost/unordered_map.hpp>
 
 #include "FileHandler.h"
 
@@ -78,7 +79,7 @@ struct Plugin {
 		return name < other.name;
 	}
 
-	bool get_resource(uint32_t checksum, uint32_t type, int id, LoadedResource& rsrc) const;
+	bool read_resource(const std::string& path, LoadedResource& rsrc) const;
 };
 
 class Plugins {
@@ -90,7 +91,7 @@ public:
 	enum GameMode { kMode_Menu, kMode_Solo, kMode_Net };
 	
 	void enumerate();
-	void invalidate() { m_validated = false; }
+	void invalidate() { m_validated = false; m_resource_index_valid = false; }
 	void set_mode(GameMode mode) { m_mode = mode; }
 	GameMode mode() { return m_mode; }
 	void load_mml(bool load_menu_mml_only);
@@ -115,6 +116,7 @@ private:
 
 	void add(const Plugin& plugin) { m_plugins.push_back(plugin); }
 	void validate();
+	void build_resource_index();
 
 	std::vector<Plugin> m_plugins;
 	bool m_validated = false;
@@ -123,6 +125,10 @@ private:
 	std::stack<ScopedSearchPath, std::list<ScopedSearchPath>> m_search_paths;
 
 	uint32_t m_map_checksum;
+
+	// (type, id) -> (index into m_plugins, path within the plugin)
+	boost::unordered_map<MapPatch::resource_key_t, std::pair<size_t, std::string>> m_resource_index;
+	bool m_resource_index_valid = false;
 };
 
 
@@ -417,6 +417,7 @@ size_t saved_game_was_networked(FileSpecifier& saved_game)
 
 bool load_quick_save_dialog(FileSpecifier& saved_game)
 {
+    wait_for_save_game_file();
     QuickSaves::instance()->enumerate();
 
     dialog d;
@@ -499,12 +500,13 @@ bool load_quick_save_dialog(FileSpecifier& saved_game)
 extern SDL_Surface *draw_surface;
 extern bool OGL_MapActive;
 
-static bool build_map_preview(std::ostringstream& ostream)
+// draws the overhead map; this has to happen on the main thread
+static std::shared_ptr<SDL_Surface> render_map_preview()
 {
     SDL_Rect r = {0, 0, RENDER_WIDTH, RENDER_HEIGHT};
     SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, r.w, r.h, 32, 0xff0000, 0x00ff00, 0x0000ff, 0);
     if (!surface)
-        return false;
+        return nullptr;
 	
     SDL_FillRect(surface, &r, SDL_MapRGB(surface->format, 0, 0, 0));
 	
@@ -526,6 +528,16 @@ static bool build_map_preview(std::ostringstream& ostream)
     OGL_MapActive = old_OGL_MapActive;
     _restore_port();
 	
+    return std::shared_ptr<SDL_Surface>(surface, SDL_FreeSurface);
+}
+
+// compresses the preview; this can happen on any thread
+static std::string encode_map_preview(SDL_Surface *surface)
+{
+    if (!surface)
+        return std::string();
+	
+    std::ostringstream ostream;
     SDL_RWops *rwops = SDL_RWFromOStream(ostream);
 //#if defined(HAVE_PNG) && defined(HAVE_SDL_IMAGE)
 //    int ret = aoIMG_SavePNG_RW(rwops, surface, IMG_COMPRESS_DEFAULT, NULL, 0);
@@ -534,10 +546,9 @@ static bool build_map_preview(std::ostringstream& ostream)
 #else
     int ret = SDL_SaveBMP_RW(surface, rwops, false);
 #endif
-    SDL_FreeSurface(surface);
     SDL_RWclose(rwops);
 	
-    return (ret == 0);
+    return (ret == 0) ? ostream.str() : std::string();
 }
 
 std::string build_save_metadata(QuickSave& save)
@@ -656,7 +667,7 @@ void create_updated_save(QuickSave& save)
 	}
 }
 
-bool create_quick_save(void)
+bool create_quick_save(std::function<void(bool)> on_complete)
 {
     QuickSave save;
 
@@ -691,13 +702,15 @@ bool create_quick_save(void)
     save.save_file.AddPart(base + ".sgaA");
 	
     std::string metadata = build_save_metadata(save);
-    std::ostringstream image_stream;
-    bool success = build_map_preview(image_stream);
-    success = save_game_file(save.save_file, metadata, image_stream.str());
-    
-    if (success)
-        QuickSaves::instance()->delete_surplus_saves(environment_preferences->maximum_quick_saves);
-    return success;
+    std::shared_ptr<SDL_Surface> preview = render_map_preview();
+    return save_game_file(save.save_file, metadata,
+                          [preview]() { return encode_map_preview(preview.get()); },
+                          [on_complete](bool success) {
+                              if (success)
+                                  QuickSaves::instance()->delete_surplus_saves(environment_preferences->maximum_quick_saves);
+                              if (on_complete)
+                                  on_complete(success);
+                          });
 }
 
 bool delete_quick_save(QuickSave& save)
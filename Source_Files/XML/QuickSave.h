@@ -24,6 +24,7 @@
 #define QUICK_SAVE_H
 
 #include "FileHandler.h"
+#include <functional>
 #include <string>
 #include <vector>
 #include <time.h>
@@ -63,7 +64,9 @@ private:
     std::vector<QuickSave> m_saves;
 };
 
-bool create_quick_save(void);
+// the file is written in the background; on_complete is called from the
+// main thread once it has landed
+bool create_quick_save(std::function<void(bool)> on_complete = nullptr);
 bool delete_quick_save(QuickSave& save);
 bool load_quick_save_dialog(FileSpecifier& saved_game);
 size_t saved_game_was_networked(FileSpecifier& saved_game);
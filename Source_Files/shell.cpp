@@ -50,6 +50,8 @@
 #include "interface_menus.h"
 #include "weapons.h"
 #include "lua_script.h"
+#include "lua_collector.h"
+#include "lua_profiler.h"
 
 #include "Crosshairs.h"
 #include "OGL_Render.h"
@@ -602,6 +604,8 @@ void initialize_application(void)
 
 void shutdown_application(void)
 {
+	L_Profiler_Stop();
+	wait_for_save_game_file();
 	WadImageCache::instance()->save_cache();
 
 	shutdown_dialogs();
@@ -730,6 +734,11 @@ short get_level_number_from_user(void)
 }
 
 const uint32 TICKS_BETWEEN_EVENT_POLL = 16; // 60 Hz
+
+// Lua garbage collection, in microseconds per pass: out of time we'd
+// otherwise sleep, or when there's none to spare
+const int LUA_COLLECTOR_IDLE_BUDGET = 500;
+const int LUA_COLLECTOR_MINIMUM_BUDGET = 100;
 void main_event_loop(void)
 {
 	uint32 last_event_poll = 0;
@@ -824,10 +833,19 @@ void main_event_loop(void)
 
 			if (desired_elapsed_machine_ticks - elapsed_machine_ticks > desired_elapsed_machine_ticks / 3)
 			{
+				L_Collector_Step(LUA_COLLECTOR_IDLE_BUDGET);
 				sleep_for_machine_ticks(1);
 			}
+			else
+			{
+				L_Collector_Step(LUA_COLLECTOR_MINIMUM_BUDGET);
+			}
 		}
-		else if (game_state != _game_in_progress)
+		else if (game_state == _game_in_progress)
+		{
+			L_Collector_Step(LUA_COLLECTOR_MINIMUM_BUDGET);
+		}
+		else
 		{
 			static auto last_redraw = 0;
 			if (machine_tick_count() > last_redraw + TICKS_PER_SECOND / 30)
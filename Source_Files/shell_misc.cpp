@@ -41,6 +41,7 @@ bool chat_input_mode = false;
 #include "vbl.h"
 #include "player.h"
 #include "Music.h"
+#include "game_wad.h"
 #include "items.h"
 #include "TextStrings.h"
 #include "InfoTree.h"
@@ -65,6 +66,7 @@ void global_idle_proc(void)
 {
 	Music::instance()->Idle();
 	SoundManager::instance()->Idle();
+	idle_save_game_file();
 }
 
 /*
@@ -95,6 +95,7 @@ static const std::vector<ShellOptionsFlag> shell_options_flags {
 	{"m", "nogamma", "Disable gamma table effects (menu fades)", shell_options.nogamma},
 	{"j", "nojoystick", "Do not initialize joysticks", shell_options.nojoystick},
 	{"i", "insecure_lua", "", shell_options.insecure_lua},
+	{"", "lua-profile", "Profile Lua scripts; write Lua Profile.txt to the log directory on quit", shell_options.lua_profile},
 	{"Q", "skip-intro", "Skip intro screens", shell_options.skip_intro},
 	{"e", "editor", "Use editor prefs; jump directly to map", shell_options.editor},
 	{"", "no-chooser", "Disable the scenario chooser", shell_options.no_chooser}
@@ -16,6 +16,7 @@ struct ShellOptions {
 	bool debug;
 	bool nojoystick;
 	bool insecure_lua;
+	bool lua_profile;
 
 	bool force_fullscreen;
 	bool force_windowed;
@@ -0,0 +1,171 @@
+#include "FileHandler.h"
+#include "shell_options.h"
+#include "AStream.h"
+#include "ActionFlagsCodec.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+
+extern ShellOptions shell_options;
+
+// film layout (see vbl.cpp): a header, then chunks of each player's flags as
+// runs of (int16 count, uint32 flags), until a run with the end indicator count
+static const int kFilmHeaderSize = 352;
+static const int kFilmPlayerCountOffset = 4;
+static const int kFilmChunkSize = 256;
+static const int kFilmEndOfRecording = kFilmChunkSize + 1;
+
+// the most a hub recovery send covers (4 * 15 ticks of latency)
+static const int kWindowTicks = 60;
+
+static std::vector<std::string> get_films(std::string& directory_path) {
+
+	FileSpecifier directory = directory_path;
+
+	std::vector<dir_entry> entries;
+	directory.ReadDirectory(entries);
+
+	std::vector<std::string> results;
+	for (std::vector<dir_entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+
+		FileSpecifier entry = directory + it->name;
+		std::string entry_path = entry.GetPath();
+
+		if (entry.IsDir()) {
+			auto sub_films = get_films(entry_path);
+			results.insert(results.end(), sub_films.begin(), sub_films.end());
+		}
+		else if (entry.GetType() == _typecode_film) {
+			results.push_back(entry_path);
+		}
+	}
+
+	return results;
+}
+
+// each player's flags, one per tick
+static std::vector<std::vector<uint32>> read_film_flags(const std::string& path) {
+
+	FileSpecifier file = path;
+	OpenedFile f;
+	REQUIRE(file.Open(f));
+
+	int32 length;
+	REQUIRE(f.GetLength(length));
+	REQUIRE(length >= kFilmHeaderSize);
+
+	std::vector<uint8> data(length);
+	REQUIRE(f.Read(length, data.data()));
+
+	AIStreamBE header(data.data(), data.size(), kFilmPlayerCountOffset);
+	int16 player_count;
+	header >> player_count;
+	REQUIRE(player_count > 0);
+
+	std::vector<std::vector<uint32>> flags(player_count);
+	std::vector<bool> ended(player_count, false);
+
+	AIStreamBE chunks(data.data(), data.size(), kFilmHeaderSize);
+	while (std::find(ended.begin(), ended.end(), false) != ended.end() && chunks.tellg() < chunks.maxg()) {
+		for (int i = 0; i < player_count; i++) {
+			for (int count = 0; !ended[i] && count < kFilmChunkSize; ) {
+				int16 run_count;
+				uint32 run_flags;
+				chunks >> run_count >> run_flags;
+				if (run_count == kFilmEndOfRecording) {
+					ended[i] = true;
+				}
+				else {
+					flags[i].insert(flags[i].end(), run_count, run_flags);
+					count += run_count;
+				}
+			}
+		}
+	}
+
+	return flags;
+}
+
+TEST_CASE("Action flags codec", "[ActionFlagsCodec]") {
+
+	SECTION("round trip") {
+		std::vector<uint32> flags = { 0, 0, 0x12345678, 0x12345678, 0x12340078, 0xffffffff, 0x80000001, 0x80000001 };
+		for (uint8 stride = 0; stride < 4; stride++) {
+			std::vector<uint8> packed;
+			pack_action_flags(flags.data(), flags.size(), stride, packed);
+
+			AIStreamBE stream(packed.data(), packed.size());
+			std::vector<uint32> unpacked;
+			unpack_action_flags(stream, unpacked);
+			CHECK(unpacked == flags);
+			CHECK(stream.tellg() == stream.maxg());
+		}
+	}
+
+	SECTION("truncated") {
+		std::vector<uint32> flags = { 0x12345678, 0x9abcdef0 };
+		std::vector<uint8> packed;
+		pack_action_flags(flags.data(), flags.size(), 1, packed);
+
+		AIStreamBE stream(packed.data(), packed.size() - 1);
+		std::vector<uint32> unpacked;
+		CHECK_THROWS_AS(unpack_action_flags(stream, unpacked), AStream::failure);
+	}
+}
+
+TEST_CASE("Action flags codec compression of films", "[ActionFlagsCodec]") {
+
+	REQUIRE(!shell_options.replay_directory.empty());
+
+	const auto films = get_films(shell_options.replay_directory);
+	REQUIRE(!films.empty());
+
+	size_t total_raw = 0;
+	size_t total_packed = 0;
+
+	for (const auto& film : films) {
+		INFO(film);
+		const auto flags = read_film_flags(film);
+
+		size_t ticks = flags[0].size();
+		for (const auto& player_flags : flags)
+			ticks = std::min(ticks, player_flags.size());
+
+		// pack the film the way the hub sends it: tick-major windows, every player every tick
+		size_t raw = 0;
+		size_t packed = 0;
+		std::vector<uint32> window;
+		std::vector<uint8> packed_window;
+		std::vector<uint32> unpacked;
+		for (size_t tick = 0; tick < ticks; tick += kWindowTicks) {
+			window.clear();
+			for (size_t t = tick; t < std::min(ticks, tick + kWindowTicks); t++) {
+				for (const auto& player_flags : flags)
+					window.push_back(player_flags[t]);
+			}
+
+			packed_window.clear();
+			pack_action_flags(window.data(), window.size(), static_cast<uint8>(flags.size()), packed_window);
+
+			AIStreamBE stream(packed_window.data(), packed_window.size());
+			unpacked.clear();
+			unpack_action_flags(stream, unpacked);
+			REQUIRE(unpacked == window);
+
+			raw += window.size() * sizeof(uint32);
+			packed += packed_window.size();
+		}
+
+		if (packed)
+			WARN(film << ": " << flags.size() << " players, " << ticks << " ticks, " << raw << " -> " << packed << " bytes (" << static_cast<double>(raw) / packed << ":1)");
+
+		total_raw += raw;
+		total_packed += packed;
+	}
+
+	REQUIRE(total_packed > 0);
+	WARN("all films: " << total_raw << " -> " << total_packed << " bytes (" << static_cast<double>(total_raw) / total_packed << ":1)");
+
+	// recorded play packs to well under half
+	CHECK(total_packed * 2 < total_raw);
+}
@@ -0,0 +1,87 @@
+#include "cseries.h"
+#include "FileHandler.h"
+#include "HubFilm.h"
+#include "network_star.h"
+#include "vbl_definitions.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <boost/filesystem.hpp>
+
+extern DirectorySpecifier recordings_dir;
+
+static const int kPlayers = 2;
+static const int kTicks = 600;	// a couple of chunks and a bit
+
+TEST_CASE("Standalone hub film switch", "[HubFilm]") {
+
+	bool was_recording = hub_get_record_films();
+
+	hub_set_record_films(true);
+	CHECK(hub_get_record_films());
+	hub_set_record_films(false);
+	CHECK(!hub_get_record_films());
+
+	hub_set_record_films(was_recording);
+}
+
+TEST_CASE("Hub film lands in the recordings directory", "[HubFilm]") {
+
+	DirectorySpecifier saved_recordings_dir = recordings_dir;
+	auto temp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("hub-film-%%%%-%%%%");
+	recordings_dir = temp.string();
+	REQUIRE(recordings_dir.CreateDirectory());
+
+	recording_header header;
+	obj_clear(header);
+	header.num_players = kPlayers;
+	header.length = SIZEOF_recording_header;
+
+	std::vector<uint32> flags(kTicks * kPlayers);
+	for (size_t i = 0; i < flags.size(); ++i)
+		flags[i] = static_cast<uint32>(i / 50);
+
+	FileSpecifier file = hub_film_file(1, kPlayers);
+	{
+		HubFilm film;
+		REQUIRE(film.start(file, header));
+		film.record(flags.data(), kTicks / 2);
+		film.record(flags.data() + kTicks / 2 * kPlayers, kTicks / 2);
+		REQUIRE(film.stop());
+	}
+
+	std::vector<dir_entry> entries;
+	REQUIRE(recordings_dir.ReadDirectory(entries));
+
+	std::vector<std::string> films;
+	for (auto& entry : entries) {
+		if (!entry.is_directory && entry.name.size() > 5 && entry.name.substr(entry.name.size() - 5) == ".filA")
+			films.push_back(entry.name);
+	}
+	REQUIRE(films.size() == 1);
+
+	FileSpecifier found = recordings_dir + films[0];
+	CHECK(found.GetType() == _typecode_film);
+
+	// the header's length is the whole file
+	OpenedFile opened;
+	REQUIRE(found.Open(opened));
+	int32 file_length = 0;
+	REQUIRE(opened.GetLength(file_length));
+	uint8 length_bytes[4];
+	REQUIRE(opened.Read(4, length_bytes));
+	opened.Close();
+
+	int32 recorded_length = (length_bytes[0] << 24) | (length_bytes[1] << 16) | (length_bytes[2] << 8) | length_bytes[3];
+	CHECK(file_length > SIZEOF_recording_header);
+	CHECK(recorded_length == file_length);
+
+	// nobody played, so there's nothing to record
+	header.num_players = 0;
+	FileSpecifier empty = hub_film_file(2, 0);
+	HubFilm empty_film;
+	CHECK(!empty_film.start(empty, header));
+
+	boost::system::error_code ec;
+	boost::filesystem::remove_all(temp, ec);
+	recordings_dir = saved_recordings_dir;
+}
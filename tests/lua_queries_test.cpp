@@ -0,0 +1,263 @@
+#include "cseries.h"
+#include "map.h"
+#include "monsters.h"
+#include "projectiles.h"
+#include "lua_map.h"
+#include "lua_monsters.h"
+#include "lua_projectiles.h"
+#include <catch2/catch_test_macros.hpp>
+
+// Drives Monsters.in_radius, Polygons.adjacent and Projectiles.in_polygon
+// over a small map of their own: four square polygons in a row, each one
+// world unit across, with monsters and projectiles standing in them.
+
+namespace {
+
+const int kPolygonCount = 4;
+
+class TestMap {
+public:
+	TestMap() : old_world(dynamic_world) {
+		obj_clear(world);
+		dynamic_world = &world;
+
+		old_endpoints.swap(EndpointList);
+		old_lines.swap(LineList);
+		old_polygons.swap(PolygonList);
+		old_objects.swap(ObjectList);
+		old_monsters.swap(MonsterList);
+		old_projectiles.swap(ProjectileList);
+
+		ObjectList.resize(MAXIMUM_OBJECTS_PER_MAP);
+		MonsterList.resize(MAXIMUM_MONSTERS_PER_MAP);
+		ProjectileList.resize(MAXIMUM_PROJECTILES_PER_MAP);
+
+		// along the bottom, then along the top
+		for (int row = 0; row < 2; ++row)
+			for (int i = 0; i <= kPolygonCount; ++i) {
+				endpoint_data endpoint;
+				obj_clear(endpoint);
+				endpoint.vertex.x = i * WORLD_ONE;
+				endpoint.vertex.y = row * WORLD_ONE;
+				EndpointList.push_back(endpoint);
+			}
+
+		for (int i = 0; i < kPolygonCount; ++i) {
+			polygon_data polygon;
+			obj_clear(polygon);
+			polygon.vertex_count = 4;
+			polygon.first_object = NONE;
+
+			// clockwise, from the bottom left
+			const int16 corners[4] = { static_cast<int16>(i), static_cast<int16>(i + 1), static_cast<int16>(kPolygonCount + 2 + i), static_cast<int16>(kPolygonCount + 1 + i) };
+			for (int side = 0; side < 4; ++side) {
+				polygon.endpoint_indexes[side] = corners[side];
+				polygon.line_indexes[side] = line_between(corners[side], corners[(side + 1) % 4]);
+			}
+
+			polygon.adjacent_polygon_indexes[0] = NONE;
+			polygon.adjacent_polygon_indexes[1] = i + 1 < kPolygonCount ? i + 1 : NONE;
+			polygon.adjacent_polygon_indexes[2] = NONE;
+			polygon.adjacent_polygon_indexes[3] = i > 0 ? i - 1 : NONE;
+			PolygonList.push_back(polygon);
+		}
+
+		world.endpoint_count = static_cast<int16>(EndpointList.size());
+		world.line_count = static_cast<int16>(LineList.size());
+		world.polygon_count = static_cast<int16>(PolygonList.size());
+	}
+
+	~TestMap() {
+		EndpointList.swap(old_endpoints);
+		LineList.swap(old_lines);
+		PolygonList.swap(old_polygons);
+		ObjectList.swap(old_objects);
+		MonsterList.swap(old_monsters);
+		ProjectileList.swap(old_projectiles);
+
+		dynamic_world = old_world;
+	}
+
+	// puts an object at the end of the polygon's list, at (x, y) in world units
+	void add_object(int owner, int16 permutation, int16 polygon_index, double x, double y) {
+		int16 object_index = next_object++;
+		object_data *object = &ObjectList[object_index];
+		MARK_SLOT_AS_USED(object);
+		SET_OBJECT_OWNER(object, owner);
+		object->permutation = permutation;
+		object->polygon = polygon_index;
+		object->location.x = static_cast<world_distance>(x * WORLD_ONE);
+		object->location.y = static_cast<world_distance>(y * WORLD_ONE);
+		object->next_object = NONE;
+
+		int16 *link = &PolygonList[polygon_index].first_object;
+		while (*link != NONE)
+			link = &ObjectList[*link].next_object;
+		*link = object_index;
+
+		if (owner == _object_is_monster)
+			MARK_SLOT_AS_USED(&MonsterList[permutation]);
+		else if (owner == _object_is_projectile)
+			MARK_SLOT_AS_USED(&ProjectileList[permutation]);
+	}
+
+private:
+	int16 line_between(int16 a, int16 b) {
+		for (size_t i = 0; i < LineList.size(); ++i) {
+			const line_data& line = LineList[i];
+			if ((line.endpoint_indexes[0] == a && line.endpoint_indexes[1] == b) ||
+			    (line.endpoint_indexes[0] == b && line.endpoint_indexes[1] == a))
+				return static_cast<int16>(i);
+		}
+
+		line_data line;
+		obj_clear(line);
+		line.endpoint_indexes[0] = a;
+		line.endpoint_indexes[1] = b;
+		LineList.push_back(line);
+		return static_cast<int16>(LineList.size() - 1);
+	}
+
+	dynamic_data world;
+	dynamic_data *old_world;
+	int16 next_object = 0;
+
+	std::vector<endpoint_data> old_endpoints;
+	std::vector<line_data> old_lines;
+	std::vector<polygon_data> old_polygons;
+	std::vector<object_data> old_objects;
+	std::vector<monster_data> old_monsters;
+	std::vector<projectile_data> old_projectiles;
+};
+
+class QueryLuaState {
+public:
+	QueryLuaState() : L(luaL_newstate()) {
+		luaL_openlibs(L);
+
+		lua_pushlightuserdata(L, L_Persistent_Table_Key());
+		lua_newtable(L);
+		lua_settable(L, LUA_REGISTRYINDEX);
+
+		Lua_Map_register(L);
+		Lua_Monsters_register(L);
+		Lua_Projectiles_register(L);
+	}
+
+	~QueryLuaState() { lua_close(L); }
+
+	// runs a chunk, leaving its result (or error message) on top of the stack
+	bool run(const std::string& chunk) {
+		lua_settop(L, 0);
+		return luaL_loadbuffer(L, chunk.data(), chunk.size(), "=test") == LUA_OK && lua_pcall(L, 0, 1, 0) == LUA_OK;
+	}
+
+	std::string string() { return lua_isstring(L, -1) ? lua_tostring(L, -1) : std::string(); }
+
+	lua_State *L;
+};
+
+// the indexes of a table of objects, as "1 2 3"
+const char *kIndexes =
+	"local function indexes(t) "
+	"  local s = {} "
+	"  for i = 1, #t do s[i] = tostring(t[i].index) end "
+	"  return table.concat(s, ' ') "
+	"end ";
+
+}
+
+TEST_CASE("Lua map queries", "[LuaTemplates]") {
+
+	TestMap map;
+
+	// left to right, but listed in each polygon out of index order
+	map.add_object(_object_is_monster, 3, 0, 0.5, 0.5);
+	map.add_object(_object_is_monster, 9, 1, 1.5, 0.5);
+	map.add_object(_object_is_projectile, 6, 1, 1.5, 0.25);
+	map.add_object(_object_is_monster, 1, 1, 1.25, 0.5);
+	map.add_object(_object_is_projectile, 2, 1, 1.75, 0.75);
+	map.add_object(_object_is_monster, 5, 2, 2.5, 0.5);
+	map.add_object(_object_is_monster, 7, 3, 3.5, 0.5);
+
+	QueryLuaState state;
+
+	SECTION("in index order") {
+		REQUIRE(state.run(std::string(kIndexes) + "return indexes(Monsters.in_radius(1.5, 0.5, 0, 1.1))"));
+		CHECK(state.string() == "1 3 5 9");
+
+		REQUIRE(state.run(std::string(kIndexes) + "return indexes(Monsters.in_radius(1.5, 0.5, 0, 1.1, 1))"));
+		CHECK(state.string() == "1 3 5 9");
+
+		REQUIRE(state.run(std::string(kIndexes) + "return indexes(Projectiles.in_polygon(1))"));
+		CHECK(state.string() == "2 6");
+
+		// nearest first, as documented, rather than in index order
+		REQUIRE(state.run(std::string(kIndexes) + "return indexes(Polygons.adjacent(3, 3))"));
+		CHECK(state.string() == "2 1 0");
+
+		REQUIRE(state.run(std::string(kIndexes) + "return indexes(Polygons.adjacent(1))"));
+		CHECK(state.string() == "2 0");
+	}
+
+	SECTION("results tables are reused and cleared past the new end") {
+		REQUIRE(state.run(std::string(kIndexes) +
+			"local t = { 'a', 'b', 'c', 'd', 'e', 'f', 'g', name = 'kept' } "
+			"local r = Monsters.in_radius(1.5, 0.5, 0, 0.3, nil, t) "
+			"assert(r == t and t.name == 'kept') "
+			"for k in pairs(t) do assert(k == 'name' or (type(k) == 'number' and k <= #t)) end "
+			"return indexes(t)"));
+		CHECK(state.string() == "1 9");
+
+		REQUIRE(state.run(std::string(kIndexes) +
+			"local t = {} "
+			"local r = Projectiles.in_polygon(2, Projectiles.in_polygon(1, t)) "
+			"assert(r == t and next(t) == nil) "
+			"return indexes(Projectiles.in_polygon(1, t))"));
+		CHECK(state.string() == "2 6");
+	}
+
+	SECTION("a hole doesn't hide what's past it") {
+		REQUIRE(state.run(std::string(kIndexes) +
+			"local t = { 'a', 'b', nil, 'd', nil, nil, 'g', [100] = 'z', [2.5] = 'kept' } "
+			"Polygons.adjacent(0, nil, t) "
+			"assert(t[2] == nil and t[4] == nil and t[7] == nil and t[100] == nil and t[2.5] == 'kept') "
+			"return indexes(t)"));
+		CHECK(state.string() == "1");
+	}
+
+	SECTION("nil holds an optional argument's place") {
+		REQUIRE(state.run(std::string(kIndexes) +
+			"local t = {} "
+			"local r = Polygons.adjacent(0, nil, t) "
+			"assert(r == t) "
+			"return indexes(t)"));
+		CHECK(state.string() == "1");
+
+		REQUIRE(state.run(std::string(kIndexes) +
+			"local t = {} "
+			"local r = Monsters.in_radius(3.5, 0.5, 0, 0.5, nil, t) "
+			"assert(r == t) "
+			"return indexes(t)"));
+		CHECK(state.string() == "7");
+
+		// the results table can also go straight after the last required argument
+		REQUIRE(state.run(std::string(kIndexes) +
+			"local t = {} "
+			"local r = Monsters.in_radius(3.5, 0.5, 0, 0.5, t) "
+			"assert(r == t) "
+			"return indexes(t)"));
+		CHECK(state.string() == "7");
+	}
+
+	SECTION("bad arguments") {
+		CHECK(!state.run("return Polygons.adjacent(4)"));
+		CHECK(state.string().find("adjacent: invalid polygon index") != std::string::npos);
+		CHECK(!state.run("return Polygons.adjacent(0, -1)"));
+		CHECK(state.string().find("adjacent: invalid depth") != std::string::npos);
+		CHECK(!state.run("return Projectiles.in_polygon(4)"));
+		CHECK(state.string().find("in_polygon: invalid polygon index") != std::string::npos);
+		CHECK(!state.run("return Monsters.in_radius(1, 1, 0)"));
+		CHECK(state.string().find("in_radius: incorrect argument type") != std::string::npos);
+	}
+}
@@ -0,0 +1,177 @@
+#include "cseries.h"
+#include "lua_serialize.h"
+#include "lua_templates.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <sstream>
+
+// Round trips values through lua_save() and lua_restore() in a state of
+// their own, reads data an older engine saved, and times saving a table
+// shaped like a big scenario's inventory.
+
+char Lua_Test_Item_Name[] = "item";
+typedef L_Class<Lua_Test_Item_Name> Lua_Test_Item;
+
+static bool Lua_Test_Item_Valid(int16 index)
+{
+	return index >= 0 && index < 32;
+}
+
+// Item(index)
+static int Lua_Test_Item_New(lua_State *L)
+{
+	Lua_Test_Item::Push(L, static_cast<int16>(lua_tonumber(L, 1)));
+	return 1;
+}
+
+namespace {
+
+struct SerializeLuaState {
+	SerializeLuaState() : L(luaL_newstate()) {
+		luaL_openlibs(L);
+		Lua_Test_Item::Register(L);
+		Lua_Test_Item::Valid = Lua_Test_Item_Valid;
+		lua_pushcfunction(L, Lua_Test_Item_New);
+		lua_setglobal(L, "Item");
+	}
+
+	~SerializeLuaState() { lua_close(L); }
+
+	bool run(const char *script) {
+		lua_settop(L, 0);
+		return luaL_loadbufferx(L, script, strlen(script), "test", "t") == LUA_OK && lua_pcall(L, 0, 1, 0) == LUA_OK;
+	}
+
+	// saves the value on top of the stack
+	std::string save() {
+		std::stringbuf sb;
+		REQUIRE(lua_save(L, &sb));
+		return sb.str();
+	}
+
+	// restores s and sets it as the global "restored"
+	bool restore(const std::string& s) {
+		lua_settop(L, 0);
+		std::stringbuf sb(s);
+		if (!lua_restore(L, &sb))
+			return false;
+
+		lua_setglobal(L, "restored");
+		return true;
+	}
+
+	bool round_trip(const char *script) {
+		if (!run(script))
+			return false;
+
+		return restore(save());
+	}
+
+	bool check(const char *script) {
+		return run(script) && lua_toboolean(L, -1);
+	}
+
+	lua_State *L;
+};
+
+}
+
+TEST_CASE("Lua serialization", "[LuaSerialize]") {
+
+	SerializeLuaState state;
+
+	SECTION("values") {
+		REQUIRE(state.round_trip("return { 1, 2.5, -7, 'one', true, false, 2^53, -2^60, 1/0, -0.0, [0.5] = 'half', [true] = 'yes', name = 'test', nested = { x = 1 } }"));
+		CHECK(state.check("local t = restored return t[1] == 1 and t[2] == 2.5 and t[3] == -7 and t[4] == 'one' and t[5] == true and t[6] == false and t[7] == 2^53 and t[8] == -2^60 and t[9] == 1/0 and 1/t[10] == -1/0"));
+		CHECK(state.check("local t = restored return t[0.5] == 'half' and t[true] == 'yes' and t.name == 'test' and t.nested.x == 1"));
+
+		REQUIRE(state.round_trip("return 0/0"));
+		CHECK(state.check("return restored ~= restored"));
+
+		REQUIRE(state.round_trip("return 'just a string'"));
+		CHECK(state.check("return restored == 'just a string'"));
+	}
+
+	SECTION("arrays with holes") {
+		REQUIRE(state.round_trip("local t = {} for i = 1, 100 do t[i] = i * 2 end t[50] = nil t[101] = nil t[200] = 'far' return t"));
+		CHECK(state.check("local t = restored for i = 1, 100 do if i ~= 50 and t[i] ~= i * 2 then return false end end return t[50] == nil and t[200] == 'far'"));
+	}
+
+	SECTION("shared tables and strings") {
+		REQUIRE(state.round_trip("local shared = { 'shared' } local t = { a = shared, b = shared, keys = {} } t.self = t t.keys[shared] = 'by table' for i = 1, 10 do t[i] = { kind = 'repeated' } end return t"));
+		CHECK(state.check("local t = restored return t.a == t.b and t.self == t and t.keys[t.a] == 'by table' and t[10].kind == 'repeated'"));
+
+		// each repeat of a string costs a reference, not the string
+		REQUIRE(state.run("local t = {} for i = 1, 1000 do t[i] = { kind = 'a fairly long kind of thing' } end return t"));
+		CHECK(state.save().size() < 1000 * 16);
+	}
+
+	SECTION("functions are left out") {
+		REQUIRE(state.round_trip("return { 1, print, 3, f = print, [print] = 1, g = 'kept' }"));
+		CHECK(state.check("local t = restored local n = 0 for k in pairs(t) do n = n + 1 end return n == 3 and t[1] == 1 and t[2] == nil and t[3] == 3 and t.g == 'kept'"));
+	}
+
+	SECTION("userdata") {
+		REQUIRE(state.round_trip("return { Item(4), Item(4), [Item(7)] = 'seven' }"));
+		CHECK(state.check("local t = restored return t[1].index == 4 and t[1] == t[2] and t[Item(7)] == 'seven'"));
+	}
+
+	SECTION("deep nesting") {
+		REQUIRE(state.round_trip("local t = {} local inner = t for i = 1, 50000 do inner.next = {} inner = inner.next end inner.last = true return t"));
+		CHECK(state.check("local n, t = 0, restored while t.next do t = t.next n = n + 1 end return n == 50000 and t.last"));
+	}
+
+	SECTION("data from before version 2") {
+		// { a = 1 }, as saved with version 1
+		const unsigned char data[] = {
+			0x00, 0x01,
+			LUA_TTABLE, 0x00, 0x00, 0x00, 0x01,
+			LUA_TSTRING, 0x00, 0x00, 0x00, 0x01, 'a',
+			LUA_TNUMBER, 0x3f, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			LUA_TNIL
+		};
+		REQUIRE(state.restore(std::string(reinterpret_cast<const char *>(data), sizeof(data))));
+		CHECK(state.check("return restored.a == 1"));
+	}
+
+	SECTION("bad data") {
+		REQUIRE(state.run("return { 1, 2, 3, name = 'truncated' }"));
+		std::string s = state.save();
+
+		lua_settop(state.L, 0);
+		lua_pushboolean(state.L, true);
+		std::stringbuf truncated(s.substr(0, s.size() - 3));
+		CHECK(!lua_restore(state.L, &truncated));
+		CHECK(lua_gettop(state.L) == 1);
+
+		std::stringbuf newer(std::string("\x7f\x00", 2));
+		CHECK(!lua_restore(state.L, &newer));
+		CHECK(lua_gettop(state.L) == 1);
+	}
+}
+
+TEST_CASE("Lua serialization speed", "[LuaSerialize]") {
+
+	SerializeLuaState state;
+	REQUIRE(state.run(
+		"local inventory = {} "
+		"for i = 1, 20000 do "
+		"  inventory[i] = { name = 'item ' .. (i % 50), kind = 'weapon', count = i % 7, weight = i * 0.25, flags = { true, false, true } } "
+		"end "
+		"return { inventory = inventory, visited = {}, version = 3 }"));
+
+	auto start = std::chrono::steady_clock::now();
+	std::string s = state.save();
+	auto saved = std::chrono::steady_clock::now();
+	REQUIRE(state.restore(s));
+	auto restored = std::chrono::steady_clock::now();
+
+	CHECK(state.check("return #restored.inventory == 20000 and restored.inventory[20000].weight == 5000"));
+
+	std::ostringstream report;
+	report << "20000 items: " << s.size() << " bytes, saved in "
+	       << std::chrono::duration<double, std::milli>(saved - start).count() << " ms, restored in "
+	       << std::chrono::duration<double, std::milli>(restored - saved).count() << " ms";
+	WARN(report.str());
+}
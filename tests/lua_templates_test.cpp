@@ -0,0 +1,364 @@
+#include "cseries.h"
+#include "lua_templates.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <sstream>
+
+// Checks L_Class field dispatch against objects shaped like the ones scripts
+// loop over most, Monsters() and Players(), in a state of their own, and
+// times a field access against calling the same getter as a plain function.
+
+namespace {
+
+struct TestObject {
+	bool used;
+	double x, y, z;
+	double facing;
+};
+
+const int kMonsterCount = 256;
+const int kPlayerCount = 8;
+
+std::vector<TestObject> monsters;
+std::vector<TestObject> players;
+
+}
+
+char Lua_Test_Monster_Name[] = "monster";
+typedef L_Class<Lua_Test_Monster_Name> Lua_Test_Monster;
+
+char Lua_Test_Monsters_Name[] = "Monsters";
+typedef L_Container<Lua_Test_Monsters_Name, Lua_Test_Monster> Lua_Test_Monsters;
+
+char Lua_Test_Player_Name[] = "player";
+typedef L_Class<Lua_Test_Player_Name> Lua_Test_Player;
+
+char Lua_Test_Players_Name[] = "Players";
+typedef L_Container<Lua_Test_Players_Name, Lua_Test_Player> Lua_Test_Players;
+
+static int Lua_Test_Monster_Get_X(lua_State *L)
+{
+	lua_pushnumber(L, monsters[Lua_Test_Monster::Index(L, 1)].x);
+	return 1;
+}
+
+static int Lua_Test_Monster_Get_Y(lua_State *L)
+{
+	lua_pushnumber(L, monsters[Lua_Test_Monster::Index(L, 1)].y);
+	return 1;
+}
+
+static int Lua_Test_Monster_Get_Z(lua_State *L)
+{
+	lua_pushnumber(L, monsters[Lua_Test_Monster::Index(L, 1)].z);
+	return 1;
+}
+
+static int Lua_Test_Monster_Get_Facing(lua_State *L)
+{
+	lua_pushnumber(L, monsters[Lua_Test_Monster::Index(L, 1)].facing);
+	return 1;
+}
+
+static int Lua_Test_Monster_Get_Broken(lua_State *L)
+{
+	return luaL_error(L, "broken: out of order");
+}
+
+static int Lua_Test_Monster_Get_Nothing(lua_State *L)
+{
+	return 0;
+}
+
+static int Lua_Test_Monster_Set_Facing(lua_State *L)
+{
+	if (!lua_isnumber(L, 2))
+		return luaL_error(L, "facing: incorrect argument type");
+
+	monsters[Lua_Test_Monster::Index(L, 1)].facing = lua_tonumber(L, 2);
+	return 0;
+}
+
+static int Lua_Test_Monster_Kill(lua_State *L)
+{
+	monsters[Lua_Test_Monster::Index(L, 1)].used = false;
+	return 0;
+}
+
+static const luaL_Reg Lua_Test_Monster_Get[] = {
+	{"broken", Lua_Test_Monster_Get_Broken},
+	{"facing", Lua_Test_Monster_Get_Facing},
+	{"kill", L_TableFunction<Lua_Test_Monster_Kill>},
+	{"nothing", Lua_Test_Monster_Get_Nothing},
+	{"x", Lua_Test_Monster_Get_X},
+	{"y", Lua_Test_Monster_Get_Y},
+	{"z", Lua_Test_Monster_Get_Z},
+	{0, 0}
+};
+
+static const luaL_Reg Lua_Test_Monster_Set[] = {
+	{"facing", Lua_Test_Monster_Set_Facing},
+	{0, 0}
+};
+
+// Monsters.facing_at_least(facing, [results])
+static int Lua_Test_Monsters_Facing_At_Least(lua_State *L)
+{
+	std::vector<int16> indexes;
+	for (int16 i = 0; i < kMonsterCount; ++i)
+		if (monsters[i].used && monsters[i].facing >= lua_tonumber(L, 1))
+			indexes.push_back(i);
+
+	L_Push_Results<Lua_Test_Monster>(L, 2, indexes);
+	return 1;
+}
+
+static const luaL_Reg Lua_Test_Monsters_Methods[] = {
+	{"facing_at_least", L_TableFunction<Lua_Test_Monsters_Facing_At_Least>},
+	{0, 0}
+};
+
+static int Lua_Test_Player_Get_X(lua_State *L)
+{
+	lua_pushnumber(L, players[Lua_Test_Player::Index(L, 1)].x);
+	return 1;
+}
+
+static int Lua_Test_Player_Get_Y(lua_State *L)
+{
+	lua_pushnumber(L, players[Lua_Test_Player::Index(L, 1)].y);
+	return 1;
+}
+
+static int Lua_Test_Player_Get_Z(lua_State *L)
+{
+	lua_pushnumber(L, players[Lua_Test_Player::Index(L, 1)].z);
+	return 1;
+}
+
+static int Lua_Test_Player_Get_Facing(lua_State *L)
+{
+	lua_pushnumber(L, players[Lua_Test_Player::Index(L, 1)].facing);
+	return 1;
+}
+
+static const luaL_Reg Lua_Test_Player_Get[] = {
+	{"facing", Lua_Test_Player_Get_Facing},
+	{"x", Lua_Test_Player_Get_X},
+	{"y", Lua_Test_Player_Get_Y},
+	{"z", Lua_Test_Player_Get_Z},
+	{0, 0}
+};
+
+// the same getters, as plain functions taking the object
+static const luaL_Reg Lua_Test_Plain_Functions[] = {
+	{"monster_x", Lua_Test_Monster_Get_X},
+	{"monster_y", Lua_Test_Monster_Get_Y},
+	{"monster_z", Lua_Test_Monster_Get_Z},
+	{"monster_facing", Lua_Test_Monster_Get_Facing},
+	{"player_x", Lua_Test_Player_Get_X},
+	{"player_y", Lua_Test_Player_Get_Y},
+	{"player_z", Lua_Test_Player_Get_Z},
+	{"player_facing", Lua_Test_Player_Get_Facing},
+	{0, 0}
+};
+
+class TestLuaState {
+public:
+	TestLuaState() : L(luaL_newstate()) {
+		luaL_openlibs(L);
+
+		// custom fields live in the persistent table, as in lua_script.cpp
+		lua_pushlightuserdata(L, L_Persistent_Table_Key());
+		lua_newtable(L);
+		lua_settable(L, LUA_REGISTRYINDEX);
+
+		monsters.assign(kMonsterCount, TestObject());
+		for (int i = 0; i < kMonsterCount; ++i)
+			monsters[i] = {i % 3 != 0, i * 1.0, i * 2.0, i * 0.5, i * 0.25};
+
+		players.assign(kPlayerCount, TestObject());
+		for (int i = 0; i < kPlayerCount; ++i)
+			players[i] = {true, i * 10.0, i * 20.0, i * 5.0, i * 2.5};
+
+		Lua_Test_Monster::Register(L, Lua_Test_Monster_Get, Lua_Test_Monster_Set);
+		Lua_Test_Monster::Valid = [](int16 index) { return index >= 0 && index < kMonsterCount && monsters[index].used; };
+
+		Lua_Test_Monsters::Register(L, Lua_Test_Monsters_Methods);
+		Lua_Test_Monsters::Length = Lua_Test_Monsters::ConstantLength(kMonsterCount);
+
+		Lua_Test_Player::Register(L, Lua_Test_Player_Get);
+		Lua_Test_Player::Valid = Lua_Test_Player::ValidRange(kPlayerCount);
+
+		Lua_Test_Players::Register(L);
+		Lua_Test_Players::Length = Lua_Test_Players::ConstantLength(kPlayerCount);
+
+		lua_pushglobaltable(L);
+		luaL_setfuncs(L, Lua_Test_Plain_Functions, 0);
+		lua_pop(L, 1);
+	}
+
+	~TestLuaState() { lua_close(L); }
+
+	// runs a chunk, leaving its result (or error message) on top of the stack
+	bool run(const std::string& chunk) {
+		lua_settop(L, 0);
+		return luaL_loadbuffer(L, chunk.data(), chunk.size(), "=test") == LUA_OK && lua_pcall(L, 0, 1, 0) == LUA_OK;
+	}
+
+	double number() { return lua_tonumber(L, -1); }
+	std::string string() { return lua_isstring(L, -1) ? lua_tostring(L, -1) : std::string(); }
+
+	lua_State *L;
+};
+
+TEST_CASE("L_Class field dispatch", "[LuaTemplates]") {
+
+	TestLuaState state;
+
+	SECTION("getters") {
+		REQUIRE(state.run("return Monsters[4].x + Monsters[4].y + Monsters[4].z"));
+		CHECK(state.number() == 4 + 8 + 2);
+
+		REQUIRE(state.run("return Players[3].facing"));
+		CHECK(state.number() == 7.5);
+
+		REQUIRE(state.run("return Monsters[4].index"));
+		CHECK(state.number() == 4);
+
+		REQUIRE(state.run("return Monsters[4].nothing == nil and Monsters[4].no_such_field == nil"));
+		CHECK(lua_toboolean(state.L, -1));
+
+		REQUIRE(state.run("return #Monsters"));
+		CHECK(state.number() == kMonsterCount);
+	}
+
+	SECTION("setters and methods") {
+		REQUIRE(state.run("Monsters[4].facing = 90 return Monsters[4].facing"));
+		CHECK(monsters[4].facing == 90);
+		CHECK(state.number() == 90);
+
+		REQUIRE(state.run("Monsters[5]:kill() return Monsters[5]"));
+		CHECK(!monsters[5].used);
+		CHECK(lua_isnil(state.L, -1));
+	}
+
+	SECTION("custom fields") {
+		REQUIRE(state.run("Monsters[4]._target = Players[1] return Monsters[4]._target.x"));
+		CHECK(state.number() == 10);
+
+		REQUIRE(state.run("return Monsters[7]._target"));
+		CHECK(lua_isnil(state.L, -1));
+	}
+
+	SECTION("errors report the script's line") {
+		CHECK(!state.run("local m = Monsters[4]\nreturn m.broken"));
+		CHECK(state.string() == "test:2: broken: out of order");
+
+		CHECK(!state.run("local m = Monsters[4]\n\nm.facing = 'north'"));
+		CHECK(state.string() == "test:3: facing: incorrect argument type");
+
+		CHECK(!state.run("Monsters[4].x = 1"));
+		CHECK(state.string() == "test:1: no such index");
+
+		CHECK(!state.run("local m = Monsters[4]\nm:kill()\nreturn m.x"));
+		CHECK(state.string() == "test:3: invalid object");
+
+		REQUIRE(state.run("local m = Monsters[8]\nm:kill()\nreturn m.index"));
+		CHECK(state.number() == 8);
+	}
+
+	SECTION("objects of the wrong type") {
+		CHECK(!state.run("return getmetatable(Monsters[4]).__index(Players[1], 'x')"));
+		CHECK(state.string().find("monster expected") != std::string::npos);
+
+		CHECK(!state.run("return getmetatable(Monsters[4]).__index({}, 'x')"));
+		CHECK(state.string().find("userdata expected") != std::string::npos);
+	}
+
+	SECTION("bulk queries") {
+		int expected = 0;
+		for (const auto& monster : monsters)
+			expected += monster.used && monster.facing >= 60 ? 1 : 0;
+
+		REQUIRE(state.run("local t = Monsters.facing_at_least(60) return #t"));
+		CHECK(state.number() == expected);
+
+		REQUIRE(state.run("local t = Monsters.facing_at_least(60) for i = 2, #t do if t[i].index <= t[i - 1].index then return false end end return true"));
+		CHECK(lua_toboolean(state.L, -1));
+
+		// a table handed back is refilled, and whatever was past the end is cleared
+		REQUIRE(state.run("local t = {} for i = 1, 100 do t[i] = i end local r = Monsters.facing_at_least(60, t) return r == t and t[#t + 1] == nil and #t"));
+		CHECK(state.number() == expected);
+
+		REQUIRE(state.run("local t = Monsters.facing_at_least(0) return #Monsters.facing_at_least(1000, t) + #t"));
+		CHECK(state.number() == 0);
+	}
+
+	SECTION("iteration") {
+		REQUIRE(state.run("local n = 0 for m in Monsters() do n = n + 1 end for p in Players() do n = n + 1 end return n"));
+		int expected = kPlayerCount;
+		for (const auto& monster : monsters)
+			expected += monster.used ? 1 : 0;
+		CHECK(state.number() == expected);
+	}
+}
+
+TEST_CASE("L_Class field dispatch speed", "[LuaTemplates]") {
+
+	TestLuaState state;
+
+	const int kIterations = 200;
+	std::ostringstream s;
+	s << "local total = 0\n"
+	  << "for i = 1, " << kIterations << " do\n"
+	  << "  for m in Monsters() do total = total + %MONSTER% end\n"
+	  << "  for p in Players() do total = total + %PLAYER% end\n"
+	  << "end\n"
+	  << "return total";
+
+	auto make_chunk = [&s](const std::string& monster, const std::string& player) {
+		std::string chunk = s.str();
+		chunk.replace(chunk.find("%MONSTER%"), 9, monster);
+		chunk.replace(chunk.find("%PLAYER%"), 8, player);
+		return chunk;
+	};
+
+	const std::string fields = make_chunk("m.x + m.y + m.z + m.facing", "p.x + p.y + p.z + p.facing");
+	const std::string functions = make_chunk("monster_x(m) + monster_y(m) + monster_z(m) + monster_facing(m)", "player_x(p) + player_y(p) + player_z(p) + player_facing(p)");
+
+	double expected = 0;
+	int accesses = 0;
+	for (const auto& monster : monsters)
+		if (monster.used) {
+			expected += monster.x + monster.y + monster.z + monster.facing;
+			accesses += 4;
+		}
+	for (const auto& player : players) {
+		expected += player.x + player.y + player.z + player.facing;
+		accesses += 4;
+	}
+	expected *= kIterations;
+	accesses *= kIterations;
+
+	auto time = [&state, expected](const std::string& chunk) {
+		auto best = std::chrono::steady_clock::duration::max();
+		for (int i = 0; i < 3; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			REQUIRE(state.run(chunk));
+			best = std::min(best, std::chrono::steady_clock::now() - start);
+			CHECK(state.number() == expected);
+		}
+		return std::chrono::duration<double, std::nano>(best).count();
+	};
+
+	double field_time = time(fields);
+	double function_time = time(functions);
+
+	std::ostringstream report;
+	report << accesses << " accesses: "
+	       << field_time / accesses << " ns per field access, "
+	       << function_time / accesses << " ns per function call";
+	WARN(report.str());
+}
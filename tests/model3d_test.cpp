@@ -0,0 +1,151 @@
+#include "cseries.h"
+#include "Model3D.h"
+#include "world.h"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include <vector>
+
+// Finds the positions of a small boned model with two bones and one
+// three-frame sequence, checks them against the bone and model transforms
+// worked out by hand, and checks that a pose found again, from the cache
+// or not, comes out the same as the first time.
+
+#ifdef HAVE_OPENGL
+
+using Catch::Matchers::WithinAbs;
+
+namespace {
+
+Model3D make_model()
+{
+	Model3D model;
+
+	// a root vertex, one on the first bone, and one blended between the two
+	Model3D_VertexSource sources[] = {
+		{ { 0, 0, 1 }, -1, -1, 0 },
+		{ { 2, 0, 0 }, 0, -1, 0 },
+		{ { 0, 2, 0 }, 0, 1, 0.5f }
+	};
+	model.VtxSources.assign(std::begin(sources), std::end(sources));
+
+	GLushort indices[] = { 0, 1, 2, 2 };
+	model.VtxSrcIndices.assign(std::begin(indices), std::end(indices));
+	model.VertIndices.assign(std::begin(indices), std::begin(indices) + 3);
+
+	GLfloat normals[] = { 0, 0, 1, 1, 0, 0, 0, 1, 0, 0, 1, 0 };
+	model.NormSources.assign(std::begin(normals), std::end(normals));
+
+	Model3D_Bone bones[] = {
+		{ { 0, 0, 0 }, 0 },
+		{ { 0, 1, 0 }, 0 }
+	};
+	model.Bones.assign(std::begin(bones), std::end(bones));
+
+	// frame f moves the first bone f along x and turns the second a quarter turn per frame
+	for (int f = 0; f < 3; ++f)
+	{
+		Model3D_Frame first = { { GLfloat(f), 0, 0 }, { 0, 0, 0 } };
+		Model3D_Frame second = { { 0, 0, 0 }, { 0, 0, short(f * QUARTER_CIRCLE) } };
+		model.Frames.push_back(first);
+		model.Frames.push_back(second);
+	}
+
+	for (int f = 0; f < 3; ++f)
+	{
+		Model3D_SeqFrame frame;
+		obj_clear(frame);
+		frame.Frame = f;
+		model.SeqFrames.push_back(frame);
+	}
+	model.SeqFrmPointers = { 0, 3 };
+
+	return model;
+}
+
+void check_position(Model3D& model, int vertex, GLfloat x, GLfloat y, GLfloat z)
+{
+	CHECK_THAT(model.Positions[3 * vertex], WithinAbs(x, 1e-4));
+	CHECK_THAT(model.Positions[3 * vertex + 1], WithinAbs(y, 1e-4));
+	CHECK_THAT(model.Positions[3 * vertex + 2], WithinAbs(z, 1e-4));
+}
+
+}
+
+TEST_CASE("Model positions", "[Model3D]") {
+
+	Model3D::BuildTrigTables();
+	Model3D model = make_model();
+
+	SECTION("neutral") {
+		REQUIRE(model.FindPositions_Neutral(false));
+		check_position(model, 0, 0, 0, 1);
+		check_position(model, 1, 2, 0, 0);
+		check_position(model, 3, 0, 2, 0);
+	}
+
+	SECTION("frames") {
+		REQUIRE(model.FindPositions_Sequence(false, 0, 1));
+		check_position(model, 0, 0, 0, 1);
+		check_position(model, 1, 3, 0, 0);
+
+		// the second bone follows the first, so it takes (0, 2) a quarter turn
+		// around (0, 1) and then 1 along x, to (0, 1); the vertex is halfway
+		// between that and the first bone's (1, 2)
+		check_position(model, 2, 0.5f, 1.5f, 0);
+
+		CHECK(!model.FindPositions_Sequence(false, 0, 3));
+		CHECK(!model.FindPositions_Sequence(false, -1, 0));
+		CHECK(!model.FindPositions_Frame(false, 3));
+		check_position(model, 1, 3, 0, 0);
+	}
+
+	SECTION("model transform") {
+		// a quarter turn around z, then a shift
+		model.TransformPos.Identity();
+		model.TransformPos.M[0][0] = 0;
+		model.TransformPos.M[0][1] = -1;
+		model.TransformPos.M[1][0] = 1;
+		model.TransformPos.M[1][1] = 0;
+		model.TransformPos.M[0][3] = 10;
+		model.TransformPos.M[2][3] = -5;
+		model.TransformNorm = model.TransformPos;
+		model.TransformNorm.M[0][3] = model.TransformNorm.M[2][3] = 0;
+		model.InvalidatePoses();
+
+		REQUIRE(model.FindPositions_Neutral(true));
+		check_position(model, 0, 10, 0, -4);
+		check_position(model, 1, 10, 2, -5);
+		check_position(model, 3, 8, 0, -5);
+		CHECK_THAT(model.Normals[3], WithinAbs(0, 1e-4));
+		CHECK_THAT(model.Normals[4], WithinAbs(1, 1e-4));
+
+		REQUIRE(model.FindPositions_Sequence(true, 0, 2));
+		check_position(model, 1, 10, 4, -5);
+	}
+
+	SECTION("poses found again") {
+		REQUIRE(model.FindPositions_Sequence(true, 0, 0, 0.25f, 1));
+		std::vector<GLfloat> positions = model.Positions;
+		std::vector<GLfloat> normals = model.Normals;
+
+		REQUIRE(model.FindPositions_Sequence(true, 0, 1, 0.5f, 2));
+		std::vector<GLfloat> other_positions = model.Positions;
+
+		// from the cache
+		REQUIRE(model.FindPositions_Sequence(true, 0, 0, 0.25f, 1));
+		CHECK(model.Positions == positions);
+		CHECK(model.Normals == normals);
+		REQUIRE(model.FindPositions_Sequence(true, 0, 1, 0.5f, 2));
+		CHECK(model.Positions == other_positions);
+
+		// pushed out of the cache, then found again
+		for (int i = 1; i <= Model3D::PoseCacheSize + 2; ++i)
+			REQUIRE(model.FindPositions_Sequence(true, 0, 1, i / 16.0f, 2));
+		REQUIRE(model.FindPositions_Sequence(true, 0, 0, 0.25f, 1));
+		CHECK(model.Positions == positions);
+		CHECK(model.Normals == normals);
+	}
+}
+
+#endif
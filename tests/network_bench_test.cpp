@@ -0,0 +1,358 @@
+#include "cseries.h"
+#include "mytm.h"
+#include "crc.h"
+#include "network.h"
+#include "network_star.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <sstream>
+
+// One hub and several spokes, all in this process, talking through a simulated
+// network instead of the socket. Everything runs on a virtual clock, so a run
+// is the same every time for the same seed.
+
+struct NetworkConditions {
+	std::string name;
+	int latency;	// ms, one way
+	int jitter;	// ms on top of the latency, so datagrams get reordered
+	double loss;
+};
+
+class PacketSwitch {
+public:
+	PacketSwitch(const NetworkConditions& conditions, uint32 seed) : m_conditions(conditions), m_random(seed) {}
+
+	void attach(const NetAddrBlock& address, std::function<void(DDPPacketBufferPtr)> receiver) {
+		m_receivers[address.host] = receiver;
+	}
+
+	// drops everything to and from the address
+	void unplug(const NetAddrBlock& address) { m_unplugged.push_back(address.host); }
+
+	void send(const NetAddrBlock& from, const NetAddrBlock& to, const byte* data, uint16 size) {
+		packets_sent++;
+		bytes_sent += size;
+
+		if (is_unplugged(from) || is_unplugged(to) || std::uniform_real_distribution<double>()(m_random) < m_conditions.loss) {
+			packets_dropped++;
+			return;
+		}
+
+		uint32 delay = m_conditions.latency;
+		if (m_conditions.jitter)
+			delay += std::uniform_int_distribution<int>(0, m_conditions.jitter)(m_random);
+
+		InFlight& datagram = m_in_flight.emplace(m_now + delay, InFlight())->second;
+		datagram.destination = to.host;
+		obj_clear(datagram.packet.sourceAddress);	// the hub compares whole addresses
+		datagram.packet.sourceAddress.host = from.host;
+		datagram.packet.sourceAddress.port = from.port;
+		datagram.packet.datagramSize = size;
+		memcpy(datagram.packet.datagramData, data, size);
+	}
+
+	// hands over everything due by now
+	void deliver(uint32 now) {
+		m_now = now;
+		while (!m_in_flight.empty() && m_in_flight.begin()->first <= now) {
+			InFlight datagram = m_in_flight.begin()->second;
+			m_in_flight.erase(m_in_flight.begin());
+
+			auto receiver = m_receivers.find(datagram.destination);
+			if (receiver != m_receivers.end() && !is_unplugged(datagram.packet.sourceAddress))
+				receiver->second(&datagram.packet);
+		}
+	}
+
+	uint32 packets_sent = 0;
+	uint32 bytes_sent = 0;
+	uint32 packets_dropped = 0;
+
+private:
+	struct InFlight {
+		uint32 destination;
+		DDPPacketBuffer packet;
+	};
+
+	bool is_unplugged(const NetAddrBlock& address) const {
+		return std::find(m_unplugged.begin(), m_unplugged.end(), address.host) != m_unplugged.end();
+	}
+
+	NetworkConditions m_conditions;
+	std::mt19937 m_random;
+	uint32 m_now = 0;
+	std::multimap<uint32, InFlight> m_in_flight;	// by delivery time, then in the order sent
+	std::map<uint32, std::function<void(DDPPacketBufferPtr)>> m_receivers;
+	std::vector<uint32> m_unplugged;
+};
+
+// where one node plugs into the switch
+class SwitchPort : public StarTransport {
+public:
+	SwitchPort(PacketSwitch& packet_switch, const NetAddrBlock& address) : m_switch(packet_switch), m_address(address) {}
+
+	using StarTransport::send;
+	void send(const NetAddrBlock& address, const byte* data, uint16 size) override {
+		m_switch.send(m_address, address, data, size);
+	}
+
+private:
+	PacketSwitch& m_switch;
+	NetAddrBlock m_address;
+};
+
+static NetAddrBlock bench_address(int node) {
+	NetAddrBlock address;
+	obj_clear(address);
+	address.host = 0x0a000001 + node;	// 10.0.0.1 is the hub
+	address.port = 4226;
+	return address;
+}
+
+// a spoke, and the game it would be running
+struct BenchSpoke {
+	std::vector<std::unique_ptr<TickBasedActionQueue>> queues;
+	std::unique_ptr<SwitchPort> port;
+	std::unique_ptr<StarBenchSpoke> spoke;
+
+	// scripted input: mostly holding the same keys, with the mouse moving now and then
+	std::mt19937 input;
+	action_flags_t flags = 0;
+
+	// running checksum of every player's flags, as of each executed tick
+	std::vector<uint16> checksums;
+	std::vector<size_t> net_dead;
+	double next_tick = 0;
+	double tick_period = 0;
+	bool unplugged = false;
+
+	action_flags_t next_flags() {
+		if (input() % 8 == 0)
+			flags ^= 1u << (input() % 31);	// never NET_DEAD_ACTION_FLAG
+		return flags;
+	}
+
+	// what the game would do with the flags: execute every tick everyone has flags for
+	void execute_ticks() {
+		for (;;) {
+			for (auto& queue : queues) {
+				if (queue->size() == 0)
+					return;
+			}
+
+			uint16 checksum = checksums.empty() ? 0xffff : checksums.back();
+			for (auto& queue : queues) {
+				action_flags_t tick_flags = queue->peek(queue->getReadTick());
+				byte serialized[4] = { byte(tick_flags >> 24), byte(tick_flags >> 16), byte(tick_flags >> 8), byte(tick_flags) };
+				checksum = update_data_crc_ccitt(checksum, serialized, sizeof(serialized));
+				queue->dequeue();
+			}
+			checksums.push_back(checksum);
+		}
+	}
+};
+
+struct BenchReport {
+	int32 converged = NONE;	// ms until every spoke executed its first tick
+	size_t common_ticks = 0;	// executed by every connected spoke
+	bool checksums_agree = true;
+	bool spectator_agrees = true;	// the hub's confirmed flags, as a spectator would get them
+	uint32 flags_made_up = 0;
+	uint32 late_flags = 0;
+	std::vector<std::vector<size_t>> net_dead;	// who each spoke saw go netdead
+	uint32 packets = 0;
+	uint32 bytes = 0;
+	uint32 dropped = 0;
+	std::vector<int32> latencies;	// as the hub sees each player
+};
+
+static BenchReport run_bench(int players, const NetworkConditions& conditions, uint32 seed, uint32 duration, int unplug_player = NONE, uint32 unplug_at = 0) {
+
+	static bool initialized = false;
+	if (!initialized) {
+		mytm_initialize();
+		initialized = true;
+	}
+	DefaultHubPreferences();
+	DefaultSpokePreferences();
+
+	const int32 first_tick = 0;
+	const double tick_period = 1000.0 / TICKS_PER_SECOND;
+
+	std::mt19937 random(seed);
+	PacketSwitch packet_switch(conditions, random());
+
+	std::vector<NetAddrBlock> addresses;
+	std::vector<const NetAddrBlock*> address_pointers;
+	for (int i = 0; i < players; i++)
+		addresses.push_back(bench_address(1 + i));
+	for (int i = 0; i < players; i++)
+		address_pointers.push_back(&addresses[i]);
+
+	SwitchPort hub_port(packet_switch, bench_address(0));
+	StarBenchHub hub(first_tick, players, address_pointers.data(), hub_port);
+	packet_switch.attach(bench_address(0), [&hub](DDPPacketBufferPtr packet) { hub.received_packet(packet); });
+	double hub_next_tick = std::uniform_real_distribution<double>(0, tick_period)(random);
+
+	std::vector<uint16> spectator_checksums;
+	std::vector<action_flags_t> confirmed_flags;
+	int32 confirmed_first_tick;
+
+	std::vector<BenchSpoke> spokes(players);
+	for (int i = 0; i < players; i++) {
+		BenchSpoke& spoke = spokes[i];
+		std::vector<WritableTickBasedActionQueue*> queues;
+		for (int j = 0; j < players; j++) {
+			spoke.queues.emplace_back(new TickBasedActionQueue(TICKS_PER_SECOND * 5));
+			queues.push_back(spoke.queues.back().get());
+		}
+
+		spoke.input.seed(random());
+		spoke.next_tick = std::uniform_real_distribution<double>(0, tick_period)(random);
+		// crystals drift a little
+		spoke.tick_period = tick_period * (1 + std::uniform_real_distribution<double>(-0.002, 0.002)(random));
+
+		spoke.port.reset(new SwitchPort(packet_switch, addresses[i]));
+		spoke.spoke.reset(new StarBenchSpoke(bench_address(0), first_tick, players, queues.data(), i, *spoke.port,
+						     [&spoke]() { return spoke.next_flags(); },
+						     [&spoke](size_t player) { spoke.net_dead.push_back(player); }));
+		packet_switch.attach(addresses[i], [&spoke](DDPPacketBufferPtr packet) { spoke.spoke->received_packet(packet); });
+	}
+
+	BenchReport report;
+	for (uint32 now = 0; now < duration; now++) {
+		if (unplug_player != NONE && now == unplug_at) {
+			packet_switch.unplug(addresses[unplug_player]);
+			spokes[unplug_player].unplugged = true;
+		}
+
+		packet_switch.deliver(now);
+
+		while (hub_next_tick <= now) {
+			hub.tick();
+			hub_next_tick += tick_period;
+		}
+
+		if (hub.take_confirmed_flags(confirmed_first_tick, confirmed_flags)) {
+			if (confirmed_first_tick != first_tick + static_cast<int32>(spectator_checksums.size()))
+				report.spectator_agrees = false;	// a gap, or the same tick twice
+			for (size_t i = 0; i < confirmed_flags.size(); i += players) {
+				uint16 checksum = spectator_checksums.empty() ? 0xffff : spectator_checksums.back();
+				for (int j = 0; j < players; j++) {
+					action_flags_t tick_flags = confirmed_flags[i + j];
+					byte serialized[4] = { byte(tick_flags >> 24), byte(tick_flags >> 16), byte(tick_flags >> 8), byte(tick_flags) };
+					checksum = update_data_crc_ccitt(checksum, serialized, sizeof(serialized));
+				}
+				spectator_checksums.push_back(checksum);
+			}
+		}
+
+		for (auto& spoke : spokes) {
+			while (spoke.next_tick <= now) {
+				spoke.spoke->tick();
+				spoke.execute_ticks();
+				spoke.next_tick += spoke.tick_period;
+			}
+		}
+
+		if (report.converged == NONE && std::all_of(spokes.begin(), spokes.end(), [](const BenchSpoke& spoke) { return !spoke.checksums.empty(); }))
+			report.converged = now;
+	}
+
+	report.common_ticks = SIZE_MAX;
+	for (auto& spoke : spokes) {
+		if (!spoke.unplugged)
+			report.common_ticks = std::min(report.common_ticks, spoke.checksums.size());
+	}
+
+	const BenchSpoke* reference = NULL;
+	for (auto& spoke : spokes) {
+		if (spoke.unplugged || report.common_ticks == 0)
+			continue;
+
+		if (!reference)
+			reference = &spoke;
+		else if (spoke.checksums[report.common_ticks - 1] != reference->checksums[report.common_ticks - 1])
+			report.checksums_agree = false;
+	}
+
+	if (reference && report.spectator_agrees)
+		report.spectator_agrees = spectator_checksums.size() >= report.common_ticks && spectator_checksums[report.common_ticks - 1] == reference->checksums[report.common_ticks - 1];
+
+	report.flags_made_up = hub.flags_made_up();
+	report.late_flags = hub.late_flags_received();
+	for (auto& spoke : spokes)
+		report.net_dead.push_back(spoke.net_dead);
+	report.packets = packet_switch.packets_sent;
+	report.bytes = packet_switch.bytes_sent;
+	report.dropped = packet_switch.packets_dropped;
+	for (int i = 0; i < players; i++)
+		report.latencies.push_back(hub.stats(i).latency);
+
+	return report;
+}
+
+static std::string describe(int players, const NetworkConditions& conditions, uint32 duration, const BenchReport& report) {
+	std::ostringstream s;
+	s << conditions.name << " (" << players << " players, " << conditions.latency << "+" << conditions.jitter << " ms, " << conditions.loss * 100 << "% loss): ";
+	s << "converged after " << report.converged << " ms; " << report.common_ticks << " ticks in common; ";
+	s << "hub made up " << report.flags_made_up << " flags, " << report.late_flags << " arrived late; ";
+	s << "latency";
+	for (auto latency : report.latencies)
+		s << " " << latency;
+	s << " ms; " << report.packets << " packets (" << report.dropped << " dropped), " << report.bytes / 1024.0 / (duration / 1000.0) << " KB/s";
+	return s.str();
+}
+
+TEST_CASE("Network bench", "[NetworkBench]") {
+
+	const int players = 4;
+	const uint32 duration = 30 * 1000;
+	const uint32 seed = 1;
+
+	const std::vector<NetworkConditions> conditions = {
+		{ "LAN", 1, 0, 0 },
+		{ "internet", 40, 10, 0.01 },
+		{ "bad internet", 100, 60, 0.05 },
+	};
+
+	for (const auto& condition : conditions) {
+		INFO(condition.name);
+		auto report = run_bench(players, condition, seed, duration);
+		WARN(describe(players, condition, duration, report));
+
+		CHECK(report.converged != NONE);
+		CHECK(report.common_ticks > duration / 2 * TICKS_PER_SECOND / 1000);
+		CHECK(report.checksums_agree);
+		CHECK(report.spectator_agrees);
+		for (auto& net_dead : report.net_dead)
+			CHECK(net_dead.empty());
+	}
+}
+
+TEST_CASE("Network bench with a player dropping out", "[NetworkBench]") {
+
+	const int players = 4;
+	const uint32 duration = 30 * 1000;
+	const int dropped_player = 2;
+	const NetworkConditions condition = { "internet, one player unplugged", 40, 10, 0.01 };
+
+	auto report = run_bench(players, condition, 1, duration, dropped_player, 10 * 1000);
+	WARN(describe(players, condition, duration, report));
+
+	CHECK(report.checksums_agree);
+	CHECK(report.spectator_agrees);
+	for (int i = 0; i < players; i++) {
+		INFO("player " << i);
+		if (i == dropped_player) {
+			// gave up on the hub, so on everyone
+			CHECK(report.net_dead[i].size() == players);
+		}
+		else {
+			CHECK(report.net_dead[i] == std::vector<size_t>{ static_cast<size_t>(dropped_player) });
+		}
+	}
+}
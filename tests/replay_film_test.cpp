@@ -3,8 +3,11 @@
 #include "FileHandler.h"
 #include "shell_options.h"
 #include "interface.h"
+#include "map.h"
 #include <catch2/catch_test_macros.hpp>
 
+#include <chrono>
+
 extern ShellOptions shell_options;
 
 using Replay = std::pair<std::string, uint16_t>; //replay file path and seed
@@ -61,7 +64,10 @@ TEST_CASE("Film replay", "[Replay]") {
 		INFO(replay.first);
 		REQUIRE(handle_open_document(replay.first));
 		set_replay_speed(INT16_MAX);
+		auto start = std::chrono::steady_clock::now();
 		main_event_loop();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		WARN(replay.first << ": " << dynamic_world->tick_count / elapsed.count() << " ticks per second");
 		auto seed = get_random_seed();
 		CHECK(seed == replay.second);
 	}
@@ -0,0 +1,246 @@
+#include "cseries.h"
+#include "FileHandler.h"
+#include "shell_options.h"
+#include "network_star.h"
+#include "WindowedNthElementFinder.h"
+#include "AdaptiveJitterBuffer.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <functional>
+#include <random>
+#include <sstream>
+
+extern ShellOptions shell_options;
+
+// Plays latency traces (ticks from a spoke sending its flags to the hub's
+// confirmation of them coming back) through both ways a spoke can pick its
+// local delay, and compares what the player would get from each: how far
+// behind their own input the game runs, and how often it has to stop and wait.
+
+// as network_star_spoke.cpp sets them up
+static const int kTimingWindowSize = 3 * TICKS_PER_SECOND;
+static const int kTimingNthElement = kTimingWindowSize / 2;
+static const double kAdaptiveQuantile = 0.9;
+static const int kAdaptiveHalfLife = 2 * TICKS_PER_SECOND;
+
+struct LatencyTrace {
+	std::string name;
+	std::vector<int32> latencies;	// one per tick sent
+};
+
+struct TimingReport {
+	double mean_input_lag = 0;	// ticks
+	int stalls = 0;			// ticks the game was due to run and couldn't
+	int32 ticks_run = 0;
+};
+
+// an estimator is handed each latency measurement, and says what delay to use (or NONE, if it can't yet)
+typedef std::function<int32(int32)> TimingEstimator;
+
+static TimingReport play_trace(const LatencyTrace& trace, TimingEstimator estimator) {
+
+	// confirmations come back in order, so one late tick holds up the ones after it
+	std::vector<int32> arrivals(trace.latencies.size());
+	for (size_t tick = 0; tick < arrivals.size(); tick++) {
+		arrivals[tick] = static_cast<int32>(tick) + std::max(trace.latencies[tick], static_cast<int32>(0));
+		if (tick)
+			arrivals[tick] = std::max(arrivals[tick], arrivals[tick - 1]);
+	}
+
+	TimingReport report;
+	int32 delay = 0;
+	int32 next_arrival = 0;
+	int32 game_tick = 0;
+	int64_t total_lag = 0;
+	const int32 ticks = static_cast<int32>(arrivals.size());
+
+	for (int32 now = 0; game_tick < ticks; now++) {
+
+		while (next_arrival < ticks && arrivals[next_arrival] <= now) {
+			int32 measurement = estimator(now - next_arrival);
+			if (measurement != NONE)
+				delay = measurement;
+			next_arrival++;
+		}
+
+		// what SpokeGame::get_net_time() would say
+		int32 net_time = now - delay;
+		while (game_tick < ticks && game_tick < net_time && arrivals[game_tick] <= now) {
+			total_lag += now - game_tick;
+			game_tick++;
+		}
+
+		if (game_tick < ticks && game_tick < net_time)
+			report.stalls++;
+	}
+
+	report.ticks_run = game_tick;
+	report.mean_input_lag = ticks ? static_cast<double>(total_lag) / ticks : 0;
+	return report;
+}
+
+static TimingReport play_trace_windowed(const LatencyTrace& trace) {
+	WindowedNthElementFinder<int32> finder(kTimingWindowSize);
+	return play_trace(trace, [&finder](int32 latency) {
+		finder.insert(latency);
+		return finder.window_full() ? finder.nth_largest_element(kTimingNthElement) : NONE;
+	});
+}
+
+static TimingReport play_trace_adaptive(const LatencyTrace& trace) {
+	AdaptiveJitterBuffer buffer(kAdaptiveQuantile, kAdaptiveHalfLife);
+	return play_trace(trace, [&buffer](int32 latency) {
+		buffer.insert(latency);
+		return buffer.ready() ? buffer.lead() : NONE;
+	});
+}
+
+static LatencyTrace wired_trace(uint32 seed) {
+	std::mt19937 random(seed);
+	LatencyTrace trace{"wired", {}};
+	for (int i = 0; i < 60 * TICKS_PER_SECOND; i++)
+		trace.latencies.push_back(std::uniform_int_distribution<int32>(3, 4)(random));
+	return trace;
+}
+
+// steady most of the time, but with bursts of much worse (a scan, a microwave,
+// someone else's download) every few seconds, and the odd lone spike
+static LatencyTrace wifi_trace(uint32 seed) {
+	std::mt19937 random(seed);
+	LatencyTrace trace{"wifi", {}};
+	int burst_left = 0;
+	int32 burst_extra = 0;
+	int until_burst = std::uniform_int_distribution<int>(2 * TICKS_PER_SECOND, 5 * TICKS_PER_SECOND)(random);
+	for (int i = 0; i < 60 * TICKS_PER_SECOND; i++) {
+		int32 latency = std::uniform_int_distribution<int32>(3, 5)(random);
+
+		if (burst_left) {
+			latency += burst_extra + std::uniform_int_distribution<int32>(-2, 2)(random);
+			if (!--burst_left)
+				until_burst = std::uniform_int_distribution<int>(2 * TICKS_PER_SECOND, 5 * TICKS_PER_SECOND)(random);
+		}
+		else if (!--until_burst) {
+			burst_left = std::uniform_int_distribution<int>(TICKS_PER_SECOND / 3, TICKS_PER_SECOND)(random);
+			burst_extra = std::uniform_int_distribution<int32>(4, 10)(random);
+		}
+
+		if (std::uniform_int_distribution<int>(0, 19)(random) == 0)
+			latency += std::uniform_int_distribution<int32>(3, 8)(random);
+
+		trace.latencies.push_back(latency);
+	}
+	return trace;
+}
+
+// a route change partway through
+static LatencyTrace step_trace() {
+	LatencyTrace trace{"step", {}};
+	trace.latencies.insert(trace.latencies.end(), 30 * TICKS_PER_SECOND, 4);
+	trace.latencies.insert(trace.latencies.end(), 30 * TICKS_PER_SECOND, 12);
+	return trace;
+}
+
+// a spoke logging at dump level writes every measurement it takes ("latency measurement: 5")
+static std::vector<LatencyTrace> get_logged_traces(const std::string& directory_path) {
+
+	FileSpecifier directory = directory_path;
+
+	std::vector<dir_entry> entries;
+	directory.ReadDirectory(entries);
+
+	std::vector<LatencyTrace> results;
+	for (const auto& dir_entry : entries) {
+
+		FileSpecifier entry = directory + dir_entry.name;
+		std::string entry_path = entry.GetPath();
+
+		if (entry.IsDir()) {
+			auto sub_traces = get_logged_traces(entry_path);
+			results.insert(results.end(), sub_traces.begin(), sub_traces.end());
+			continue;
+		}
+
+		if (entry_path.size() < 4 || entry_path.compare(entry_path.size() - 4, 4, ".txt") != 0)
+			continue;
+
+		OpenedFile f;
+		int32 length;
+		if (!entry.Open(f) || !f.GetLength(length) || length <= 0)
+			continue;
+
+		std::string data(length, '\0');
+		if (!f.Read(length, &data[0]))
+			continue;
+
+		LatencyTrace trace{entry_path, {}};
+		static const std::string kMarker = "latency measurement: ";
+		for (size_t found = data.find(kMarker); found != std::string::npos; found = data.find(kMarker, found + 1))
+			trace.latencies.push_back(std::atoi(data.c_str() + found + kMarker.size()));
+
+		if (!trace.latencies.empty())
+			results.push_back(trace);
+	}
+
+	return results;
+}
+
+static std::string describe(const LatencyTrace& trace, const TimingReport& windowed, const TimingReport& adaptive) {
+	std::ostringstream s;
+	s << trace.name << ": " << trace.latencies.size() << " ticks; "
+	  << "windowed lag " << windowed.mean_input_lag << ", " << windowed.stalls << " stalls; "
+	  << "adaptive lag " << adaptive.mean_input_lag << ", " << adaptive.stalls << " stalls";
+	return s.str();
+}
+
+TEST_CASE("Spoke timing on latency traces", "[SpokeTiming]") {
+
+	SECTION("wired") {
+		auto trace = wired_trace(1);
+		auto windowed = play_trace_windowed(trace);
+		auto adaptive = play_trace_adaptive(trace);
+		WARN(describe(trace, windowed, adaptive));
+
+		// nothing to gain on a steady connection, so nothing to lose either
+		CHECK(adaptive.ticks_run == windowed.ticks_run);
+		CHECK(adaptive.mean_input_lag <= windowed.mean_input_lag + 1);
+	}
+
+	SECTION("wifi") {
+		for (uint32 seed = 1; seed <= 4; seed++) {
+			auto trace = wifi_trace(seed);
+			auto windowed = play_trace_windowed(trace);
+			auto adaptive = play_trace_adaptive(trace);
+			WARN(describe(trace, windowed, adaptive));
+
+			// buffering the bursts costs some lag, but not all of them
+			CHECK(adaptive.stalls * 3 < windowed.stalls);
+			CHECK(adaptive.mean_input_lag < windowed.mean_input_lag * 2);
+		}
+	}
+
+	SECTION("step") {
+		auto trace = step_trace();
+		auto windowed = play_trace_windowed(trace);
+		auto adaptive = play_trace_adaptive(trace);
+		WARN(describe(trace, windowed, adaptive));
+
+		CHECK(adaptive.stalls <= windowed.stalls);
+		CHECK(adaptive.mean_input_lag <= windowed.mean_input_lag + 1);
+	}
+}
+
+TEST_CASE("Spoke timing on logged latency traces", "[SpokeTiming][.]") {
+
+	REQUIRE(!shell_options.replay_directory.empty());
+
+	const auto traces = get_logged_traces(shell_options.replay_directory);
+	REQUIRE(!traces.empty());
+
+	for (const auto& trace : traces) {
+		auto windowed = play_trace_windowed(trace);
+		auto adaptive = play_trace_adaptive(trace);
+		WARN(describe(trace, windowed, adaptive));
+
+		CHECK(adaptive.ticks_run == windowed.ticks_run);
+	}
+}